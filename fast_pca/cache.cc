@@ -0,0 +1,316 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "fast_pca/cache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <utility>
+#include <vector>
+
+#include "fast_pca/logging.h"
+
+using std::lock_guard;
+using std::pair;
+using std::sort;
+using std::vector;
+
+static const char CACHE_MAGIC[8] = {'F', 'P', 'C', 'A', 'C', 'H', 'E', '1'};
+static const char CACHE_EXT[] = ".fpc";
+// Blobs are written to a temporary file, "<blob>.tmp.<pid>.<n>", which is
+// renamed when the blob is complete
+static const char CACHE_TMP[] = ".tmp.";
+// Temporary files of the processes that died, or older than this (seconds),
+// are removed when the cache is opened
+static const int64_t CACHE_STALE_TMP_SECONDS = 24 * 3600;
+// When the cache exceeds its maximum size, blobs are removed until it is
+// below this fraction of the maximum size
+static const double CACHE_EVICT_TARGET = 0.9;
+
+InputCache* InputCache::global_ = NULL;
+
+static uint64_t hash_bytes(uint64_t h, const unsigned char* p, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    h = (h ^ p[i]) * 0x100000001B3ULL;
+  }
+  return h;
+}
+
+// Hash of the content of a file, computed on 64-bit words.
+static bool hash_file(const string& fname, uint64_t* hash) {
+  FILE* file = fopen(fname.c_str(), "rb");
+  if (!file) return false;
+  vector<uint64_t> buf(1 << 17);
+  uint64_t h = 0xCBF29CE484222325ULL;
+  uint64_t total = 0;
+  size_t r = 0;
+  while ((r = fread(buf.data(), 1, buf.size() * sizeof(uint64_t), file)) > 0) {
+    const size_t w = r / sizeof(uint64_t);
+    for (size_t i = 0; i < w; ++i) {
+      h ^= buf[i];
+      h = (h << 31) | (h >> 33);
+      h *= 0x9E3779B97F4A7C15ULL;
+    }
+    h = hash_bytes(
+        h, reinterpret_cast<const unsigned char*>(buf.data() + w),
+        r - w * sizeof(uint64_t));
+    total += r;
+  }
+  const bool ok = !ferror(file);
+  fclose(file);
+  *hash = h ^ total;
+  return ok;
+}
+
+// Process writing the given temporary blob, or 0 if the name is not the
+// name of a temporary blob.
+static int tmp_blob_pid(const string& name) {
+  const size_t p = name.find(CACHE_TMP);
+  int pid = 0;
+  unsigned int n = 0;
+  char c = 0;
+  if (p == string::npos ||
+      sscanf(name.c_str() + p + strlen(CACHE_TMP), "%d.%u%c", &pid, &n, &c)
+      != 2) {
+    return 0;
+  }
+  return pid;
+}
+
+// Size of all the blobs in the directory, and their names and access times.
+// The temporary blobs count towards the size, but they are not listed, and
+// the stale ones are removed if sweep is true.
+static uint64_t list_blobs(
+    const string& dir, vector<pair<int64_t, pair<string, uint64_t> > >* blobs,
+    bool sweep) {
+  uint64_t total = 0;
+  DIR* d = opendir(dir.c_str());
+  if (!d) return 0;
+  const size_t ext_len = strlen(CACHE_EXT);
+  const time_t now = time(NULL);
+  for (dirent* e = readdir(d); e != NULL; e = readdir(d)) {
+    const string name = e->d_name;
+    const int pid = tmp_blob_pid(name);
+    if (pid <= 0 && (name.size() <= ext_len ||
+        name.compare(name.size() - ext_len, ext_len, CACHE_EXT) != 0)) {
+      continue;
+    }
+    const string fname = dir + "/" + name;
+    struct stat st;
+    if (stat(fname.c_str(), &st) != 0) continue;
+    if (pid > 0) {
+      const bool stale =
+          (kill(pid, 0) != 0 && errno == ESRCH) ||
+          now - st.st_mtime > CACHE_STALE_TMP_SECONDS;
+      if (!sweep || !stale || unlink(fname.c_str()) != 0) {
+        total += st.st_size;
+      }
+      continue;
+    }
+    total += st.st_size;
+    if (blobs) {
+      const int64_t t = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+      blobs->push_back(make_pair(t, make_pair(fname, st.st_size)));
+    }
+  }
+  closedir(d);
+  return total;
+}
+
+InputCache::InputCache(
+    const string& dir, uint64_t max_size, bool content_hash) :
+    dir_(dir), max_size_(max_size), content_hash_(content_hash),
+    tmp_counter_(0) {
+  CHECK_FMT(
+      mkdir(dir.c_str(), 0777) == 0 || errno == EEXIST,
+      "Failed to create cache directory \"%s\": %s", dir.c_str(),
+      strerror(errno));
+  total_size_ = list_blobs(dir_, NULL, true);
+}
+
+bool InputCache::make_key(
+    const string& fname, FORMAT_CODE format, size_t real_size,
+    Key* key) const {
+  char path[PATH_MAX];
+  struct stat st;
+  if (!realpath(fname.c_str(), path) || stat(path, &st) != 0 ||
+      !S_ISREG(st.st_mode)) {
+    return false;
+  }
+  key->path = path;
+  key->format = format;
+  key->real_size = real_size;
+  key->size = st.st_size;
+  key->mtime = 0;
+  key->content_hash = 0;
+  if (content_hash_) {
+    return hash_file(key->path, &key->content_hash);
+  }
+  key->mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+  return true;
+}
+
+string InputCache::blob_name(const Key& key) const {
+  uint64_t h = 0xCBF29CE484222325ULL;
+  h = hash_bytes(
+      h, reinterpret_cast<const unsigned char*>(key.path.data()),
+      key.path.size());
+  h = hash_bytes(
+      h, reinterpret_cast<const unsigned char*>(&key.format),
+      sizeof(key.format));
+  h = hash_bytes(
+      h, reinterpret_cast<const unsigned char*>(&key.real_size),
+      sizeof(key.real_size));
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(h));
+  return dir_ + "/" + name;
+}
+
+FILE* InputCache::open(
+    const string& fname, FORMAT_CODE format, size_t real_size,
+    string* header) {
+  Key key;
+  if (!make_key(fname, format, real_size, &key)) return NULL;
+  const string blob = blob_name(key) + CACHE_EXT;
+  FILE* file = fopen(blob.c_str(), "rb");
+  if (!file) return NULL;
+  char magic[8];
+  Key bkey;
+  uint32_t path_len = 0, header_len = 0;
+  bool ok =
+      fread(magic, 1, 8, file) == 8 &&
+      memcmp(magic, CACHE_MAGIC, 8) == 0 &&
+      fread(&bkey.format, sizeof(bkey.format), 1, file) == 1 &&
+      fread(&bkey.real_size, sizeof(bkey.real_size), 1, file) == 1 &&
+      fread(&bkey.size, sizeof(bkey.size), 1, file) == 1 &&
+      fread(&bkey.mtime, sizeof(bkey.mtime), 1, file) == 1 &&
+      fread(&bkey.content_hash, sizeof(bkey.content_hash), 1, file) == 1 &&
+      fread(&path_len, sizeof(path_len), 1, file) == 1 &&
+      fread(&header_len, sizeof(header_len), 1, file) == 1 &&
+      path_len == key.path.size() && bkey.format == key.format &&
+      bkey.real_size == key.real_size && bkey.size == key.size &&
+      bkey.mtime == key.mtime && bkey.content_hash == key.content_hash;
+  if (ok) {
+    bkey.path.resize(path_len);
+    header->resize(header_len);
+    ok = fread(&bkey.path[0], 1, path_len, file) == path_len &&
+        bkey.path == key.path &&
+        fread(&(*header)[0], 1, header_len, file) == header_len;
+  }
+  if (!ok) {
+    fclose(file);
+    return NULL;
+  }
+  // update the modification time, used to remove the least recently used
+  // blobs
+  utimensat(AT_FDCWD, blob.c_str(), NULL, 0);
+  return file;
+}
+
+InputCache::Writer* InputCache::create(
+    const string& fname, FORMAT_CODE format, size_t real_size,
+    const string& header) {
+  Key key;
+  if (!make_key(fname, format, real_size, &key)) return NULL;
+  const string blob = blob_name(key);
+  char suffix[64];
+  {
+    lock_guard<mutex> lock(mutex_);
+    snprintf(
+        suffix, sizeof(suffix), "%s%d.%u", CACHE_TMP,
+        static_cast<int>(getpid()), tmp_counter_++);
+  }
+  const string tmp = blob + suffix;
+  FILE* file = fopen(tmp.c_str(), "wb");
+  if (!file) return NULL;
+  const uint32_t path_len = key.path.size();
+  const uint32_t header_len = header.size();
+  fwrite(CACHE_MAGIC, 1, 8, file);
+  fwrite(&key.format, sizeof(key.format), 1, file);
+  fwrite(&key.real_size, sizeof(key.real_size), 1, file);
+  fwrite(&key.size, sizeof(key.size), 1, file);
+  fwrite(&key.mtime, sizeof(key.mtime), 1, file);
+  fwrite(&key.content_hash, sizeof(key.content_hash), 1, file);
+  fwrite(&path_len, sizeof(path_len), 1, file);
+  fwrite(&header_len, sizeof(header_len), 1, file);
+  fwrite(key.path.data(), 1, path_len, file);
+  fwrite(header.data(), 1, header_len, file);
+  return new Writer(this, tmp, blob + CACHE_EXT, file);
+}
+
+void InputCache::add_size(uint64_t size) {
+  lock_guard<mutex> lock(mutex_);
+  total_size_ += size;
+  if (total_size_ <= max_size_) return;
+  // remove the least recently used blobs
+  vector<pair<int64_t, pair<string, uint64_t> > > blobs;
+  total_size_ = list_blobs(dir_, &blobs, false);
+  sort(blobs.begin(), blobs.end());
+  for (size_t b = 0;
+       b < blobs.size() && total_size_ > CACHE_EVICT_TARGET * max_size_; ++b) {
+    if (unlink(blobs[b].second.first.c_str()) == 0) {
+      total_size_ -= blobs[b].second.second;
+    }
+  }
+}
+
+InputCache::Writer::Writer(
+    InputCache* cache, const string& tmp_fname, const string& fname,
+    FILE* file) :
+    cache_(cache), tmp_fname_(tmp_fname), fname_(fname), file_(file),
+    committed_(false) {}
+
+InputCache::Writer::~Writer() {
+  if (!committed_) {
+    fclose(file_);
+    unlink(tmp_fname_.c_str());
+  }
+}
+
+void InputCache::Writer::write(const void* data, size_t n) {
+  // errors are detected on commit
+  fwrite(data, 1, n, file_);
+}
+
+void InputCache::Writer::commit() {
+  const bool ok = !ferror(file_);
+  const long size = ftell(file_);
+  if (fclose(file_) != 0 || !ok || rename(tmp_fname_.c_str(), fname_.c_str())) {
+    WARN_FMT("Failed to write cache file \"%s\"!", fname_.c_str());
+    unlink(tmp_fname_.c_str());
+  } else {
+    cache_->add_size(size);
+  }
+  committed_ = true;
+}
@@ -0,0 +1,120 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef FAST_PCA_CACHE_H_
+#define FAST_PCA_CACHE_H_
+
+#include <stdint.h>
+
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+#include "fast_pca/file.h"
+
+using std::mutex;
+using std::string;
+
+// Persistent cache of parsed input files. Each input file is stored in the
+// cache directory as a binary blob containing its header (as written by the
+// matrix format) and its parsed elements, in the native binary format.
+// Blobs are identified by the absolute path of the input file, the format
+// and the floating point type, and they are valid while the size and
+// modification time of the input file do not change (or, optionally, while
+// the hash of its content does not change).
+// When the total size of the cache exceeds the limit, the least recently
+// used blobs are removed. Blobs are written to temporary files, which count
+// towards the size of the cache; the ones left by aborted runs are removed
+// when the cache is opened.
+class InputCache {
+ public:
+  // A new blob being written. It is added to the cache only if it is
+  // committed, otherwise the partial blob is removed.
+  class Writer {
+   public:
+    ~Writer();
+    void write(const void* data, size_t n);
+    void commit();
+
+   private:
+    friend class InputCache;
+    Writer(InputCache* cache, const string& tmp_fname, const string& fname,
+           FILE* file);
+    InputCache* cache_;
+    string tmp_fname_;
+    string fname_;
+    FILE* file_;
+    bool committed_;
+  };
+
+  // Default maximum size of the cache, in MB
+  static const int DEFAULT_MAX_SIZE = 4096;
+
+  InputCache(const string& dir, uint64_t max_size, bool content_hash);
+
+  // Open the blob of the given input file, if it exists and it is still
+  // valid. The serialized header is returned, and the returned file is
+  // positioned at the start of the elements. Returns NULL if there is no
+  // valid blob.
+  FILE* open(
+      const string& fname, FORMAT_CODE format, size_t real_size,
+      string* header);
+
+  // Start writing the blob of the given input file, with the given
+  // serialized header. Returns NULL if the blob cannot be created.
+  Writer* create(
+      const string& fname, FORMAT_CODE format, size_t real_size,
+      const string& header);
+
+  // Global cache used by the input files, NULL if caching is disabled.
+  static InputCache* Get() { return global_; }
+  static void Set(InputCache* cache) { global_ = cache; }
+
+ private:
+  struct Key {
+    string path;            // absolute path of the input file
+    uint32_t format;
+    uint32_t real_size;
+    uint64_t size;          // size of the input file
+    int64_t mtime;          // modification time (ns) of the input file
+    uint64_t content_hash;  // hash of the content of the input file
+  };
+
+  bool make_key(
+      const string& fname, FORMAT_CODE format, size_t real_size,
+      Key* key) const;
+  string blob_name(const Key& key) const;
+  void add_size(uint64_t size);
+
+  const string dir_;
+  const uint64_t max_size_;
+  const bool content_hash_;
+  uint64_t total_size_;
+  unsigned int tmp_counter_;
+  mutex mutex_;
+
+  static InputCache* global_;
+};
+
+#endif  // FAST_PCA_CACHE_H_
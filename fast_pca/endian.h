@@ -55,6 +55,15 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 template <int n>
 inline void swap_bytes(void* bytes) {
@@ -76,6 +85,165 @@ inline void swap_bytes<4>(void* bytes) {
   cbytes[3] = tmp[0];
 }
 
+template <>
+inline void swap_bytes<8>(void* bytes) {
+  uint64_t x;
+  memcpy(&x, bytes, 8);
+#if defined(__GNUC__)
+  x = __builtin_bswap64(x);
+#else
+  x = ((x & 0x00000000FFFFFFFFULL) << 32) | ((x & 0xFFFFFFFF00000000ULL) >> 32);
+  x = ((x & 0x0000FFFF0000FFFFULL) << 16) | ((x & 0xFFFF0000FFFF0000ULL) >> 16);
+  x = ((x & 0x00FF00FF00FF00FFULL) << 8)  | ((x & 0xFF00FF00FF00FF00ULL) >> 8);
+#endif
+  memcpy(bytes, &x, 8);
+}
+
+// Swap the bytes of each of the n elements (of k bytes each) in the
+// given buffer. The SSSE3/AVX2 byte shuffles are used when the compiler
+// targets them (i.e. with -march=native), otherwise each element is
+// swapped independently.
+template <int k>
+inline void swap_bytes_block(size_t n, void* data) {
+  char* cdata = reinterpret_cast<char*>(data);
+  for (size_t i = 0; i < n; ++i) swap_bytes<k>(cdata + i * k);
+}
+
+template <>
+inline void swap_bytes_block<4>(size_t n, void* data) {
+  char* cdata = reinterpret_cast<char*>(data);
+  size_t i = 0;
+#if defined(__AVX2__)
+  const __m256i mask = _mm256_setr_epi8(
+      3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+      3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  for (; i + 8 <= n; i += 8) {
+    __m256i* p = reinterpret_cast<__m256i*>(cdata + i * 4);
+    _mm256_storeu_si256(p, _mm256_shuffle_epi8(_mm256_loadu_si256(p), mask));
+  }
+#elif defined(__SSSE3__)
+  const __m128i mask = _mm_setr_epi8(
+      3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  for (; i + 4 <= n; i += 4) {
+    __m128i* p = reinterpret_cast<__m128i*>(cdata + i * 4);
+    _mm_storeu_si128(p, _mm_shuffle_epi8(_mm_loadu_si128(p), mask));
+  }
+#endif
+  for (; i < n; ++i) swap_bytes<4>(cdata + i * 4);
+}
+
+template <>
+inline void swap_bytes_block<8>(size_t n, void* data) {
+  char* cdata = reinterpret_cast<char*>(data);
+  size_t i = 0;
+#if defined(__AVX2__)
+  const __m256i mask = _mm256_setr_epi8(
+      7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+      7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+  for (; i + 4 <= n; i += 4) {
+    __m256i* p = reinterpret_cast<__m256i*>(cdata + i * 8);
+    _mm256_storeu_si256(p, _mm256_shuffle_epi8(_mm256_loadu_si256(p), mask));
+  }
+#elif defined(__SSSE3__)
+  const __m128i mask = _mm_setr_epi8(
+      7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+  for (; i + 2 <= n; i += 2) {
+    __m128i* p = reinterpret_cast<__m128i*>(cdata + i * 8);
+    _mm_storeu_si128(p, _mm_shuffle_epi8(_mm_loadu_si128(p), mask));
+  }
+#endif
+  for (; i < n; ++i) swap_bytes<8>(cdata + i * 8);
+}
+
+// Convert n elements of type TF into type TT.
+template <typename TF, typename TT>
+inline void cast_block(size_t n, const TF* src, TT* dst) {
+  for (size_t i = 0; i < n; ++i) dst[i] = src[i];
+}
+
+template <>
+inline void cast_block<float, double>(size_t n, const float* src, double* dst) {
+  size_t i = 0;
+#if defined(__AVX2__)
+  for (; i + 4 <= n; i += 4) {
+    _mm256_storeu_pd(dst + i, _mm256_cvtps_pd(_mm_loadu_ps(src + i)));
+  }
+#elif defined(__SSE2__)
+  for (; i + 2 <= n; i += 2) {
+    const __m128 f = _mm_castpd_ps(
+        _mm_load_sd(reinterpret_cast<const double*>(src + i)));
+    _mm_storeu_pd(dst + i, _mm_cvtps_pd(f));
+  }
+#endif
+  for (; i < n; ++i) dst[i] = src[i];
+}
+
+template <>
+inline void cast_block<double, float>(size_t n, const double* src, float* dst) {
+  size_t i = 0;
+#if defined(__AVX2__)
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_ps(dst + i, _mm256_cvtpd_ps(_mm256_loadu_pd(src + i)));
+  }
+#elif defined(__SSE2__)
+  for (; i + 2 <= n; i += 2) {
+    _mm_store_sd(
+        reinterpret_cast<double*>(dst + i),
+        _mm_castps_pd(_mm_cvtpd_ps(_mm_loadu_pd(src + i))));
+  }
+#endif
+  for (; i < n; ++i) dst[i] = src[i];
+}
+
+// Widening of 8-bit and 16-bit integers, used to read integer matrices
+// directly into the single precision blocks.
+template <>
+inline void cast_block<uint8_t, float>(
+    size_t n, const uint8_t* src, float* dst) {
+  size_t i = 0;
+#if defined(__AVX2__)
+  for (; i + 8 <= n; i += 8) {
+    const __m128i b =
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i));
+    _mm256_storeu_ps(dst + i, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(b)));
+  }
+#elif defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 8 <= n; i += 8) {
+    const __m128i w = _mm_unpacklo_epi8(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)), zero);
+    _mm_storeu_ps(dst + i, _mm_cvtepi32_ps(_mm_unpacklo_epi16(w, zero)));
+    _mm_storeu_ps(dst + i + 4, _mm_cvtepi32_ps(_mm_unpackhi_epi16(w, zero)));
+  }
+#endif
+  for (; i < n; ++i) dst[i] = src[i];
+}
+
+template <>
+inline void cast_block<int16_t, float>(
+    size_t n, const int16_t* src, float* dst) {
+  size_t i = 0;
+#if defined(__AVX2__)
+  for (; i + 8 <= n; i += 8) {
+    const __m128i w =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm256_storeu_ps(dst + i, _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(w)));
+  }
+#elif defined(__SSE2__)
+  for (; i + 8 <= n; i += 8) {
+    const __m128i w =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    // sign extension: place each element in the upper half of a 32-bit
+    // integer, and shift it back arithmetically
+    const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(w, w), 16);
+    const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(w, w), 16);
+    _mm_storeu_ps(dst + i, _mm_cvtepi32_ps(lo));
+    _mm_storeu_ps(dst + i + 4, _mm_cvtepi32_ps(hi));
+  }
+#endif
+  for (; i < n; ++i) dst[i] = src[i];
+}
+
 // Determine whether the machine is bigendian or not
 // NOTE: The output of this function is known at compile time, a good
 // compiler should know this (i.e. GCC does know it at compile time).
@@ -105,4 +273,28 @@ inline float htobef(float f) {
   return f2;
 }
 
+// Convert n big-endian elements to the host endianness, in place
+template <typename T>
+inline void betoh_block(size_t n, T* data) {
+  if (!is_big_endian()) swap_bytes_block<sizeof(T)>(n, data);
+}
+
+// Convert n elements in the host endianness to big-endian, in place
+template <typename T>
+inline void htobe_block(size_t n, T* data) {
+  if (!is_big_endian()) swap_bytes_block<sizeof(T)>(n, data);
+}
+
+// Convert n little-endian elements to the host endianness, in place
+template <typename T>
+inline void letoh_block(size_t n, T* data) {
+  if (is_big_endian()) swap_bytes_block<sizeof(T)>(n, data);
+}
+
+// Convert n elements in the host endianness to little-endian, in place
+template <typename T>
+inline void htole_block(size_t n, T* data) {
+  if (is_big_endian()) swap_bytes_block<sizeof(T)>(n, data);
+}
+
 #endif  // FAST_PCA_ENDIAN_H_
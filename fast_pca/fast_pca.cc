@@ -32,15 +32,32 @@
 
 #include "fast_pca/file.h"
 #include "fast_pca/file_pca.h"
+#include "fast_pca/file_text.h"
 #include "fast_pca/pca.h"
 #include "fast_pca/fast_pca_common.h"
 #include "fast_pca/logging.h"
+#include "fast_pca/memory.h"
+#include "fast_pca/progress.h"
+#include "fast_pca/stats.h"
 
+using std::find;
 using std::min;
 using std::max;
 using std::string;
 using std::vector;
 
+// Default amount of memory (MB) used to keep a copy of the data, when it is
+// read from stdin and projected (-C -P)
+static const int DEFAULT_KEEP_MEM = 1024;
+// Projected data quantized to 8-bit integers (-O int8) is clipped at this
+// number of standard deviations
+static const float INT8_CLIP_STDDEV = 4.0f;
+// Regularizer added to the eigenvalues when the projected data is whitened
+static const double DEFAULT_WHITEN_EPS = 1E-5;
+// Maximum number of rows of the validation data used to measure the error
+// of the projection with the eigenvectors quantized to 8-bit integers (-Q)
+static const int INT8_VALIDATION_ROWS = 10000;
+
 void help(const char* prog) {
   fprintf(
       stderr,
@@ -48,25 +65,71 @@ void help(const char* prog) {
       "Examples:\n"
       "Compute PCA: %s -C [options] [input ...]\n"
       "Project: %s -P -m pca.mat [options] [input [output] ...]\n"
-      "Compute PCA & project: %s -C -P [options] input [input ...] [output]\n\n"
+      "Compute PCA & project: %s -C -P [options] [input [output] ...]\n\n"
       "Options:\n"
       "  -C         compute pca from data\n"
       "  -P         project data using computed pca\n"
-      "  -b size    number of rows in the batch (default: 1000)\n"
+      "  -b size    number of rows in the batch (default: planned from the\n"
+      "             number of dimensions and the memory limit)\n"
+      "  -c dir     cache the parsed text input files in this directory\n"
+      "  -H         validate cached files by content hash instead of mtime\n"
+      "  -L size    maximum size of the cache, in MB (default: %d)\n"
       "  -d         use double precision\n"
       "  -e dims    do not project first (positive) or last (negative) dims\n"
+      "  -E eps     regularizer added to the eigenvalues when whitening\n"
+      "             (default: %g)\n"
       "  -f format  format of the data matrix (ascii, binary, octave, vbosch,\n"
-      "             htk, mat4)\n"
+      "             htk, mat4, fpca, npy, kaldi)\n"
+      "  -F format  format of the projected data (default: same as -f)\n"
+      "  -i backend I/O backend used to read files (stdio, uring)\n"
       "  -j energy  minimum relative amount of energy preserved\n"
+      "  -k mem     with -C -P, keep a copy of the parsed data to project it,\n"
+      "             using up to mem MB of memory and then a temporary file\n"
+      "             (default: only when reading from stdin, %d MB)\n"
       "  -m pca     write/read pca information to/from this file\n"
       "  -n         normalize data before projection\n"
+      "  -O type    type of the projected data (float32, float64, float16,\n"
+      "             bfloat16, int8), not supported by all the formats\n"
       "  -p idim    data input dimensions\n"
-      "  -q odim    data output dimensions\n",
-      prog, prog, prog, prog);
+      "  -q odim    data output dimensions\n"
+      "  -Q loss    project with the eigenvectors quantized to 8-bit\n"
+      "             integers, if the relative error in the validation data\n"
+      "             is not bigger than loss (e.g. 0.01)\n"
+      "  -R file    write the reconstruction error and the squared\n"
+      "             Mahalanobis distance of each projected row to this file\n"
+      "  -S list    read input (and output) file names from this list, one\n"
+      "             input (and optional output) per line\n"
+      "  -T type    type of the elements of binary input files (float32,\n"
+      "             float64, float16, bfloat16, int32, int16, uint16, int8,\n"
+      "             uint8)\n"
+      "  -s dir     with -C, keep the statistics of each input file in this\n"
+      "             directory, and only read the new or modified files\n"
+      "  -t threads number of threads used to parse/format text data\n"
+      "  -V file    validation data for -Q (default: the first input file)\n"
+      "  -W mode    whiten the projected data (pca), and rotate it back to\n"
+      "             the input space (zca)\n"
+      "  -w pca     with -C, compute only the leading eigenvectors, starting\n"
+      "             from the eigenvectors of this (previous) pca file\n"
+      "  --mem-limit MB\n"
+      "             plan the buffers to use at most MB megabytes of memory,\n"
+      "             and refuse early the problems that do not fit\n"
+      "  --perf-counters\n"
+      "             with --stats-json, measure also the cycles, instructions\n"
+      "             and LLC misses of the compute phases (Linux)\n"
+      "  --progress secs\n"
+      "             report the progress every secs seconds (it is always\n"
+      "             reported when the process receives SIGUSR1)\n"
+      "  --stats-json file\n"
+      "             write the time, bytes and rows of each phase of the\n"
+      "             computation to this file, in JSON\n",
+      prog, prog, prog, prog, InputCache::DEFAULT_MAX_SIZE, DEFAULT_WHITEN_EPS,
+      DEFAULT_KEEP_MEM);
 }
 
 // input          -> (input) list of input file names
-// block          -> (input) block size (number of rows to load in memory)
+// block          -> (input) block size (number of rows to load in memory, 0:
+//                   planned with the memory limit)
+// threads        -> (input) number of threads used to parse text files
 // exclude_dims   -> (input) exclude these first/last dimensions from pca
 // min_rel_energy -> (input) minimum amount of relative energy to preserve
 // inp_dim        -> (input/output) number of input dimensions
@@ -82,16 +145,27 @@ void help(const char* prog) {
 //                   size: inp_dim elements
 // stddev         -> (output) vector with the standard deviation
 //                   size: inp_dim elements
+// spill          -> (output) if not NULL, keeps a copy of the input data
+// stats_dir      -> (input) if not empty, directory where the statistics of
+//                   each input file are kept for future runs
+// init_fn        -> (input) if not empty, pca file whose eigenvectors are
+//                   used to start the iterative eigensolver
 template <FORMAT_CODE fmt, typename real_t>
 void compute_pca(
-    const vector<string>& input, int block, int exclude_dims,
+    const vector<string>& input, int block, int threads, int exclude_dims,
     double min_rel_energy, int* inp_dim, int* out_dim, double* miss_energy,
     vector<real_t>* eigval, vector<real_t>* eigvec, vector<real_t>* mean,
-    vector<real_t>* stddev) {
+    vector<real_t>* stddev, DataSpill<real_t>* spill,
+    const string& stats_dir, const string& init_fn) {
   int n = 0;  // number of data samples
   // process input to compute mean and co-moments
-  compute_mean_comoments_from_inputs<fmt, real_t>(
-      block, input, &n, inp_dim, mean, eigvec);
+  if (stats_dir != "") {
+    compute_mean_comoments_incremental<fmt, real_t>(
+        stats_dir, block, threads, input, &n, inp_dim, mean, eigvec);
+  } else {
+    compute_mean_comoments_from_inputs<fmt, real_t>(
+        block, threads, input, &n, inp_dim, mean, eigvec, spill);
+  }
   CHECK_FMT(*inp_dim >= *out_dim,
             "Number of output dimensions (%d) is bigger than the input "
             "dimensions (%d)!", *out_dim, *inp_dim);
@@ -111,19 +185,224 @@ void compute_pca(
   for (int i = 0; i < (*inp_dim); ++i) {
     (*stddev)[i] = sqrt((*eigvec)[i * (*inp_dim) + i]);
   }
+  // eigenvectors of a previous model, to start the eigensolver from them
+  vector<real_t> init_eigvec;
+  if (init_fn != "") {
+    load_initial_eigvec<real_t>(
+        init_fn, exclude_dims, *inp_dim, &init_eigvec);
+  }
   // compute eigenvectors and eigenvalues of the covariance matrix
   compute_pca_from_covariance<real_t>(
       exclude_dims, min_rel_energy, *inp_dim, out_dim, miss_energy,
-      eigvec, eigval);
+      eigvec, eigval, &init_eigvec);
+}
+
+// Write the reconstruction error and the Mahalanobis distance of each row
+// of a block that was just projected (x is still mean-centered), one row
+// per line.
+template <typename real_t>
+void write_scores(
+    FILE* file, const int n, const int idim, const int odim,
+    const int exclude_dims, const vector<real_t>& score_c,
+    const vector<real_t>& score_iw, const real_t* x, const real_t* z,
+    vector<real_t>* s) {
+  reconstruction_scores<real_t>(
+      n, idim, odim, exclude_dims, score_c.data(), score_iw.data(), x, z,
+      s->data());
+  for (int i = 0; i < n; ++i) {
+    fprintf(file, "%.8g %.8g\n", (*s)[2 * i], (*s)[2 * i + 1]);
+  }
+}
+
+// Write a block of br rows of projected data
+template <typename real_t>
+void write_projected_block(
+    MatrixFile* mw, const int br, const int odim, const real_t* z) {
+  STATS_SCOPE(STATS_WRITE);
+  STATS_COUNT(STATS_WRITE, sizeof(real_t) * br * odim, br);
+  mw->write_block(br * odim, z);
+}
+
+// Project a matrix from the copy of the input data kept in memory/disk.
+// Returns the number of projected rows.
+template <typename real_t>
+int project_spilled_matrix(
+    DataSpill<real_t>* spill, size_t m, const int block, const int odim,
+    const int exclude_dims, const bool normalize_data,
+    const vector<real_t>& mean, const vector<real_t>& stddev,
+    const vector<real_t>& eigvec, const vector<real_t>& score_c,
+    const vector<real_t>& score_iw, FILE* scores_file,
+    Int8Projection<real_t>* qv, vector<real_t>* x, vector<real_t>* z,
+    vector<real_t>* s, MatrixFile* mw) {
+  const int idim = mean.size();
+  const int rows = spill->matrix_rows(m);
+  for (int r = 0; r < rows; r += block) {
+    const int br = min(block, rows - r);
+    spill->read(br * idim, x->data());
+    Progress::AddRows(br, sizeof(real_t) * br * idim);
+    project<real_t>(
+        br, idim, odim, exclude_dims, eigvec.data(), mean.data(),
+        normalize_data ? stddev.data() : NULL, x->data(), z->data(), qv);
+    if (scores_file) {
+      write_scores<real_t>(
+          scores_file, br, idim, odim, exclude_dims, score_c, score_iw,
+          x->data(), z->data(), s);
+    }
+    write_projected_block<real_t>(mw, br, odim, z->data());
+  }
+  return rows;
+}
+
+// Scale of each output dimension, used to quantize the projected data to
+// 8-bit integers. The standard deviation of the projected dimensions is
+// the square root of their eigenvalue (only approximately, when the data is
+// normalized), and the standard deviation of the non-projected dimensions
+// is known (or 1, when the data is normalized).
+template <typename real_t>
+void compute_output_scales(
+    const int odim, const int exclude_dims, const bool normalize_data,
+    const vector<real_t>& stddev, const vector<real_t>& eigval,
+    vector<float>* scale) {
+  const int idim = stddev.size();
+  const int r = abs(exclude_dims);
+  scale->resize(odim);
+  for (int j = 0; j < odim; ++j) {
+    real_t s = 0;
+    if (exclude_dims > 0 && j < r) {
+      // first dimensions were not projected
+      s = normalize_data && stddev[j] > 1E-6 ? 1 : stddev[j];
+    } else if (exclude_dims < 0 && j >= odim - r) {
+      // last dimensions were not projected
+      const int i = idim - (odim - j);
+      s = normalize_data && stddev[i] > 1E-6 ? 1 : stddev[i];
+    } else {
+      const int k = exclude_dims > 0 ? j - r : j;
+      s = k < static_cast<int>(eigval.size()) ?
+          sqrt(max<real_t>(eigval[k], 0)) : 0;
+    }
+    (*scale)[j] = s > 0 ? INT8_CLIP_STDDEV * s / 127 : 1;
+  }
+}
+
+// Whether the scales of the int8 output must be written to a side file:
+// Binary and NPY files store only the quantized values (FPCA files store
+// the scales in their header, and other formats do not support int8).
+bool needs_scales_file(const FORMAT_CODE format, const ELEM_TYPE type) {
+  return type == ELEM_TYPE_INT8 && (format == FMT_BINARY || format == FMT_NPY);
+}
+
+// Write the scales of the int8 output to the side file of the given output
+// file (fname + ".scales"), as a float32 matrix with one row, in the same
+// format as the output file.
+void write_scales_file(
+    const string& fname, const FORMAT_CODE format, const vector<float>& scale) {
+  const string sfname = fname + ".scales";
+  FILE* file = open_file(sfname.c_str(), "wb");
+  unique_ptr<MatrixFile> header(MatrixFile::Create(FMT_BINARY));
+  header->rows(1);
+  header->cols(scale.size());
+  unique_ptr<MatrixFile> mw(MatrixFile::Create(format));
+  mw->file(file);
+  mw->copy_header_from(*header);
+  CHECK(mw->output_type(ELEM_TYPE_FLOAT32, vector<float>()));
+  mw->write_header();
+  mw->write_block(scale.size(), scale.data());
+  mw->write_footer();
+  close_file(file);
+}
+
+// Plan the rows of the blocks of data projected from idim to odim
+// dimensions, to fit in the memory limit (see Memory::Plan). The dense
+// buffers are the projection matrix (and its 8-bit copy) and the copy of
+// the data kept in memory. Each row is kept in the input and the projected
+// blocks (twice, when the 8-bit projection is validated), along with its
+// reconstruction scores and its characters, when it is written as text.
+template <typename real_t>
+void plan_projection_memory(
+    const int idim, const int odim, const vector<real_t>& eigvec,
+    const DataSpill<real_t>* spill, const bool int8, const bool scores,
+    const FORMAT_CODE out_format, int* block) {
+  const size_t dense = sizeof(real_t) * (eigvec.size() + 2 * idim) +
+      (int8 ? eigvec.size() + sizeof(float) * odim : 0) +
+      (spill ? spill->mem_limit() : 0);
+  const size_t row = sizeof(real_t) * max<size_t>(
+      (idim + odim) * (int8 ? 2 : 1), idim + odim + (scores ? 2 : 0)) +
+      (is_text_format(out_format) ? odim * (FORMAT_REAL_MAX_CHARS + 1) : 0);
+  Memory::Plan("projection", idim, dense, row, block);
+}
+
+// Relative error (Frobenius norm) of the projection with the eigenvectors
+// quantized to 8-bit integers, with respect to the float projection, of the
+// first rows (up to INT8_VALIDATION_ROWS) of the given file.
+template <FORMAT_CODE fmt, typename real_t>
+double int8_projection_loss(
+    const string& fname, const int block, const int odim,
+    const int exclude_dims, const bool normalize_data, const int threads,
+    const vector<real_t>& mean, const vector<real_t>& stddev,
+    const vector<real_t>& eigvec, Int8Projection<real_t>* qv) {
+  const int idim = mean.size();
+  const int r = abs(exclude_dims);
+  // only the projected dimensions are compared
+  const int c0 = exclude_dims > 0 ? r : 0;
+  const int c1 = exclude_dims < 0 ? odim - r : odim;
+  vector<real_t> x(block * idim), xq(block * idim);
+  vector<real_t> z(block * odim), zq(block * odim);
+  FILE* file = open_file(fname.c_str(), "rb");
+  unique_ptr<MatrixFile> mr(MatrixFile::Create<fmt>());
+  mr->file(file);
+  mr->threads(threads);
+  CHECK_FMT(mr->read_header(), "Invalid header in file \"%s\"!",
+            fname.c_str());
+  double err = 0.0, ref = 0.0;
+  int n = 0, be = 0;
+  do {
+    CHECK_FMT(
+        mr->cols() < 0 || mr->cols() == idim,
+        "Bad number of dimensions in file \"%s\" (found: %d, expected: "
+        "%d)!", fname.c_str(), mr->cols(), idim);
+    if (mr->cols() < 0) mr->cols(idim);
+    while (n < INT8_VALIDATION_ROWS &&
+           (be = mr->read_block(
+               min(block, INT8_VALIDATION_ROWS - n) * idim, x.data())) > 0) {
+      CHECK_FMT(
+          be % idim == 0,
+          "Corrupted matrix in file \"%s\" (block expected a multiple of "
+          "%d elements, but %d where read)!\n", fname.c_str(), idim, be);
+      const int br = be / idim;
+      xq = x;
+      project<real_t>(
+          br, idim, odim, exclude_dims, eigvec.data(), mean.data(),
+          normalize_data ? stddev.data() : NULL, x.data(), z.data());
+      project<real_t>(
+          br, idim, odim, exclude_dims, eigvec.data(), mean.data(),
+          normalize_data ? stddev.data() : NULL, xq.data(), zq.data(), qv);
+      for (int i = 0; i < br; ++i) {
+        for (int j = c0; j < c1; ++j) {
+          const double d = zq[i * odim + j] - z[i * odim + j];
+          err += d * d;
+          ref += z[i * odim + j] * z[i * odim + j];
+        }
+      }
+      n += br;
+    }
+  } while (n < INT8_VALIDATION_ROWS && mr->read_next_header());
+  close_file(file);
+  CHECK_FMT(n > 0, "No rows were read from the validation file \"%s\"!",
+            fname.c_str());
+  return ref > 0 ? sqrt(err / ref) : 0.0;
 }
 
 template <FORMAT_CODE fmt, typename real_t>
 int project_data(
     const vector<string>& input, const vector<string>& output,
     const int block, const int odim, const int exclude_dims,
-    const bool normalize_data, const vector<real_t>& mean,
+    const bool normalize_data, const int threads, const vector<real_t>& mean,
     const vector<real_t>& stddev, const vector<real_t>& eigval,
-    const vector<real_t>& eigvec) {
+    const vector<real_t>& eigvec, DataSpill<real_t>* spill,
+    const FORMAT_CODE out_format, const ELEM_TYPE out_type,
+    const char* out_type_str, const string& scores_fn,
+    const vector<real_t>& score_c, const vector<real_t>& score_iw,
+    Int8Projection<real_t>* qv) {
   const int idim = mean.size();
   CHECK(idim > 0);
   CHECK(odim > 0);
@@ -133,63 +412,182 @@ int project_data(
   // ----- process input files -----
   vector<real_t> x(block * idim, 0);  // data block
   vector<real_t> z(block * odim, 0);  // auxiliar data block
+  // reconstruction error and Mahalanobis distance of each row, written to a
+  // side file
+  FILE* scores_file = scores_fn == "" ? NULL : open_file(
+      scores_fn.c_str(), "w");
+  vector<real_t> s(scores_file ? block * 2 : 0, 0);
   // matrix reader
-  unique_ptr<MatrixFile> mr(MatrixFile::Create<fmt>());  // matrix reader
-  unique_ptr<MatrixFile> mw(MatrixFile::Create<fmt>());  // matrix writer
+  // matrix readers, opened ahead on helper threads (unless the input data
+  // is read from its copy)
+  unique_ptr<MatrixPrefetcher> prefetcher(
+      spill ? NULL : new MatrixPrefetcher(
+          input, &MatrixFile::Create<fmt>, sizeof(real_t),
+          MatrixPrefetcher::DEFAULT_THREADS, Memory::PrefetchDepth()));
+  if (spill) spill->rewind();
+  size_t spill_m = 0;  // next matrix in the copy of the data
+  // matrix writer, the output format may be different from the input
+  unique_ptr<MatrixFile> mw(MatrixFile::Create(out_format));
+  mw->threads(threads);
+  // projected rows kept until the end of each matrix, when the output format
+  // needs the number of rows in the header and the input does not have it
+  unique_ptr<DataSpill<real_t> > held;
+  // scales of the output dimensions, when they are quantized
+  vector<float> out_scale;
+  if (out_type == ELEM_TYPE_INT8) {
+    compute_output_scales<real_t>(
+        odim, exclude_dims, normalize_data, stddev, eigval, &out_scale);
+  }
 
   int n = 0;         // total number of processed samples (rows)
+  Progress::Stage("project", input);
   for (size_t f = 0; f < input.size(); ++f) {
     // open input/output files
     const char* ifname = input[f] == "" ? "**stdin**" : input[f].c_str();
     const char* ofname = output[f] == "" ? "**stdout**" : output[f].c_str();
-    FILE* ifile = input[f] == "" ? stdin : open_file(ifname, "rb");
-    FILE* ofile = output[f] == "" ? stdout : open_file(ofname, "wb");
-    // read input file header
-    mr->file(ifile);
-    CHECK_FMT(mr->read_header(), "Invalid header in file \"%s\"!", ifname);
     CHECK_FMT(
-        mr->cols() < 0 || mr->cols() == idim,
-        "Bad number of dimensions in file \"%s\" (found: %d, expected: %d)!",
-        ifname, mr->cols(), idim);
-    // write output file header
+        output[f] != "" || !needs_scales_file(out_format, out_type),
+        "Output type \"%s\" cannot be written to stdout with this format, "
+        "since the scales are written to a side file!", out_type_str);
+    FILE* ofile = output[f] == "" ? stdout : open_file(ofname, "wb");
     mw->file(ofile);
-    mw->copy_header_from(*mr);
-    mw->cols(odim);
-    mw->write_header();
-    // read, project and write data
-    int fr = 0, be = 0, br = 0;
-    while ((be = mr->read_block(block * idim, x.data())) > 0) {
+    int fr = 0;
+    if (spill) {
+      int spill_rows = 0;
+      size_t m = spill_m;
+      for (; m < spill->matrices() && spill->matrix_file(m) == f; ++m) {
+        spill_rows += spill->matrix_rows(m);
+      }
       CHECK_FMT(
-          be % idim == 0,
-          "Corrupted matrix in file \"%s\" (block expected a multiple of "
-          "%d elements, but %d where read)!\n", ifname, idim, be);
-      br = be / idim;
-      fr += br;
-      // project input data using pca
-      project<real_t>(
-          br, idim, odim, exclude_dims, eigvec.data(), mean.data(),
-          normalize_data ? stddev.data() : NULL, x.data(), z.data());
-      // output data
-      mw->write_block(br * odim, z.data());
+          m - spill_m <= 1 || is_archive_format(out_format),
+          "File \"%s\" contains several matrices, but the output format can "
+          "store only one (use -F kaldi, ascii or binary)!", ifname);
+      Progress::BeginFile(f, spill_rows);
+      for (; spill_m < spill->matrices() && spill->matrix_file(spill_m) == f;
+           ++spill_m) {
+        mw->copy_header_from(spill->matrix_header(spill_m));
+        mw->rows(spill->matrix_rows(spill_m));
+        mw->cols(odim);
+        CHECK_FMT(
+            mw->output_type(out_type, out_scale),
+            "Output type \"%s\" is not supported by this format!",
+            out_type_str);
+        mw->write_header();
+        fr += project_spilled_matrix<real_t>(
+            spill, spill_m, block, odim, exclude_dims, normalize_data, mean,
+            stddev, eigvec, score_c, score_iw, scores_file, qv, &x, &z, &s,
+            mw.get());
+      }
+      mw->write_footer();
+      close_file(ofile);
+      if (needs_scales_file(out_format, out_type)) {
+        write_scales_file(output[f], out_format, out_scale);
+      }
+      Progress::EndFile();
+      n += fr;
+      continue;
+    }
+    unique_ptr<MatrixPrefetcher::Entry> entry = prefetcher->next();
+    FILE* ifile = entry->file;
+    // input file header was already read by the prefetcher
+    MatrixFile* mr = entry->reader.get();
+    mr->threads(threads);
+    CHECK_FMT(entry->header, "Invalid header in file \"%s\"!", ifname);
+    Progress::BeginFile(f, mr->rows());
+    // archives contain multiple matrices, all of them are projected
+    bool first_matrix = true;
+    do {
+      CHECK_FMT(
+          first_matrix || is_archive_format(out_format),
+          "File \"%s\" contains several matrices, but the output format can "
+          "store only one (use -F kaldi, ascii or binary)!", ifname);
+      first_matrix = false;
+      CHECK_FMT(
+          mr->cols() < 0 || mr->cols() == idim,
+          "Bad number of dimensions in file \"%s\" (found: %d, expected: "
+          "%d)!", ifname, mr->cols(), idim);
+      if (mr->cols() < 0) mr->cols(idim);
+      // write output matrix header
+      mw->copy_header_from(*mr);
+      mw->cols(odim);
+      CHECK_FMT(
+          mw->output_type(out_type, out_scale),
+          "Output type \"%s\" is not supported by this format!",
+          out_type_str);
+      const bool hold = mw->rows() < 0 && mw->needs_rows();
+      if (hold) {
+        if (!held) {
+          held.reset(new DataSpill<real_t>(
+              static_cast<size_t>(DEFAULT_KEEP_MEM) << 20));
+        }
+        held->begin_matrix(f, NULL);
+      } else {
+        mw->write_header();
+      }
+      // read, project and write data
+      int mr_rows = 0, be = 0, br = 0;
+      while ((be = entry->read_block(block * idim, x.data())) > 0) {
+        CHECK_FMT(
+            be % idim == 0,
+            "Corrupted matrix in file \"%s\" (block expected a multiple of "
+            "%d elements, but %d where read)!\n", ifname, idim, be);
+        br = be / idim;
+        mr_rows += br;
+        // project input data using pca
+        project<real_t>(
+            br, idim, odim, exclude_dims, eigvec.data(), mean.data(),
+            normalize_data ? stddev.data() : NULL, x.data(), z.data(), qv);
+        if (scores_file) {
+          write_scores<real_t>(
+              scores_file, br, idim, odim, exclude_dims, score_c, score_iw,
+              x.data(), z.data(), &s);
+        }
+        // output data
+        if (hold) {
+          held->write(br, odim, z.data());
+        } else {
+          write_projected_block<real_t>(mw.get(), br, odim, z.data());
+        }
+      }
+      if (hold) {
+        // the number of rows is known now
+        mw->rows(mr_rows);
+        mw->write_header();
+        held->rewind();
+        for (int r = 0; r < mr_rows; r += block) {
+          br = min(block, mr_rows - r);
+          held->read(br * odim, z.data());
+          write_projected_block<real_t>(mw.get(), br, odim, z.data());
+        }
+        held->clear();
+      }
+      fr += mr_rows;
+      // if the number of read rows is not equal to the number of expected
+      // rows, show a warning to the user
+      if (mr->rows() > 0 && mr->rows() != mr_rows) {
+        WARN_FMT(
+            "Number of processed rows (%d) is lower than expected (%d) "
+            "in file \"%s\"!", mr_rows, mr->rows(), ifname);
+      }
+    } while (mr->read_next_header());
+    mw->write_footer();
+    close_file(ifile);
+    close_file(ofile);
+    if (needs_scales_file(out_format, out_type)) {
+      write_scales_file(output[f], out_format, out_scale);
     }
-    fclose(ifile);
-    fclose(ofile);
+    Progress::EndFile();
     // update total number of processed rows
     n += fr;
-    // if the number of read rows is not equal to the number of expected
-    // rows, show a warning to the user
-    if (mr->rows() > 0 && mr->rows() != fr) {
-      WARN_FMT(
-          "Number of processed rows (%d) is lower than expected (%d) "
-          "in file \"%s\"!", fr, mr->rows(), ifname);
-    }
   }
+  if (scores_file) close_file(scores_file);
   return n;
 }
 
 void projection_summary(
     const int n, const int idim, const int odim, const int exclude_dims,
-    const double miss_energy, const double kept_energy) {
+    const double miss_energy, const double kept_energy,
+    const double int8_loss, const bool int8_used) {
   const double rel_kept_energy = kept_energy / (miss_energy + kept_energy);
   fprintf(stderr, "---------------- Projection summary -----------------\n");
   fprintf(stderr, "Processed rows: %d\n", n);
@@ -203,6 +601,11 @@ void projection_summary(
         stderr, "Projected dimensions: %d-%d\n", 1, idim + exclude_dims);
   }
   fprintf(stderr, "Preserved energy: %.4g%%\n", rel_kept_energy * 100.0);
+  if (int8_loss >= 0) {
+    fprintf(
+        stderr, "Int8 projection error: %.4g%%%s\n", int8_loss * 100.0,
+        int8_used ? "" : " (not used)");
+  }
   fprintf(stderr, "-----------------------------------------------------\n");
 }
 
@@ -212,17 +615,28 @@ void do_work(
     const string& pca_fn,
     const vector<string>& input, const vector<string>& output, int block,
     int inp_dim, int out_dim, double min_rel_energy, bool normalize_data,
-    int exclude_dims) {
+    int exclude_dims, int threads, double keep_mem, const string& stats_dir,
+    const string& init_fn, FORMAT_CODE out_format, ELEM_TYPE out_type,
+    const char* out_type_str, WHITEN_MODE whiten_mode, double whiten_eps,
+    const string& scores_fn, double int8_max_loss, const string& valid_fn) {
   vector<real_t> mean;
   vector<real_t> stdev;
   vector<real_t> eigval;
   vector<real_t> eigvec;
   double miss_energy = 0.0;
+  // copy of the input data, to project it without reading the input again
+  unique_ptr<DataSpill<real_t> > spill(
+      do_compute_pca && do_project_data && keep_mem >= 0 ?
+      new DataSpill<real_t>(keep_mem * (1 << 20)) : NULL);
   if (do_compute_pca) {
     // Compute PCA from input files
     compute_pca<fmt, real_t>(
-        input, block, exclude_dims, min_rel_energy, &inp_dim,
-        &out_dim, &miss_energy, &eigval, &eigvec, &mean, &stdev);
+        input, block, threads, exclude_dims, min_rel_energy, &inp_dim,
+        &out_dim, &miss_energy, &eigval, &eigvec, &mean, &stdev, spill.get(),
+        stats_dir, init_fn);
+    // the eigenvectors are kept in the space of the co-moments matrix,
+    // release the unused part before the data is projected
+    eigvec.shrink_to_fit();
     if (!do_project_data || pca_fn != "") {
       save_pca<real_t>(
           pca_fn, exclude_dims, miss_energy, mean, stdev, eigval, eigvec);
@@ -263,12 +677,50 @@ void do_work(
       pca_odim = out_dim - abs(exclude_dims);
     }
     miss_energy = total_energy - cumulative_energy[pca_odim];
+    // weights used to compute the reconstruction scores of the whitened data
+    vector<real_t> score_c, score_iw;
+    if (scores_fn != "") {
+      reconstruction_score_weights<real_t>(
+          whiten_mode, pca_odim, whiten_eps, eigval, &score_c, &score_iw);
+    }
+    // the whitening is folded into the projection matrix, with ZCA the
+    // projected dimensions are rotated back to the input space
+    if (whiten_mode != WHITEN_NONE) {
+      whiten<real_t>(
+          whiten_mode, inp_dim - abs(exclude_dims), pca_odim, whiten_eps,
+          &eigval, &eigvec);
+      if (whiten_mode == WHITEN_ZCA) out_dim = inp_dim;
+    }
+    // rows of the blocks of projected data
+    plan_projection_memory<real_t>(
+        inp_dim, out_dim, eigvec, spill.get(), int8_max_loss >= 0,
+        scores_fn != "", out_format, &block);
+    // eigenvectors quantized to 8-bit integers, used only if the error of
+    // the projection of the validation data is small enough
+    unique_ptr<Int8Projection<real_t> > qv;
+    double int8_loss = -1.0;
+    if (int8_max_loss >= 0) {
+      qv.reset(new Int8Projection<real_t>(
+          inp_dim - abs(exclude_dims), out_dim - abs(exclude_dims),
+          eigvec.data()));
+      int8_loss = int8_projection_loss<fmt, real_t>(
+          valid_fn, block, out_dim, exclude_dims, normalize_data, threads,
+          mean, stdev, eigvec, qv.get());
+      if (int8_loss > int8_max_loss) {
+        WARN_FMT(
+            "The relative error of the int8 projection (%g) is bigger than "
+            "the maximum (-Q %g), using the float projection...", int8_loss,
+            int8_max_loss);
+        qv.reset();
+      }
+    }
     const int n = project_data<fmt, real_t>(
-        input, output, block, out_dim, exclude_dims, normalize_data, mean,
-        stdev, eigval, eigvec);
+        input, output, block, out_dim, exclude_dims, normalize_data, threads,
+        mean, stdev, eigval, eigvec, spill.get(), out_format, out_type,
+        out_type_str, scores_fn, score_c, score_iw, qv.get());
     projection_summary(
         n, inp_dim, out_dim, exclude_dims, miss_energy,
-        cumulative_energy[pca_odim]);
+        cumulative_energy[pca_odim], int8_loss, qv != NULL);
   }
 }
 
@@ -276,7 +728,8 @@ int main(int argc, char** argv) {
   int opt = -1;
   int inp_dim = -1, out_dim = -1;
   int exclude_dims = 0;
-  int block = 1000;
+  int block = 0;
+  int threads = 1;
   bool simple_precision = true;
   bool normalize_data = false;
   bool do_compute_pca = false;
@@ -284,8 +737,41 @@ int main(int argc, char** argv) {
   double min_rel_energy = -1.0;
   string pca_fn = "";
   FORMAT_CODE format = FMT_ASCII;
+  FORMAT_CODE out_format = FMT_UNKNOWN;
   const char* format_str = NULL;
-  while ((opt = getopt(argc, argv, "CPb:de:f:hj:m:np:q:")) != -1) {
+  const char* out_format_str = NULL;
+  const char* backend_str = NULL;
+  const char* input_type_str = NULL;
+  const char* out_type_str = NULL;
+  ELEM_TYPE out_type = ELEM_TYPE_NATIVE;
+  const char* whiten_str = NULL;
+  WHITEN_MODE whiten_mode = WHITEN_NONE;
+  double whiten_eps = DEFAULT_WHITEN_EPS;
+  const char* list_fn = NULL;
+  const char* cache_dir = NULL;
+  int cache_size = InputCache::DEFAULT_MAX_SIZE;
+  bool cache_hash = false;
+  double keep_mem = -1;
+  string stats_dir = "";
+  string init_fn = "";
+  string scores_fn = "";
+  double int8_max_loss = -1;
+  string valid_fn = "";
+  string stats_json = "";
+  double progress = 0;
+  bool perf_counters = false;
+  double mem_limit = 0;
+  static const struct option long_options[] = {
+    {"mem-limit", required_argument, NULL, MEM_LIMIT_OPTION},
+    {"perf-counters", no_argument, NULL, STATS_COUNTERS_OPTION},
+    {"progress", required_argument, NULL, PROGRESS_OPTION},
+    {"stats-json", required_argument, NULL, STATS_JSON_OPTION},
+    {NULL, 0, NULL, 0}
+  };
+  while ((opt = getopt_long(
+              argc, argv,
+              "CE:F:HL:O:PQ:R:S:T:V:W:b:c:de:f:hi:j:k:m:np:q:s:t:w:",
+              long_options, NULL)) != -1) {
     switch (opt) {
       case 'C':
         do_compute_pca = true;
@@ -293,6 +779,64 @@ int main(int argc, char** argv) {
       case 'P':
         do_project_data = true;
         break;
+      case 'F':
+        out_format_str = optarg;
+        out_format = format_code_from_name(out_format_str);
+        CHECK_FMT(
+            out_format != FMT_UNKNOWN, "Unknown format (-F \"%s\")!", optarg);
+        break;
+      case 'O':
+        out_type_str = optarg;
+        out_type = elem_type_from_name(out_type_str);
+        CHECK_FMT(
+            out_type == ELEM_TYPE_FLOAT32 || out_type == ELEM_TYPE_FLOAT64 ||
+            out_type == ELEM_TYPE_FLOAT16 || out_type == ELEM_TYPE_BFLOAT16 ||
+            out_type == ELEM_TYPE_INT8,
+            "Unknown output type (-O \"%s\")!", optarg);
+        break;
+      case 'V':
+        valid_fn = optarg;
+        break;
+      case 'W':
+        whiten_str = optarg;
+        if (whiten_str == string("pca")) {
+          whiten_mode = WHITEN_PCA;
+        } else if (whiten_str == string("zca")) {
+          whiten_mode = WHITEN_ZCA;
+        } else {
+          ERROR_FMT("Unknown whitening mode (-W \"%s\")!", optarg);
+        }
+        break;
+      case 'E':
+        whiten_eps = atof(optarg);
+        CHECK_FMT(
+            whiten_eps >= 0, "Whitening regularizer must be non-negative "
+            "(-E %g)!", whiten_eps);
+        break;
+      case 'Q':
+        int8_max_loss = atof(optarg);
+        CHECK_FMT(
+            int8_max_loss >= 0, "Maximum relative error must be non-negative "
+            "(-Q %g)!", int8_max_loss);
+        break;
+      case 'R':
+        scores_fn = optarg;
+        break;
+      case 'S':
+        list_fn = optarg;
+        break;
+      case 'c':
+        cache_dir = optarg;
+        break;
+      case 'H':
+        cache_hash = true;
+        break;
+      case 'L':
+        cache_size = atoi(optarg);
+        CHECK_FMT(
+            cache_size > 0, "Cache size must be positive (-L %d)!",
+            cache_size);
+        break;
       case 'b':
         block = atoi(optarg);
         CHECK_FMT(block > 0, "Block size must be positive (-b %d)!", block);
@@ -311,6 +855,23 @@ int main(int argc, char** argv) {
         format = format_code_from_name(format_str);
         CHECK_FMT(format != FMT_UNKNOWN, "Unknown format (-f \"%s\")!", optarg);
         break;
+      case 'T':
+        input_type_str = optarg;
+        CHECK_FMT(
+            elem_type_from_name(input_type_str) != ELEM_TYPE_UNKNOWN,
+            "Unknown element type (-T \"%s\")!", optarg);
+        set_binary_input_type(elem_type_from_name(input_type_str));
+        break;
+      case 'i':
+        backend_str = optarg;
+        CHECK_FMT(
+            io_backend_from_name(backend_str) != IO_BACKEND_UNKNOWN,
+            "Unknown I/O backend (-i \"%s\")!", optarg);
+        if (!set_io_backend(io_backend_from_name(backend_str))) {
+          WARN_FMT(
+              "I/O backend \"%s\" is not available, using stdio!", optarg);
+        }
+        break;
       case 'h':
         help(argv[0]);
         return 0;
@@ -321,6 +882,12 @@ int main(int argc, char** argv) {
             "Invalid minimum amount of relative energy (-j %f)!",
             min_rel_energy);
         break;
+      case 'k':
+        keep_mem = atof(optarg);
+        CHECK_FMT(
+            keep_mem >= 0, "Memory size must be non-negative (-k %g)!",
+            keep_mem);
+        break;
       case 'm':
         pca_fn = optarg;
         break;
@@ -334,6 +901,37 @@ int main(int argc, char** argv) {
         CHECK_FMT(
             out_dim > 0, "Output dimension must be positive (-q %d)!", out_dim);
         break;
+      case 's':
+        stats_dir = optarg;
+        break;
+      case 't':
+        threads = atoi(optarg);
+        CHECK_FMT(
+            threads > 0, "Number of threads must be positive (-t %d)!",
+            threads);
+        break;
+      case 'w':
+        init_fn = optarg;
+        break;
+      case MEM_LIMIT_OPTION:
+        mem_limit = atof(optarg);
+        CHECK_FMT(
+            mem_limit > 0, "Memory limit must be positive (--mem-limit %g)!",
+            mem_limit);
+        break;
+      case STATS_COUNTERS_OPTION:
+        perf_counters = true;
+        break;
+      case PROGRESS_OPTION:
+        progress = atof(optarg);
+        CHECK_FMT(
+            progress >= 0, "Progress interval must be non-negative "
+            "(--progress %g)!", progress);
+        break;
+      case STATS_JSON_OPTION:
+        stats_json = optarg;
+        Stats::Enable();
+        break;
       default:
         return 1;
     }
@@ -347,21 +945,61 @@ int main(int argc, char** argv) {
   fprintf(stderr, "%s", argv[0]);
   if (do_compute_pca) fprintf(stderr, " -C");
   if (do_project_data) fprintf(stderr, " -P");
+  if (out_format_str) fprintf(stderr, " -F \"%s\"", out_format_str);
+  if (out_type_str) fprintf(stderr, " -O \"%s\"", out_type_str);
+  if (whiten_str) fprintf(stderr, " -W \"%s\"", whiten_str);
+  if (whiten_eps != DEFAULT_WHITEN_EPS) fprintf(stderr, " -E %g", whiten_eps);
+  if (cache_dir) fprintf(stderr, " -c \"%s\"", cache_dir);
+  if (cache_dir && cache_hash) fprintf(stderr, " -H");
+  if (cache_dir && cache_size != InputCache::DEFAULT_MAX_SIZE) {
+    fprintf(stderr, " -L %d", cache_size);
+  }
+  if (int8_max_loss >= 0) fprintf(stderr, " -Q %g", int8_max_loss);
+  if (scores_fn != "") fprintf(stderr, " -R \"%s\"", scores_fn.c_str());
+  if (list_fn) fprintf(stderr, " -S \"%s\"", list_fn);
+  if (input_type_str) fprintf(stderr, " -T \"%s\"", input_type_str);
+  if (valid_fn != "") fprintf(stderr, " -V \"%s\"", valid_fn.c_str());
   if (!simple_precision) fprintf(stderr, " -d");
   if (exclude_dims) fprintf(stderr, " -e %d", exclude_dims);
   if (format_str) fprintf(stderr, " -f \"%s\"", format_str);
+  if (backend_str) fprintf(stderr, " -i \"%s\"", backend_str);
   if (min_rel_energy > 0) fprintf(stderr, " -j %g", min_rel_energy);
+  if (keep_mem >= 0) fprintf(stderr, " -k %g", keep_mem);
   if (pca_fn != "") fprintf(stderr, " -m \"%s\"", pca_fn.c_str());
   if (normalize_data) fprintf(stderr, " -n");
   if (inp_dim > 0) fprintf(stderr, " -p %d", inp_dim);
   if (out_dim > 0) fprintf(stderr, " -q %d", out_dim);
+  if (stats_dir != "") fprintf(stderr, " -s \"%s\"", stats_dir.c_str());
+  if (threads > 1) fprintf(stderr, " -t %d", threads);
+  if (init_fn != "") fprintf(stderr, " -w \"%s\"", init_fn.c_str());
+  if (mem_limit > 0) fprintf(stderr, " --mem-limit %g", mem_limit);
+  if (perf_counters) fprintf(stderr, " --perf-counters");
+  if (progress > 0) fprintf(stderr, " --progress %g", progress);
+  if (stats_json != "") {
+    fprintf(stderr, " --stats-json \"%s\"", stats_json.c_str());
+  }
   for (int a = optind; a < argc; ++a) {
     fprintf(stderr, " \"%s\"", argv[a]);
   }
   fprintf(stderr, "\n-----------------------------------------------------\n");
 
+  CHECK_MSG(
+      !perf_counters || stats_json != "",
+      "Option --perf-counters requires --stats-json!");
+  if (perf_counters) Stats::EnableCounters();
+  Memory::Limit(static_cast<size_t>(mem_limit * (1 << 20)), threads);
+  Progress::Start(progress);
+
+  if (cache_dir) {
+    InputCache::Set(new InputCache(
+        cache_dir, static_cast<uint64_t>(cache_size) << 20, cache_hash));
+  }
+
   // input & output file names
   vector<string> input, output;
+  if (list_fn) {
+    read_file_list(list_fn, &input, do_project_data ? &output : NULL);
+  }
   if (do_project_data) {
     for (int a = optind; a < argc; a+=2) {
       input.push_back(argv[a]);
@@ -376,10 +1014,74 @@ int main(int argc, char** argv) {
       input.push_back(argv[a]);
     }
   }
-  // when reading from stdin, we cannot process data twice!
+  // read from stdin (and write to stdout) by default
+  if (input.empty()) {
+    input.push_back("");
+    if (do_project_data) output.push_back("");
+  }
+  // stdin cannot be read twice, keep a copy of the data read while
+  // computing the PCA, to project it
+  if (do_compute_pca && do_project_data && keep_mem < 0 &&
+      find(input.begin(), input.end(), "") != input.end()) {
+    // the copy may not use most of the memory limit
+    keep_mem = mem_limit > 0 ?
+        min<double>(DEFAULT_KEEP_MEM, mem_limit / 4) : DEFAULT_KEEP_MEM;
+  }
+  // the statistics of stdin cannot be reused, since it cannot be identified
+  if (stats_dir != "" &&
+      find(input.begin(), input.end(), "") != input.end()) {
+    WARN("Ignoring \"-s\": statistics of stdin cannot be reused...");
+    stats_dir = "";
+  }
+  // the files whose statistics are reused are not read, the copy of the
+  // data would be incomplete
+  if (stats_dir != "" && keep_mem >= 0) {
+    WARN_FMT("Ignoring \"-k %g\": input files are read again...", keep_mem);
+    keep_mem = -1;
+  }
+  if (!do_compute_pca) stats_dir = "";
+  if (!do_project_data && out_format_str) {
+    WARN_FMT(
+        "Ignoring \"-F %s\": data is not projected...", out_format_str);
+  }
+  // projected data is written in the input format, by default
+  if (out_format == FMT_UNKNOWN) out_format = format;
+  if (!do_project_data && out_type_str) {
+    WARN_FMT("Ignoring \"-O %s\": data is not projected...", out_type_str);
+    out_type = ELEM_TYPE_NATIVE;
+  }
+  if (!do_project_data && whiten_str) {
+    WARN_FMT("Ignoring \"-W %s\": data is not projected...", whiten_str);
+    whiten_mode = WHITEN_NONE;
+  }
+  // the eigenvalues are the variances of the projected data only when the
+  // data is not normalized
   CHECK_MSG(
-      !do_compute_pca || !do_project_data || input.size() > 0,
-      "You cannot perform PCA and project data when reading from stdin!");
+      whiten_mode == WHITEN_NONE || !normalize_data,
+      "Whitening (-W) cannot be used with normalized data (-n)!");
+  if (!do_project_data && scores_fn != "") {
+    WARN_FMT(
+        "Ignoring \"-R %s\": data is not projected...", scores_fn.c_str());
+    scores_fn = "";
+  }
+  if (!do_project_data && int8_max_loss >= 0) {
+    WARN_FMT("Ignoring \"-Q %g\": data is not projected...", int8_max_loss);
+    int8_max_loss = -1;
+  }
+  // the int8 projection is validated with the first input file, by default
+  if (int8_max_loss >= 0 && valid_fn == "") {
+    CHECK_MSG(
+        input[0] != "",
+        "Specify a validation file (-V) to use the int8 projection (-Q) "
+        "with the standard input!");
+    valid_fn = input[0];
+  }
+  // ZCA-whitened data is rotated back to the input space, the coordinates in
+  // the subspace of the eigenvectors are not known
+  CHECK_MSG(
+      scores_fn == "" || whiten_mode != WHITEN_ZCA,
+      "Reconstruction scores (-R) cannot be computed with ZCA whitening "
+      "(-W zca)!");
 
   // Launch the appropiate do_work function, depending on the format of the
   // data and whether double or single precision is used.
@@ -392,71 +1094,164 @@ int main(int argc, char** argv) {
       if (simple_precision) {
         do_work<FMT_ASCII, float>(
             do_compute_pca, do_project_data, pca_fn, input, output, block,
-            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims);
+            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims,
+            threads, keep_mem, stats_dir, init_fn, out_format,
+            out_type, out_type_str, whiten_mode, whiten_eps,
+            scores_fn, int8_max_loss, valid_fn);
       } else {
         do_work<FMT_ASCII, double>(
             do_compute_pca, do_project_data, pca_fn, input, output, block,
-            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims);
+            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims,
+            threads, keep_mem, stats_dir, init_fn, out_format,
+            out_type, out_type_str, whiten_mode, whiten_eps,
+            scores_fn, int8_max_loss, valid_fn);
       }
       break;
     case FMT_BINARY:
       if (simple_precision) {
         do_work<FMT_BINARY, float>(
             do_compute_pca, do_project_data, pca_fn, input, output, block,
-            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims);
+            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims,
+            threads, keep_mem, stats_dir, init_fn, out_format,
+            out_type, out_type_str, whiten_mode, whiten_eps,
+            scores_fn, int8_max_loss, valid_fn);
       } else {
         do_work<FMT_BINARY, double>(
             do_compute_pca, do_project_data, pca_fn, input,
             output, block, inp_dim, out_dim, min_rel_energy, normalize_data,
-            exclude_dims);
+            exclude_dims, threads, keep_mem, stats_dir, init_fn,
+            out_format, out_type, out_type_str, whiten_mode, whiten_eps,
+            scores_fn, int8_max_loss, valid_fn);
       }
       break;
     case FMT_OCTAVE:
       if (simple_precision) {
         do_work<FMT_OCTAVE, float>(
             do_compute_pca, do_project_data, pca_fn, input, output, block,
-            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims);
+            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims,
+            threads, keep_mem, stats_dir, init_fn, out_format,
+            out_type, out_type_str, whiten_mode, whiten_eps,
+            scores_fn, int8_max_loss, valid_fn);
       } else {
         do_work<FMT_OCTAVE, double>(
             do_compute_pca, do_project_data, pca_fn, input, output, block,
-            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims);
+            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims,
+            threads, keep_mem, stats_dir, init_fn, out_format,
+            out_type, out_type_str, whiten_mode, whiten_eps,
+            scores_fn, int8_max_loss, valid_fn);
       }
       break;
     case FMT_VBOSCH:
       if (simple_precision) {
         do_work<FMT_VBOSCH, float>(
             do_compute_pca, do_project_data, pca_fn, input, output, block,
-            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims);
+            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims,
+            threads, keep_mem, stats_dir, init_fn, out_format,
+            out_type, out_type_str, whiten_mode, whiten_eps,
+            scores_fn, int8_max_loss, valid_fn);
       } else {
         do_work<FMT_VBOSCH, double>(
             do_compute_pca, do_project_data, pca_fn, input, output, block,
-            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims);
+            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims,
+            threads, keep_mem, stats_dir, init_fn, out_format,
+            out_type, out_type_str, whiten_mode, whiten_eps,
+            scores_fn, int8_max_loss, valid_fn);
       }
       break;
     case FMT_HTK:
       if (simple_precision) {
         do_work<FMT_HTK, float>(
             do_compute_pca, do_project_data, pca_fn, input, output, block,
-            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims);
+            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims,
+            threads, keep_mem, stats_dir, init_fn, out_format,
+            out_type, out_type_str, whiten_mode, whiten_eps,
+            scores_fn, int8_max_loss, valid_fn);
       } else {
         do_work<FMT_HTK, double>(
             do_compute_pca, do_project_data, pca_fn, input, output, block,
-            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims);
+            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims,
+            threads, keep_mem, stats_dir, init_fn, out_format,
+            out_type, out_type_str, whiten_mode, whiten_eps,
+            scores_fn, int8_max_loss, valid_fn);
       }
       break;
     case FMT_MAT4:
       if (simple_precision) {
         do_work<FMT_MAT4, float>(
             do_compute_pca, do_project_data, pca_fn, input, output, block,
-            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims);
+            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims,
+            threads, keep_mem, stats_dir, init_fn, out_format,
+            out_type, out_type_str, whiten_mode, whiten_eps,
+            scores_fn, int8_max_loss, valid_fn);
       } else {
         do_work<FMT_MAT4, double>(
             do_compute_pca, do_project_data, pca_fn, input, output, block,
-            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims);
+            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims,
+            threads, keep_mem, stats_dir, init_fn, out_format,
+            out_type, out_type_str, whiten_mode, whiten_eps,
+            scores_fn, int8_max_loss, valid_fn);
+      }
+      break;
+    case FMT_FPCA:
+      if (simple_precision) {
+        do_work<FMT_FPCA, float>(
+            do_compute_pca, do_project_data, pca_fn, input, output, block,
+            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims,
+            threads, keep_mem, stats_dir, init_fn, out_format,
+            out_type, out_type_str, whiten_mode, whiten_eps,
+            scores_fn, int8_max_loss, valid_fn);
+      } else {
+        do_work<FMT_FPCA, double>(
+            do_compute_pca, do_project_data, pca_fn, input, output, block,
+            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims,
+            threads, keep_mem, stats_dir, init_fn, out_format,
+            out_type, out_type_str, whiten_mode, whiten_eps,
+            scores_fn, int8_max_loss, valid_fn);
+      }
+      break;
+    case FMT_NPY:
+      if (simple_precision) {
+        do_work<FMT_NPY, float>(
+            do_compute_pca, do_project_data, pca_fn, input, output, block,
+            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims,
+            threads, keep_mem, stats_dir, init_fn, out_format,
+            out_type, out_type_str, whiten_mode, whiten_eps,
+            scores_fn, int8_max_loss, valid_fn);
+      } else {
+        do_work<FMT_NPY, double>(
+            do_compute_pca, do_project_data, pca_fn, input, output, block,
+            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims,
+            threads, keep_mem, stats_dir, init_fn, out_format,
+            out_type, out_type_str, whiten_mode, whiten_eps,
+            scores_fn, int8_max_loss, valid_fn);
+      }
+      break;
+    case FMT_KALDI:
+      if (simple_precision) {
+        do_work<FMT_KALDI, float>(
+            do_compute_pca, do_project_data, pca_fn, input, output, block,
+            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims,
+            threads, keep_mem, stats_dir, init_fn, out_format,
+            out_type, out_type_str, whiten_mode, whiten_eps,
+            scores_fn, int8_max_loss, valid_fn);
+      } else {
+        do_work<FMT_KALDI, double>(
+            do_compute_pca, do_project_data, pca_fn, input, output, block,
+            inp_dim, out_dim, min_rel_energy, normalize_data, exclude_dims,
+            threads, keep_mem, stats_dir, init_fn, out_format,
+            out_type, out_type_str, whiten_mode, whiten_eps,
+            scores_fn, int8_max_loss, valid_fn);
       }
       break;
     default:
       ERROR("Not implemented for this format!");
   }
+  Progress::Stop();
+  Memory::Report();
+  if (stats_json != "") {
+    CHECK_FMT(
+        Stats::WriteJson(stats_json, argv[0]),
+        "Failed to write the stats to \"%s\"!", stats_json.c_str());
+  }
   return 0;
 }
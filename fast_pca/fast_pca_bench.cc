@@ -0,0 +1,470 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <dlfcn.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fast_pca/fast_pca_common.h"
+#include "fast_pca/logging.h"
+
+using std::min;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+// Libraries used for BLAS/LAPACK, given by CMake
+#ifndef FAST_PCA_BLAS_LIBRARIES
+#define FAST_PCA_BLAS_LIBRARIES "unknown"
+#endif
+
+void help(const char* prog) {
+  fprintf(
+      stderr,
+      "Usage: %s [options]\n\n"
+      "Microbenchmarks of the main kernels: reading/writing each format\n"
+      "(io), the update of the co-moments matrix (comoments), the\n"
+      "eigendecomposition (eig) and the projection (project).\n\n"
+      "Options:\n"
+      "  -b size    number of rows in the batch (default: 1000)\n"
+      "  -f list    formats used by the io benchmark (default: all)\n"
+      "  -J         print the results as JSON (default: CSV)\n"
+      "  -k list    kernels to run (default: io,comoments,eig,project)\n"
+      "  -n rows    number of rows of the data (default: 10000)\n"
+      "  -p list    data dimensions (default: 32,256)\n"
+      "  -q list    output dimensions of the projection (default: 16,64)\n"
+      "  -r reps    repetitions of each benchmark, the fastest one is\n"
+      "             reported (default: 3)\n"
+      "  -t threads number of threads used to parse/format text data\n",
+      prog);
+}
+
+// Split a comma-separated list
+vector<string> split_list(const string& str) {
+  vector<string> items;
+  std::istringstream iss(str);
+  string item;
+  while (std::getline(iss, item, ',')) {
+    if (!item.empty()) items.push_back(item);
+  }
+  return items;
+}
+
+vector<int> split_int_list(const string& str) {
+  vector<int> items;
+  const vector<string> s = split_list(str);
+  for (size_t i = 0; i < s.size(); ++i) {
+    items.push_back(atoi(s[i].c_str()));
+    CHECK_FMT(items.back() > 0, "Invalid dimension (\"%s\")!", s[i].c_str());
+  }
+  return items;
+}
+
+// Model of the CPU, from /proc/cpuinfo (Linux only)
+string cpu_name() {
+  FILE* file = fopen("/proc/cpuinfo", "r");
+  if (!file) return "unknown";
+  char line[1024];
+  string name = "unknown";
+  while (fgets(line, sizeof(line), file)) {
+    if (strncmp(line, "model name", 10) == 0 && strchr(line, ':')) {
+      name = strchr(line, ':') + 1;
+      name.erase(0, name.find_first_not_of(" \t"));
+      name.erase(name.find_last_not_of(" \t\n") + 1);
+      break;
+    }
+  }
+  fclose(file);
+  return name;
+}
+
+// BLAS implementation: OpenBLAS and MKL report their version at run time,
+// otherwise the libraries found by CMake are reported.
+string blas_name() {
+  typedef char* (*openblas_config_t)();
+  openblas_config_t openblas_config = reinterpret_cast<openblas_config_t>(
+      dlsym(RTLD_DEFAULT, "openblas_get_config"));
+  if (openblas_config) return openblas_config();
+  typedef void (*mkl_version_t)(char*, int);
+  mkl_version_t mkl_version = reinterpret_cast<mkl_version_t>(
+      dlsym(RTLD_DEFAULT, "mkl_get_version_string"));
+  if (mkl_version) {
+    char buf[256] = {0};
+    mkl_version(buf, sizeof(buf) - 1);
+    return string(buf);
+  }
+  return FAST_PCA_BLAS_LIBRARIES;
+}
+
+// Number of threads used by BLAS, -1 if it is unknown
+int blas_threads() {
+  typedef int (*num_threads_t)();
+  num_threads_t num_threads = reinterpret_cast<num_threads_t>(
+      dlsym(RTLD_DEFAULT, "openblas_get_num_threads"));
+  if (!num_threads) {
+    num_threads = reinterpret_cast<num_threads_t>(
+        dlsym(RTLD_DEFAULT, "MKL_Get_Max_Threads"));
+  }
+  if (num_threads) return num_threads();
+  const char* env = getenv("OMP_NUM_THREADS");
+  return env ? atoi(env) : -1;
+}
+
+string json_escape(const string& str) {
+  string out;
+  for (size_t i = 0; i < str.size(); ++i) {
+    if (str[i] == '"' || str[i] == '\\') out += '\\';
+    if (static_cast<unsigned char>(str[i]) >= 0x20) out += str[i];
+  }
+  return out;
+}
+
+// Result of a benchmark, rate is given in the units of unit (e.g. MB/s)
+struct Result {
+  string kernel;
+  string variant;
+  string precision;
+  int n, p, q;
+  double seconds;
+  double rate;
+  string unit;
+};
+
+class Reporter {
+ public:
+  Reporter(bool json, int threads) :
+      json_(json), cpu_(cpu_name()), blas_(blas_name()), threads_(threads),
+      blas_threads_(blas_threads()),
+      hw_threads_(std::thread::hardware_concurrency()) {
+    if (json_) {
+      printf("{\n  \"cpu\": \"%s\",\n  \"blas\": \"%s\",\n",
+             json_escape(cpu_).c_str(), json_escape(blas_).c_str());
+      printf("  \"threads\": %d,\n  \"blas_threads\": %d,\n", threads_,
+             blas_threads_);
+      printf("  \"hw_threads\": %d,\n  \"results\": [", hw_threads_);
+    } else {
+      printf("kernel,variant,precision,n,p,q,seconds,rate,unit,cpu,blas,"
+             "threads,blas_threads,hw_threads\n");
+    }
+  }
+
+  ~Reporter() {
+    if (json_) printf("\n  ]\n}\n");
+  }
+
+  void add(const Result& r) {
+    if (json_) {
+      printf(
+          "%s\n    {\"kernel\": \"%s\", \"variant\": \"%s\", "
+          "\"precision\": \"%s\", \"n\": %d, \"p\": %d, \"q\": %d, "
+          "\"seconds\": %.6g, \"rate\": %.6g, \"unit\": \"%s\"}",
+          count_ ? "," : "", r.kernel.c_str(), r.variant.c_str(),
+          r.precision.c_str(), r.n, r.p, r.q, r.seconds, r.rate,
+          r.unit.c_str());
+    } else {
+      // the CPU and BLAS names may contain commas
+      printf(
+          "%s,%s,%s,%d,%d,%d,%.6g,%.6g,%s,\"%s\",\"%s\",%d,%d,%d\n",
+          r.kernel.c_str(), r.variant.c_str(), r.precision.c_str(), r.n, r.p,
+          r.q, r.seconds, r.rate, r.unit.c_str(), cpu_.c_str(),
+          blas_.c_str(), threads_, blas_threads_, hw_threads_);
+    }
+    fflush(stdout);
+    ++count_;
+  }
+
+ private:
+  bool json_;
+  string cpu_;
+  string blas_;
+  int threads_;
+  int blas_threads_;
+  int hw_threads_;
+  int count_ = 0;
+};
+
+// Run the function reps times, and return the time of the fastest run
+template <typename F>
+double best_time(int reps, F f) {
+  double best = 0.0;
+  for (int r = 0; r < reps; ++r) {
+    const auto t0 = std::chrono::steady_clock::now();
+    f();
+    const auto t1 = std::chrono::steady_clock::now();
+    const double t = std::chrono::duration<double>(t1 - t0).count();
+    if (r == 0 || t < best) best = t;
+  }
+  return best;
+}
+
+template <typename real_t>
+const char* precision_name() {
+  return sizeof(real_t) == 4 ? "float" : "double";
+}
+
+template <typename real_t>
+vector<real_t> random_data(size_t n, unsigned seed) {
+  std::mt19937 gen(seed);
+  std::normal_distribution<real_t> dist(0, 1);
+  vector<real_t> x(n);
+  for (size_t i = 0; i < n; ++i) x[i] = dist(gen);
+  return x;
+}
+
+// Write and read a n x p matrix with the given format, in a temporary file
+// (i.e. mostly in the page cache). The rate is the amount of data (in the
+// precision used for the computations) written or read per second.
+template <typename real_t>
+void bench_io(
+    const string& format_str, int n, int p, int block, int threads, int reps,
+    Reporter* reporter) {
+  const FORMAT_CODE format = format_code_from_name(format_str);
+  CHECK_FMT(format != FMT_UNKNOWN, "Unknown format (\"%s\")!",
+            format_str.c_str());
+  const vector<real_t> x = random_data<real_t>(static_cast<size_t>(n) * p, 1);
+  vector<real_t> y(static_cast<size_t>(block) * p);
+  const double mb = static_cast<double>(n) * p * sizeof(real_t) / (1 << 20);
+  FILE* file = tmpfile();
+  CHECK_MSG(file, "Temporary file could not be created!");
+  // the header is copied from a matrix of the same size, so that each
+  // format fills the rest of its fields (names, etc) with default values
+  unique_ptr<MatrixFile> header(MatrixFile::Create(FMT_BINARY));
+  header->rows(n);
+  header->cols(p);
+  const double tw = best_time(reps, [&]() {
+      rewind(file);
+      CHECK(ftruncate(fileno(file), 0) == 0);
+      unique_ptr<MatrixFile> mw(MatrixFile::Create(format));
+      mw->file(file);
+      mw->threads(threads);
+      mw->copy_header_from(*header);
+      mw->write_header();
+      for (int r = 0; r < n; r += block) {
+        const int br = min(block, n - r);
+        mw->write_block(br * p, x.data() + static_cast<size_t>(r) * p);
+      }
+      mw->write_footer();
+      fflush(file);
+    });
+  reporter->add(Result{"write", format_str, precision_name<real_t>(), n, p, 0,
+                       tw, mb / tw, "MB/s"});
+  size_t read = 0;
+  const double tr = best_time(reps, [&]() {
+      rewind(file);
+      unique_ptr<MatrixFile> mr(MatrixFile::Create(format));
+      mr->file(file);
+      mr->threads(threads);
+      CHECK_FMT(mr->read_header(), "Invalid header (format \"%s\")!",
+                format_str.c_str());
+      if (mr->cols() < 0) mr->cols(p);
+      read = 0;
+      int be = 0;
+      while ((be = mr->read_block(block * p, y.data())) > 0) read += be;
+    });
+  if (read != static_cast<size_t>(n) * p) {
+    WARN_FMT("Format \"%s\" read %lu elements, but %lu were written!",
+             format_str.c_str(), read, static_cast<size_t>(n) * p);
+  }
+  reporter->add(Result{"read", format_str, precision_name<real_t>(), n, p, 0,
+                       tr, mb / tr, "MB/s"});
+  fclose(file);
+}
+
+// Update of the mean and co-moments matrix, block by block, as done by
+// compute_mean_comoments_from_inputs(). The rate is given in rows/s.
+template <typename real_t>
+void bench_comoments(int n, int p, int block, int reps, Reporter* reporter) {
+  const vector<real_t> data =
+      random_data<real_t>(static_cast<size_t>(n) * p, 2);
+  const vector<real_t> ones(block, 1);
+  vector<real_t> x(static_cast<size_t>(block) * p), m(p), d(p);
+  vector<real_t> M(p), C(static_cast<size_t>(p) * p);
+  const double t = best_time(reps, [&]() {
+      int acc_n = 0;
+      std::fill(M.begin(), M.end(), 0);
+      std::fill(C.begin(), C.end(), 0);
+      for (int r = 0; r < n; r += block) {
+        const int br = min(block, n - r);
+        memcpy(x.data(), data.data() + static_cast<size_t>(r) * p,
+               sizeof(real_t) * br * p);
+        update_mean_comoments<real_t>(
+            br, p, ones.data(), x.data(), m.data(), d.data(), &acc_n,
+            M.data(), C.data());
+      }
+    });
+  reporter->add(Result{"comoments", "gemm", precision_name<real_t>(), n, p, 0,
+                       t, n / t, "rows/s"});
+}
+
+// Eigendecomposition of a p x p covariance matrix
+template <typename real_t>
+void bench_eig(int p, int reps, Reporter* reporter) {
+  // covariance of 2 * p random rows (full rank)
+  const int n = 2 * p;
+  const vector<real_t> x = random_data<real_t>(static_cast<size_t>(n) * p, 3);
+  vector<real_t> c(static_cast<size_t>(p) * p), a(c.size()), w(p);
+  gemm<real_t>('T', 'N', p, p, n, 1.0 / n, x.data(), p, x.data(), p, 0,
+               c.data(), p);
+  const double t = best_time(reps, [&]() {
+      a = c;
+      CHECK(eig<real_t>(p, p, a.data(), w.data()) == 0);
+    });
+  reporter->add(Result{"eig", "syev", precision_name<real_t>(), 0, p, p, t,
+                       1.0 / t, "eig/s"});
+}
+
+// Projection of n rows from p to q dimensions, with the float eigenvectors
+// (gemm) and with the eigenvectors quantized to 8-bit integers (int8).
+// The rate is given in GFLOP/s (2 * n * p * q operations).
+template <typename real_t>
+void bench_project(
+    int n, int p, int q, int block, int reps, Reporter* reporter) {
+  const vector<real_t> data =
+      random_data<real_t>(static_cast<size_t>(n) * p, 4);
+  // orthonormal eigenvectors
+  vector<real_t> v = random_data<real_t>(static_cast<size_t>(q) * p, 5);
+  CHECK(orthonormalize_rows<real_t>(q, p, 0, v.data()) == q);
+  const vector<real_t> mean(p, 0);
+  vector<real_t> x(static_cast<size_t>(block) * p);
+  vector<real_t> z(static_cast<size_t>(block) * q);
+  Int8Projection<real_t> qv(p, q, v.data());
+  const double gflop = 2.0 * n * p * q * 1E-9;
+  for (int variant = 0; variant < 2; ++variant) {
+    const double t = best_time(reps, [&]() {
+        for (int r = 0; r < n; r += block) {
+          const int br = min(block, n - r);
+          memcpy(x.data(), data.data() + static_cast<size_t>(r) * p,
+                 sizeof(real_t) * br * p);
+          project<real_t>(
+              br, p, q, 0, v.data(), mean.data(), NULL, x.data(), z.data(),
+              variant ? &qv : NULL);
+        }
+      });
+    reporter->add(Result{"project", variant ? "int8" : "gemm",
+                         precision_name<real_t>(), n, p, q, t, gflop / t,
+                         "GFLOP/s"});
+  }
+}
+
+template <typename real_t>
+void do_work(
+    const vector<string>& kernels, const vector<string>& formats, int n,
+    const vector<int>& dims, const vector<int>& odims, int block,
+    int threads, int reps, Reporter* reporter) {
+  for (size_t k = 0; k < kernels.size(); ++k) {
+    for (size_t i = 0; i < dims.size(); ++i) {
+      const int p = dims[i];
+      if (kernels[k] == "io") {
+        for (size_t f = 0; f < formats.size(); ++f) {
+          bench_io<real_t>(formats[f], n, p, block, threads, reps, reporter);
+        }
+      } else if (kernels[k] == "comoments") {
+        bench_comoments<real_t>(n, p, block, reps, reporter);
+      } else if (kernels[k] == "eig") {
+        bench_eig<real_t>(p, reps, reporter);
+      } else if (kernels[k] == "project") {
+        for (size_t j = 0; j < odims.size(); ++j) {
+          if (odims[j] > p) continue;
+          bench_project<real_t>(n, p, odims[j], block, reps, reporter);
+        }
+      } else {
+        ERROR_FMT("Unknown kernel (\"%s\")!", kernels[k].c_str());
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  int opt = -1;
+  int block = 1000;
+  int n = 10000;
+  int reps = 3;
+  int threads = 1;
+  bool json = false;
+  vector<string> kernels = split_list("io,comoments,eig,project");
+  vector<string> formats = split_list(
+      "ascii,binary,octave,vbosch,htk,mat4,fpca,npy,kaldi");
+  vector<int> dims = split_int_list("32,256");
+  vector<int> odims = split_int_list("16,64");
+  while ((opt = getopt(argc, argv, "Jb:f:hk:n:p:q:r:t:")) != -1) {
+    switch (opt) {
+      case 'J':
+        json = true;
+        break;
+      case 'b':
+        block = atoi(optarg);
+        CHECK_FMT(block > 0, "Block size must be positive (-b %d)!", block);
+        break;
+      case 'f':
+        formats = split_list(optarg);
+        break;
+      case 'h':
+        help(argv[0]);
+        return 0;
+      case 'k':
+        kernels = split_list(optarg);
+        break;
+      case 'n':
+        n = atoi(optarg);
+        CHECK_FMT(n > 0, "Number of rows must be positive (-n %d)!", n);
+        break;
+      case 'p':
+        dims = split_int_list(optarg);
+        break;
+      case 'q':
+        odims = split_int_list(optarg);
+        break;
+      case 'r':
+        reps = atoi(optarg);
+        CHECK_FMT(reps > 0, "Repetitions must be positive (-r %d)!", reps);
+        break;
+      case 't':
+        threads = atoi(optarg);
+        CHECK_FMT(
+            threads > 0, "Number of threads must be positive (-t %d)!",
+            threads);
+        break;
+      default:
+        return 1;
+    }
+  }
+  Reporter reporter(json, threads);
+  do_work<float>(
+      kernels, formats, n, dims, odims, block, threads, reps, &reporter);
+  do_work<double>(
+      kernels, formats, n, dims, odims, block, threads, reps, &reporter);
+  return 0;
+}
@@ -28,27 +28,185 @@
 #include "fast_pca/file.h"
 #include "fast_pca/file_pca.h"
 #include "fast_pca/math.h"
+#include "fast_pca/memory.h"
 #include "fast_pca/pca.h"
+#include "fast_pca/prefetch.h"
+#include "fast_pca/progress.h"
+#include "fast_pca/spill.h"
+#include "fast_pca/stats.h"
+#include "fast_pca/stats_cache.h"
 
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <limits>
 #include <memory>
 #include <string>
 #include <vector>
 
+using std::back_inserter;
+using std::binary_search;
+using std::function;
+using std::lower_bound;
+using std::set_difference;
+using std::sort;
 using std::string;
 using std::unique_ptr;
 using std::vector;
 
+// Maximum number of iterations of the iterative eigensolver
+static const int LOBPCG_MAX_ITER = 500;
+
+// Merge the statistics of a set of rows (nb, Mb, Cb) into the statistics
+// (n, M, C) of another set: number of rows, mean and co-moments matrix.
+template <typename real_t>
+void merge_n_mean_comoments(
+    int nb, const vector<real_t>& Mb, const vector<real_t>& Cb, int* n,
+    vector<real_t>* M, vector<real_t>* C) {
+  const int dim = Mb.size();
+  if (nb == 0) return;
+  if (*n == 0) {
+    *n = nb;
+    *M = Mb;
+    *C = Cb;
+    return;
+  }
+  // D = M - Mb
+  vector<real_t> D(*M);
+  axpy<real_t>(dim, -1, Mb.data(), D.data());
+  // C += Cb
+  axpy<real_t>(dim * dim, 1, Cb.data(), C->data());
+  // C += D * D' * (nb * n) / (nb + n)
+  {
+    STATS_SCOPE(STATS_GER);
+    STATS_FLOPS(STATS_GER, 2.0 * dim * dim);
+    ger<real_t>(
+        dim, dim, (1.0 * nb) * (*n) / (*n + nb), D.data(), D.data(),
+        C->data());
+  }
+  // update mean
+  for (int i = 0; i < dim; ++i) {
+    (*M)[i] = ((*n) * (*M)[i] + nb * Mb[i]) / (*n + nb);
+  }
+  *n += nb;
+}
+
+// Remove the statistics of a subset of rows (nb, Mb, Cb) from the
+// statistics (n, M, C) of the whole set. This is the inverse of
+// merge_n_mean_comoments, note that it is less numerically stable.
+template <typename real_t>
+void downdate_n_mean_comoments(
+    int nb, const vector<real_t>& Mb, const vector<real_t>& Cb, int* n,
+    vector<real_t>* M, vector<real_t>* C) {
+  const int dim = Mb.size();
+  if (nb == 0) return;
+  CHECK_FMT(
+      nb <= *n, "Cannot remove %d rows from a set of %d rows!", nb, *n);
+  const int na = *n - nb;
+  if (na == 0) {
+    *n = 0;
+    std::fill(M->begin(), M->end(), 0);
+    std::fill(C->begin(), C->end(), 0);
+    return;
+  }
+  // mean of the remaining rows
+  for (int i = 0; i < dim; ++i) {
+    (*M)[i] = ((*n) * (*M)[i] - nb * Mb[i]) / na;
+  }
+  // D = M - Mb
+  vector<real_t> D(*M);
+  axpy<real_t>(dim, -1, Mb.data(), D.data());
+  // C -= Cb
+  axpy<real_t>(dim * dim, -1, Cb.data(), C->data());
+  // C -= D * D' * (nb * na) / n
+  ger<real_t>(
+      dim, dim, -(1.0 * nb) * na / (*n), D.data(), D.data(), C->data());
+  *n = na;
+}
+
+// Update the statistics (n, M, C) with a block of br rows of dim elements.
+// ones -> (input) vector of (at least) br ones
+// x    -> (input) data block, (output) mean-centered data block
+// m, d -> auxiliar vectors of dim elements
+template <typename real_t>
+void update_mean_comoments(
+    int br, int dim, const real_t* ones, real_t* x, real_t* m, real_t* d,
+    int* n, real_t* M, real_t* C) {
+  {
+    STATS_SCOPE(STATS_CENTER);
+    STATS_COUNT(STATS_CENTER, sizeof(real_t) * br * dim, br);
+    STATS_FLOPS(STATS_CENTER, 3.0 * br * dim);
+    // compute block mean
+    gemv<real_t>('T', br, dim, 1.0 / br, x, dim, ones, 1, 0, m, 1);
+    // subtract mean to the current block
+    for (int i = 0; i < br; ++i) {
+      axpy<real_t>(dim, -1, m, x + i * dim);
+    }
+    // d = M - m
+    memcpy(d, M, sizeof(real_t) * dim);
+    axpy<real_t>(dim, -1, m, d);
+  }
+  // update co-moments matrix
+  // C += (x - m)' * (x - m)
+  {
+    STATS_SCOPE(STATS_GEMM);
+    STATS_COUNT(STATS_GEMM, sizeof(real_t) * br * dim, br);
+    STATS_FLOPS(STATS_GEMM, 2.0 * br * dim * dim);
+    gemm<real_t>('T', 'N', dim, dim, br, 1, x, dim, x, dim, 1, C, dim);
+  }
+  // C += D * D' * (br * n) / (br + n)
+  const int nn = *n + br;
+  const real_t cf = br * ((*n) / (1.0 * nn));
+  {
+    STATS_SCOPE(STATS_GER);
+    STATS_FLOPS(STATS_GER, 2.0 * dim * dim);
+    ger<real_t>(dim, dim, cf, d, d, C);
+  }
+  // update mean
+  for (int i = 0; i < dim; ++i) {
+    M[i] = ((*n) * M[i] + br * m[i]) / nn;
+  }
+  // update total number of processed rows
+  *n = nn;
+}
+
+// Plan the rows of the data blocks used to compute the co-moments of dim
+// dimensions, to fit in the memory limit (see Memory::Plan). The dense
+// buffers are the co-moments matrix (and the ones of the current file and
+// of the new files, when the statistics are reported for each file), the
+// workspace of the eigendecomposition that usually follows and the copy of
+// the data kept in memory.
+template <typename real_t>
+void plan_comoments_memory(
+    int dim, bool file_stats, const DataSpill<real_t>* spill, int* block) {
+  const size_t d = dim;
+  const size_t dense = sizeof(real_t) * (
+      d * d * (file_stats ? 3 : 1) + syev_workspace<real_t>(dim) + 4 * d) +
+      (spill ? spill->mem_limit() : 0);
+  // each row of the block, and the ones used to compute its mean
+  Memory::Plan(
+      "co-moments computation", dim, dense, sizeof(real_t) * (d + 1), block);
+}
+
+// Compute the number of rows, the mean and the co-moments matrix of the
+// data in the input files.
+// If spill is not NULL, a copy of the read data is kept in it.
+// If file_stats is given, it is called with the statistics of each file.
 template <FORMAT_CODE fmt, typename real_t>
 void compute_mean_comoments_from_inputs(
-    int block, vector<string> input, int* n, int* inp_dim,
-    vector<real_t>* M, vector<real_t>* C) {
+    int block, int threads, vector<string> input, int* n, int* inp_dim,
+    vector<real_t>* M, vector<real_t>* C, DataSpill<real_t>* spill = NULL,
+    const function<void(int, int, const vector<real_t>&,
+                        const vector<real_t>&)>& file_stats = nullptr) {
   CHECK(!input.empty());
-  CHECK(block > 0);
-  const vector<real_t> ones(block, 1);
-  vector<real_t> x;  // data block
-  vector<real_t> m;  // mean of the current block
-  vector<real_t> d;  // diff between global and block mean
+  CHECK(block >= 0);
+  vector<real_t> ones;  // ones used to compute the block mean
+  vector<real_t> x;     // data block
+  vector<real_t> m;     // mean of the current block
+  vector<real_t> d;     // diff between global and block mean
   if (*inp_dim > 0) {
+    plan_comoments_memory<real_t>(*inp_dim, !!file_stats, spill, &block);
+    ones.resize(block, 1);
     x.resize(block * *inp_dim, 0);
     m.resize(*inp_dim, 0);
     d.resize(*inp_dim, 0);
@@ -56,19 +214,26 @@ void compute_mean_comoments_from_inputs(
     C->resize((*inp_dim) * (*inp_dim), 0);
   }
   *n = 0;            // total processed rows
-  unique_ptr<MatrixFile> mh(MatrixFile::Create<fmt>());
+  Progress::Stage("comoments", input);
+  // files are opened and their headers parsed ahead, on helper threads
+  MatrixPrefetcher prefetcher(
+      input, &MatrixFile::Create<fmt>, sizeof(real_t),
+      MatrixPrefetcher::DEFAULT_THREADS, Memory::PrefetchDepth());
   for (size_t f = 0; f < input.size(); ++f) {
     const char* fname = input[f] == "" ? "**stdin**" : input[f].c_str();
-    FILE* file = input[f] == "" ? stdin : open_file(fname, "rb");
-    mh->file(file);
-    CHECK_FMT(
-        mh->read_header(), "Failed to read header in file \"%s\"!", fname);
+    unique_ptr<MatrixPrefetcher::Entry> entry = prefetcher.next();
+    FILE* file = entry->file;
+    MatrixFile* mh = entry->reader.get();
+    mh->threads(threads);
+    CHECK_FMT(entry->header, "Failed to read header in file \"%s\"!", fname);
     if (*inp_dim < 1) {
       CHECK_FMT(
           mh->cols() > 0,
           "Number of input dimensions could not be determined by file \"%s\" "
           "(number of read columns in file: %d)!", fname, mh->cols());
       *inp_dim = mh->cols();
+      plan_comoments_memory<real_t>(*inp_dim, !!file_stats, spill, &block);
+      ones.resize(block, 1);
       x.resize(block * (*inp_dim), 0);
       m.resize(*inp_dim, 0);
       d.resize(*inp_dim, 0);
@@ -79,44 +244,169 @@ void compute_mean_comoments_from_inputs(
           mh->cols() < 0 || mh->cols() == *inp_dim,
           "Number of read dimensions in file \"%s\" (%d) is not the "
           "expected (%d)!", fname, mh->cols(), *inp_dim);
+      // formats without header need to know the number of columns to read
+      // the file in parallel
+      if (mh->cols() < 0) mh->cols(*inp_dim);
+    }
+    Progress::BeginFile(f, mh->rows());
+    // statistics of the current file, when they are reported for each
+    // file, otherwise the global statistics are updated directly
+    int fn = 0;
+    vector<real_t> fM, fC;
+    int* acc_n = n;
+    vector<real_t>* acc_M = M;
+    vector<real_t>* acc_C = C;
+    if (file_stats) {
+      fM.resize(*inp_dim, 0);
+      fC.resize((*inp_dim) * (*inp_dim), 0);
+      acc_n = &fn;
+      acc_M = &fM;
+      acc_C = &fC;
     }
     int fr = 0, be = 0, br = 0;
-    while ((be = mh->read_block(block * (*inp_dim), x.data())) > 0) {
+    // archives contain multiple matrices, all of them are processed
+    do {
       CHECK_FMT(
-        be % (*inp_dim) == 0,
-        "Corrupted matrix in file \"%s\" (block expected a multiple of "
-        "%d elements, but %d where read)!\n",
-        fname, *inp_dim, be);
-      br = be / (*inp_dim);
-      fr += br;
-      // compute block mean
-      gemv<real_t>(
-          'T', br, *inp_dim, 1.0 / br, x.data(), *inp_dim, ones.data(), 1,
-          0, m.data(), 1);
-      // subtract mean to the current block
-      for (int i = 0; i < br; ++i) {
-        axpy<real_t>(*inp_dim, -1, m.data(), x.data() + i * (*inp_dim));
+          mh->cols() < 0 || mh->cols() == *inp_dim,
+          "Number of read dimensions in file \"%s\" (%d) is not the "
+          "expected (%d)!", fname, mh->cols(), *inp_dim);
+      if (spill) {
+        MatrixFile* header = MatrixFile::Create<fmt>();
+        header->copy_header_from(*mh);
+        spill->begin_matrix(f, header);
       }
-      // d = M - m
-      memcpy(d.data(), M->data(), sizeof(real_t) * (*inp_dim));
-      axpy<real_t>(*inp_dim, -1, m.data(), d.data());
-      // update co-moments matrix
-      // C += (x - m)' * (x - m)
-      gemm<real_t>(
-          'T', 'N', *inp_dim, *inp_dim, br, 1, x.data(), *inp_dim, x.data(),
-          *inp_dim, 1, C->data(), *inp_dim);
-      // C += D * D' * (br * n) / (br + n)
-      const int nn = *n + br;
-      const real_t cf = br * ((*n) / (1.0 * nn));
-      ger<real_t>(*inp_dim, *inp_dim, cf, d.data(), d.data(), C->data());
-      // update mean
-      for (int i = 0; i < *inp_dim; ++i) {
-        (*M)[i] = ((*n) * (*M)[i] + br * m[i]) / nn;
+      while ((be = entry->read_block(block * (*inp_dim), x.data())) > 0) {
+        CHECK_FMT(
+          be % (*inp_dim) == 0,
+          "Corrupted matrix in file \"%s\" (block expected a multiple of "
+          "%d elements, but %d where read)!\n",
+          fname, *inp_dim, be);
+        br = be / (*inp_dim);
+        fr += br;
+        // keep a copy of the data, before it is modified
+        if (spill) spill->write(br, *inp_dim, x.data());
+        update_mean_comoments<real_t>(
+            br, *inp_dim, ones.data(), x.data(), m.data(), d.data(), acc_n,
+            acc_M->data(), acc_C->data());
       }
-      // update total number of processed rows
-      *n = nn;
+    } while (mh->read_next_header());
+    close_file(file);
+    Progress::EndFile();
+    if (file_stats) {
+      file_stats(f, fn, fM, fC);
+      merge_n_mean_comoments<real_t>(fn, fM, fC, n, M, C);
+    }
+  }
+}
+
+// Compute the number of rows, the mean and the co-moments matrix of the
+// data in the input files, reusing the statistics of each file saved in
+// the directory dir by previous runs. Only new or modified files are read;
+// the statistics of the files removed since the last run are subtracted
+// from the merged statistics of that run.
+template <FORMAT_CODE fmt, typename real_t>
+void compute_mean_comoments_incremental(
+    const string& dir, int block, int threads, const vector<string>& input,
+    int* n, int* inp_dim, vector<real_t>* M, vector<real_t>* C) {
+  StatsCache cache(dir, fmt, sizeof(real_t));
+  vector<string> ids(input.size());
+  for (size_t f = 0; f < input.size(); ++f) {
+    ids[f] = StatsCache::identity(input[f]);
+  }
+  vector<string> new_ids(ids);
+  sort(new_ids.begin(), new_ids.end());
+  // start from the merged statistics of the last run
+  vector<string> old_ids;
+  *n = 0;
+  M->clear();
+  C->clear();
+  if (cache.load_state(&old_ids)) {
+    load_n_mean_cov<real_t>(cache.merged_stats(old_ids), n, inp_dim, M, C);
+  }
+  const string old_merged = cache.merged_stats(old_ids);
+  sort(old_ids.begin(), old_ids.end());
+  vector<string> removed, added;
+  set_difference(
+      old_ids.begin(), old_ids.end(), new_ids.begin(), new_ids.end(),
+      back_inserter(removed));
+  set_difference(
+      new_ids.begin(), new_ids.end(), old_ids.begin(), old_ids.end(),
+      back_inserter(added));
+  // subtract the statistics of the removed files. If any of them is
+  // missing, or most of the rows were removed, start from scratch, which
+  // is also numerically safer.
+  vector<int> nb(removed.size(), 0);
+  vector<vector<real_t> > Mb(removed.size()), Cb(removed.size());
+  int removed_rows = 0;
+  bool rebuild = false;
+  for (size_t r = 0; r < removed.size() && !rebuild; ++r) {
+    const string fname = cache.input_stats(removed[r]);
+    if (!StatsCache::exists(fname)) {
+      rebuild = true;
+    } else {
+      load_n_mean_cov<real_t>(fname, &nb[r], inp_dim, &Mb[r], &Cb[r]);
+      removed_rows += nb[r];
+    }
+  }
+  rebuild = rebuild || 2 * removed_rows > *n;
+  if (rebuild) {
+    *n = 0;
+    M->clear();
+    C->clear();
+    added = new_ids;
+  } else {
+    for (size_t r = 0; r < removed.size(); ++r) {
+      downdate_n_mean_comoments<real_t>(nb[r], Mb[r], Cb[r], n, M, C);
+    }
+  }
+  // add the statistics of the new files, reading only those that were not
+  // processed before
+  vector<string> todo_input, todo_ids;
+  for (size_t f = 0; f < input.size(); ++f) {
+    vector<string>::iterator it =
+        lower_bound(added.begin(), added.end(), ids[f]);
+    if (it == added.end() || *it != ids[f]) continue;
+    added.erase(it);
+    const string fname = cache.input_stats(ids[f]);
+    if (StatsCache::exists(fname)) {
+      int fn = 0;
+      vector<real_t> fM, fC;
+      load_n_mean_cov<real_t>(fname, &fn, inp_dim, &fM, &fC);
+      merge_n_mean_comoments<real_t>(fn, fM, fC, n, M, C);
+    } else {
+      todo_input.push_back(input[f]);
+      todo_ids.push_back(ids[f]);
+    }
+  }
+  fprintf(
+      stderr, "Statistics: %d files reused, %d files read, %d files "
+      "removed\n", static_cast<int>(input.size() - todo_input.size()),
+      static_cast<int>(todo_input.size()),
+      static_cast<int>(rebuild ? 0 : removed.size()));
+  if (!todo_input.empty()) {
+    int tn = 0;
+    vector<real_t> tM, tC;
+    compute_mean_comoments_from_inputs<fmt, real_t>(
+        block, threads, todo_input, &tn, inp_dim, &tM, &tC, NULL,
+        [&](int f, int fn, const vector<real_t>& fM,
+            const vector<real_t>& fC) {
+          const string fname = cache.input_stats(todo_ids[f]);
+          save_n_mean_cov<real_t>(fname + ".tmp", fn, *inp_dim, fM, fC);
+          StatsCache::commit(fname + ".tmp", fname);
+        });
+    merge_n_mean_comoments<real_t>(tn, tM, tC, n, M, C);
+  }
+  // save the merged statistics of this run
+  const string merged = cache.merged_stats(ids);
+  save_n_mean_cov<real_t>(merged + ".tmp", *n, *inp_dim, *M, *C);
+  StatsCache::commit(merged + ".tmp", merged);
+  cache.save_state(ids);
+  if (old_merged != merged) remove(old_merged.c_str());
+  // the statistics of the removed files are not needed anymore
+  for (size_t r = 0; r < removed.size(); ++r) {
+    if (!binary_search(new_ids.begin(), new_ids.end(), removed[r])) {
+      remove(cache.input_stats(removed[r]).c_str());
     }
-    fclose(file);
   }
 }
 
@@ -128,7 +418,7 @@ void compute_cumulative_energy(
   (*cumulative_energy)[0] = 0.0;
   for (size_t k = 1; k <= eigval.size(); ++k) {
     (*cumulative_energy)[k] = (*cumulative_energy)[k - 1] + \
-        (eigval[k] > 0.0 ? fabs(eigval[k]) : 0.0);
+        (eigval[k - 1] > 0.0 ? fabs(eigval[k - 1]) : 0.0);
   }
 }
 
@@ -157,12 +447,119 @@ void count_negative_and_zero_eigenvalues(
 }
 
 
+// Compute the leading eigenvectors of the covariance matrix with an
+// iterative method, starting from the eigenvectors of a previous model
+// (init_eigvec), which is much faster than computing all the eigenvectors
+// when only a few of them are needed. Returns false if the iterative method
+// cannot be used, or it did not converge.
+template <typename real_t>
+bool compute_pca_from_covariance_warm(
+    const int exclude_dims, const double min_rel_energy, const int inp_dim,
+    const vector<real_t>& init_eigvec, int* out_dim, double* miss_energy,
+    vector<real_t>* eigvec, vector<real_t>* eigval) {
+  const int pca_idim = inp_dim - abs(exclude_dims);
+  if (init_eigvec.size() % pca_idim != 0) {
+    WARN_FMT(
+        "Ignoring the initial eigenvectors: their dimension does not match "
+        "the number of projected dimensions (%d)!", pca_idim);
+    return false;
+  }
+  // number of eigenvectors to compute, given by the output dimensions or
+  // by the previous model
+  const int k = *out_dim > 0 ?
+      *out_dim - abs(exclude_dims) : init_eigvec.size() / pca_idim;
+  if (k < 1 || 3 * k > pca_idim) return false;
+  const real_t* cov_ptr = eigvec->data() + \
+      (exclude_dims > 0) * exclude_dims * (inp_dim + 1);
+  // total energy is the trace of the covariance matrix
+  double total_energy = 0.0;
+  for (int d = 0; d < pca_idim; ++d) {
+    total_energy += cov_ptr[d * inp_dim + d];
+  }
+  vector<real_t> v(k * pca_idim, 0), w(k, 0);
+  memcpy(
+      v.data(), init_eigvec.data(),
+      sizeof(real_t) * std::min<size_t>(v.size(), init_eigvec.size()));
+  int iter = 0;
+  real_t res = 0;
+  const real_t tol = pow(std::numeric_limits<real_t>::epsilon(), 0.75);
+  int info = 0;
+  {
+    STATS_SCOPE(STATS_EIG);
+    info = lobpcg<real_t>(
+        pca_idim, k, inp_dim, cov_ptr, tol, LOBPCG_MAX_ITER, v.data(),
+        w.data(), &iter, &res);
+  }
+  fprintf(
+      stderr, "Eigensolver: %d iterations, relative residual %g\n", iter,
+      static_cast<double>(res));
+  if (info != 0) {
+    WARN_FMT(
+        "The iterative eigensolver did not converge (%d iterations, "
+        "relative residual %g), computing all eigenvectors...", iter,
+        static_cast<double>(res));
+    return false;
+  }
+  vector<real_t> cumulative_energy;
+  compute_cumulative_energy(w, &cumulative_energy);
+  int pca_odim = k;
+  if (*out_dim < 1 && min_rel_energy > 0.0) {
+    if (cumulative_energy.back() < min_rel_energy * total_energy) {
+      WARN_FMT(
+          "The %d eigenvectors of the previous model do not preserve the "
+          "requested energy, computing all eigenvectors...", k);
+      return false;
+    }
+    pca_odim = compute_pca_output_dim<real_t>(
+        cumulative_energy, min_rel_energy,
+        total_energy - cumulative_energy.back());
+  }
+  *out_dim = pca_odim + abs(exclude_dims);
+  *miss_energy = total_energy - cumulative_energy[pca_odim];
+  eigval->assign(w.begin(), w.begin() + pca_odim);
+  eigvec->assign(v.begin(), v.begin() + pca_odim * pca_idim);
+  return true;
+}
+
+// Load the eigenvectors of the pca file fname, to start the iterative
+// eigensolver from them. Returns false if the pca does not match the given
+// dimensions.
+template <typename real_t>
+bool load_initial_eigvec(
+    const string& fname, int exclude_dims, int inp_dim,
+    vector<real_t>* eigvec) {
+  int pca_exclude_dims = 0;
+  double pca_miss_energy = 0.0;
+  vector<real_t> pca_mean, pca_stddev, pca_eigval;
+  load_pca<real_t>(
+      fname, &pca_exclude_dims, &pca_miss_energy, &pca_mean, &pca_stddev,
+      &pca_eigval, eigvec);
+  if (pca_exclude_dims != exclude_dims ||
+      static_cast<int>(pca_mean.size()) != inp_dim) {
+    WARN_FMT(
+        "Ignoring the pca file \"%s\": its dimensions do not match the "
+        "data dimensions!", fname.c_str());
+    eigvec->clear();
+    return false;
+  }
+  return true;
+}
+
+// init_eigvec -> (input) if not NULL, eigenvectors of a previous model used
+//                to compute only the leading eigenvectors iteratively
 template <typename real_t>
 void compute_pca_from_covariance(
     const int exclude_dims, const double min_rel_energy, const int inp_dim,
     int* out_dim, double* miss_energy, vector<real_t>* eigvec,
-    vector<real_t>* eigval) {
+    vector<real_t>* eigval, const vector<real_t>* init_eigvec = NULL) {
   const int pca_idim = inp_dim - abs(exclude_dims);
+  Progress::Stage("eig");
+  if (pca_idim > 0 && init_eigvec && !init_eigvec->empty() &&
+      compute_pca_from_covariance_warm<real_t>(
+          exclude_dims, min_rel_energy, inp_dim, *init_eigvec, out_dim,
+          miss_energy, eigvec, eigval)) {
+    return;
+  }
   if (pca_idim < 1) {
     WARN_FMT(
         "All input dimensions (%d) were excluded from pca. "
@@ -0,0 +1,344 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "fast_pca/file.h"
+#include "fast_pca/file_fpca.h"
+#include "fast_pca/file_pca.h"
+#include "fast_pca/logging.h"
+#include "fast_pca/math.h"
+#include "fast_pca/pca.h"
+#include "fast_pca/stats.h"
+
+using std::min;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+void help(const char* prog) {
+  fprintf(
+      stderr,
+      "Usage: %s [options] [output ...]\n"
+      "       %s -c truth.mat [-q k] pca.mat\n\n"
+      "Write synthetic data with a known covariance matrix, split among the\n"
+      "output files (default: stdout). With -c, compare the pca computed\n"
+      "from the data with the ground truth.\n\n"
+      "Options:\n"
+      "  -a         append the rows to the existing output files (fpca only)\n"
+      "  -b size    number of rows generated in each batch (default: 1000)\n"
+      "  -c truth   compare the given pca file with this ground truth\n"
+      "  -d         write double precision data\n"
+      "  -e spec    eigenvalues of the covariance: exp:r (r^k, default\n"
+      "             exp:0.9), pow:a (1 / (k + 1)^a) or flat\n"
+      "  -f format  format of the data (ascii, binary, octave, vbosch, htk,\n"
+      "             mat4, fpca, npy, kaldi)\n"
+      "  -m truth   write the ground truth (pca file) to this file\n"
+      "  -n rows    number of rows (default: 10000)\n"
+      "  -p dim     data dimensions (default: 10)\n"
+      "  -q k       number of eigenvectors compared (default: all)\n"
+      "  -s seed    seed of the random generator (default: 1)\n"
+      "  --stats-json file\n"
+      "             write the time and peak memory of the generation to\n"
+      "             this file, in JSON\n",
+      prog, prog);
+}
+
+// Random number generator (xorshift128+), much faster than the standard
+// generators, which would dominate the time needed to write the data.
+class Random {
+ public:
+  explicit Random(uint64_t seed) : has_next_(false), next_(0) {
+    // splitmix64, to initialize the state from the seed
+    for (int i = 0; i < 2; ++i) {
+      seed += 0x9E3779B97F4A7C15ULL;
+      uint64_t z = seed;
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+      s_[i] = z ^ (z >> 31);
+    }
+  }
+
+  // uniform in (0, 1)
+  double uniform() {
+    uint64_t s1 = s_[0];
+    const uint64_t s0 = s_[1];
+    s_[0] = s0;
+    s1 ^= s1 << 23;
+    s_[1] = s1 ^ s0 ^ (s1 >> 17) ^ (s0 >> 26);
+    return ((s_[1] + s0) >> 11) * (1.0 / 9007199254740992.0) +
+        (0.5 / 9007199254740992.0);
+  }
+
+  // standard normal (Box-Muller), values are generated in pairs
+  double normal() {
+    if (has_next_) {
+      has_next_ = false;
+      return next_;
+    }
+    const double r = sqrt(-2.0 * log(uniform()));
+    const double t = 2.0 * M_PI * uniform();
+    next_ = r * sin(t);
+    has_next_ = true;
+    return r * cos(t);
+  }
+
+ private:
+  uint64_t s_[2];
+  bool has_next_;
+  double next_;
+};
+
+// Eigenvalues of the covariance matrix, in descending order
+void spectrum(const string& spec, int p, vector<double>* w) {
+  w->resize(p);
+  const size_t c = spec.find(':');
+  const string type = spec.substr(0, c);
+  const double a = c == string::npos ? 0.0 : atof(spec.c_str() + c + 1);
+  for (int k = 0; k < p; ++k) {
+    if (type == "exp") {
+      CHECK_FMT(a > 0 && a <= 1, "Invalid spectrum (-e \"%s\")!",
+                spec.c_str());
+      (*w)[k] = pow(a, k);
+    } else if (type == "pow") {
+      CHECK_FMT(a > 0, "Invalid spectrum (-e \"%s\")!", spec.c_str());
+      (*w)[k] = pow(k + 1.0, -a);
+    } else if (type == "flat") {
+      (*w)[k] = 1.0;
+    } else {
+      ERROR_FMT("Unknown spectrum (-e \"%s\")!", spec.c_str());
+    }
+  }
+}
+
+// Write n rows of p dimensions, x = mean + z * diag(sqrt(w)) * V, with
+// z ~ N(0, I), into the output files (the rows are split among them).
+// If append is true, the rows are appended to the existing (fpca) files.
+template <typename real_t>
+void generate(
+    const vector<string>& output, FORMAT_CODE format, bool append, int n,
+    int p, int block, const vector<double>& mean, const vector<double>& w,
+    const vector<double>& v, Random* rnd) {
+  vector<double> z(static_cast<size_t>(block) * p);
+  vector<double> x(static_cast<size_t>(block) * p);
+  vector<real_t> y(static_cast<size_t>(block) * p);
+  vector<double> sw(p);
+  for (int k = 0; k < p; ++k) sw[k] = sqrt(w[k]);
+  // the header is copied from a matrix of the same size, so that each
+  // format fills the rest of its fields (names, etc) with default values
+  unique_ptr<MatrixFile> header(MatrixFile::Create(FMT_BINARY));
+  header->cols(p);
+  const int files = output.size();
+  for (int f = 0; f < files; ++f) {
+    const int rows = n / files + (f < n % files ? 1 : 0);
+    FILE* file = output[f] == "" ? stdout :
+        open_file(output[f].c_str(), append ? "r+b" : "wb");
+    unique_ptr<MatrixFile> mw(MatrixFile::Create(format));
+    mw->file(file);
+    if (append) {
+      MatrixFile_FPCA* fpca = dynamic_cast<MatrixFile_FPCA*>(mw.get());
+      CHECK_FMT(
+          fpca->append(), "Rows cannot be appended to file \"%s\"!",
+          output[f].c_str());
+      CHECK_FMT(
+          fpca->cols() == p, "Wrong number of columns in file \"%s\" "
+          "(expected = %d, found = %d)!", output[f].c_str(), p, fpca->cols());
+    } else {
+      header->rows(rows);
+      mw->copy_header_from(*header);
+      mw->write_header();
+    }
+    for (int r = 0; r < rows; r += block) {
+      const int br = min(block, rows - r);
+      for (int i = 0; i < br; ++i) {
+        for (int k = 0; k < p; ++k) z[i * p + k] = sw[k] * rnd->normal();
+        memcpy(x.data() + i * p, mean.data(), sizeof(double) * p);
+      }
+      gemm<double>(
+          'N', 'N', br, p, p, 1, z.data(), p, v.data(), p, 1, x.data(), p);
+      for (int i = 0; i < br * p; ++i) y[i] = x[i];
+      mw->write_block(br * p, y.data());
+    }
+    mw->write_footer();
+    close_file(file);
+  }
+}
+
+// Compare a pca with the ground truth: maximum relative error of the
+// first k eigenvalues, and maximum error of the first k eigenvectors
+// (1 - |cos| of the angle with the true eigenvector).
+void compare(const string& truth_fn, const string& pca_fn, int k) {
+  int te = 0, pe = 0;
+  double tr = 0, pr = 0;
+  vector<double> tm, ts, tw, tv, pm, ps, pw, pv;
+  load_pca<double>(truth_fn, &te, &tr, &tm, &ts, &tw, &tv);
+  load_pca<double>(pca_fn, &pe, &pr, &pm, &ps, &pw, &pv);
+  CHECK_MSG(te == 0 && pe == 0,
+            "Pca files with non-projected dimensions are not supported!");
+  CHECK_FMT(tm.size() == pm.size(),
+            "Number of dimensions do not match (%d vs. %d)!",
+            static_cast<int>(tm.size()), static_cast<int>(pm.size()));
+  const int p = tm.size();
+  const int kmax = min(tw.size(), pw.size());
+  if (k < 1 || k > kmax) k = kmax;
+  double eigval_err = 0.0, eigvec_err = 0.0;
+  for (int i = 0; i < k; ++i) {
+    eigval_err = std::max(eigval_err, fabs(pw[i] - tw[i]) / tw[i]);
+    double dot = 0.0;
+    for (int d = 0; d < p; ++d) dot += pv[i * p + d] * tv[i * p + d];
+    eigvec_err = std::max(eigvec_err, 1.0 - fabs(dot));
+  }
+  double mean_err = 0.0;
+  for (int d = 0; d < p; ++d) {
+    mean_err = std::max(mean_err, fabs(pm[d] - tm[d]));
+  }
+  printf("eigenvectors %d\n", k);
+  printf("eigval_error %.6g\n", eigval_err);
+  printf("eigvec_error %.6g\n", eigvec_err);
+  printf("mean_error %.6g\n", mean_err);
+}
+
+int main(int argc, char** argv) {
+  int opt = -1;
+  int block = 1000;
+  int n = 10000;
+  int p = 10;
+  int k = -1;
+  uint64_t seed = 1;
+  bool simple = true;
+  string spec = "exp:0.9";
+  string truth_fn = "";
+  string compare_fn = "";
+  FORMAT_CODE format = FMT_ASCII;
+  bool append = false;
+  string stats_json = "";
+  static const struct option long_options[] = {
+    {"stats-json", required_argument, NULL, STATS_JSON_OPTION},
+    {NULL, 0, NULL, 0}
+  };
+  while ((opt = getopt_long(
+              argc, argv, "ab:c:de:f:hm:n:p:q:s:", long_options,
+              NULL)) != -1) {
+    switch (opt) {
+      case 'a':
+        append = true;
+        break;
+      case 'b':
+        block = atoi(optarg);
+        CHECK_FMT(block > 0, "Block size must be positive (-b %d)!", block);
+        break;
+      case 'c':
+        compare_fn = optarg;
+        break;
+      case 'd':
+        simple = false;
+        break;
+      case 'e':
+        spec = optarg;
+        break;
+      case 'f':
+        format = format_code_from_name(optarg);
+        CHECK_FMT(format != FMT_UNKNOWN, "Unknown format (-f \"%s\")!", optarg);
+        break;
+      case 'h':
+        help(argv[0]);
+        return 0;
+      case 'm':
+        truth_fn = optarg;
+        break;
+      case 'n':
+        n = atoi(optarg);
+        CHECK_FMT(n > 0, "Number of rows must be positive (-n %d)!", n);
+        break;
+      case 'p':
+        p = atoi(optarg);
+        CHECK_FMT(p > 0, "Data dimensions must be positive (-p %d)!", p);
+        break;
+      case 'q':
+        k = atoi(optarg);
+        break;
+      case 's':
+        seed = strtoull(optarg, NULL, 10);
+        break;
+      case STATS_JSON_OPTION:
+        stats_json = optarg;
+        Stats::Enable();
+        break;
+      default:
+        return 1;
+    }
+  }
+  if (compare_fn != "") {
+    CHECK_MSG(optind + 1 == argc, "Specify the pca file to compare!");
+    compare(compare_fn, argv[optind], k);
+    return 0;
+  }
+  vector<string> output;
+  for (int a = optind; a < argc; ++a) output.push_back(argv[a]);
+  if (output.empty()) output.push_back("");
+  CHECK_MSG(
+      !append || format == FMT_FPCA,
+      "Rows can only be appended to fpca files (-a requires -f fpca)!");
+  CHECK_MSG(
+      !append || output[0] != "", "Rows cannot be appended to stdout!");
+
+  // ground truth: random mean and eigenvectors, and the given eigenvalues
+  Random rnd(seed);
+  vector<double> mean(p), w, v(static_cast<size_t>(p) * p);
+  for (int d = 0; d < p; ++d) mean[d] = rnd.normal();
+  spectrum(spec, p, &w);
+  for (size_t i = 0; i < v.size(); ++i) v[i] = rnd.normal();
+  CHECK_MSG(orthonormalize_rows<double>(p, p, 0, v.data()) == p,
+            "Random eigenvectors could not be orthonormalized!");
+  if (truth_fn != "") {
+    vector<double> stddev(p, 0);
+    for (int i = 0; i < p; ++i) {
+      for (int d = 0; d < p; ++d) {
+        stddev[d] += w[i] * v[i * p + d] * v[i * p + d];
+      }
+    }
+    for (int d = 0; d < p; ++d) stddev[d] = sqrt(stddev[d]);
+    save_pca<double>(truth_fn, 0, 0.0, mean, stddev, w, v);
+  }
+  if (simple) {
+    generate<float>(output, format, append, n, p, block, mean, w, v, &rnd);
+  } else {
+    generate<double>(output, format, append, n, p, block, mean, w, v, &rnd);
+  }
+  if (stats_json != "") {
+    CHECK_FMT(
+        Stats::WriteJson(stats_json, argv[0]),
+        "Failed to write the stats to \"%s\"!", stats_json.c_str());
+  }
+  return 0;
+}
@@ -32,6 +32,9 @@
 
 #include "fast_pca/fast_pca_common.h"
 #include "fast_pca/logging.h"
+#include "fast_pca/memory.h"
+#include "fast_pca/progress.h"
+#include "fast_pca/stats.h"
 
 using std::string;
 using std::vector;
@@ -42,22 +45,49 @@ void help(const char* prog) {
       "Usage: %s [options] [input ...]\n\n"
       "Options:\n"
       "  -b size    process data in batches of this number of rows\n"
+      "             (default: planned from the number of dimensions and the\n"
+      "             memory limit)\n"
+      "  -c dir     cache the parsed text input files in this directory\n"
+      "  -H         validate cached files by content hash instead of mtime\n"
+      "  -L size    maximum size of the cache, in MB (default: %d)\n"
       "  -d         use double precision\n"
       "  -f format  format of the data matrix (ascii, binary, octave, vbosch,\n"
-      "             htk, mat4)\n"
+      "             htk, mat4, fpca, npy, kaldi)\n"
+      "  -i backend I/O backend used to read files (stdio, uring)\n"
       "  -o output  output file\n"
-      "  -p dim     data dimensions\n",
-      prog);
+      "  -p dim     data dimensions\n"
+      "  -S list    read input file names from this list, one per line\n"
+      "  -T type    type of the elements of binary input files (float32,\n"
+      "             float64, float16, bfloat16, int32, int16, uint16, int8,\n"
+      "             uint8)\n"
+      "  -t threads number of threads used to parse text data\n"
+      "  --mem-limit MB\n"
+      "             plan the buffers to use at most MB megabytes of memory,\n"
+      "             and refuse early the problems that do not fit\n"
+      "  --perf-counters\n"
+      "             with --stats-json, measure also the cycles, instructions\n"
+      "             and LLC misses of the compute phases (Linux)\n"
+      "  --progress secs\n"
+      "             report the progress every secs seconds (it is always\n"
+      "             reported when the process receives SIGUSR1)\n"
+      "  --shard k/n\n"
+      "             process only the k-th of n equal ranges of rows of each\n"
+      "             input file (seekable fpca files only), k in [0, n)\n"
+      "  --stats-json file\n"
+      "             write the time, bytes and rows of each phase of the\n"
+      "             computation to this file, in JSON\n",
+      prog, InputCache::DEFAULT_MAX_SIZE);
 }
 
 template <FORMAT_CODE fmt, typename real_t>
-void do_work(int block, int dims, string output, vector<string> input) {
+void do_work(
+    int block, int threads, int dims, string output, vector<string> input) {
   int n;
   vector<real_t> M;  // global mean
   vector<real_t> C;  // global co-moments matrix
   // compute mean and comoments matrix
   compute_mean_comoments_from_inputs<fmt, real_t>(
-      block, input, &n, &dims, &M, &C);
+      block, threads, input, &n, &dims, &M, &C);
   // output number of processed rows, mean and co-moments matrix
   save_n_mean_cov(output, n, dims, M, C);
 }
@@ -65,13 +95,35 @@ void do_work(int block, int dims, string output, vector<string> input) {
 int main(int argc, char** argv) {
   int opt = -1;
   int dims = -1;             // number of dimensions
-  int block = 1000;          // block size
+  int block = 0;             // block size (0: planned)
+  int threads = 1;           // number of threads
   bool simple = true;        // use simple precision ?
   string output = "";
   FORMAT_CODE format = FMT_ASCII;
   const char* format_str = NULL;
+  const char* backend_str = NULL;
+  const char* input_type_str = NULL;
+  const char* list_fn = NULL;
+  const char* cache_dir = NULL;
+  int cache_size = InputCache::DEFAULT_MAX_SIZE;
+  bool cache_hash = false;
+  string stats_json = "";
+  double progress = 0;
+  bool perf_counters = false;
+  double mem_limit = 0;
+  int shard_k = 0, shard_n = 1;
+  static const struct option long_options[] = {
+    {"mem-limit", required_argument, NULL, MEM_LIMIT_OPTION},
+    {"perf-counters", no_argument, NULL, STATS_COUNTERS_OPTION},
+    {"progress", required_argument, NULL, PROGRESS_OPTION},
+    {"shard", required_argument, NULL, SHARD_OPTION},
+    {"stats-json", required_argument, NULL, STATS_JSON_OPTION},
+    {NULL, 0, NULL, 0}
+  };
 
-  while ((opt = getopt(argc, argv, "db:f:o:p:h")) != -1) {
+  while ((opt = getopt_long(
+              argc, argv, "HL:T:b:c:df:i:o:p:S:t:h", long_options,
+              NULL)) != -1) {
     switch (opt) {
       case 'd':
         simple = false;
@@ -85,6 +137,23 @@ int main(int argc, char** argv) {
         format = format_code_from_name(format_str);
         CHECK_FMT(format != FMT_UNKNOWN, "Unknown format (-f \"%s\")!", optarg);
         break;
+      case 'T':
+        input_type_str = optarg;
+        CHECK_FMT(
+            elem_type_from_name(input_type_str) != ELEM_TYPE_UNKNOWN,
+            "Unknown element type (-T \"%s\")!", optarg);
+        set_binary_input_type(elem_type_from_name(input_type_str));
+        break;
+      case 'i':
+        backend_str = optarg;
+        CHECK_FMT(
+            io_backend_from_name(backend_str) != IO_BACKEND_UNKNOWN,
+            "Unknown I/O backend (-i \"%s\")!", optarg);
+        if (!set_io_backend(io_backend_from_name(backend_str))) {
+          WARN_FMT(
+              "I/O backend \"%s\" is not available, using stdio!", optarg);
+        }
+        break;
       case 'o':
         output = optarg;
         break;
@@ -92,9 +161,55 @@ int main(int argc, char** argv) {
         dims = atoi(optarg);
         CHECK_FMT(dims > 0, "Input dimensions must be positive (-p %d)!", dims);
         break;
+      case 'S':
+        list_fn = optarg;
+        break;
+      case 'c':
+        cache_dir = optarg;
+        break;
+      case 'H':
+        cache_hash = true;
+        break;
+      case 'L':
+        cache_size = atoi(optarg);
+        CHECK_FMT(
+            cache_size > 0, "Cache size must be positive (-L %d)!",
+            cache_size);
+        break;
+      case 't':
+        threads = atoi(optarg);
+        CHECK_FMT(
+            threads > 0, "Number of threads must be positive (-t %d)!",
+            threads);
+        break;
       case 'h':
         help(argv[0]);
         return 0;
+      case MEM_LIMIT_OPTION:
+        mem_limit = atof(optarg);
+        CHECK_FMT(
+            mem_limit > 0, "Memory limit must be positive (--mem-limit %g)!",
+            mem_limit);
+        break;
+      case STATS_COUNTERS_OPTION:
+        perf_counters = true;
+        break;
+      case PROGRESS_OPTION:
+        progress = atof(optarg);
+        CHECK_FMT(
+            progress >= 0, "Progress interval must be non-negative "
+            "(--progress %g)!", progress);
+        break;
+      case SHARD_OPTION:
+        CHECK_FMT(
+            sscanf(optarg, "%d/%d", &shard_k, &shard_n) == 2 &&
+            shard_k >= 0 && shard_k < shard_n,
+            "Shard must be k/n, with 0 <= k < n (--shard \"%s\")!", optarg);
+        break;
+      case STATS_JSON_OPTION:
+        stats_json = optarg;
+        Stats::Enable();
+        break;
       default:
         return 1;
     }
@@ -102,59 +217,114 @@ int main(int argc, char** argv) {
 
   fprintf(stderr, "-------------------- Command line -------------------\n");
   fprintf(stderr, "%s", argv[0]);
-  fprintf(stderr, " -b %d", block);
+  if (block > 0) fprintf(stderr, " -b %d", block);
+  if (cache_dir) fprintf(stderr, " -c \"%s\"", cache_dir);
+  if (cache_dir && cache_hash) fprintf(stderr, " -H");
+  if (cache_dir && cache_size != InputCache::DEFAULT_MAX_SIZE) {
+    fprintf(stderr, " -L %d", cache_size);
+  }
   if (!simple) fprintf(stderr, " -d");
   if (format_str) fprintf(stderr, " -f \"%s\"", format_str);
+  if (backend_str) fprintf(stderr, " -i \"%s\"", backend_str);
   if (output != "") fprintf(stderr, "-o %s", output.c_str());
   if (dims > 0) fprintf(stderr, " -p %d", dims);
+  if (list_fn) fprintf(stderr, " -S \"%s\"", list_fn);
+  if (input_type_str) fprintf(stderr, " -T \"%s\"", input_type_str);
+  if (threads > 1) fprintf(stderr, " -t %d", threads);
+  if (mem_limit > 0) fprintf(stderr, " --mem-limit %g", mem_limit);
+  if (perf_counters) fprintf(stderr, " --perf-counters");
+  if (progress > 0) fprintf(stderr, " --progress %g", progress);
+  if (shard_n > 1) fprintf(stderr, " --shard %d/%d", shard_k, shard_n);
+  if (stats_json != "") {
+    fprintf(stderr, " --stats-json \"%s\"", stats_json.c_str());
+  }
   for (int a = optind; a < argc; ++a) {
     fprintf(stderr, " \"%s\"", argv[a]);
   }
   fprintf(stderr, "\n-----------------------------------------------------\n");
 
+  CHECK_MSG(
+      !perf_counters || stats_json != "",
+      "Option --perf-counters requires --stats-json!");
+  if (perf_counters) Stats::EnableCounters();
+  Memory::Limit(static_cast<size_t>(mem_limit * (1 << 20)), threads);
+  Progress::Start(progress);
+  MatrixPrefetcher::Shard(shard_k, shard_n);
+
+  if (cache_dir) {
+    InputCache::Set(new InputCache(
+        cache_dir, static_cast<uint64_t>(cache_size) << 20, cache_hash));
+  }
+
   vector<string> input;
+  if (list_fn) read_file_list(list_fn, &input, NULL);
   for (int a = optind; a < argc; ++a) { input.push_back(argv[a]); }
 
   switch (format) {
     case FMT_ASCII:
       if (simple)
-        do_work<FMT_ASCII, float>(block, dims, output, input);
+        do_work<FMT_ASCII, float>(block, threads, dims, output, input);
       else
-        do_work<FMT_ASCII, double>(block, dims, output, input);
+        do_work<FMT_ASCII, double>(block, threads, dims, output, input);
       break;
     case FMT_BINARY:
       if (simple)
-        do_work<FMT_BINARY, float>(block, dims, output, input);
+        do_work<FMT_BINARY, float>(block, threads, dims, output, input);
       else
-        do_work<FMT_BINARY, double>(block, dims, output, input);
+        do_work<FMT_BINARY, double>(block, threads, dims, output, input);
       break;
     case FMT_OCTAVE:
       if (simple)
-        do_work<FMT_OCTAVE, float>(block, dims, output, input);
+        do_work<FMT_OCTAVE, float>(block, threads, dims, output, input);
       else
-        do_work<FMT_OCTAVE, double>(block, dims, output, input);
+        do_work<FMT_OCTAVE, double>(block, threads, dims, output, input);
       break;
     case FMT_VBOSCH:
       if (simple)
-        do_work<FMT_VBOSCH, float>(block, dims, output, input);
+        do_work<FMT_VBOSCH, float>(block, threads, dims, output, input);
       else
-        do_work<FMT_VBOSCH, double>(block, dims, output, input);
+        do_work<FMT_VBOSCH, double>(block, threads, dims, output, input);
       break;
     case FMT_HTK:
       if (simple)
-        do_work<FMT_HTK, float>(block, dims, output, input);
+        do_work<FMT_HTK, float>(block, threads, dims, output, input);
       else
-        do_work<FMT_HTK, double>(block, dims, output, input);
+        do_work<FMT_HTK, double>(block, threads, dims, output, input);
       break;
     case FMT_MAT4:
       if (simple)
-        do_work<FMT_MAT4, float>(block, dims, output, input);
+        do_work<FMT_MAT4, float>(block, threads, dims, output, input);
       else
-        do_work<FMT_MAT4, double>(block, dims, output, input);
+        do_work<FMT_MAT4, double>(block, threads, dims, output, input);
+      break;
+    case FMT_FPCA:
+      if (simple)
+        do_work<FMT_FPCA, float>(block, threads, dims, output, input);
+      else
+        do_work<FMT_FPCA, double>(block, threads, dims, output, input);
+      break;
+    case FMT_NPY:
+      if (simple)
+        do_work<FMT_NPY, float>(block, threads, dims, output, input);
+      else
+        do_work<FMT_NPY, double>(block, threads, dims, output, input);
+      break;
+    case FMT_KALDI:
+      if (simple)
+        do_work<FMT_KALDI, float>(block, threads, dims, output, input);
+      else
+        do_work<FMT_KALDI, double>(block, threads, dims, output, input);
       break;
     default:
       ERROR("Not implemented for this format!");
   }
+  Progress::Stop();
+  Memory::Report();
+  if (stats_json != "") {
+    CHECK_FMT(
+        Stats::WriteJson(stats_json, argv[0]),
+        "Failed to write the stats to \"%s\"!", stats_json.c_str());
+  }
 
   return 0;
 }
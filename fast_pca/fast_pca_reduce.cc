@@ -33,6 +33,9 @@
 #include "fast_pca/file.h"
 #include "fast_pca/file_pca.h"
 #include "fast_pca/pca.h"
+#include "fast_pca/memory.h"
+#include "fast_pca/progress.h"
+#include "fast_pca/stats.h"
 
 using std::string;
 using std::vector;
@@ -47,45 +50,57 @@ void help(const char* prog) {
       "  -e dims    do not project first (positive) or last (negative) dims\n"
       "  -j energy  minimum relative amount of energy preserved\n"
       "  -m output  write (temporal) pca information to this file\n"
-      "  -q odim    maximum output dimensions of the projected data\n",
+      "  -q odim    maximum output dimensions of the projected data\n"
+      "  -w pca     compute only the leading eigenvectors, starting from the\n"
+      "             eigenvectors of this (previous) pca file\n"
+      "  --mem-limit MB\n"
+      "             refuse early the problems that do not fit in MB\n"
+      "             megabytes of memory\n"
+      "  --perf-counters\n"
+      "             with --stats-json, measure also the cycles, instructions\n"
+      "             and LLC misses of the compute phases (Linux)\n"
+      "  --progress secs\n"
+      "             report the progress every secs seconds (it is always\n"
+      "             reported when the process receives SIGUSR1)\n"
+      "  --stats-json file\n"
+      "             write the time, bytes and rows of each phase of the\n"
+      "             computation to this file, in JSON\n",
       prog);
 }
 
 template <typename real_t>
 void do_work(
     const vector<string>& input, const string& output, bool compute_pca,
-    int exclude_dims, int out_dim, double min_rel_energy) {
+    int exclude_dims, int out_dim, double min_rel_energy,
+    const string& init_fn) {
   vector<real_t> M;  // global mean
   vector<real_t> C;  // global co-momentum
-  vector<real_t> D;  // diff between the global mean and the file mean
   vector<real_t> m;
   vector<real_t> c;
   int n = -1;
   int inp_dim = -1;
   double miss_energy = 0.0;
+  Progress::Stage("reduce", input);
   // process first file
+  Progress::BeginFile(0, -1);
   load_n_mean_cov<real_t>(input[0], &n, &inp_dim, &M, &C);
-  D.resize(inp_dim);
+  // the statistics of each file are merged into the global ones, and the
+  // eigendecomposition is computed in place
+  const size_t d = inp_dim;
+  Memory::Plan(
+      "reduction", inp_dim, sizeof(real_t) * (
+          2 * d * d + syev_workspace<real_t>(inp_dim) + 6 * d), 0, NULL);
+  Progress::AddRows(n, sizeof(real_t) * (M.size() + C.size()));
+  Progress::EndFile();
   // process rest of files
   for (size_t f = 1; f < input.size(); ++f) {
     // load n, inp_dim, mean and covariance
     int br = -1;
+    Progress::BeginFile(f, -1);
     load_n_mean_cov<real_t>(input[f], &br, &inp_dim, &m, &c);
-    // D = M - m
-    memcpy(D.data(), M.data(), sizeof(real_t) * inp_dim);
-    axpy<real_t>(inp_dim, -1, m.data(), D.data());
-    // update co-moments matrix
-    // C += c
-    axpy<real_t>(inp_dim * inp_dim, 1, c.data(), C.data());
-    // C += D * D' * (br * n) / (br + n)
-    ger<real_t>(
-        inp_dim, inp_dim, (1.0 * br) * n / (n + br),
-        D.data(), D.data(), C.data());
-    // update mean
-    for (int d = 0; d < inp_dim; ++d) {
-      M[d] = (n * M[d] + br * m[d]) / (n + br);
-    }
-    n += br;
+    Progress::AddRows(br, sizeof(real_t) * (m.size() + c.size()));
+    merge_n_mean_comoments<real_t>(br, m, c, &n, &M, &C);
+    Progress::EndFile();
   }
   if (compute_pca) {
     CHECK_FMT(
@@ -104,12 +119,20 @@ void do_work(
     for (int i = 0; i < inp_dim * inp_dim; ++i) { C[i] /= (n - 1); }
     // compute standard deviation in each dimension
     vector<real_t> stddev(inp_dim);
-    for (int i = 0; i < inp_dim; ++i) { C[i] = sqrt(C[i * inp_dim + i]); }
+    for (int i = 0; i < inp_dim; ++i) {
+      stddev[i] = sqrt(C[i * inp_dim + i]);
+    }
+    // eigenvectors of a previous model, to start the eigensolver from them
+    vector<real_t> init_eigvec;
+    if (init_fn != "") {
+      load_initial_eigvec<real_t>(
+          init_fn, exclude_dims, inp_dim, &init_eigvec);
+    }
     // compute eigenvectors and eigenvalues of the covariance matrix
     vector<real_t> eigval;
     compute_pca_from_covariance<real_t>(
         exclude_dims, min_rel_energy, inp_dim, &out_dim, &miss_energy,
-        &C, &eigval);
+        &C, &eigval, &init_eigvec);
     // Compute PCA summary
     vector<real_t> cumulative_energy;
     compute_cumulative_energy(eigval, &cumulative_energy);
@@ -130,7 +153,20 @@ int main(int argc, char** argv) {
   string output = "";        // output filename
   int out_dim = -1;          // output dimension
   double min_rel_energy = -1.0;  // preserve energy
-  while ((opt = getopt(argc, argv, "cde:hj:m:q:")) != -1) {
+  string init_fn = "";       // pca to start the eigensolver from
+  string stats_json = "";    // write the stats of each phase to this file
+  double progress = 0;       // interval of the progress reports
+  bool perf_counters = false;  // measure the hardware counters
+  double mem_limit = 0;      // memory limit, in MB
+  static const struct option long_options[] = {
+    {"mem-limit", required_argument, NULL, MEM_LIMIT_OPTION},
+    {"perf-counters", no_argument, NULL, STATS_COUNTERS_OPTION},
+    {"progress", required_argument, NULL, PROGRESS_OPTION},
+    {"stats-json", required_argument, NULL, STATS_JSON_OPTION},
+    {NULL, 0, NULL, 0}
+  };
+  while ((opt = getopt_long(
+              argc, argv, "cde:hj:m:q:w:", long_options, NULL)) != -1) {
     switch (opt) {
       case 'c':
         compute_pca = false;
@@ -159,6 +195,28 @@ int main(int argc, char** argv) {
         CHECK_FMT(
             out_dim > 0, "Output dimension must be positive (-q %d)!", out_dim);
         break;
+      case 'w':
+        init_fn = optarg;
+        break;
+      case MEM_LIMIT_OPTION:
+        mem_limit = atof(optarg);
+        CHECK_FMT(
+            mem_limit > 0, "Memory limit must be positive (--mem-limit %g)!",
+            mem_limit);
+        break;
+      case STATS_COUNTERS_OPTION:
+        perf_counters = true;
+        break;
+      case PROGRESS_OPTION:
+        progress = atof(optarg);
+        CHECK_FMT(
+            progress >= 0, "Progress interval must be non-negative "
+            "(--progress %g)!", progress);
+        break;
+      case STATS_JSON_OPTION:
+        stats_json = optarg;
+        Stats::Enable();
+        break;
       default:
         return 1;
     }
@@ -172,21 +230,44 @@ int main(int argc, char** argv) {
   if (min_rel_energy > 0) fprintf(stderr, " -j %g", min_rel_energy);
   if (output != "") fprintf(stderr, " -m \"%s\"", output.c_str());
   if (out_dim > 0) fprintf(stderr, " -q %d", out_dim);
+  if (init_fn != "") fprintf(stderr, " -w \"%s\"", init_fn.c_str());
+  if (mem_limit > 0) fprintf(stderr, " --mem-limit %g", mem_limit);
+  if (perf_counters) fprintf(stderr, " --perf-counters");
+  if (progress > 0) fprintf(stderr, " --progress %g", progress);
+  if (stats_json != "") {
+    fprintf(stderr, " --stats-json \"%s\"", stats_json.c_str());
+  }
   for (int a = optind; a < argc; ++a) {
     fprintf(stderr, " \"%s\"", argv[a]);
   }
   fprintf(stderr, "\n-----------------------------------------------------\n");
 
+  CHECK_MSG(
+      !perf_counters || stats_json != "",
+      "Option --perf-counters requires --stats-json!");
+  if (perf_counters) Stats::EnableCounters();
+  Memory::Limit(static_cast<size_t>(mem_limit * (1 << 20)), 1);
+  Progress::Start(progress);
+
   vector<string> input;
   for (int a = optind; a < argc; ++a) { input.push_back(argv[a]); }
   if (input.empty()) input.push_back("");
 
   if (simple) {
     do_work<float>(
-        input, output, compute_pca, exclude_dims, out_dim, min_rel_energy);
+        input, output, compute_pca, exclude_dims, out_dim, min_rel_energy,
+        init_fn);
   } else {
     do_work<double>(
-        input, output, compute_pca, exclude_dims, out_dim, min_rel_energy);
+        input, output, compute_pca, exclude_dims, out_dim, min_rel_energy,
+        init_fn);
+  }
+  Progress::Stop();
+  Memory::Report();
+  if (stats_json != "") {
+    CHECK_FMT(
+        Stats::WriteJson(stats_json, argv[0]),
+        "Failed to write the stats to \"%s\"!", stats_json.c_str());
   }
 
   return 0;
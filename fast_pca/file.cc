@@ -23,7 +23,37 @@
 */
 
 #include "fast_pca/file.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
 #include "fast_pca/logging.h"
+#include "fast_pca/stats.h"
+#include "fast_pca/uring.h"
+
+using std::map;
+using std::mutex;
+using std::lock_guard;
+using std::thread;
+
+// Size of the buffers used to compress/decompress data
+static const size_t COMPRESSION_BUFFER_SIZE = 1 << 20;
 
 FORMAT_CODE format_code_from_name(const string& name) {
   if (name == "ascii") {
@@ -38,15 +68,295 @@ FORMAT_CODE format_code_from_name(const string& name) {
     return FMT_HTK;
   } else if (name == "mat4") {
     return FMT_MAT4;
+  } else if (name == "fpca") {
+    return FMT_FPCA;
+  } else if (name == "npy") {
+    return FMT_NPY;
+  } else if (name == "kaldi") {
+    return FMT_KALDI;
   } else {
     return FMT_UNKNOWN;
   }
 }
 
+bool is_text_format(FORMAT_CODE format) {
+  return format == FMT_ASCII || format == FMT_OCTAVE || format == FMT_VBOSCH;
+}
+
+bool is_archive_format(FORMAT_CODE format) {
+  return format == FMT_ASCII || format == FMT_BINARY || format == FMT_KALDI;
+}
+
+IO_BACKEND io_backend_from_name(const string& name) {
+  if (name == "stdio") {
+    return IO_BACKEND_STDIO;
+  } else if (name == "uring") {
+    return IO_BACKEND_URING;
+  } else {
+    return IO_BACKEND_UNKNOWN;
+  }
+}
+
+ELEM_TYPE elem_type_from_name(const string& name) {
+  if (name == "float32") {
+    return ELEM_TYPE_FLOAT32;
+  } else if (name == "float64") {
+    return ELEM_TYPE_FLOAT64;
+  } else if (name == "float16") {
+    return ELEM_TYPE_FLOAT16;
+  } else if (name == "bfloat16") {
+    return ELEM_TYPE_BFLOAT16;
+  } else if (name == "int32") {
+    return ELEM_TYPE_INT32;
+  } else if (name == "int16") {
+    return ELEM_TYPE_INT16;
+  } else if (name == "uint16") {
+    return ELEM_TYPE_UINT16;
+  } else if (name == "int8") {
+    return ELEM_TYPE_INT8;
+  } else if (name == "uint8") {
+    return ELEM_TYPE_UINT8;
+  } else {
+    return ELEM_TYPE_UNKNOWN;
+  }
+}
+
+static IO_BACKEND io_backend = IO_BACKEND_STDIO;
+
+bool set_io_backend(IO_BACKEND backend) {
+  if (backend == IO_BACKEND_URING && !uring_available()) return false;
+  io_backend = backend;
+  return true;
+}
+
+// ------------------------------------------------------------------------
+// ---- Compressed streams are implemented with a pipe: a dedicated thread
+// ---- decompresses the file into the pipe (when reading) or compresses
+// ---- the data written into the pipe (when writing), while the other end
+// ---- of the pipe is given to the caller as a regular FILE*.
+// ------------------------------------------------------------------------
+
+static mutex compressed_streams_mutex;
+static map<FILE*, thread*> compressed_streams;
+
+// Write all n bytes of buf into the file descriptor fd. Returns false if
+// the other end of the pipe was closed.
+static bool write_all(int fd, const char* buf, size_t n) {
+  while (n > 0) {
+    const ssize_t w = write(fd, buf, n);
+    if (w < 0 && errno == EINTR) continue;
+    if (w < 0 && errno == EPIPE) return false;
+    CHECK_FMT(w > 0, "Failed to write into pipe: %s", strerror(errno));
+    buf += w;
+    n -= w;
+  }
+  return true;
+}
+
+// Block SIGPIPE in the current thread, so that writing into a pipe whose
+// read end was closed (e.g. the reader did not consume all the data) just
+// returns an error.
+static void block_sigpipe() {
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &set, NULL);
+}
+
+static COMPRESSION_CODE compression_from_magic(const unsigned char* m) {
+  if (m[0] == 0x1F && m[1] == 0x8B) return COMPRESSION_GZIP;
+  if (m[0] == 0x28 && m[1] == 0xB5 && m[2] == 0x2F && m[3] == 0xFD)
+    return COMPRESSION_ZSTD;
+  return COMPRESSION_NONE;
+}
+
+static COMPRESSION_CODE compression_from_name(const string& fname) {
+  const size_t n = fname.size();
+  if (n > 3 && fname.compare(n - 3, 3, ".gz") == 0) return COMPRESSION_GZIP;
+  if (n > 4 && fname.compare(n - 4, 4, ".zst") == 0) return COMPRESSION_ZSTD;
+  return COMPRESSION_NONE;
+}
+
+static void check_compression_support(
+    COMPRESSION_CODE comp, const char* fname) {
+#ifndef HAVE_ZLIB
+  CHECK_FMT(
+      comp != COMPRESSION_GZIP,
+      "File \"%s\" is compressed with gzip, but fast_pca was compiled "
+      "without zlib support!", fname);
+#endif
+#ifndef HAVE_ZSTD
+  CHECK_FMT(
+      comp != COMPRESSION_ZSTD,
+      "File \"%s\" is compressed with zstd, but fast_pca was compiled "
+      "without zstd support!", fname);
+#endif
+}
+
+// Decompress the file and write the uncompressed data into fd
+static void decompress_thread(
+    COMPRESSION_CODE comp, FILE* file, const string& fname, int fd) {
+  block_sigpipe();
+  vector<char> obuf(COMPRESSION_BUFFER_SIZE);
+  if (comp == COMPRESSION_GZIP) {
+#ifdef HAVE_ZLIB
+    gzFile gz = gzdopen(dup(fileno(file)), "rb");
+    CHECK_FMT(gz, "Failed to open gzip file \"%s\"!", fname.c_str());
+    gzbuffer(gz, COMPRESSION_BUFFER_SIZE);
+    int r = 0;
+    while ((r = gzread(gz, obuf.data(), obuf.size())) > 0) {
+      if (!write_all(fd, obuf.data(), r)) break;
+    }
+    CHECK_FMT(r >= 0, "Failed to decompress gzip file \"%s\"!", fname.c_str());
+    gzclose(gz);
+#endif
+  } else if (comp == COMPRESSION_ZSTD) {
+#ifdef HAVE_ZSTD
+    ZSTD_DStream* zds = ZSTD_createDStream();
+    CHECK(zds);
+    ZSTD_initDStream(zds);
+    vector<char> ibuf(ZSTD_DStreamInSize());
+    size_t r = 0;
+    bool closed = false;
+    while (!closed && (r = fread(ibuf.data(), 1, ibuf.size(), file)) > 0) {
+      ZSTD_inBuffer in = {ibuf.data(), r, 0};
+      while (!closed && in.pos < in.size) {
+        ZSTD_outBuffer out = {obuf.data(), obuf.size(), 0};
+        const size_t ret = ZSTD_decompressStream(zds, &out, &in);
+        CHECK_FMT(
+            !ZSTD_isError(ret), "Failed to decompress zstd file \"%s\": %s",
+            fname.c_str(), ZSTD_getErrorName(ret));
+        closed = !write_all(fd, obuf.data(), out.pos);
+      }
+    }
+    ZSTD_freeDStream(zds);
+#endif
+  }
+  fclose(file);
+  close(fd);
+}
+
+// Read the uncompressed data from fd, and write it compressed into file
+static void compress_thread(
+    COMPRESSION_CODE comp, FILE* file, const string& fname, int fd) {
+  vector<char> ibuf(COMPRESSION_BUFFER_SIZE);
+  ssize_t r = 0;
+  if (comp == COMPRESSION_GZIP) {
+#ifdef HAVE_ZLIB
+    gzFile gz = gzdopen(dup(fileno(file)), "wb");
+    CHECK_FMT(gz, "Failed to open gzip file \"%s\"!", fname.c_str());
+    gzbuffer(gz, COMPRESSION_BUFFER_SIZE);
+    while ((r = read(fd, ibuf.data(), ibuf.size())) != 0) {
+      if (r < 0 && errno == EINTR) continue;
+      CHECK_FMT(r > 0, "Failed to read from pipe: %s", strerror(errno));
+      CHECK_FMT(
+          gzwrite(gz, ibuf.data(), r) == r,
+          "Failed to write gzip file \"%s\"!", fname.c_str());
+    }
+    CHECK_FMT(
+        gzclose(gz) == Z_OK, "Failed to write gzip file \"%s\"!",
+        fname.c_str());
+#endif
+  } else if (comp == COMPRESSION_ZSTD) {
+#ifdef HAVE_ZSTD
+    ZSTD_CCtx* cctx = ZSTD_createCCtx();
+    CHECK(cctx);
+    vector<char> obuf(ZSTD_CStreamOutSize());
+    bool last = false;
+    while (!last) {
+      r = read(fd, ibuf.data(), ibuf.size());
+      if (r < 0 && errno == EINTR) continue;
+      CHECK_FMT(r >= 0, "Failed to read from pipe: %s", strerror(errno));
+      last = (r == 0);
+      const ZSTD_EndDirective mode = last ? ZSTD_e_end : ZSTD_e_continue;
+      ZSTD_inBuffer in = {ibuf.data(), static_cast<size_t>(r), 0};
+      bool finished = false;
+      while (!finished) {
+        ZSTD_outBuffer out = {obuf.data(), obuf.size(), 0};
+        const size_t rem = ZSTD_compressStream2(cctx, &out, &in, mode);
+        CHECK_FMT(
+            !ZSTD_isError(rem), "Failed to compress zstd file \"%s\": %s",
+            fname.c_str(), ZSTD_getErrorName(rem));
+        CHECK_FMT(
+            fwrite(obuf.data(), 1, out.pos, file) == out.pos,
+            "Failed to write zstd file \"%s\"!", fname.c_str());
+        finished = last ? (rem == 0) : (in.pos == in.size);
+      }
+    }
+    ZSTD_freeCCtx(cctx);
+#endif
+  }
+  close(fd);
+  CHECK_FMT(fclose(file) == 0, "Failed to write file \"%s\"!", fname.c_str());
+}
+
 FILE* open_file(const char* fname, const char* mode) {
-  FILE* file = fopen(fname, mode);
+  STATS_SCOPE(STATS_OPEN);
+  const bool reading = mode[0] == 'r' && !strchr(mode, '+');
+  FILE* file = NULL;
+  if (reading && io_backend == IO_BACKEND_URING) file = uring_open(fname);
+  const bool uring = file != NULL;
+  if (!file) file = fopen(fname, mode);
   CHECK_FMT(file, "Failed to open file \"%s\" with mode \"%s\"!", fname, mode);
-  return file;
+  COMPRESSION_CODE comp = COMPRESSION_NONE;
+  if (reading) {
+    // Check the magic number of compressed files
+    unsigned char magic[4] = {0, 0, 0, 0};
+    const size_t r = fread(magic, 1, 4, file);
+    if (r == 4) comp = compression_from_magic(magic);
+    if (comp == COMPRESSION_NONE && fseek(file, 0, SEEK_SET) != 0) {
+      // Not seekable, this should not happen with files opened by name
+      // (and, in any case, the file cannot be compressed).
+      fclose(file);
+      file = fopen(fname, mode);
+      CHECK_FMT(
+          file, "Failed to open file \"%s\" with mode \"%s\"!", fname, mode);
+    }
+    if (comp != COMPRESSION_NONE) fseek(file, 0, SEEK_SET);
+    if (comp != COMPRESSION_NONE && uring) {
+      // the decompressor needs a file descriptor
+      fclose(file);
+      file = fopen(fname, mode);
+      CHECK_FMT(
+          file, "Failed to open file \"%s\" with mode \"%s\"!", fname, mode);
+    }
+  } else if (mode[0] == 'w') {
+    comp = compression_from_name(fname);
+  }
+  if (comp == COMPRESSION_NONE) return file;
+  check_compression_support(comp, fname);
+  int fd[2];
+  CHECK_FMT(pipe(fd) == 0, "Failed to create pipe: %s", strerror(errno));
+  FILE* stream = NULL;
+  thread* worker = NULL;
+  if (reading) {
+    stream = fdopen(fd[0], mode);
+    worker = new thread(decompress_thread, comp, file, string(fname), fd[1]);
+  } else {
+    stream = fdopen(fd[1], mode);
+    worker = new thread(compress_thread, comp, file, string(fname), fd[0]);
+  }
+  CHECK_FMT(stream, "Failed to open pipe: %s", strerror(errno));
+  lock_guard<mutex> lock(compressed_streams_mutex);
+  compressed_streams[stream] = worker;
+  return stream;
+}
+
+void close_file(FILE* file) {
+  thread* worker = NULL;
+  {
+    lock_guard<mutex> lock(compressed_streams_mutex);
+    map<FILE*, thread*>::iterator it = compressed_streams.find(file);
+    if (it != compressed_streams.end()) {
+      worker = it->second;
+      compressed_streams.erase(it);
+    }
+  }
+  fclose(file);
+  if (worker) {
+    worker->join();
+    delete worker;
+  }
 }
 
 void open_files(
@@ -66,7 +376,67 @@ void close_files(const vector<FILE*>& files) {
   for (size_t f = 0; f < files.size(); ++f) {
     FILE* file = files[f];
     if (file != stdin && file != stdout && file != stderr) {
-      fclose(file);
+      close_file(file);
     }
   }
 }
+
+void read_file_list(
+    const char* fname, vector<string>* inputs, vector<string>* outputs) {
+  FILE* file = open_file(fname, "r");
+  char* line = NULL;
+  size_t line_size = 0;
+  size_t num_line = 0;
+  while (getline(&line, &line_size, file) > 0) {
+    ++num_line;
+    char* saveptr = NULL;
+    const char* inp = strtok_r(line, " \t\r\n", &saveptr);
+    if (inp == NULL) continue;  // ignore blank lines
+    const char* out = strtok_r(NULL, " \t\r\n", &saveptr);
+    CHECK_FMT(
+        strtok_r(NULL, " \t\r\n", &saveptr) == NULL &&
+        (out == NULL || outputs != NULL),
+        "Too many file names in line %lu of list \"%s\"!", num_line, fname);
+    inputs->push_back(inp);
+    if (outputs) outputs->push_back(out ? out : "");
+  }
+  free(line);
+  close_file(file);
+}
+
+bool is_variable_name(const string& name) {
+  if (name.empty() || isdigit(static_cast<unsigned char>(name[0])))
+    return false;
+  for (size_t i = 0; i < name.size(); ++i) {
+    if (!isalnum(static_cast<unsigned char>(name[i])) && name[i] != '_')
+      return false;
+  }
+  return true;
+}
+
+// static
+MatrixFile* MatrixFile::Create(FORMAT_CODE format) {
+  switch (format) {
+    case FMT_ASCII:
+      return Create<FMT_ASCII>();
+    case FMT_BINARY:
+      return Create<FMT_BINARY>();
+    case FMT_OCTAVE:
+      return Create<FMT_OCTAVE>();
+    case FMT_VBOSCH:
+      return Create<FMT_VBOSCH>();
+    case FMT_HTK:
+      return Create<FMT_HTK>();
+    case FMT_MAT4:
+      return Create<FMT_MAT4>();
+    case FMT_FPCA:
+      return Create<FMT_FPCA>();
+    case FMT_NPY:
+      return Create<FMT_NPY>();
+    case FMT_KALDI:
+      return Create<FMT_KALDI>();
+    default:
+      ERROR_FMT("Unknown matrix format (%d)!", format);
+  }
+  return nullptr;
+}
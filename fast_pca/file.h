@@ -25,6 +25,8 @@
 #ifndef FAST_PCA_FILE_H_
 #define FAST_PCA_FILE_H_
 
+#include <stdint.h>
+
 #include <cstdio>
 #include <string>
 #include <vector>
@@ -41,16 +43,83 @@ typedef enum {
   FMT_OCTAVE  = 2,
   FMT_VBOSCH  = 3,
   FMT_HTK     = 4,
-  FMT_MAT4    = 5
+  FMT_MAT4    = 5,
+  FMT_FPCA    = 6,
+  FMT_NPY     = 7,
+  FMT_KALDI   = 8
 } FORMAT_CODE;
 
 FORMAT_CODE format_code_from_name(const string& name);
 
+// Whether the matrices are written as text in the given format
+bool is_text_format(FORMAT_CODE format);
+
+// Whether several matrices can be written one after the other into a single
+// file of the given format (archives, or formats without a header)
+bool is_archive_format(FORMAT_CODE format);
+
+typedef enum {
+  IO_BACKEND_UNKNOWN = -1,
+  IO_BACKEND_STDIO   = 0,
+  IO_BACKEND_URING   = 1
+} IO_BACKEND;
+
+IO_BACKEND io_backend_from_name(const string& name);
+
+// ------------------------------------------------------------------------
+// ---- set_io_backend: Select the backend used by open_file to read
+// ---- regular files: stdio (default) or io_uring, which keeps several
+// ---- large reads in flight for the current and the following files.
+// ---- Returns false (and keeps stdio) if the backend is not available.
+// ------------------------------------------------------------------------
+bool set_io_backend(IO_BACKEND backend);
+
+typedef enum {
+  ELEM_TYPE_UNKNOWN = -1,
+  ELEM_TYPE_NATIVE  = 0,  // type used for the computations (float/double)
+  ELEM_TYPE_FLOAT32 = 1,
+  ELEM_TYPE_FLOAT64 = 2,
+  ELEM_TYPE_FLOAT16 = 3,
+  ELEM_TYPE_INT32   = 4,
+  ELEM_TYPE_INT16   = 5,
+  ELEM_TYPE_UINT16  = 6,
+  ELEM_TYPE_INT8    = 7,
+  ELEM_TYPE_UINT8   = 8,
+  ELEM_TYPE_BFLOAT16 = 9
+} ELEM_TYPE;
+
+ELEM_TYPE elem_type_from_name(const string& name);
+
+// ------------------------------------------------------------------------
+// ---- set_binary_input_type: Select the type of the elements read from
+// ---- binary files, since they have no header. By default, elements have
+// ---- the type used for the computations.
+// ------------------------------------------------------------------------
+void set_binary_input_type(ELEM_TYPE type);
+ELEM_TYPE get_binary_input_type();
+
+typedef enum {
+  COMPRESSION_NONE = 0,
+  COMPRESSION_GZIP = 1,
+  COMPRESSION_ZSTD = 2
+} COMPRESSION_CODE;
+
 // ------------------------------------------------------------------------
-// ---- open_file: Open a file with the specified mode
+// ---- open_file: Open a file with the specified mode.
+// ---- Files compressed with gzip or zstd are detected when reading (by
+// ---- their magic number) and decompressed on a dedicated thread.
+// ---- When writing, files with the extension .gz or .zst are compressed
+// ---- on a dedicated thread as well.
+// ---- Files opened with this function must be closed with close_file.
 // ------------------------------------------------------------------------
 FILE* open_file(const char* fname, const char* mode);
 
+// ------------------------------------------------------------------------
+// ---- close_file: Close a file opened with open_file, waiting for the
+// ---- compression/decompression thread, if any, to finish.
+// ------------------------------------------------------------------------
+void close_file(FILE* file);
+
 // ------------------------------------------------------------------------
 // ---- open_files: Open a list of files with the specified mode. If the
 // ---- list is empty, appends the selected standard file with the given
@@ -65,6 +134,21 @@ void open_files(
 // ------------------------------------------------------------------------
 void close_files(const vector<FILE*>& files);
 
+// ------------------------------------------------------------------------
+// ---- read_file_list: Read a list of file names, one per line, and append
+// ---- them to inputs. If outputs is not NULL, each line may contain an
+// ---- input and an output file name separated by white spaces (a missing
+// ---- output name is appended as "", the standard output).
+// ------------------------------------------------------------------------
+void read_file_list(
+    const char* fname, vector<string>* inputs, vector<string>* outputs);
+
+
+// ------------------------------------------------------------------------
+// ---- is_variable_name: Check whether a matrix name (e.g. a Kaldi key) can
+// ---- be used as the name of an Octave/MATLAB variable.
+// ------------------------------------------------------------------------
+bool is_variable_name(const string& name);
 
 // ------------------------------------------------------------------------
 // ---- Abstract templated methods for reading / writing matrices in
@@ -79,29 +163,56 @@ class MatrixFile {
   FILE* file_;
   int rows_;
   int cols_;
+  int threads_;
 
  public:
   explicit MatrixFile(FORMAT_CODE format) :
-      format_(format), file_(nullptr), rows_(-1), cols_(-1) {}
-  explicit MatrixFile(FILE* file) :
-      file_(file), rows_(-1), cols_(-1) {}
+      format_(format), file_(nullptr), rows_(-1), cols_(-1), threads_(1) {}
+  MatrixFile(FORMAT_CODE format, FILE* file) :
+      format_(format), file_(file), rows_(-1), cols_(-1), threads_(1) {}
   virtual ~MatrixFile() {}
 
   inline FORMAT_CODE format() const { return format_; }
   inline void file(FILE* f) { file_ = f; }
   inline void rows(int n) { rows_ = n; }
   inline void cols(int n) { cols_ = n; }
+  inline void threads(int n) { threads_ = n; }
   inline FILE* file() const { return file_; }
   inline int rows() const { return rows_; }
   inline int cols() const { return cols_; }
+  inline int threads() const { return threads_; }
 
   virtual bool read_header() { return true; }
+  // formats storing multiple matrices in a single file (e.g. archives)
+  // move to the header of the next matrix, returns false when there are
+  // no more matrices
+  virtual bool read_next_header() { return false; }
   virtual void write_header() const {}
+  // called once all blocks were written, before closing the file
+  virtual void write_footer() const {}
+  // Copy the header of another matrix, which may be stored in a different
+  // format: the size of the matrix is always copied, and the rest of the
+  // fields that can be translated between formats (see below).
   virtual bool copy_header_from(const MatrixFile& other) {
     rows_ = other.rows();
     cols_ = other.cols();
     return true;
   }
+  // name of the matrix (e.g. Octave/MAT4 variable, Kaldi key), if any
+  virtual string matrix_name() const { return ""; }
+  // sampling period of the rows (HTK, in 100ns units), if any
+  virtual uint32_t sample_period() const { return 0; }
+  // formats which store the number of rows in the header need to know it
+  // before the first block is written
+  virtual bool needs_rows() const { return false; }
+
+  // Select the type of the elements written by write_block(), which must
+  // be called after copy_header_from(). Data written as 8-bit integers is
+  // quantized with a scale for each column (x ~= scale[j] * q).
+  // Returns false if the format does not support the type.
+  virtual bool output_type(ELEM_TYPE type, const vector<float>& scale) {
+    return type == ELEM_TYPE_NATIVE;
+  }
 
   virtual int read_block(int n, float* m) const = 0;
   virtual int read_block(int n, double* m) const = 0;
@@ -111,6 +222,8 @@ class MatrixFile {
 
   template <FORMAT_CODE format>
   static MatrixFile* Create();
+  // same as above, with the format selected at run time
+  static MatrixFile* Create(FORMAT_CODE format);
   template <FORMAT_CODE format>
   static MatrixFile* Create(FILE* file);
 };
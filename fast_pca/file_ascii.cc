@@ -26,38 +26,12 @@
 
 #include <cstdio>
 
-int MatrixFile_ASCII::read_block(int n, float* m) const {
-  CHECK(file_);
-  int i = 0;
-  for (; i < n && fscanf(file_, "%f", m + i) == 1; ++i) { }
-  return i;
-}
-
-int MatrixFile_ASCII::read_block(int n, double* m) const {
-  CHECK(file_);
-  int i = 0;
-  for (; i < n && fscanf(file_, "%lf", m + i) == 1; ++i) { }
-  return i;
-}
-
 void MatrixFile_ASCII::write_block(int n, const float* m) const {
-  CHECK(file_);
-  for (int i = 0; i < n; ++i) {
-    if ((i + 1) % cols_ == 0)
-      fprintf(file_, "%.16g\n", m[i]);
-    else
-      fprintf(file_, "%.16g ", m[i]);
-  }
+  write_text_block(file_, n, cols_, m, threads_);
 }
 
 void MatrixFile_ASCII::write_block(int n, const double* m) const {
-  CHECK(file_);
-  for (int i = 0; i < n; ++i) {
-    if ((i + 1) % cols_ == 0)
-      fprintf(file_, "%.16g\n", m[i]);
-    else
-      fprintf(file_, "%.16g ", m[i]);
-  }
+  write_text_block(file_, n, cols_, m, threads_);
 }
 
 // static
@@ -26,14 +26,13 @@
 #define FAST_PCA_FILE_ASCII_H_
 
 #include "fast_pca/file.h"
+#include "fast_pca/file_text.h"
 
-class MatrixFile_ASCII : public MatrixFile {
+class MatrixFile_ASCII : public MatrixFile_Text {
  public:
-  MatrixFile_ASCII() : MatrixFile(FMT_ASCII) {}
-  explicit MatrixFile_ASCII(FILE* file) : MatrixFile(file) {}
+  MatrixFile_ASCII() : MatrixFile_Text(FMT_ASCII) {}
+  explicit MatrixFile_ASCII(FILE* file) : MatrixFile_Text(FMT_ASCII, file) {}
 
-  virtual int read_block(int n, float* m) const;
-  virtual int read_block(int n, double* m) const;
   virtual void write_block(int n, const float* m) const;
   virtual void write_block(int n, const double* m) const;
 };
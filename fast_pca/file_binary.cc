@@ -26,28 +26,139 @@
 
 #include <cstdio>
 
-// virtual
-int MatrixFile_Binary::read_block(int n, float* m) const {
-  CHECK(file_);
-  return fread(m, sizeof(float), n, file_);
+#include "fast_pca/endian.h"
+#include "fast_pca/float16.h"
+#include "fast_pca/quantize.h"
+
+static ELEM_TYPE binary_input_type = ELEM_TYPE_NATIVE;
+
+void set_binary_input_type(ELEM_TYPE type) {
+  binary_input_type = type;
 }
 
-// virtual
-int MatrixFile_Binary::read_block(int n, double* m) const {
-  CHECK(file_);
-  return fread(m, sizeof(double), n, file_);
+ELEM_TYPE get_binary_input_type() {
+  return binary_input_type;
 }
 
-// virtual
-void MatrixFile_Binary::write_block(int n, const float* m) const {
+// read n elements of type TF from the file, into the buffer m of type TT
+template <typename TF, typename TT>
+static int read_cast_block(FILE* file, int n, TT* m, vector<char>* raw) {
+  raw->resize(n * sizeof(TF));
+  TF* buf = reinterpret_cast<TF*>(raw->data());
+  n = fread(buf, sizeof(TF), n, file);
+  cast_block(n, buf, m);
+  return n;
+}
+
+template <typename T>
+int MatrixFile_Binary::read_block(int n, T* m) const {
   CHECK(file_);
-  fwrite(m, sizeof(float), n, file_);
+  const ELEM_TYPE type = binary_input_type;
+  if (type == ELEM_TYPE_NATIVE ||
+      (type == ELEM_TYPE_FLOAT32 && sizeof(T) == sizeof(float)) ||
+      (type == ELEM_TYPE_FLOAT64 && sizeof(T) == sizeof(double))) {
+    return fread(m, sizeof(T), n, file_);
+  }
+  switch (type) {
+    case ELEM_TYPE_FLOAT32:
+      return read_cast_block<float>(file_, n, m, &raw_);
+    case ELEM_TYPE_FLOAT64:
+      return read_cast_block<double>(file_, n, m, &raw_);
+    case ELEM_TYPE_FLOAT16: {
+      raw_.resize(n * sizeof(uint16_t));
+      uint16_t* buf = reinterpret_cast<uint16_t*>(raw_.data());
+      n = fread(buf, sizeof(uint16_t), n, file_);
+      half_to_real_block(n, buf, m);
+      return n;
+    }
+    case ELEM_TYPE_BFLOAT16: {
+      raw_.resize(n * sizeof(uint16_t));
+      uint16_t* buf = reinterpret_cast<uint16_t*>(raw_.data());
+      n = fread(buf, sizeof(uint16_t), n, file_);
+      bfloat16_to_real_block(n, buf, m);
+      return n;
+    }
+    case ELEM_TYPE_INT32:
+      return read_cast_block<int32_t>(file_, n, m, &raw_);
+    case ELEM_TYPE_INT16:
+      return read_cast_block<int16_t>(file_, n, m, &raw_);
+    case ELEM_TYPE_UINT16:
+      return read_cast_block<uint16_t>(file_, n, m, &raw_);
+    case ELEM_TYPE_INT8:
+      return read_cast_block<int8_t>(file_, n, m, &raw_);
+    default:
+      return read_cast_block<uint8_t>(file_, n, m, &raw_);
+  }
 }
 
 // virtual
-void MatrixFile_Binary::write_block(int n, const double* m) const {
+bool MatrixFile_Binary::output_type(
+    ELEM_TYPE type, const vector<float>& scale) {
+  switch (type) {
+    case ELEM_TYPE_NATIVE:
+    case ELEM_TYPE_FLOAT32:
+    case ELEM_TYPE_FLOAT64:
+    case ELEM_TYPE_FLOAT16:
+    case ELEM_TYPE_BFLOAT16:
+      break;
+    case ELEM_TYPE_INT8:
+      CHECK(scale.size() == static_cast<size_t>(cols_));
+      out_inv_scale_.resize(cols_);
+      for (int j = 0; j < cols_; ++j) out_inv_scale_[j] = 1.0f / scale[j];
+      break;
+    default:
+      return false;
+  }
+  out_type_ = type;
+  out_col_ = 0;
+  return true;
+}
+
+// write n elements of type TF from the buffer m, as elements of type TT
+template <typename TT, typename TF>
+static void write_cast_block(
+    FILE* file, int n, const TF* m, vector<char>* raw) {
+  raw->resize(n * sizeof(TT));
+  TT* buf = reinterpret_cast<TT*>(raw->data());
+  cast_block(n, m, buf);
+  fwrite(buf, sizeof(TT), n, file);
+}
+
+template <typename T>
+void MatrixFile_Binary::write_block(int n, const T* m) const {
   CHECK(file_);
-  fwrite(m, sizeof(double), n, file_);
+  const ELEM_TYPE type = out_type_;
+  if (type == ELEM_TYPE_NATIVE ||
+      (type == ELEM_TYPE_FLOAT32 && sizeof(T) == sizeof(float)) ||
+      (type == ELEM_TYPE_FLOAT64 && sizeof(T) == sizeof(double))) {
+    fwrite(m, sizeof(T), n, file_);
+    return;
+  }
+  switch (type) {
+    case ELEM_TYPE_FLOAT32:
+      write_cast_block<float>(file_, n, m, &raw_);
+      break;
+    case ELEM_TYPE_FLOAT64:
+      write_cast_block<double>(file_, n, m, &raw_);
+      break;
+    case ELEM_TYPE_FLOAT16:
+    case ELEM_TYPE_BFLOAT16: {
+      raw_.resize(n * sizeof(uint16_t));
+      uint16_t* buf = reinterpret_cast<uint16_t*>(raw_.data());
+      if (type == ELEM_TYPE_FLOAT16) real_to_half_block(n, m, buf);
+      else real_to_bfloat16_block(n, m, buf);
+      fwrite(buf, sizeof(uint16_t), n, file_);
+      break;
+    }
+    default: {
+      raw_.resize(n);
+      int8_t* buf = reinterpret_cast<int8_t*>(raw_.data());
+      quantize_int8_block(
+          n, cols_, out_col_, m, out_inv_scale_.data(), buf);
+      out_col_ = (out_col_ + n) % cols_;
+      fwrite(buf, 1, n, file_);
+    }
+  }
 }
 
 // static
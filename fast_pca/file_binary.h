@@ -27,15 +27,51 @@
 
 #include "fast_pca/file.h"
 
+#include <vector>
+
+using std::vector;
+
 class MatrixFile_Binary : public MatrixFile {
  public:
-  MatrixFile_Binary() : MatrixFile(FMT_BINARY) {}
-  explicit MatrixFile_Binary(FILE* file) : MatrixFile(file) {}
+  MatrixFile_Binary() :
+      MatrixFile(FMT_BINARY), out_type_(ELEM_TYPE_NATIVE), out_col_(0) {}
+  explicit MatrixFile_Binary(FILE* file) :
+      MatrixFile(FMT_BINARY, file), out_type_(ELEM_TYPE_NATIVE), out_col_(0) {}
+
+  // binary files can be written with any floating point type, or as
+  // 8-bit integers (the scales are not stored in the file, fast_pca writes
+  // them to a side file)
+  virtual bool output_type(ELEM_TYPE type, const vector<float>& scale);
+
+  virtual int read_block(int n, float* m) const {
+    return read_block<float>(n, m);
+  }
+  virtual int read_block(int n, double* m) const {
+    return read_block<double>(n, m);
+  }
+  virtual void write_block(int n, const float* m) const {
+    write_block<float>(n, m);
+  }
+  virtual void write_block(int n, const double* m) const {
+    write_block<double>(n, m);
+  }
+
+ private:
+  // elements are read with the type given by set_binary_input_type, and
+  // converted to the type of the buffer
+  template <typename T>
+  int read_block(int n, T* m) const;
+  template <typename T>
+  void write_block(int n, const T* m) const;
 
-  virtual int read_block(int n, float* m) const;
-  virtual int read_block(int n, double* m) const;
-  virtual void write_block(int n, const float* m) const;
-  virtual void write_block(int n, const double* m) const;
+  // type of the written elements, and inverse of the scale of each column
+  // when they are quantized
+  ELEM_TYPE out_type_;
+  vector<float> out_inv_scale_;
+  // column of the next written element
+  mutable size_t out_col_;
+  // staging buffer for the elements of a different type
+  mutable vector<char> raw_;
 };
 
 #endif  // FAST_PCA_FILE_BINARY_H_
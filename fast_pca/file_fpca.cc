@@ -0,0 +1,670 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "fast_pca/file_fpca.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "fast_pca/endian.h"
+#include "fast_pca/float16.h"
+#include "fast_pca/quantize.h"
+#include "fast_pca/uring.h"
+
+static const char FPCA_MAGIC[4] = {'F', 'P', 'C', 'A'};
+static const char FPCA_INDEX_MAGIC[8] = {'F', 'P', 'C', 'A', 'I', 'D', 'X', '1'};
+static const uint16_t FPCA_VERSION = 1;
+static const uint64_t FPCA_UNKNOWN_ROWS = ~static_cast<uint64_t>(0);
+static const uint32_t FPCA_CHUNK_COMPRESSED = 1;
+static const int FPCA_ZSTD_LEVEL = 3;
+
+// little-endian serialization of the header fields
+static inline void put_u16(char* p, uint16_t v) {
+  v = htole16(v);
+  memcpy(p, &v, 2);
+}
+static inline void put_u32(char* p, uint32_t v) {
+  v = htole32(v);
+  memcpy(p, &v, 4);
+}
+static inline void put_u64(char* p, uint64_t v) {
+  v = htole64(v);
+  memcpy(p, &v, 8);
+}
+static inline uint16_t get_u16(const char* p) {
+  uint16_t v;
+  memcpy(&v, p, 2);
+  return le16toh(v);
+}
+static inline uint32_t get_u32(const char* p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return le32toh(v);
+}
+static inline uint64_t get_u64(const char* p) {
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return le64toh(v);
+}
+
+static inline uint64_t align16(uint64_t n) {
+  return (n + 15) & ~static_cast<uint64_t>(15);
+}
+
+// decode n little-endian elements of type TF into the buffer m of type TT
+template <typename TF, typename TT>
+static void decode_block(size_t n, const char* src, TT* m, vector<TF>* buf) {
+  buf->resize(n);
+  memcpy(buf->data(), src, n * sizeof(TF));
+  letoh_block(n, buf->data());
+  cast_block(n, buf->data(), m);
+}
+
+template <typename T>
+static void decode_block(size_t n, const char* src, T* m, vector<T>*) {
+  memcpy(m, src, n * sizeof(T));
+  letoh_block(n, m);
+}
+
+template <typename T>
+static void decode_half_block(
+    size_t n, const char* src, T* m, vector<uint16_t>* buf) {
+  buf->resize(n);
+  memcpy(buf->data(), src, n * 2);
+  letoh_block(n, buf->data());
+  half_to_real_block(n, buf->data(), m);
+}
+
+template <typename T>
+static void decode_bfloat16_block(
+    size_t n, const char* src, T* m, vector<uint16_t>* buf) {
+  buf->resize(n);
+  memcpy(buf->data(), src, n * 2);
+  letoh_block(n, buf->data());
+  bfloat16_to_real_block(n, buf->data(), m);
+}
+
+// encode n elements of type TF as little-endian elements of type TT
+template <typename TF, typename TT>
+static void encode_block(size_t n, const TF* m, char* dst, vector<TT>* buf) {
+  buf->resize(n);
+  cast_block(n, m, buf->data());
+  htole_block(n, buf->data());
+  memcpy(dst, buf->data(), n * sizeof(TT));
+}
+
+template <typename T>
+static void encode_block(size_t n, const T* m, char* dst, vector<T>*) {
+  memcpy(dst, m, n * sizeof(T));
+  if (is_big_endian()) swap_bytes_block<sizeof(T)>(n, dst);
+}
+
+template <typename T>
+static void encode_half_block(
+    size_t n, const T* m, char* dst, vector<uint16_t>* buf) {
+  buf->resize(n);
+  real_to_half_block(n, m, buf->data());
+  htole_block(n, buf->data());
+  memcpy(dst, buf->data(), n * 2);
+}
+
+template <typename T>
+static void encode_bfloat16_block(
+    size_t n, const T* m, char* dst, vector<uint16_t>* buf) {
+  buf->resize(n);
+  real_to_bfloat16_block(n, m, buf->data());
+  htole_block(n, buf->data());
+  memcpy(dst, buf->data(), n * 2);
+}
+
+static void check_compression(COMPRESSION_CODE compression) {
+  CHECK_FMT(
+      compression == COMPRESSION_NONE || compression == COMPRESSION_ZSTD,
+      "Unsupported compression in FPCA file (%d)!", compression);
+#ifndef HAVE_ZSTD
+  CHECK_MSG(
+      compression != COMPRESSION_ZSTD,
+      "FPCA file uses zstd compression, but fast_pca was compiled without "
+      "zstd support!");
+#endif
+}
+
+void MatrixFile_FPCA::reset() {
+  dtype_ = DTYPE_NATIVE;
+  compression_ = COMPRESSION_NONE;
+  chunk_rows_ = 0;
+  footer_offset_ = 0;
+  offset_ = 0;
+  map_ = nullptr;
+  map_size_ = 0;
+  chunk_left_ = 0;
+  chunk_ptr_ = nullptr;
+  eof_ = false;
+  header_written_ = false;
+  written_rows_ = 0;
+  appending_ = false;
+}
+
+void MatrixFile_FPCA::unmap() {
+  if (map_) munmap(const_cast<char*>(map_), map_size_);
+  map_ = nullptr;
+  map_size_ = 0;
+}
+
+size_t MatrixFile_FPCA::dtype_size() const {
+  switch (dtype_) {
+    case DTYPE_FLOAT32:
+      return 4;
+    case DTYPE_FLOAT64:
+      return 8;
+    case DTYPE_FLOAT16:
+      return 2;
+    case DTYPE_UINT8:
+      return 1;
+    case DTYPE_INT16:
+      return 2;
+    case DTYPE_BFLOAT16:
+      return 2;
+    case DTYPE_INT8:
+      return 1;
+    default:
+      ERROR_FMT("Unknown FPCA data type (%d)!", dtype_);
+  }
+  return 0;
+}
+
+void MatrixFile_FPCA::read_bytes(void* dst, size_t n) const {
+  if (map_) {
+    CHECK_MSG(offset_ + n <= map_size_, "Corrupted FPCA file!");
+    memcpy(dst, map_ + offset_, n);
+  } else {
+    CHECK_MSG(fread(dst, 1, n, file_) == n, "Corrupted FPCA file!");
+  }
+  offset_ += n;
+}
+
+void MatrixFile_FPCA::write_bytes(const void* src, size_t n) const {
+  CHECK_MSG(fwrite(src, 1, n, file_) == n, "Failed to write FPCA file!");
+  offset_ += n;
+}
+
+bool MatrixFile_FPCA::read_index() {
+  index_.clear();
+  if (!map_ || map_size_ < HEADER_SIZE + CHUNK_HEADER_SIZE + TRAILER_SIZE)
+    return false;
+  const char* trailer = map_ + map_size_ - TRAILER_SIZE;
+  // the footer is missing (e.g. the file is still being written)
+  if (memcmp(trailer + 24, FPCA_INDEX_MAGIC, 8) != 0) return false;
+  const uint64_t nchunks = get_u64(trailer);
+  const uint64_t rows = get_u64(trailer + 8);
+  footer_offset_ = get_u64(trailer + 16);
+  CHECK_MSG(
+      footer_offset_ + nchunks * 8 + TRAILER_SIZE == map_size_ &&
+      nchunks == (rows + chunk_rows_ - 1) / chunk_rows_ &&
+      rows <= static_cast<uint64_t>(INT_MAX),
+      "Corrupted FPCA file (invalid footer)!");
+  index_.resize(nchunks);
+  for (uint64_t c = 0; c < nchunks; ++c) {
+    index_[c] = get_u64(map_ + footer_offset_ + c * 8);
+  }
+  rows_ = rows;
+  return true;
+}
+
+bool MatrixFile_FPCA::next_chunk() const {
+  if (eof_) return false;
+  char header[CHUNK_HEADER_SIZE];
+  if (!map_) {
+    // a file without the end-of-data mark is read until the EOF
+    const size_t r = fread(header, 1, CHUNK_HEADER_SIZE, file_);
+    if (r == 0) { eof_ = true; return false; }
+    CHECK_MSG(r == CHUNK_HEADER_SIZE, "Corrupted FPCA file!");
+    offset_ += r;
+  } else {
+    if (offset_ == map_size_) { eof_ = true; return false; }
+    read_bytes(header, CHUNK_HEADER_SIZE);
+  }
+  const uint32_t rows = get_u32(header);
+  const uint32_t flags = get_u32(header + 4);
+  const uint64_t size = get_u64(header + 8);
+  if (rows == 0) { eof_ = true; return false; }
+  const uint64_t elems = static_cast<uint64_t>(rows) * cols_;
+  const uint64_t raw_size = elems * dtype_size();
+  const char* payload = nullptr;
+  if (map_) {
+    CHECK_MSG(
+        offset_ + align16(size) <= map_size_, "Corrupted FPCA file!");
+    payload = map_ + offset_;
+    offset_ += align16(size);
+  } else {
+    payload_.resize(align16(size));
+    read_bytes(payload_.data(), payload_.size());
+    payload = payload_.data();
+  }
+  if (flags & FPCA_CHUNK_COMPRESSED) {
+#ifdef HAVE_ZSTD
+    chunk_.resize(raw_size);
+    const size_t r = ZSTD_decompress(chunk_.data(), raw_size, payload, size);
+    CHECK_FMT(
+        !ZSTD_isError(r) && r == raw_size,
+        "Corrupted FPCA file (failed to decompress chunk at offset %lu)!",
+        static_cast<unsigned long>(offset_));
+    chunk_ptr_ = chunk_.data();
+#else
+    check_compression(COMPRESSION_ZSTD);
+#endif
+  } else {
+    CHECK_MSG(size == raw_size, "Corrupted FPCA file (bad chunk size)!");
+    chunk_ptr_ = payload;
+  }
+  chunk_left_ = elems;
+  return true;
+}
+
+// virtual
+bool MatrixFile_FPCA::copy_header_from(const MatrixFile& other) {
+  rows_ = other.rows();
+  cols_ = other.cols();
+  // matrices from other formats are written with the type of the data,
+  // uncompressed
+  if (other.format() != format_) {
+    dtype_ = DTYPE_NATIVE;
+    compression_ = COMPRESSION_NONE;
+    return true;
+  }
+  const MatrixFile_FPCA* other_fpca =
+      static_cast<const MatrixFile_FPCA*>(&other);
+  // integer types are only used to store the input data (int8 scales
+  // are specific to each matrix)
+  dtype_ = other_fpca->dtype_ == DTYPE_UINT8 ||
+      other_fpca->dtype_ == DTYPE_INT16 || other_fpca->dtype_ == DTYPE_INT8 ?
+      DTYPE_NATIVE : other_fpca->dtype_;
+  compression_ = other_fpca->compression_;
+  return true;
+}
+
+// virtual
+bool MatrixFile_FPCA::output_type(
+    ELEM_TYPE type, const vector<float>& scale) {
+  switch (type) {
+    case ELEM_TYPE_NATIVE:
+      break;
+    case ELEM_TYPE_FLOAT32:
+      dtype_ = DTYPE_FLOAT32;
+      break;
+    case ELEM_TYPE_FLOAT64:
+      dtype_ = DTYPE_FLOAT64;
+      break;
+    case ELEM_TYPE_FLOAT16:
+      dtype_ = DTYPE_FLOAT16;
+      break;
+    case ELEM_TYPE_BFLOAT16:
+      dtype_ = DTYPE_BFLOAT16;
+      break;
+    case ELEM_TYPE_INT8:
+      CHECK(scale.size() == static_cast<size_t>(cols_));
+      dtype_ = DTYPE_INT8;
+      scale_ = scale;
+      inv_scale_.resize(cols_);
+      for (int j = 0; j < cols_; ++j) inv_scale_[j] = 1.0f / scale[j];
+      break;
+    default:
+      return false;
+  }
+  return true;
+}
+
+// virtual
+bool MatrixFile_FPCA::read_header() {
+  CHECK(file_);
+  unmap();
+  index_.clear();
+  footer_offset_ = 0;
+  offset_ = 0;
+  chunk_left_ = 0;
+  eof_ = false;
+  char header[HEADER_SIZE];
+  if (fread(header, 1, HEADER_SIZE, file_) != HEADER_SIZE) return false;
+  CHECK_MSG(
+      memcmp(header, FPCA_MAGIC, 4) == 0,
+      "Invalid FPCA file (bad magic number)!");
+  CHECK_FMT(
+      get_u16(header + 4) == FPCA_VERSION &&
+      get_u16(header + 6) == HEADER_SIZE,
+      "Unsupported FPCA file version (%d)!", get_u16(header + 4));
+  dtype_ = static_cast<DTYPE_CODE>(get_u32(header + 8));
+  compression_ = static_cast<COMPRESSION_CODE>(get_u32(header + 12));
+  const uint64_t rows = get_u64(header + 16);
+  const uint64_t cols = get_u64(header + 24);
+  chunk_rows_ = get_u64(header + 32);
+  dtype_size();
+  check_compression(compression_);
+  CHECK_MSG(
+      cols > 0 && cols <= static_cast<uint64_t>(INT_MAX) && chunk_rows_ > 0 &&
+      (rows == FPCA_UNKNOWN_ROWS || rows <= static_cast<uint64_t>(INT_MAX)),
+      "Corrupted FPCA file (invalid header)!");
+  rows_ = rows == FPCA_UNKNOWN_ROWS ? -1 : rows;
+  cols_ = cols;
+  offset_ = HEADER_SIZE;
+  if (dtype_ == DTYPE_INT8) {
+    vector<char> scales(align16(cols_ * 4));
+    if (fread(scales.data(), 1, scales.size(), file_) != scales.size())
+      return false;
+    scale_.resize(cols_);
+    inv_scale_.resize(cols_);
+    for (int j = 0; j < cols_; ++j) {
+      const uint32_t u = get_u32(scales.data() + j * 4);
+      memcpy(&scale_[j], &u, 4);
+      inv_scale_[j] = 1.0f / scale_[j];
+    }
+    offset_ += scales.size();
+  }
+  // regular files are mapped into memory, and the index of chunks is
+  // loaded from the footer
+  struct stat st;
+  if (fstat(uring_fd(file_), &st) == 0 && S_ISREG(st.st_mode) &&
+      st.st_size >= static_cast<off_t>(HEADER_SIZE)) {
+    void* p = mmap(
+        nullptr, st.st_size, PROT_READ, MAP_SHARED, uring_fd(file_), 0);
+    if (p != MAP_FAILED) {
+      madvise(p, st.st_size, MADV_SEQUENTIAL);
+      map_ = static_cast<const char*>(p);
+      map_size_ = st.st_size;
+      read_index();
+    }
+  }
+  return true;
+}
+
+bool MatrixFile_FPCA::seek_row(uint64_t row) {
+  if (index_.empty() || row >= static_cast<uint64_t>(rows_)) return false;
+  const uint64_t c = row / chunk_rows_;
+  offset_ = index_[c];
+  eof_ = false;
+  CHECK(next_chunk());
+  const uint64_t skip = (row - c * chunk_rows_) * cols_;
+  chunk_ptr_ += skip * dtype_size();
+  chunk_left_ -= skip;
+  return true;
+}
+
+template <typename T>
+int MatrixFile_FPCA::read_block(int n, T* m) const {
+  CHECK(file_);
+  int r = 0;
+  while (r < n) {
+    if (chunk_left_ == 0 && !next_chunk()) break;
+    const size_t k = std::min<uint64_t>(n - r, chunk_left_);
+    switch (dtype_) {
+      case DTYPE_FLOAT32:
+        decode_block(k, chunk_ptr_, m + r, &fbuffer_);
+        break;
+      case DTYPE_FLOAT64:
+        decode_block(k, chunk_ptr_, m + r, &dbuffer_);
+        break;
+      case DTYPE_UINT8:
+        // bytes need no conversion, they are widened directly
+        cast_block(k, reinterpret_cast<const uint8_t*>(chunk_ptr_), m + r);
+        break;
+      case DTYPE_INT16:
+        decode_block(k, chunk_ptr_, m + r, &ibuffer_);
+        break;
+      case DTYPE_BFLOAT16:
+        decode_bfloat16_block(k, chunk_ptr_, m + r, &hbuffer_);
+        break;
+      case DTYPE_INT8:
+        // chunks contain complete rows
+        dequantize_int8_block(
+            k, cols_, (cols_ - chunk_left_ % cols_) % cols_,
+            reinterpret_cast<const int8_t*>(chunk_ptr_), scale_.data(),
+            m + r);
+        break;
+      default:
+        decode_half_block(k, chunk_ptr_, m + r, &hbuffer_);
+    }
+    chunk_ptr_ += k * dtype_size();
+    chunk_left_ -= k;
+    r += k;
+  }
+  return r;
+}
+
+void MatrixFile_FPCA::put_header() const {
+  check_compression(compression_);
+  CHECK_MSG(cols_ > 0, "The number of columns of a FPCA file is unknown!");
+  if (chunk_rows_ == 0) {
+    chunk_rows_ = std::max<uint64_t>(1, CHUNK_SIZE / (cols_ * dtype_size()));
+  }
+  char header[HEADER_SIZE];
+  memset(header, 0, HEADER_SIZE);
+  memcpy(header, FPCA_MAGIC, 4);
+  put_u16(header + 4, FPCA_VERSION);
+  put_u16(header + 6, HEADER_SIZE);
+  put_u32(header + 8, dtype_);
+  put_u32(header + 12, compression_);
+  put_u64(header + 16, FPCA_UNKNOWN_ROWS);
+  put_u64(header + 24, cols_);
+  put_u64(header + 32, chunk_rows_);
+  write_bytes(header, HEADER_SIZE);
+  if (dtype_ == DTYPE_INT8) {
+    CHECK(scale_.size() == static_cast<size_t>(cols_));
+    vector<char> scales(align16(cols_ * 4), 0);
+    for (int j = 0; j < cols_; ++j) {
+      uint32_t u;
+      memcpy(&u, &scale_[j], 4);
+      put_u32(scales.data() + j * 4, u);
+    }
+    write_bytes(scales.data(), scales.size());
+  }
+  header_written_ = true;
+}
+
+void MatrixFile_FPCA::put_chunk(size_t n, const char* data) const {
+  const uint64_t rows = n / cols_;
+  const char* payload = data;
+  uint64_t size = n * dtype_size();
+  uint32_t flags = 0;
+#ifdef HAVE_ZSTD
+  if (compression_ == COMPRESSION_ZSTD) {
+    payload_.resize(ZSTD_compressBound(size));
+    const size_t c = ZSTD_compress(
+        payload_.data(), payload_.size(), data, size, FPCA_ZSTD_LEVEL);
+    CHECK_FMT(
+        !ZSTD_isError(c), "Failed to compress FPCA chunk: %s",
+        ZSTD_getErrorName(c));
+    // incompressible chunks are stored raw
+    if (c < size) {
+      payload = payload_.data();
+      size = c;
+      flags |= FPCA_CHUNK_COMPRESSED;
+    }
+  }
+#endif
+  char header[CHUNK_HEADER_SIZE];
+  put_u32(header, rows);
+  put_u32(header + 4, flags);
+  put_u64(header + 8, size);
+  index_.push_back(offset_);
+  write_bytes(header, CHUNK_HEADER_SIZE);
+  write_bytes(payload, size);
+  static const char padding[16] = {0};
+  write_bytes(padding, align16(size) - size);
+  written_rows_ += rows;
+}
+
+// virtual
+void MatrixFile_FPCA::write_header() const {
+  CHECK(file_);
+  // the header is actually written with the first block, once the type of
+  // the data is known
+  index_.clear();
+  pending_.clear();
+  offset_ = 0;
+  header_written_ = false;
+  written_rows_ = 0;
+}
+
+template <typename T>
+void MatrixFile_FPCA::write_block(int n, const T* m) const {
+  CHECK(file_);
+  if (!header_written_) {
+    if (dtype_ == DTYPE_NATIVE) {
+      dtype_ = sizeof(T) == 4 ? DTYPE_FLOAT32 : DTYPE_FLOAT64;
+    }
+    put_header();
+  }
+  const size_t es = dtype_size();
+  const size_t p = pending_.size();
+  pending_.resize(p + n * es);
+  switch (dtype_) {
+    case DTYPE_FLOAT32:
+      encode_block(n, m, pending_.data() + p, &fbuffer_);
+      break;
+    case DTYPE_FLOAT64:
+      encode_block(n, m, pending_.data() + p, &dbuffer_);
+      break;
+    case DTYPE_FLOAT16:
+      encode_half_block(n, m, pending_.data() + p, &hbuffer_);
+      break;
+    case DTYPE_BFLOAT16:
+      encode_bfloat16_block(n, m, pending_.data() + p, &hbuffer_);
+      break;
+    case DTYPE_INT8:
+      quantize_int8_block(
+          n, cols_, (p / es) % cols_, m, inv_scale_.data(),
+          reinterpret_cast<int8_t*>(pending_.data() + p));
+      break;
+    default:
+      ERROR_FMT("Unsupported FPCA output data type (%d)!", dtype_);
+  }
+  // write all complete chunks
+  const size_t chunk_elems = chunk_rows_ * cols_;
+  const size_t pending_elems = pending_.size() / es;
+  size_t w = 0;
+  for (; w + chunk_elems <= pending_elems; w += chunk_elems) {
+    put_chunk(chunk_elems, pending_.data() + w * es);
+  }
+  pending_.erase(pending_.begin(), pending_.begin() + w * es);
+}
+
+// virtual
+void MatrixFile_FPCA::write_footer() const {
+  CHECK(file_);
+  if (!header_written_) {
+    if (dtype_ == DTYPE_NATIVE) dtype_ = DTYPE_FLOAT32;
+    put_header();
+  }
+  // write the last (incomplete) chunk
+  const size_t pending_elems = pending_.size() / dtype_size();
+  CHECK_FMT(
+      pending_elems % cols_ == 0,
+      "Corrupted matrix (%lu elements are not a multiple of %d columns)!",
+      static_cast<unsigned long>(pending_elems), cols_);
+  if (pending_elems > 0) put_chunk(pending_elems, pending_.data());
+  pending_.clear();
+  // end-of-data mark, index and trailer
+  char end[CHUNK_HEADER_SIZE];
+  memset(end, 0, CHUNK_HEADER_SIZE);
+  write_bytes(end, CHUNK_HEADER_SIZE);
+  const uint64_t index_offset = offset_;
+  vector<char> footer(index_.size() * 8 + TRAILER_SIZE);
+  for (size_t c = 0; c < index_.size(); ++c) {
+    put_u64(footer.data() + c * 8, index_[c]);
+  }
+  char* trailer = footer.data() + index_.size() * 8;
+  put_u64(trailer, index_.size());
+  put_u64(trailer + 8, written_rows_);
+  put_u64(trailer + 16, index_offset);
+  memcpy(trailer + 24, FPCA_INDEX_MAGIC, 8);
+  write_bytes(footer.data(), footer.size());
+  // store the number of rows in the header too, if the file is seekable
+  // (this is not possible when writing to a pipe)
+  const long end_offset = offset_;
+  if (fseek(file_, 16, SEEK_SET) == 0) {
+    char rows[8];
+    put_u64(rows, written_rows_);
+    fwrite(rows, 8, 1, file_);
+    fseek(file_, end_offset, SEEK_SET);
+    // the appended data may be smaller than the previous footer
+    if (appending_) {
+      fflush(file_);
+      CHECK_MSG(
+          ftruncate(fileno(file_), end_offset) == 0,
+          "Failed to write FPCA file!");
+    }
+  }
+  fflush(file_);
+}
+
+bool MatrixFile_FPCA::append() {
+  CHECK(file_);
+  if (!read_header() || footer_offset_ == 0) {
+    unmap();
+    return false;
+  }
+  pending_.clear();
+  written_rows_ = rows_;
+  if (rows_ % chunk_rows_ != 0) {
+    // the last chunk is incomplete: its rows are loaded again, and the
+    // chunk will be written again with the new rows
+    offset_ = index_.back();
+    index_.pop_back();
+    const uint64_t chunk_offset = offset_;
+    CHECK(next_chunk());
+    pending_.assign(chunk_ptr_, chunk_ptr_ + chunk_left_ * dtype_size());
+    written_rows_ -= chunk_left_ / cols_;
+    offset_ = chunk_offset;
+  } else {
+    // overwrite the end-of-data mark
+    offset_ = footer_offset_ - CHUNK_HEADER_SIZE;
+  }
+  unmap();
+  CHECK_MSG(
+      fseek(file_, offset_, SEEK_SET) == 0,
+      "Failed to append data to FPCA file!");
+  header_written_ = true;
+  appending_ = true;
+  return true;
+}
+
+// static
+template <>
+MatrixFile* MatrixFile::Create<FMT_FPCA>() {
+  return new MatrixFile_FPCA;
+}
+
+// static
+template <>
+MatrixFile* MatrixFile::Create<FMT_FPCA>(FILE* file) {
+  return new MatrixFile_FPCA(file);
+}
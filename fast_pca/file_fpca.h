@@ -0,0 +1,173 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef FAST_PCA_FILE_FPCA_H_
+#define FAST_PCA_FILE_FPCA_H_
+
+#include "fast_pca/file.h"
+
+#include <stdint.h>
+
+#include <vector>
+
+using std::vector;
+
+// ------------------------------------------------------------------------
+// ---- Native fast_pca matrix format. All fields are little-endian.
+// ----
+// ---- Header (64 bytes):
+// ----   0 magic "FPCA", 4 version (u16), 6 header size (u16),
+// ----   8 dtype (u32), 12 compression (u32), 16 rows (u64, all ones if
+// ----   unknown when the header was written), 24 cols (u64),
+// ----   32 rows per chunk (u64), 40 reserved (24 bytes).
+// ---- Scales (only for int8 data): the scale of each column (f32, padded
+// ----   to 16 bytes). The value of an element is scale[j] * q.
+// ---- Chunks, each one starting at a 16-byte aligned offset:
+// ----   rows (u32), flags (u32, bit 0: compressed payload),
+// ----   payload size in bytes (u64), payload (padded to 16 bytes).
+// ----   All chunks contain the same number of rows, except the last one.
+// ----   A chunk with zero rows marks the end of the data.
+// ---- Footer:
+// ----   offset of each chunk (u64), followed by a 32-byte trailer:
+// ----   number of chunks (u64), rows (u64), offset of the chunk index (u64)
+// ----   and magic "FPCAIDX1".
+// ----
+// ---- The footer allows to seek to any row in O(1) and to append new rows
+// ---- to an existing file. Files can still be read sequentially from a
+// ---- pipe, without the footer.
+// ------------------------------------------------------------------------
+
+class MatrixFile_FPCA : public MatrixFile {
+ public:
+  typedef enum {
+    DTYPE_NATIVE  = -1,  // same type used to write the data
+    DTYPE_FLOAT32 = 0,
+    DTYPE_FLOAT64 = 1,
+    DTYPE_FLOAT16 = 2,
+    DTYPE_UINT8   = 3,  // uint8 and int16 can only be read
+    DTYPE_INT16   = 4,
+    DTYPE_BFLOAT16 = 5,
+    DTYPE_INT8    = 6   // quantized, with a scale for each column
+  } DTYPE_CODE;
+
+  static const size_t HEADER_SIZE = 64;
+  static const size_t CHUNK_HEADER_SIZE = 16;
+  static const size_t TRAILER_SIZE = 32;
+  // default size of the (uncompressed) chunks, in bytes
+  static const size_t CHUNK_SIZE = 1 << 20;
+
+ protected:
+  // the data type and the number of rows per chunk are decided when the
+  // first block is written, if they were not given explicitly
+  mutable DTYPE_CODE dtype_;
+  COMPRESSION_CODE compression_;
+  mutable uint64_t chunk_rows_;
+  // offsets of all chunks in the file (read from the footer, or written)
+  mutable vector<uint64_t> index_;
+  // offset of the chunk index in the footer
+  uint64_t footer_offset_;
+  // current offset in the file
+  mutable uint64_t offset_;
+  // the whole file is mapped into memory, when possible
+  const char* map_;
+  size_t map_size_;
+  // reading state: elements left in the current chunk, and a pointer
+  // to them (either into map_ or into chunk_)
+  mutable uint64_t chunk_left_;
+  mutable const char* chunk_ptr_;
+  mutable vector<char> chunk_;
+  mutable vector<char> payload_;
+  mutable bool eof_;
+  // writing state: elements pending to be written in the next chunk
+  mutable bool header_written_;
+  mutable vector<char> pending_;
+  mutable uint64_t written_rows_;
+  bool appending_;
+  // staging buffers used to convert data from/to the file types
+  mutable vector<float> fbuffer_;
+  mutable vector<double> dbuffer_;
+  mutable vector<uint16_t> hbuffer_;
+  mutable vector<int16_t> ibuffer_;
+  // scale of each column of int8 data, and its inverse
+  vector<float> scale_;
+  vector<float> inv_scale_;
+
+  size_t dtype_size() const;
+  void reset();
+  void unmap();
+  bool read_index();
+  void read_bytes(void* dst, size_t n) const;
+  void write_bytes(const void* src, size_t n) const;
+  bool next_chunk() const;
+  void put_header() const;
+  void put_chunk(size_t n, const char* data) const;
+
+ public:
+  MatrixFile_FPCA() : MatrixFile(FMT_FPCA) { reset(); }
+  explicit MatrixFile_FPCA(FILE* file) : MatrixFile(FMT_FPCA, file) {
+    reset();
+  }
+  virtual ~MatrixFile_FPCA() { unmap(); }
+
+  inline void dtype(DTYPE_CODE dtype) { dtype_ = dtype; }
+  inline void compression(COMPRESSION_CODE c) { compression_ = c; }
+  inline void chunk_rows(uint64_t n) { chunk_rows_ = n; }
+  inline DTYPE_CODE dtype() const { return dtype_; }
+  inline COMPRESSION_CODE compression() const { return compression_; }
+  inline uint64_t chunk_rows() const { return chunk_rows_; }
+
+  virtual bool copy_header_from(const MatrixFile& other);
+  virtual bool output_type(ELEM_TYPE type, const vector<float>& scale);
+  virtual bool read_header();
+  virtual void write_header() const;
+  virtual void write_footer() const;
+
+  // Move the reader to the given row, using the index in the footer.
+  // Returns false if the file has no index or the row is out of range.
+  bool seek_row(uint64_t row);
+
+  // Prepare an existing file (opened with mode "r+b") to append new rows
+  // with write_block(). The file must be completed with write_footer().
+  bool append();
+
+  template <typename T>
+  int read_block(int n, T* m) const;
+  template <typename T>
+  void write_block(int n, const T* m) const;
+
+  virtual int read_block(int n, float* m) const {
+    return read_block<float>(n, m);
+  }
+  virtual int read_block(int n, double* m) const {
+    return read_block<double>(n, m);
+  }
+  virtual void write_block(int n, const float* m) const {
+    write_block<float>(n, m);
+  }
+  virtual void write_block(int n, const double* m) const {
+    write_block<double>(n, m);
+  }
+};
+
+#endif  // FAST_PCA_FILE_FPCA_H_
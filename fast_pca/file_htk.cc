@@ -27,9 +27,16 @@
 
 // virtual
 bool MatrixFile_HTK::copy_header_from(const MatrixFile& other) {
-  if (other.format() != format_) return false;
   rows_ = other.rows();
   cols_ = other.cols();
+  if (other.format() != format_) {
+    // data from other formats is stored as user defined features
+    nSamples_ = rows_;
+    sampPeriod_ = other.sample_period();
+    sampSize_ = cols_ * 4;
+    parmKind_ = USER;
+    return true;
+  }
   const MatrixFile_HTK* other_htk = static_cast<const MatrixFile_HTK*>(&other);
   nSamples_ = other_htk->nSamples_;
   sampPeriod_ = other_htk->sampPeriod_;
@@ -75,39 +82,35 @@ void MatrixFile_HTK::write_header() const {
 int MatrixFile_HTK::read_block(int n, float* m) const {
   CHECK(file_);
   n = fread(m, 4, n, file_);
-  for (int i = 0; i < n; ++i) {
-    m[i] = beftoh(m[i]);
-  }
+  betoh_block(n, m);
   return n;
 }
 
 // virtual
 int MatrixFile_HTK::read_block(int n, double* m) const {
   CHECK(file_);
-  int i = 0;
-  float f = 0;
-  for (; i < n && fread(&f, 4, 1, file_) == 1; ++i) {
-    m[i] = beftoh(f);
-  }
-  return i;
+  buffer_.resize(n);
+  n = fread(buffer_.data(), 4, n, file_);
+  betoh_block(n, buffer_.data());
+  cast_block(n, buffer_.data(), m);
+  return n;
 }
 
 // virtual
 void MatrixFile_HTK::write_block(int n, const float* m) const {
   CHECK(file_);
-  for (int i = 0; i < n; ++i) {
-    const float f = htobef(m[i]);
-    fwrite(&f, 4, 1, file_);
-  }
+  buffer_.assign(m, m + n);
+  htobe_block(n, buffer_.data());
+  fwrite(buffer_.data(), 4, n, file_);
 }
 
 // virtual
 void MatrixFile_HTK::write_block(int n, const double* m) const {
   CHECK(file_);
-  for (int i = 0; i < n; ++i) {
-    const float f = htobef(m[i]);
-    fwrite(&f, 4, 1, file_);
-  }
+  buffer_.resize(n);
+  cast_block(n, m, buffer_.data());
+  htobe_block(n, buffer_.data());
+  fwrite(buffer_.data(), 4, n, file_);
 }
 
 // static
@@ -27,20 +27,33 @@
 
 #include "fast_pca/file.h"
 
+#include <vector>
+
+using std::vector;
+
 class MatrixFile_HTK : public MatrixFile {
  protected:
   uint32_t nSamples_;
   uint32_t sampPeriod_;
   uint16_t sampSize_;
   uint16_t parmKind_;
+  // staging buffer used to convert data from/to big-endian floats
+  mutable vector<float> buffer_;
 
  public:
-  MatrixFile_HTK() : MatrixFile(FMT_HTK) {}
+  // HTK parameter kind of user defined features
+  static const uint16_t USER = 9;
+
+  MatrixFile_HTK() :
+      MatrixFile(FMT_HTK), nSamples_(0), sampPeriod_(0), sampSize_(0),
+      parmKind_(USER) {}
   explicit MatrixFile_HTK(FILE* file) :
-      MatrixFile(file), nSamples_(0), sampPeriod_(0), sampSize_(0),
-      parmKind_(0) { }
+      MatrixFile(FMT_HTK, file), nSamples_(0), sampPeriod_(0), sampSize_(0),
+      parmKind_(USER) { }
 
   virtual bool copy_header_from(const MatrixFile& other);
+  virtual uint32_t sample_period() const { return sampPeriod_; }
+  virtual bool needs_rows() const { return true; }
   virtual bool read_header();
   virtual void write_header() const;
 
@@ -0,0 +1,391 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "fast_pca/file_kaldi.h"
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+#include "fast_pca/endian.h"
+
+// read a token, terminated by a space, from a Kaldi binary stream
+static string read_token(FILE* f) {
+  string token;
+  int c;
+  while ((c = getc(f)) != EOF && c != ' ') token += static_cast<char>(c);
+  CHECK_MSG(c == ' ', "Corrupted Kaldi archive (unexpected EOF)!");
+  return token;
+}
+
+// read a binary 32-bit integer (preceeded by its size) from a Kaldi stream
+static int32_t read_int32(FILE* f) {
+  char b[5];
+  CHECK_MSG(
+      fread(b, 1, 5, f) == 5 && b[0] == 4,
+      "Corrupted Kaldi archive (bad integer)!");
+  int32_t v;
+  memcpy(&v, b + 1, 4);
+  return le32toh(v);
+}
+
+static void write_int32(FILE* f, int32_t v) {
+  char b[5] = {4};
+  v = htole32(v);
+  memcpy(b + 1, &v, 4);
+  fwrite(b, 1, 5, f);
+}
+
+// skip n bytes from a stream, which may not be seekable
+static void skip_bytes(FILE* f, uint64_t n) {
+  if (n == 0 || fseek(f, n, SEEK_CUR) == 0) return;
+  char buf[4096];
+  while (n > 0) {
+    const size_t k = n < sizeof(buf) ? n : sizeof(buf);
+    CHECK_MSG(
+        fread(buf, 1, k, f) == k, "Corrupted Kaldi archive (unexpected EOF)!");
+    n -= k;
+  }
+}
+
+// decode a 16-bit value of a compressed matrix
+static inline float uint16_to_float(float min_value, float range, uint16_t v) {
+  return min_value + range * 1.52590218966964e-05F * v;
+}
+
+// decode an 8-bit value of a compressed matrix, using column percentiles
+static inline float uint8_to_float(
+    float p0, float p25, float p75, float p100, uint8_t v) {
+  if (v <= 64) {
+    return p0 + (p25 - p0) * v * (1 / 64.0f);
+  } else if (v <= 192) {
+    return p25 + (p75 - p25) * (v - 64) * (1 / 128.0f);
+  } else {
+    return p75 + (p100 - p75) * (v - 192) * (1 / 63.0f);
+  }
+}
+
+void MatrixFile_Kaldi::close_ark() {
+  if (ark_) fclose(ark_);
+  ark_ = nullptr;
+  ark_name_ = "";
+}
+
+void MatrixFile_Kaldi::decode_compressed(const char* data, size_t size) {
+  float min_value, range;
+  memcpy(&min_value, data, 4);
+  memcpy(&range, data + 4, 4);
+  const uint64_t n = static_cast<uint64_t>(rows_) * cols_;
+  decoded_.resize(n);
+  if (type_ == KALDI_CM) {
+    // column headers with 4 percentiles, followed by the data of each
+    // column (column-major order)
+    CHECK_MSG(
+        size == 8 * cols_ + n, "Corrupted Kaldi compressed matrix!");
+    const char* headers = data + 16;
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(
+        headers + 8 * cols_);
+    for (int j = 0; j < cols_; ++j) {
+      uint16_t p[4];
+      memcpy(p, headers + 8 * j, 8);
+      const float p0 = uint16_to_float(min_value, range, le16toh(p[0]));
+      const float p25 = uint16_to_float(min_value, range, le16toh(p[1]));
+      const float p75 = uint16_to_float(min_value, range, le16toh(p[2]));
+      const float p100 = uint16_to_float(min_value, range, le16toh(p[3]));
+      const uint8_t* col = bytes + static_cast<uint64_t>(j) * rows_;
+      for (int i = 0; i < rows_; ++i) {
+        decoded_[static_cast<uint64_t>(i) * cols_ + j] =
+            uint8_to_float(p0, p25, p75, p100, col[i]);
+      }
+    }
+  } else if (type_ == KALDI_CM2) {
+    CHECK_MSG(size == 2 * n, "Corrupted Kaldi compressed matrix!");
+    const float inc = range * (1.0 / 65535.0);
+    for (uint64_t i = 0; i < n; ++i) {
+      uint16_t v;
+      memcpy(&v, data + 16 + 2 * i, 2);
+      decoded_[i] = min_value + le16toh(v) * inc;
+    }
+  } else {
+    CHECK_MSG(size == n, "Corrupted Kaldi compressed matrix!");
+    const float inc = range * (1.0 / 255.0);
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data + 16);
+    for (uint64_t i = 0; i < n; ++i) {
+      decoded_[i] = min_value + bytes[i] * inc;
+    }
+  }
+}
+
+void MatrixFile_Kaldi::read_matrix() {
+  char b[2];
+  CHECK_FMT(
+      fread(b, 1, 2, stream_) == 2 && b[0] == '\0' && b[1] == 'B',
+      "Only binary Kaldi archives are supported (entry \"%s\")!",
+      key_.c_str());
+  const string token = read_token(stream_);
+  pos_ = 0;
+  decoded_.clear();
+  if (token == "FM" || token == "DM") {
+    type_ = token == "FM" ? KALDI_FM : KALDI_DM;
+    rows_ = read_int32(stream_);
+    cols_ = read_int32(stream_);
+  } else if (token == "CM" || token == "CM2" || token == "CM3") {
+    type_ = token == "CM" ? KALDI_CM : (token == "CM2" ? KALDI_CM2 : KALDI_CM3);
+    // global header: min_value, range, rows and cols
+    char header[16];
+    CHECK_MSG(
+        fread(header, 1, 16, stream_) == 16,
+        "Corrupted Kaldi archive (unexpected EOF)!");
+    int32_t rows, cols;
+    memcpy(&rows, header + 8, 4);
+    memcpy(&cols, header + 12, 4);
+    rows_ = le32toh(rows);
+    cols_ = le32toh(cols);
+    CHECK_FMT(
+        rows_ >= 0 && cols_ >= 0,
+        "Corrupted Kaldi matrix (entry \"%s\")!", key_.c_str());
+    const uint64_t n = static_cast<uint64_t>(rows_) * cols_;
+    const uint64_t size =
+        type_ == KALDI_CM ? 8 * cols_ + n : (type_ == KALDI_CM2 ? 2 * n : n);
+    buffer_.resize(16 + size);
+    memcpy(buffer_.data(), header, 16);
+    CHECK_MSG(
+        fread(buffer_.data() + 16, 1, size, stream_) == size,
+        "Corrupted Kaldi archive (unexpected EOF)!");
+    decode_compressed(buffer_.data(), size);
+  } else {
+    ERROR_FMT(
+        "Unsupported Kaldi object \"%s\" (entry \"%s\"), only matrices are "
+        "supported!", token.c_str(), key_.c_str());
+  }
+  CHECK_FMT(
+      rows_ >= 0 && cols_ >= 0,
+      "Corrupted Kaldi matrix (entry \"%s\")!", key_.c_str());
+}
+
+bool MatrixFile_Kaldi::read_entry(bool first) {
+  // read key, skipping leading whitespaces
+  int c;
+  while ((c = getc(file_)) == ' ' || c == '\t' || c == '\n' || c == '\r') {}
+  if (c == EOF) return false;
+  key_.clear();
+  for (; c != EOF && c != ' ' && c != '\t' && c != '\n'; c = getc(file_)) {
+    key_ += static_cast<char>(c);
+  }
+  CHECK_FMT(
+      c == ' ' || c == '\t', "Corrupted Kaldi archive/script (entry \"%s\")!",
+      key_.c_str());
+  if (first) {
+    // archives have a binary marker after the key, scripts do not
+    c = getc(file_);
+    ungetc(c, file_);
+    scp_ = (c != '\0');
+  }
+  if (!scp_) {
+    stream_ = file_;
+  } else {
+    // script line: key ark_filename:offset
+    string loc;
+    while ((c = getc(file_)) == ' ' || c == '\t') {}
+    for (; c != EOF && c != '\n'; c = getc(file_)) loc += static_cast<char>(c);
+    while (!loc.empty() && (loc.back() == ' ' || loc.back() == '\r')) {
+      loc.pop_back();
+    }
+    const size_t colon = loc.rfind(':');
+    char* end = nullptr;
+    const long offset =
+        colon == string::npos ? -1 : strtol(loc.c_str() + colon + 1, &end, 10);
+    CHECK_FMT(
+        offset >= 0 && end && *end == '\0',
+        "Unsupported location \"%s\" in Kaldi script (entry \"%s\"), "
+        "expected \"archive:offset\"!", loc.c_str(), key_.c_str());
+    const string ark_name = loc.substr(0, colon);
+    if (ark_name != ark_name_) {
+      close_ark();
+      ark_ = fopen(ark_name.c_str(), "rb");
+      CHECK_FMT(ark_, "Failed to open Kaldi archive \"%s\"!", ark_name.c_str());
+      ark_name_ = ark_name;
+    }
+    CHECK_FMT(
+        fseek(ark_, offset, SEEK_SET) == 0,
+        "Failed to read entry \"%s\" from Kaldi archive \"%s\"!",
+        key_.c_str(), ark_name.c_str());
+    stream_ = ark_;
+  }
+  read_matrix();
+  return true;
+}
+
+// virtual
+bool MatrixFile_Kaldi::copy_header_from(const MatrixFile& other) {
+  rows_ = other.rows();
+  cols_ = other.cols();
+  if (other.format() != format_) {
+    // the key is the name of the matrix, if it has one
+    key_ = other.matrix_name();
+    type_ = KALDI_FM;
+    return true;
+  }
+  const MatrixFile_Kaldi* other_kaldi =
+      static_cast<const MatrixFile_Kaldi*>(&other);
+  key_ = other_kaldi->key_;
+  // compressed matrices are written as float matrices
+  type_ = other_kaldi->type_ == KALDI_DM ? KALDI_DM : KALDI_FM;
+  return true;
+}
+
+// virtual
+bool MatrixFile_Kaldi::output_type(
+    ELEM_TYPE type, const vector<float>& scale) {
+  switch (type) {
+    case ELEM_TYPE_NATIVE:
+      return true;
+    case ELEM_TYPE_FLOAT32:
+      type_ = KALDI_FM;
+      return true;
+    case ELEM_TYPE_FLOAT64:
+      type_ = KALDI_DM;
+      return true;
+    default:
+      return false;
+  }
+}
+
+// virtual
+bool MatrixFile_Kaldi::read_header() {
+  CHECK(file_);
+  return read_entry(true);
+}
+
+// virtual
+bool MatrixFile_Kaldi::read_next_header() {
+  CHECK(file_);
+  // skip the elements of the current matrix which were not read
+  if (!scp_ && (type_ == KALDI_FM || type_ == KALDI_DM)) {
+    const uint64_t n = static_cast<uint64_t>(rows_) * cols_ - pos_;
+    skip_bytes(stream_, n * (type_ == KALDI_FM ? 4 : 8));
+  }
+  return read_entry(false);
+}
+
+template <typename T>
+int MatrixFile_Kaldi::read_block(int n, T* m) const {
+  CHECK(file_);
+  const uint64_t left = static_cast<uint64_t>(rows_) * cols_ - pos_;
+  if (static_cast<uint64_t>(n) > left) n = left;
+  if (n <= 0) return 0;
+  if (type_ == KALDI_FM || type_ == KALDI_DM) {
+    const size_t es = type_ == KALDI_FM ? 4 : 8;
+    if (es == sizeof(T)) {
+      n = fread(m, sizeof(T), n, stream_);
+      letoh_block(n, m);
+    } else if (es == 4) {
+      buffer_.resize(n * es);
+      float* tmp = reinterpret_cast<float*>(buffer_.data());
+      n = fread(tmp, es, n, stream_);
+      letoh_block(n, tmp);
+      cast_block(n, tmp, m);
+    } else {
+      buffer_.resize(n * es);
+      double* tmp = reinterpret_cast<double*>(buffer_.data());
+      n = fread(tmp, es, n, stream_);
+      letoh_block(n, tmp);
+      cast_block(n, tmp, m);
+    }
+  } else {
+    cast_block(n, decoded_.data() + pos_, m);
+  }
+  pos_ += n;
+  return n;
+}
+
+void MatrixFile_Kaldi::close_entry() const {
+  if (!open_entry_) return;
+  CHECK_FMT(
+      written_ == static_cast<uint64_t>(rows_) * cols_,
+      "Kaldi matrix \"%s\" must have %d rows and %d columns, but %lu "
+      "elements were written!", key_.c_str(), rows_, cols_,
+      static_cast<unsigned long>(written_));
+  open_entry_ = false;
+}
+
+// virtual
+void MatrixFile_Kaldi::write_header() const {
+  CHECK(file_);
+  close_entry();
+  CHECK_MSG(
+      rows_ >= 0 && cols_ >= 0,
+      "The size of a Kaldi matrix must be known before writing it!");
+  // matrices without a key (e.g. not read from a Kaldi archive) are named
+  // after their position in the archive
+  char name[32];
+  snprintf(name, sizeof(name), "%d", entries_);
+  const string& key = key_.empty() ? string(name) : key_;
+  fwrite(key.c_str(), 1, key.size(), file_);
+  fwrite(type_ == KALDI_DM ? " \0BDM " : " \0BFM ", 1, 6, file_);
+  write_int32(file_, rows_);
+  write_int32(file_, cols_);
+  written_ = 0;
+  open_entry_ = true;
+  ++entries_;
+}
+
+template <typename T>
+void MatrixFile_Kaldi::write_block(int n, const T* m) const {
+  CHECK(file_);
+  const size_t es = type_ == KALDI_DM ? 8 : 4;
+  buffer_.resize(n * es);
+  if (es == 4) {
+    float* tmp = reinterpret_cast<float*>(buffer_.data());
+    cast_block(n, m, tmp);
+    htole_block(n, tmp);
+  } else {
+    double* tmp = reinterpret_cast<double*>(buffer_.data());
+    cast_block(n, m, tmp);
+    htole_block(n, tmp);
+  }
+  CHECK_MSG(
+      fwrite(buffer_.data(), es, n, file_) == static_cast<size_t>(n),
+      "Failed to write Kaldi archive!");
+  written_ += n;
+}
+
+// virtual
+void MatrixFile_Kaldi::write_footer() const {
+  CHECK(file_);
+  close_entry();
+  entries_ = 0;
+}
+
+// static
+template <>
+MatrixFile* MatrixFile::Create<FMT_KALDI>() {
+  return new MatrixFile_Kaldi;
+}
+
+// static
+template <>
+MatrixFile* MatrixFile::Create<FMT_KALDI>(FILE* file) {
+  return new MatrixFile_Kaldi(file);
+}
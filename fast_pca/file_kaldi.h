@@ -0,0 +1,140 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef FAST_PCA_FILE_KALDI_H_
+#define FAST_PCA_FILE_KALDI_H_
+
+#include "fast_pca/file.h"
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+// ------------------------------------------------------------------------
+// ---- Kaldi binary archives (ark) and script files (scp).
+// ---- Each entry of an archive is a matrix with its own key: the reader
+// ---- moves to the next entry with read_next_header(), and the writer
+// ---- writes a new entry with each call to write_header(), keeping the
+// ---- key copied from the reader.
+// ---- Float (FM) and double (DM) matrices are supported, as well as all
+// ---- types of compressed matrices (CM, CM2, CM3), which are decoded to
+// ---- single precision.
+// ---- Script files are detected automatically: each line contains the key
+// ---- and the location (ark:offset) of a matrix, which is read directly
+// ---- from the referenced archive.
+// ------------------------------------------------------------------------
+
+class MatrixFile_Kaldi : public MatrixFile {
+ public:
+  typedef enum {
+    KALDI_FM  = 0,  // float matrix
+    KALDI_DM  = 1,  // double matrix
+    KALDI_CM  = 2,  // compressed matrix, 8 bits per element and column headers
+    KALDI_CM2 = 3,  // compressed matrix, 16 bits per element
+    KALDI_CM3 = 4   // compressed matrix, 8 bits per element
+  } KALDI_TYPE;
+
+ protected:
+  string key_;
+  KALDI_TYPE type_;
+  // reading from a script file: the archive that is currently open
+  bool scp_;
+  string ark_name_;
+  FILE* ark_;
+  // stream containing the data of the current matrix
+  FILE* stream_;
+  // number of elements read from the current matrix
+  mutable uint64_t pos_;
+  // compressed matrices are decoded completely when the header is read
+  vector<float> decoded_;
+  // writing state: number of entries and elements written
+  mutable int entries_;
+  mutable uint64_t written_;
+  mutable bool open_entry_;
+  // staging buffer used to convert data from/to the file types
+  mutable vector<char> buffer_;
+
+  bool read_entry(bool first);
+  void read_matrix();
+  void decode_compressed(const char* data, size_t size);
+  void close_ark();
+  void close_entry() const;
+
+ public:
+  MatrixFile_Kaldi() : MatrixFile(FMT_KALDI) { reset(); }
+  explicit MatrixFile_Kaldi(FILE* file) : MatrixFile(FMT_KALDI, file) {
+    reset();
+  }
+  virtual ~MatrixFile_Kaldi() { close_ark(); }
+
+  inline void reset() {
+    type_ = KALDI_FM;
+    scp_ = false;
+    ark_ = nullptr;
+    stream_ = nullptr;
+    pos_ = 0;
+    entries_ = 0;
+    written_ = 0;
+    open_entry_ = false;
+  }
+
+  inline const string& key() const { return key_; }
+  inline void key(const string& key) { key_ = key; }
+  inline KALDI_TYPE type() const { return type_; }
+  inline void type(KALDI_TYPE type) { type_ = type; }
+
+  virtual bool copy_header_from(const MatrixFile& other);
+  virtual string matrix_name() const { return key_; }
+  virtual bool needs_rows() const { return true; }
+  // matrices can be written as float or double matrices
+  virtual bool output_type(ELEM_TYPE type, const vector<float>& scale);
+  virtual bool read_header();
+  virtual bool read_next_header();
+  virtual void write_header() const;
+  virtual void write_footer() const;
+
+  template <typename T>
+  int read_block(int n, T* m) const;
+  template <typename T>
+  void write_block(int n, const T* m) const;
+
+  virtual int read_block(int n, float* m) const {
+    return read_block<float>(n, m);
+  }
+  virtual int read_block(int n, double* m) const {
+    return read_block<double>(n, m);
+  }
+  virtual void write_block(int n, const float* m) const {
+    write_block<float>(n, m);
+  }
+  virtual void write_block(int n, const double* m) const {
+    write_block<double>(n, m);
+  }
+};
+
+#endif  // FAST_PCA_FILE_KALDI_H_
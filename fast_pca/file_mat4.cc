@@ -26,43 +26,81 @@
 #include "fast_pca/endian.h"
 
 // read from a file, using a given type TF, swap the bytes optionally, and
-// then write to the buffer with type TT
+// then write to the buffer with type TT. The data is read into the staging
+// buffer, which is reused across blocks.
 template <typename TF, typename TT, bool swap>
-int read_swap_cast_block(FILE* f, int n, TT* m) {
-  TF t = 0;
-  int i = 0;
-  for (; i < n && fread(&t, sizeof(TF), 1, f) == 1; ++i) {
-    if (swap) swap_bytes<sizeof(TF)>(&t);
-    m[i] = t;
-  }
-  return i;
+int read_swap_cast_block(FILE* f, int n, TT* m, vector<char>* buffer) {
+  buffer->resize(sizeof(TF) * n);
+  TF* b = reinterpret_cast<TF*>(buffer->data());
+  n = fread(b, sizeof(TF), n, f);
+  if (swap) swap_bytes_block<sizeof(TF)>(n, b);
+  cast_block(n, b, m);
+  return n;
+}
+
+template <typename TF, typename TT>
+int read_swap_cast_block(
+    FILE* f, int n, TT* m, bool swap, vector<char>* buffer) {
+  return swap ?
+      read_swap_cast_block<TF, TT, true>(f, n, m, buffer) :
+      read_swap_cast_block<TF, TT, false>(f, n, m, buffer);
 }
 
 // write a block of data to a file, data is first casted to the output
-// type and, optionally, bytes are swapped.
+// type (in the staging buffer) and, optionally, bytes are swapped.
 template <typename TF, typename TT, bool swap>
-void write_swap_cast_block(FILE* f, int n, const TF* m) {
-  for (int i = 0; i < n; ++i) {
-    TT t = m[i];
-    if (swap) swap_bytes<sizeof(TT)>(&t);
-    fwrite(&t, sizeof(TT), 1, f);
-  }
+void write_swap_cast_block(
+    FILE* f, int n, const TF* m, vector<char>* buffer) {
+  buffer->resize(sizeof(TT) * n);
+  TT* b = reinterpret_cast<TT*>(buffer->data());
+  cast_block(n, m, b);
+  if (swap) swap_bytes_block<sizeof(TT)>(n, b);
+  fwrite(b, sizeof(TT), n, f);
 }
 
 // virtual
 bool MatrixFile_MAT4::copy_header_from(const MatrixFile& other) {
-  if (other.format() != format_) return false;
   rows_ = other.rows();
   cols_ = other.cols();
+  if (other.format() != format_) {
+    // matrices from other formats are written in double precision, in the
+    // native byte order, and named X unless their name is valid
+    name_ = is_variable_name(other.matrix_name()) ? other.matrix_name() : "X";
+    mopt_ = 0;
+    prec_ = 0;
+    order_ = 0;
+    swap_ = false;
+    return true;
+  }
   const MatrixFile_MAT4* other_mat4 =
       static_cast<const MatrixFile_MAT4*>(&other);
   name_ = other_mat4->name_;
   mopt_ = other_mat4->mopt_;
-  prec_ = other_mat4->prec_;
+  // integer matrices are written in double precision, since the written
+  // data (e.g. projected data) is not integer
+  prec_ = other_mat4->prec_ < 2 ? other_mat4->prec_ : 0;
+  order_ = other_mat4->order_;
   swap_ = other_mat4->swap_;
   return true;
 }
 
+// virtual
+bool MatrixFile_MAT4::output_type(
+    ELEM_TYPE type, const vector<float>& scale) {
+  switch (type) {
+    case ELEM_TYPE_NATIVE:
+      return true;
+    case ELEM_TYPE_FLOAT32:
+      prec_ = 1;
+      return true;
+    case ELEM_TYPE_FLOAT64:
+      prec_ = 0;
+      return true;
+    default:
+      return false;
+  }
+}
+
 // virtual
 bool MatrixFile_MAT4::read_header() {
   CHECK(file_);
@@ -145,25 +183,26 @@ int MatrixFile_MAT4::read_block(int n, T* m) const {
   CHECK(file_);
   if (prec_ == type2prec<T>::prec) {
     n = fread(m, sizeof(T), n, file_);
-    if (swap_) {
-      for (int i = 0; i < n; ++i) swap_bytes<sizeof(T)>(m + i);
-    }
+    if (swap_) swap_bytes_block<sizeof(T)>(n, m);
     return n;
-  } else if (prec_ == 0) {
-    if (swap_)
-      return read_swap_cast_block<double, T, true>(file_, n, m);
-    else
-      return read_swap_cast_block<double, T, false>(file_, n, m);
-  } else if (prec_ == 1) {
-    if (swap_)
-      return read_swap_cast_block<float, T, true>(file_, n, m);
-    else
-      return read_swap_cast_block<float, T, false>(file_, n, m);
-  } else {
-    // TODO(jpuigcerver) Support additional casting
-    ERROR_FMT(
-        "With MAT-v4 cannot read from type %d to %d", prec_,
-        type2prec<T>::prec);
+  }
+  switch (prec_) {
+    case 0:
+      return read_swap_cast_block<double>(file_, n, m, swap_, &buffer_);
+    case 1:
+      return read_swap_cast_block<float>(file_, n, m, swap_, &buffer_);
+    case 2:
+      return read_swap_cast_block<int32_t>(file_, n, m, swap_, &buffer_);
+    case 3:
+      return read_swap_cast_block<int16_t>(file_, n, m, swap_, &buffer_);
+    case 4:
+      return read_swap_cast_block<uint16_t>(file_, n, m, swap_, &buffer_);
+    case 5:
+      return read_swap_cast_block<uint8_t>(file_, n, m, swap_, &buffer_);
+    default:
+      ERROR_FMT(
+          "With MAT-v4 cannot read from type %d to %d", prec_,
+          type2prec<T>::prec);
   }
 }
 
@@ -172,19 +211,19 @@ void MatrixFile_MAT4::write_block(int n, const T* m) const {
   CHECK(file_);
   if (prec_ == type2prec<T>::prec) {
     if (swap_)
-      write_swap_cast_block<T, T, true>(file_, n, m);
+      write_swap_cast_block<T, T, true>(file_, n, m, &buffer_);
     else
       fwrite(m, sizeof(T), n, file_);
   } else if (prec_ == 0) {
     if (swap_)
-      write_swap_cast_block<T, double, true>(file_, n, m);
+      write_swap_cast_block<T, double, true>(file_, n, m, &buffer_);
     else
-      write_swap_cast_block<T, double, false>(file_, n, m);
+      write_swap_cast_block<T, double, false>(file_, n, m, &buffer_);
   } else if (prec_ == 1) {
     if (swap_)
-      write_swap_cast_block<T, float, true>(file_, n, m);
+      write_swap_cast_block<T, float, true>(file_, n, m, &buffer_);
     else
-      write_swap_cast_block<T, float, false>(file_, n, m);
+      write_swap_cast_block<T, float, false>(file_, n, m, &buffer_);
   } else {
     // TODO(jpuigcerver) Support additional casting
     ERROR_FMT(
@@ -40,6 +40,8 @@ class MatrixFile_MAT4 : public MatrixFile {
   uint32_t prec_;
   char order_;
   bool swap_;
+  // staging buffer used to convert/swap the data read or written
+  mutable vector<char> buffer_;
 
   // this is used to map a given type T to its precision ID,
   // according to MAT-v4 format file.
@@ -48,12 +50,13 @@ class MatrixFile_MAT4 : public MatrixFile {
   struct type2prec { static uint8_t prec; };
 
  public:
-  MatrixFile_MAT4() : MatrixFile(FMT_MAT4) {}
+  MatrixFile_MAT4() :
+      MatrixFile(FMT_MAT4), mopt_(0), prec_(0), order_(0), swap_(0) {}
   explicit MatrixFile_MAT4(FILE* file) :
-      MatrixFile(file), mopt_(0), prec_(0), order_(0), swap_(0) {}
+      MatrixFile(FMT_MAT4, file), mopt_(0), prec_(0), order_(0), swap_(0) {}
   explicit MatrixFile_MAT4(
       FILE* file, int rows, int cols, const string& name, uint8_t prec) :
-      MatrixFile(file), name_(name), mopt_(0), prec_(prec), order_(0),
+      MatrixFile(FMT_MAT4, file), name_(name), mopt_(0), prec_(prec), order_(0),
       swap_(0) {
     MatrixFile::rows_ = rows;
     MatrixFile::cols_ = cols;
@@ -64,6 +67,10 @@ class MatrixFile_MAT4 : public MatrixFile {
   inline const string& name() const { return name_; }
 
   virtual bool copy_header_from(const MatrixFile& other);
+  virtual string matrix_name() const { return name_; }
+  virtual bool needs_rows() const { return true; }
+  // matrices can be written in single or double precision
+  virtual bool output_type(ELEM_TYPE type, const vector<float>& scale);
   virtual bool read_header();
   virtual void write_header() const;
 
@@ -0,0 +1,440 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "fast_pca/file_npy.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+#include "fast_pca/endian.h"
+#include "fast_pca/float16.h"
+#include "fast_pca/quantize.h"
+#include "fast_pca/uring.h"
+
+static const char NPY_MAGIC[6] = {'\x93', 'N', 'U', 'M', 'P', 'Y'};
+// number of rows transposed at once, when reading Fortran-ordered data
+static const int NPY_TRANSPOSE_ROWS = 64;
+
+// decode n elements of type TF (optionally swapping their bytes) into the
+// buffer m of type TT
+template <typename TF, typename TT>
+static void decode_block(
+    size_t n, const char* src, bool swap, TT* m, vector<char>* buf) {
+  buf->resize(n * sizeof(TF));
+  memcpy(buf->data(), src, n * sizeof(TF));
+  TF* tmp = reinterpret_cast<TF*>(buf->data());
+  if (swap) swap_bytes_block<sizeof(TF)>(n, tmp);
+  cast_block(n, tmp, m);
+}
+
+// same type: copy the data directly into the output buffer
+template <typename T>
+static void decode_same_block(size_t n, const char* src, bool swap, T* m) {
+  memcpy(m, src, n * sizeof(T));
+  if (swap) swap_bytes_block<sizeof(T)>(n, m);
+}
+
+template <typename T>
+static void decode_half_block(
+    size_t n, const char* src, bool swap, T* m, vector<char>* buf) {
+  buf->resize(n * 2);
+  memcpy(buf->data(), src, n * 2);
+  uint16_t* tmp = reinterpret_cast<uint16_t*>(buf->data());
+  if (swap) swap_bytes_block<2>(n, tmp);
+  half_to_real_block(n, tmp, m);
+}
+
+// look for the value of the given key in the header dictionary
+static const char* find_npy_key(const string& header, const char* key) {
+  const size_t k = header.find(key);
+  if (k == string::npos) return nullptr;
+  const size_t c = header.find(':', k + strlen(key));
+  if (c == string::npos) return nullptr;
+  const char* p = header.c_str() + c + 1;
+  while (*p == ' ') ++p;
+  return p;
+}
+
+void MatrixFile_NPY::reset() {
+  kind_ = 0;
+  size_ = 0;
+  swap_ = false;
+  fortran_ = false;
+  map_ = nullptr;
+  map_size_ = 0;
+  data_ = nullptr;
+  pos_ = 0;
+  header_written_ = false;
+  header_rows_ = 0;
+  written_ = 0;
+}
+
+void MatrixFile_NPY::unmap() {
+  if (map_) munmap(const_cast<char*>(map_), map_size_);
+  map_ = nullptr;
+  map_size_ = 0;
+}
+
+bool MatrixFile_NPY::parse_header(const string& header) {
+  // type of the elements, e.g. '<f4'
+  const char* p = find_npy_key(header, "'descr'");
+  if (!p || (*p != '\'' && *p != '"')) return false;
+  const char order = p[1];
+  kind_ = p[2];
+  size_ = atoi(p + 3);
+  if (order != '<' && order != '>' && order != '|' && order != '=')
+    return false;
+  CHECK_FMT(
+      ((kind_ == 'i' || kind_ == 'u') &&
+       (size_ == 1 || size_ == 2 || size_ == 4 || size_ == 8)) ||
+      (kind_ == 'f' && (size_ == 2 || size_ == 4 || size_ == 8)),
+      "Unsupported NPY data type (%c%d)!", kind_, size_);
+  swap_ = (order == '>' && !is_big_endian()) ||
+      (order == '<' && is_big_endian());
+  // ordering of the elements
+  p = find_npy_key(header, "'fortran_order'");
+  if (!p) return false;
+  if (strncmp(p, "True", 4) == 0) {
+    fortran_ = true;
+  } else if (strncmp(p, "False", 5) == 0) {
+    fortran_ = false;
+  } else {
+    return false;
+  }
+  // shape of the matrix. Vectors are treated as a single column, and
+  // the trailing dimensions of C-ordered arrays are flattened.
+  p = find_npy_key(header, "'shape'");
+  if (!p || *p != '(') return false;
+  vector<uint64_t> shape;
+  for (++p; *p != ')'; ) {
+    char* end = nullptr;
+    const uint64_t d = strtoull(p, &end, 10);
+    if (end == p) return false;
+    shape.push_back(d);
+    for (p = end; *p == ' ' || *p == ','; ++p) {}
+  }
+  CHECK_MSG(
+      !shape.empty(), "Scalar NPY arrays are not supported!");
+  CHECK_MSG(
+      !fortran_ || shape.size() <= 2,
+      "Fortran-ordered NPY arrays with more than 2 dimensions are not "
+      "supported!");
+  uint64_t cols = 1;
+  for (size_t d = 1; d < shape.size(); ++d) cols *= shape[d];
+  CHECK_MSG(
+      shape[0] <= static_cast<uint64_t>(INT_MAX) && cols > 0 &&
+      cols <= static_cast<uint64_t>(INT_MAX),
+      "Unsupported NPY array shape!");
+  rows_ = shape[0];
+  cols_ = cols;
+  return true;
+}
+
+// virtual
+bool MatrixFile_NPY::copy_header_from(const MatrixFile& other) {
+  rows_ = other.rows();
+  cols_ = other.cols();
+  // matrices from other formats are written with the type of the data
+  if (other.format() != format_) {
+    kind_ = 0;
+    size_ = 0;
+    return true;
+  }
+  // keep the same floating point type, integers are written as floats
+  const MatrixFile_NPY* other_npy = static_cast<const MatrixFile_NPY*>(&other);
+  kind_ = other_npy->kind_ == 'f' ? 'f' : 0;
+  size_ = other_npy->kind_ == 'f' ? other_npy->size_ : 0;
+  return true;
+}
+
+// virtual
+bool MatrixFile_NPY::output_type(ELEM_TYPE type, const vector<float>& scale) {
+  switch (type) {
+    case ELEM_TYPE_NATIVE:
+      break;
+    case ELEM_TYPE_FLOAT32:
+      dtype('f', 4);
+      break;
+    case ELEM_TYPE_FLOAT64:
+      dtype('f', 8);
+      break;
+    case ELEM_TYPE_FLOAT16:
+      dtype('f', 2);
+      break;
+    case ELEM_TYPE_BFLOAT16:
+      dtype('u', 2);
+      break;
+    case ELEM_TYPE_INT8:
+      CHECK(scale.size() == static_cast<size_t>(cols_));
+      inv_scale_.resize(cols_);
+      for (int j = 0; j < cols_; ++j) inv_scale_[j] = 1.0f / scale[j];
+      dtype('i', 1);
+      break;
+    default:
+      return false;
+  }
+  return true;
+}
+
+// virtual
+bool MatrixFile_NPY::read_header() {
+  CHECK(file_);
+  unmap();
+  data_buffer_.clear();
+  data_ = nullptr;
+  pos_ = 0;
+  char prefix[12];
+  if (fread(prefix, 1, 10, file_) != 10) return false;
+  CHECK_MSG(
+      memcmp(prefix, NPY_MAGIC, 6) == 0,
+      "Invalid NPY file (bad magic number)!");
+  size_t header_len = 0, offset = 10;
+  if (prefix[6] == 1) {
+    header_len = static_cast<uint8_t>(prefix[8]) |
+        (static_cast<uint8_t>(prefix[9]) << 8);
+  } else if (prefix[6] == 2 || prefix[6] == 3) {
+    if (fread(prefix + 10, 1, 2, file_) != 2) return false;
+    uint32_t len;
+    memcpy(&len, prefix + 8, 4);
+    header_len = le32toh(len);
+    offset = 12;
+  } else {
+    ERROR_FMT("Unsupported NPY file version (%d)!", prefix[6]);
+  }
+  string header(header_len, ' ');
+  if (fread(&header[0], 1, header_len, file_) != header_len) return false;
+  CHECK_FMT(
+      parse_header(header), "Invalid NPY header: %s", header.c_str());
+  offset += header_len;
+  const uint64_t data_size = static_cast<uint64_t>(rows_) * cols_ * size_;
+  // regular files are mapped into memory
+  struct stat st;
+  if (fstat(uring_fd(file_), &st) == 0 && S_ISREG(st.st_mode) &&
+      st.st_size > 0) {
+    void* p = mmap(
+        nullptr, st.st_size, PROT_READ, MAP_SHARED, uring_fd(file_), 0);
+    if (p != MAP_FAILED) {
+      map_ = static_cast<const char*>(p);
+      map_size_ = st.st_size;
+      CHECK_MSG(
+          offset + data_size <= map_size_,
+          "Corrupted NPY file (the data is truncated)!");
+      madvise(p, st.st_size, fortran_ ? MADV_NORMAL : MADV_SEQUENTIAL);
+      data_ = map_ + offset;
+    }
+  }
+  // Fortran-ordered data from a pipe must be loaded completely
+  if (!data_ && fortran_) {
+    data_buffer_.resize(data_size);
+    CHECK_MSG(
+        fread(data_buffer_.data(), 1, data_size, file_) == data_size,
+        "Corrupted NPY file (the data is truncated)!");
+    data_ = data_buffer_.data();
+  }
+  return true;
+}
+
+template <typename T>
+void MatrixFile_NPY::decode(size_t n, const char* src, T* m) const {
+  switch (kind_) {
+    case 'f':
+      if (size_ == 2) {
+        decode_half_block(n, src, swap_, m, &buffer_);
+      } else if (size_ == sizeof(T)) {
+        decode_same_block(n, src, swap_, m);
+      } else if (size_ == 4) {
+        decode_block<float>(n, src, swap_, m, &buffer_);
+      } else {
+        decode_block<double>(n, src, swap_, m, &buffer_);
+      }
+      break;
+    case 'i':
+      if (size_ == 1) decode_block<int8_t>(n, src, swap_, m, &buffer_);
+      else if (size_ == 2) decode_block<int16_t>(n, src, swap_, m, &buffer_);
+      else if (size_ == 4) decode_block<int32_t>(n, src, swap_, m, &buffer_);
+      else decode_block<int64_t>(n, src, swap_, m, &buffer_);
+      break;
+    default:
+      if (size_ == 1) decode_block<uint8_t>(n, src, swap_, m, &buffer_);
+      else if (size_ == 2) decode_block<uint16_t>(n, src, swap_, m, &buffer_);
+      else if (size_ == 4) decode_block<uint32_t>(n, src, swap_, m, &buffer_);
+      else decode_block<uint64_t>(n, src, swap_, m, &buffer_);
+  }
+}
+
+template <typename T>
+int MatrixFile_NPY::read_block(int n, T* m) const {
+  CHECK(file_);
+  const uint64_t total = static_cast<uint64_t>(rows_) * cols_;
+  n = std::min<uint64_t>(n, total - pos_);
+  if (n <= 0) return 0;
+  if (!fortran_) {
+    if (data_) {
+      decode(n, data_ + pos_ * size_, m);
+    } else {
+      raw_.resize(n * size_);
+      n = fread(raw_.data(), size_, n, file_);
+      decode(n, raw_.data(), m);
+    }
+    pos_ += n;
+    return n;
+  }
+  // Fortran-ordered data: transpose blocks of rows, each column of the
+  // block is contiguous in the file
+  CHECK_MSG(
+      pos_ % cols_ == 0 && n >= cols_,
+      "Fortran-ordered NPY arrays must be read in complete rows!");
+  const int r0 = pos_ / cols_;
+  const int nr = n / cols_;
+  T col[NPY_TRANSPOSE_ROWS];
+  for (int rb = 0; rb < nr; rb += NPY_TRANSPOSE_ROWS) {
+    const int k = std::min(NPY_TRANSPOSE_ROWS, nr - rb);
+    for (int j = 0; j < cols_; ++j) {
+      const uint64_t src = static_cast<uint64_t>(j) * rows_ + r0 + rb;
+      decode(k, data_ + src * size_, col);
+      for (int i = 0; i < k; ++i) m[(rb + i) * cols_ + j] = col[i];
+    }
+  }
+  pos_ += static_cast<uint64_t>(nr) * cols_;
+  return nr * cols_;
+}
+
+void MatrixFile_NPY::put_header(uint64_t rows) const {
+  char header[HEADER_SIZE];
+  memcpy(header, NPY_MAGIC, 6);
+  header[6] = 1;
+  header[7] = 0;
+  header[8] = (HEADER_SIZE - 10) & 0xFF;
+  header[9] = (HEADER_SIZE - 10) >> 8;
+  const int len = snprintf(
+      header + 10, HEADER_SIZE - 10,
+      "{'descr': '<%c%d', 'fortran_order': False, 'shape': (%lu, %d), }",
+      kind_, size_, static_cast<unsigned long>(rows), cols_);
+  CHECK(len > 0 && len + 11 <= static_cast<int>(HEADER_SIZE));
+  // the dictionary is padded with spaces and ends with a newline
+  memset(header + 10 + len, ' ', HEADER_SIZE - 11 - len);
+  header[HEADER_SIZE - 1] = '\n';
+  CHECK_MSG(
+      fwrite(header, 1, HEADER_SIZE, file_) == HEADER_SIZE,
+      "Failed to write NPY file!");
+  header_rows_ = rows;
+}
+
+// virtual
+void MatrixFile_NPY::write_header() const {
+  CHECK(file_);
+  // the header is actually written with the first block, once the type of
+  // the data is known
+  header_written_ = false;
+  written_ = 0;
+}
+
+template <typename T>
+void MatrixFile_NPY::write_block(int n, const T* m) const {
+  CHECK(file_);
+  if (!header_written_) {
+    if (kind_ == 0) {
+      kind_ = 'f';
+      size_ = sizeof(T);
+    }
+    CHECK_FMT(
+        (kind_ == 'f' && (size_ == 2 || size_ == 4 || size_ == 8)) ||
+        (kind_ == 'u' && size_ == 2) || (kind_ == 'i' && size_ == 1),
+        "Unsupported NPY output data type (%c%d)!", kind_, size_);
+    put_header(rows_ > 0 ? rows_ : 0);
+    header_written_ = true;
+  }
+  buffer_.resize(n * size_);
+  if (kind_ == 'i') {
+    quantize_int8_block(
+        n, cols_, written_ % cols_, m, inv_scale_.data(),
+        reinterpret_cast<int8_t*>(buffer_.data()));
+  } else if (size_ == 2) {
+    // 'u2' elements are bfloat16 numbers
+    uint16_t* tmp = reinterpret_cast<uint16_t*>(buffer_.data());
+    if (kind_ == 'f') real_to_half_block(n, m, tmp);
+    else real_to_bfloat16_block(n, m, tmp);
+    htole_block(n, tmp);
+  } else if (size_ == 4) {
+    float* tmp = reinterpret_cast<float*>(buffer_.data());
+    cast_block(n, m, tmp);
+    htole_block(n, tmp);
+  } else {
+    double* tmp = reinterpret_cast<double*>(buffer_.data());
+    cast_block(n, m, tmp);
+    htole_block(n, tmp);
+  }
+  CHECK_MSG(
+      fwrite(buffer_.data(), size_, n, file_) == static_cast<size_t>(n),
+      "Failed to write NPY file!");
+  written_ += n;
+}
+
+// virtual
+void MatrixFile_NPY::write_footer() const {
+  CHECK(file_);
+  if (!header_written_) {
+    if (kind_ == 0) {
+      kind_ = 'f';
+      size_ = 4;
+    }
+    put_header(0);
+    header_written_ = true;
+  }
+  CHECK_FMT(
+      written_ % cols_ == 0,
+      "Corrupted matrix (%lu elements are not a multiple of %d columns)!",
+      static_cast<unsigned long>(written_), cols_);
+  const uint64_t rows = written_ / cols_;
+  if (rows == header_rows_) return;
+  // update the number of rows in the header
+  const long end = HEADER_SIZE + written_ * size_;
+  if (fseek(file_, 0, SEEK_SET) == 0) {
+    put_header(rows);
+    fseek(file_, end, SEEK_SET);
+  } else {
+    WARN_FMT(
+        "The number of rows in the NPY header (%lu) could not be updated "
+        "to %lu, since the output file is not seekable!",
+        static_cast<unsigned long>(header_rows_),
+        static_cast<unsigned long>(rows));
+  }
+}
+
+// static
+template <>
+MatrixFile* MatrixFile::Create<FMT_NPY>() {
+  return new MatrixFile_NPY;
+}
+
+// static
+template <>
+MatrixFile* MatrixFile::Create<FMT_NPY>(FILE* file) {
+  return new MatrixFile_NPY(file);
+}
@@ -0,0 +1,127 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef FAST_PCA_FILE_NPY_H_
+#define FAST_PCA_FILE_NPY_H_
+
+#include "fast_pca/file.h"
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+// ------------------------------------------------------------------------
+// ---- NumPy .npy format. The header is parsed to obtain the type of the
+// ---- elements (floats of 2, 4 or 8 bytes and signed/unsigned integers),
+// ---- the ordering (C or Fortran) and the shape of the matrix.
+// ---- Regular files are mapped into memory. Fortran-ordered matrices are
+// ---- transposed on the fly, in blocks of rows.
+// ---- When writing, the header has a fixed size (128 bytes), so that the
+// ---- number of rows can be updated at the end, once it is known.
+// ---- NumPy has no bfloat16 type: bfloat16 data is written as '<u2'
+// ---- (the raw bits, i.e. the upper half of the float32 numbers). Data
+// ---- quantized to 8-bit integers is written as '<i1', without the scales
+// ---- (fast_pca writes them to a side file).
+// ------------------------------------------------------------------------
+
+class MatrixFile_NPY : public MatrixFile {
+ public:
+  static const size_t HEADER_SIZE = 128;
+
+ protected:
+  // element type: kind ('f', 'i' or 'u') and size in bytes. When writing,
+  // the type is decided when the first block is written, if it was not
+  // given explicitly.
+  mutable char kind_;
+  mutable int size_;
+  bool swap_;
+  bool fortran_;
+  // the data of regular files is mapped into memory. The data of
+  // Fortran-ordered matrices read from a pipe is loaded into memory.
+  const char* map_;
+  size_t map_size_;
+  vector<char> data_buffer_;
+  const char* data_;
+  // number of elements read (in row-major order)
+  mutable uint64_t pos_;
+  // writing state
+  mutable bool header_written_;
+  mutable uint64_t header_rows_;
+  mutable uint64_t written_;
+  // staging buffers used to read and convert data from/to the file types
+  mutable vector<char> raw_;
+  mutable vector<char> buffer_;
+  // inverse of the scale of each column, when writing 8-bit integers
+  vector<float> inv_scale_;
+
+  void reset();
+  void unmap();
+  bool parse_header(const string& header);
+  void put_header(uint64_t rows) const;
+  template <typename T>
+  void decode(size_t n, const char* src, T* m) const;
+
+ public:
+  MatrixFile_NPY() : MatrixFile(FMT_NPY) { reset(); }
+  explicit MatrixFile_NPY(FILE* file) : MatrixFile(FMT_NPY, file) {
+    reset();
+  }
+  virtual ~MatrixFile_NPY() { unmap(); }
+
+  // set the type of the elements to write (e.g. 'f', 4)
+  inline void dtype(char kind, int size) { kind_ = kind; size_ = size; }
+  inline char kind() const { return kind_; }
+  inline int size() const { return size_; }
+  inline bool fortran_order() const { return fortran_; }
+
+  virtual bool copy_header_from(const MatrixFile& other);
+  virtual bool output_type(ELEM_TYPE type, const vector<float>& scale);
+  virtual bool read_header();
+  virtual void write_header() const;
+  virtual void write_footer() const;
+
+  template <typename T>
+  int read_block(int n, T* m) const;
+  template <typename T>
+  void write_block(int n, const T* m) const;
+
+  virtual int read_block(int n, float* m) const {
+    return read_block<float>(n, m);
+  }
+  virtual int read_block(int n, double* m) const {
+    return read_block<double>(n, m);
+  }
+  virtual void write_block(int n, const float* m) const {
+    write_block<float>(n, m);
+  }
+  virtual void write_block(int n, const double* m) const {
+    write_block<double>(n, m);
+  }
+};
+
+#endif  // FAST_PCA_FILE_NPY_H_
@@ -77,16 +77,17 @@ bool read_keyword(FILE* file, const string& key, T* val) {
 
 // virtual
 bool MatrixFile_Octave::copy_header_from(const MatrixFile& other) {
-  if (other.format() != format_) return false;
   rows_ = other.rows();
   cols_ = other.cols();
-  name_ = static_cast<const MatrixFile_Octave*>(&other)->name_;
+  // matrices from other formats are named X, unless their name is valid
+  name_ = is_variable_name(other.matrix_name()) ? other.matrix_name() : "X";
   return true;
 }
 
 // virtual
 bool MatrixFile_Octave::read_header() {
   CHECK(file_);
+  MatrixFile_Text::read_header();
   string type = "";
   if (!read_keyword(file_, "name", &name_)) return false;
   if (!read_keyword(file_, "type", &type) || type != "matrix") return false;
@@ -106,36 +107,16 @@ void MatrixFile_Octave::write_header() const {
   fprintf(file_, "# columns: %d\n", cols_);
 }
 
-// virtual
-int MatrixFile_Octave::read_block(int n, float* m) const {
-  CHECK(file_);
-  int i = 0;
-  for (; i < n && fscanf(file_, "%f", m + i) == 1; ++i) { }
-  return i;
-}
-
-// virtual
-int MatrixFile_Octave::read_block(int n, double* m) const {
-  CHECK(file_);
-  int i = 0;
-  for (; i < n && fscanf(file_, "%lf", m + i) == 1; ++i) { }
-  return i;
-}
-
 // virtual
 void MatrixFile_Octave::write_block(int n, const float* m) const {
-  CHECK(file_);
-  if (n <= 0) return;
-  for (int i = 0; i < n - 1; ++i) fprintf(file_, "%.16g ", m[i]);
-  fprintf(file_, "%.16g\n", m[n - 1]);
+  // the whole block is written in a single line
+  write_text_block(file_, n, n, m, threads_);
 }
 
 // virtual
 void MatrixFile_Octave::write_block(int n, const double* m) const {
-  CHECK(file_);
-  if (n <= 0) return;
-  for (int i = 0; i < n - 1; ++i) fprintf(file_, "%.16g ", m[i]);
-  fprintf(file_, "%.16g\n", m[n - 1]);
+  // the whole block is written in a single line
+  write_text_block(file_, n, n, m, threads_);
 }
 
 // static
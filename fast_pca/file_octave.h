@@ -26,25 +26,27 @@
 #define FAST_PCA_FILE_OCTAVE_H_
 
 #include "fast_pca/file.h"
+#include "fast_pca/file_text.h"
 
 #include <string>
 
 using std::string;
 
-class MatrixFile_Octave : public MatrixFile {
+class MatrixFile_Octave : public MatrixFile_Text {
  protected:
   string name_;
 
  public:
-  MatrixFile_Octave() : MatrixFile(FMT_OCTAVE) {}
-  explicit MatrixFile_Octave(FILE* file) : MatrixFile(file), name_("") {}
+  MatrixFile_Octave() : MatrixFile_Text(FMT_OCTAVE) {}
+  explicit MatrixFile_Octave(FILE* file) :
+      MatrixFile_Text(FMT_OCTAVE, file), name_("") {}
 
   virtual bool copy_header_from(const MatrixFile& other);
+  virtual string matrix_name() const { return name_; }
+  virtual bool needs_rows() const { return true; }
   virtual bool read_header();
   virtual void write_header() const;
 
-  virtual int read_block(int n, float* m) const;
-  virtual int read_block(int n, double* m) const;
   virtual void write_block(int n, const float* m) const;
   virtual void write_block(int n, const double* m) const;
 };
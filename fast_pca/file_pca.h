@@ -30,6 +30,7 @@
 #include <vector>
 
 #include "fast_pca/file_mat4.h"
+#include "fast_pca/stats.h"
 
 template <typename real_t>
 void save_n_mean_cov(
@@ -37,10 +38,12 @@ void save_n_mean_cov(
     const vector<real_t>& c) {
   FILE* out_f = stdout;
   if (fname != "") { out_f = open_file(fname.c_str(), "w"); }
+  STATS_SCOPE(STATS_WRITE);
+  STATS_COUNT(STATS_WRITE, sizeof(real_t) * (m.size() + c.size()), 0);
   MatrixFile_MAT4::save(out_f, "N", n);
   MatrixFile_MAT4::save(out_f, "M", 1, d, m);
   MatrixFile_MAT4::save(out_f, "C", d, d, c);
-  fclose(out_f);
+  close_file(out_f);
 }
 
 template <typename real_t>
@@ -49,6 +52,7 @@ void load_n_mean_cov(
     vector<real_t>* c) {
   FILE* file = stdin;
   if (fname != "") { file = open_file(fname.c_str(), "rb"); }
+  STATS_SCOPE(STATS_READ);
   string ts;
   int tr = -1, tc = -1;
   int32_t si = 0;
@@ -77,7 +81,8 @@ void load_n_mean_cov(
       tr == *d && tc == *d,
       "Size of matrix C (%dx%d) is different than the expected (%dx%d) in "
       "file \"%s\"!", tr, tc, *d, *d, fname.c_str());
-  fclose(file);
+  STATS_COUNT(STATS_READ, sizeof(real_t) * (m->size() + c->size()), 0);
+  close_file(file);
 }
 
 // fname        -> (input) file to store the pca data, "" for stdout
@@ -100,13 +105,17 @@ void save_pca(
   const int pca_odim = eigval.size();
   FILE* file = stdout;
   if (fname != "") file = open_file(fname.c_str(), "wb");
+  STATS_SCOPE(STATS_WRITE);
+  STATS_COUNT(
+      STATS_WRITE, sizeof(real_t) * (2 * idim + eigval.size() + eigvec.size()),
+      0);
   MatrixFile_MAT4::save(file, "E", static_cast<int32_t>(exclude_dims));
   MatrixFile_MAT4::save(file, "R", miss_energy);
   MatrixFile_MAT4::save(file, "M", idim, 1, mean);
   MatrixFile_MAT4::save(file, "S", idim, 1, stddev);
   MatrixFile_MAT4::save(file, "D", 1, pca_odim, eigval);
   MatrixFile_MAT4::save(file, "V", pca_odim, pca_idim, eigvec);
-  fclose(file);
+  close_file(file);
 }
 
 // fname        -> (input)  file to store the pca data, "" for stdout
@@ -131,6 +140,7 @@ void load_pca(
   MatrixFile_MAT4::load(file, &ts, &si);
   CHECK_FMT(
       ts == "E", "Failed to read E in file \"%s\"!", fname.c_str());
+  *exclude_dims = si;
   // read missing energy, not included in the eigenvalues
   MatrixFile_MAT4::load(file, &ts, remaining_energy);
   CHECK_FMT(
@@ -162,7 +172,7 @@ void load_pca(
   CHECK_FMT(
       ts == "V" && tr >= 0 && tc >= 0,
       "Failed to read matrix V in file \"%s\"!", fname.c_str());
-  fclose(file);
+  close_file(file);
 }
 
 #endif  // FAST_PCA_FILE_PCA_H_
@@ -0,0 +1,541 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "fast_pca/file_text.h"
+
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "fast_pca/logging.h"
+#include "fast_pca/memory.h"
+#include "fast_pca/stats.h"
+#include "fast_pca/uring.h"
+
+using std::min;
+using std::thread;
+using std::vector;
+
+// Minimum number of elements per thread when formatting a block. Below
+// this, the cost of launching a thread is not worth it.
+static const int MIN_ELEMENTS_PER_THREAD = 1 << 14;
+
+// ------------------------------------------------------------------------
+// ---- Shortest round-trip formatting of floating point numbers, based on
+// ---- the Grisu2 algorithm: "Printing Floating-Point Numbers Quickly and
+// ---- Accurately with Integers", Florian Loitsch, PLDI 2010.
+// ---- The generated digits are always parsed back into the same number,
+// ---- and they are the shortest possible for ~99.9% of the numbers.
+// ------------------------------------------------------------------------
+
+namespace {
+
+// "Do-it-yourself" floating point number: f * 2^e
+struct DiyFp {
+  uint64_t f;
+  int e;
+  DiyFp() : f(0), e(0) {}
+  DiyFp(uint64_t f_, int e_) : f(f_), e(e_) {}
+
+  DiyFp operator-(const DiyFp& rhs) const { return DiyFp(f - rhs.f, e); }
+
+  // Product of the two 64-bit significands, rounded to the upper 64 bits
+  DiyFp operator*(const DiyFp& rhs) const {
+    const uint64_t M32 = 0xFFFFFFFFULL;
+    const uint64_t a = f >> 32, b = f & M32;
+    const uint64_t c = rhs.f >> 32, d = rhs.f & M32;
+    const uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+    tmp += 1ULL << 31;  // round
+    return DiyFp(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), e + rhs.e + 64);
+  }
+
+  DiyFp normalize() const {
+#if defined(__GNUC__)
+    const int s = __builtin_clzll(f);
+    return DiyFp(f << s, e - s);
+#else
+    DiyFp r = *this;
+    while (!(r.f & (1ULL << 63))) { r.f <<= 1; r.e--; }
+    return r;
+#endif
+  }
+};
+
+// Binary layout of the IEEE-754 float and double types
+template <typename real_t> struct IEEE754;
+template <> struct IEEE754<float> {
+  typedef uint32_t bits_t;
+  static const int significand_size = 23;
+  static const int exponent_bias = 127 + 23;
+  static const int max_digits = 9;
+};
+template <> struct IEEE754<double> {
+  typedef uint64_t bits_t;
+  static const int significand_size = 52;
+  static const int exponent_bias = 1023 + 52;
+  static const int max_digits = 17;
+};
+
+// Decompose the finite and positive number x into its significand and
+// exponent (v), and the boundaries (m-, m+) of the interval of real numbers
+// that are rounded to x, normalized to the same exponent.
+template <typename real_t>
+void compute_boundaries(real_t x, DiyFp* v, DiyFp* m_minus, DiyFp* m_plus) {
+  typedef typename IEEE754<real_t>::bits_t bits_t;
+  const int p = IEEE754<real_t>::significand_size;
+  const uint64_t hidden = 1ULL << p;
+  bits_t bits;
+  memcpy(&bits, &x, sizeof(real_t));
+  const uint64_t sig = bits & (hidden - 1);
+  const int exp = static_cast<int>(bits >> p);
+  if (exp != 0) {
+    *v = DiyFp(sig + hidden, exp - IEEE754<real_t>::exponent_bias);
+  } else {
+    *v = DiyFp(sig, 1 - IEEE754<real_t>::exponent_bias);
+  }
+  const DiyFp pl = DiyFp((v->f << 1) + 1, v->e - 1).normalize();
+  DiyFp mi = (v->f == hidden) ?
+      DiyFp((v->f << 2) - 1, v->e - 2) : DiyFp((v->f << 1) - 1, v->e - 1);
+  mi.f <<= mi.e - pl.e;
+  mi.e = pl.e;
+  *m_plus = pl;
+  *m_minus = mi;
+}
+
+// Normalized 64-bit approximations of 10^k, for k = -348, -340, ..., 340
+const uint64_t CACHED_POWERS_F[] = {
+  0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+  0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+  0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+  0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+  0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+  0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+  0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+  0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+  0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+  0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+  0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+  0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+  0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+  0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+  0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+  0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+  0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+  0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+  0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+  0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+  0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+  0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+  0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+  0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+  0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+  0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+  0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+  0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+  0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+const int16_t CACHED_POWERS_E[] = {
+  -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+  -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+  -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+  -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+  -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+  109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+  375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+  641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+  907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+// Returns a cached power c = 10^-k, such that the binary exponent of
+// c * 2^e is in the range [-60, -32].
+DiyFp get_cached_power(int e, int* k) {
+  const double dk = (-61 - e) * 0.30102999566398114 + 347;
+  int ik = static_cast<int>(dk);
+  if (dk - ik > 0.0) ++ik;
+  const unsigned index = static_cast<unsigned>((ik >> 3) + 1);
+  *k = -(-348 + static_cast<int>(index << 3));
+  return DiyFp(CACHED_POWERS_F[index], CACHED_POWERS_E[index]);
+}
+
+const uint32_t POW10[] = {
+  1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+int count_decimal_digits(uint32_t n) {
+  int d = 1;
+  while (d < 10 && n >= POW10[d]) ++d;
+  return d;
+}
+
+void grisu_round(
+    char* buffer, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa,
+    uint64_t wp_w) {
+  while (rest < wp_w && delta - rest >= ten_kappa &&
+         (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+    buffer[len - 1]--;
+    rest += ten_kappa;
+  }
+}
+
+// Generate the digits of w, which are in the range (mp - delta, mp).
+void digit_gen(
+    const DiyFp& w, const DiyFp& mp, uint64_t delta, char* buffer, int* len,
+    int* k) {
+  const DiyFp one(1ULL << -mp.e, mp.e);
+  const DiyFp wp_w = mp - w;
+  uint32_t p1 = static_cast<uint32_t>(mp.f >> -one.e);
+  uint64_t p2 = mp.f & (one.f - 1);
+  int kappa = count_decimal_digits(p1);
+  *len = 0;
+  while (kappa > 0) {
+    const uint32_t d = p1 / POW10[kappa - 1];
+    p1 %= POW10[kappa - 1];
+    if (d || *len) buffer[(*len)++] = static_cast<char>('0' + d);
+    --kappa;
+    const uint64_t tmp = (static_cast<uint64_t>(p1) << -one.e) + p2;
+    if (tmp <= delta) {
+      *k += kappa;
+      grisu_round(
+          buffer, *len, delta, tmp,
+          static_cast<uint64_t>(POW10[kappa]) << -one.e, wp_w.f);
+      return;
+    }
+  }
+  for (;;) {
+    p2 *= 10;
+    delta *= 10;
+    const char d = static_cast<char>(p2 >> -one.e);
+    if (d || *len) buffer[(*len)++] = static_cast<char>('0' + d);
+    p2 &= one.f - 1;
+    --kappa;
+    if (p2 < delta) {
+      *k += kappa;
+      const int index = -kappa;
+      grisu_round(
+          buffer, *len, delta, p2, one.f,
+          wp_w.f * (index < 10 ? POW10[index] : 0));
+      return;
+    }
+  }
+}
+
+// Digits and decimal exponent of x: x = digits * 10^k
+template <typename real_t>
+void grisu2(real_t x, char* digits, int* len, int* k) {
+  DiyFp v, m_minus, m_plus;
+  compute_boundaries(x, &v, &m_minus, &m_plus);
+  const DiyFp c_mk = get_cached_power(m_plus.e, k);
+  const DiyFp W = v.normalize() * c_mk;
+  DiyFp Wp = m_plus * c_mk;
+  DiyFp Wm = m_minus * c_mk;
+  Wm.f++;
+  Wp.f--;
+  digit_gen(W, Wp, Wp.f - Wm.f, digits, len, k);
+}
+
+// Write the digits into buf, using the fixed or the scientific notation,
+// following the same criterion as the %g format of printf().
+int format_digits(
+    const char* digits, int len, int k, int max_digits, char* buf) {
+  const int e10 = len + k - 1;  // exponent in the scientific notation
+  char* p = buf;
+  if (e10 >= -4 && e10 < max_digits) {
+    if (e10 < 0) {
+      // 0.000ddd
+      *p++ = '0';
+      *p++ = '.';
+      for (int i = -1; i > e10; --i) *p++ = '0';
+      memcpy(p, digits, len);
+      p += len;
+    } else if (len <= e10 + 1) {
+      // ddd000
+      memcpy(p, digits, len);
+      p += len;
+      for (int i = len; i <= e10; ++i) *p++ = '0';
+    } else {
+      // dd.ddd
+      memcpy(p, digits, e10 + 1);
+      p += e10 + 1;
+      *p++ = '.';
+      memcpy(p, digits + e10 + 1, len - e10 - 1);
+      p += len - e10 - 1;
+    }
+  } else {
+    // d.ddde+XX
+    *p++ = digits[0];
+    if (len > 1) {
+      *p++ = '.';
+      memcpy(p, digits + 1, len - 1);
+      p += len - 1;
+    }
+    *p++ = 'e';
+    *p++ = e10 < 0 ? '-' : '+';
+    const int ae = e10 < 0 ? -e10 : e10;
+    if (ae >= 100) *p++ = static_cast<char>('0' + ae / 100);
+    *p++ = static_cast<char>('0' + (ae / 10) % 10);
+    *p++ = static_cast<char>('0' + ae % 10);
+  }
+  return p - buf;
+}
+
+template <typename real_t>
+int format_real_impl(real_t x, char* buf) {
+  if (std::isnan(x)) {
+    memcpy(buf, "nan", 3);
+    return 3;
+  }
+  char* p = buf;
+  if (std::signbit(x)) {
+    *p++ = '-';
+    x = -x;
+  }
+  if (std::isinf(x)) {
+    memcpy(p, "inf", 3);
+    return p + 3 - buf;
+  }
+  if (x == 0) {
+    *p++ = '0';
+    return p - buf;
+  }
+  char digits[24];
+  int len = 0, k = 0;
+  grisu2(x, digits, &len, &k);
+  return p - buf + format_digits(
+      digits, len, k, IEEE754<real_t>::max_digits, p);
+}
+
+}  // namespace
+
+int format_real(float x, char* buf) {
+  return format_real_impl(x, buf);
+}
+
+int format_real(double x, char* buf) {
+  return format_real_impl(x, buf);
+}
+
+// Format the n elements of m into buf, which must have enough space to
+// hold n * (FORMAT_REAL_MAX_CHARS + 1) characters. Returns the number of
+// written characters.
+template <typename real_t>
+static size_t format_text_block(
+    int n, int cols, const real_t* m, char* buf) {
+  char* p = buf;
+  for (int i = 0; i < n; ++i) {
+    p += format_real(m[i], p);
+    *p++ = ((i + 1) % cols == 0) ? '\n' : ' ';
+  }
+  return p - buf;
+}
+
+template <typename real_t>
+void write_text_block(
+    FILE* file, int n, int cols, const real_t* m, int threads) {
+  CHECK(file);
+  CHECK(cols > 0);
+  if (n <= 0) return;
+  const int rows = (n + cols - 1) / cols;
+  if (threads > n / MIN_ELEMENTS_PER_THREAD)
+    threads = n / MIN_ELEMENTS_PER_THREAD;
+  if (threads > rows) threads = rows;
+  if (threads < 1) threads = 1;
+  // Each thread formats a contiguous range of rows into its own buffer
+  const int rows_per_thread = (rows + threads - 1) / threads;
+  vector< vector<char> > buf(threads);
+  vector<size_t> len(threads, 0);
+  vector<thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    const int i0 = t * rows_per_thread * cols;
+    const int i1 = min(n, (t + 1) * rows_per_thread * cols);
+    if (i0 >= i1) continue;
+    buf[t].resize(static_cast<size_t>(i1 - i0) * (FORMAT_REAL_MAX_CHARS + 1));
+    if (t + 1 < threads) {
+      workers.push_back(thread([=, &buf, &len]() {
+            len[t] = format_text_block(i1 - i0, cols, m + i0, buf[t].data());
+          }));
+    } else {
+      // The main thread formats the last chunk
+      len[t] = format_text_block(i1 - i0, cols, m + i0, buf[t].data());
+    }
+  }
+  for (size_t t = 0; t < workers.size(); ++t) workers[t].join();
+  // Write the chunks, in order
+  for (int t = 0; t < threads; ++t) {
+    if (len[t] == 0) continue;
+    CHECK_MSG(fwrite(buf[t].data(), 1, len[t], file) == len[t],
+              "Failed to write text block!");
+  }
+}
+
+template
+void write_text_block<float>(FILE*, int, int, const float*, int);
+template
+void write_text_block<double>(FILE*, int, int, const double*, int);
+
+static bool is_regular_file(FILE* file) {
+  struct stat st;
+  return fstat(uring_fd(file), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+template <typename real_t>
+real_t str_to_real(const char* s, char** e);
+
+template <>
+float str_to_real<float>(const char* s, char** e) { return strtof(s, e); }
+
+template <>
+double str_to_real<double>(const char* s, char** e) { return strtod(s, e); }
+
+// Parse all the elements in the range [b, e) and append them to vals.
+// Returns false if a non-numeric token was found, the rest of the range is
+// ignored in that case (this mimics the behavior of fscanf).
+// NOTE: The range must end with a whitespace or a '\0' character.
+template <typename real_t>
+static bool parse_text_range(
+    const char* b, const char* e, vector<real_t>* vals) {
+  vals->reserve((e - b) / 8);
+  for (const char* p = b; ; ) {
+    while (p < e && isspace(*p)) ++p;
+    if (p >= e) return true;
+    char* q = NULL;
+    const real_t v = str_to_real<real_t>(p, &q);
+    if (q == p) return false;
+    vals->push_back(v);
+    p = q;
+  }
+}
+
+// Read a new chunk of the file and parse it, leaving the parsed elements
+// in vals. Returns false if the end of file was already reached.
+template <typename real_t>
+bool MatrixFile_Text::read_chunk(vector<real_t>* vals) const {
+  vals->clear();
+  next_ = 0;
+  if (eof_) return false;
+  // Read data until the end of file or a line break is found. Characters
+  // after the last line break are kept for the next chunk.
+  // bytes read from the file for each thread, planned with the memory limit
+  const size_t thread_bytes = Memory::ChunkBytes();
+  const size_t chunk_bytes = threads_ * thread_bytes;
+  size_t len = chunk_.size(), end = 0;
+  while (!eof_ && end == 0) {
+    chunk_.resize(len + chunk_bytes + 1);
+    const size_t r = fread(chunk_.data() + len, 1, chunk_bytes, file_);
+    eof_ = r < chunk_bytes;
+    for (size_t i = len + r; !eof_ && i > len; --i) {
+      if (chunk_[i - 1] == '\n') { end = i; break; }
+    }
+    len += r;
+  }
+  if (eof_) end = len;
+  chunk_[len] = '\0';
+  // Split the chunk into ranges of lines and parse them concurrently
+  const int num_ranges = end / thread_bytes + 1;
+  const int nr = num_ranges < threads_ ? num_ranges : threads_;
+  vector<size_t> bound(nr + 1, end);
+  bound[0] = 0;
+  for (int t = 1; t < nr; ++t) {
+    size_t b = std::max(bound[t - 1], t * (end / nr));
+    while (b < end && chunk_[b] != '\n') ++b;
+    bound[t] = b < end ? b + 1 : end;
+  }
+  STATS_SCOPE(STATS_PARSE);
+  vector< vector<real_t> > part(nr);
+  vector<char> ok(nr, 1);
+  vector<thread> workers;
+  for (int t = 1; t < nr; ++t) {
+    workers.push_back(thread([=, &part, &ok]() {
+          ok[t] = parse_text_range(
+              chunk_.data() + bound[t], chunk_.data() + bound[t + 1], &part[t]);
+        }));
+  }
+  ok[0] = parse_text_range(
+      chunk_.data() + bound[0], chunk_.data() + bound[1], &part[0]);
+  for (size_t t = 0; t < workers.size(); ++t) workers[t].join();
+  // Check that each range contains a whole number of rows, and gather the
+  // elements in their original order
+  for (int t = 0; t < nr; ++t) {
+    CHECK_FMT(
+        part[t].size() % cols_ == 0,
+        "Corrupted matrix (a range of lines contains %lu elements, which is "
+        "not a multiple of %d). When multiple threads are used, each row must "
+        "be in a single line!", part[t].size(), cols_);
+    vals->insert(vals->end(), part[t].begin(), part[t].end());
+    if (!ok[t]) {
+      // Non-numeric data found, stop reading
+      eof_ = true;
+      break;
+    }
+  }
+  STATS_COUNT(STATS_PARSE, end, vals->size() / cols_);
+  chunk_.erase(chunk_.begin(), chunk_.begin() + end);
+  chunk_.resize(len - end);
+  return true;
+}
+
+template <typename real_t>
+int MatrixFile_Text::read_block_parallel(
+    int n, real_t* m, vector<real_t>* vals) const {
+  int i = 0;
+  while (i < n) {
+    if (next_ >= vals->size() && !read_chunk(vals)) break;
+    const int k = min<size_t>(n - i, vals->size() - next_);
+    memcpy(m + i, vals->data() + next_, sizeof(real_t) * k);
+    next_ += k;
+    i += k;
+  }
+  return i;
+}
+
+// virtual
+int MatrixFile_Text::read_block(int n, float* m) const {
+  CHECK(file_);
+  if (parallel_ < 0) {
+    parallel_ = threads_ > 1 && cols_ > 0 && is_regular_file(file_);
+  }
+  if (parallel_) return read_block_parallel(n, m, &fvals_);
+  int i = 0;
+  for (; i < n && fscanf(file_, "%f", m + i) == 1; ++i) { }
+  return i;
+}
+
+// virtual
+int MatrixFile_Text::read_block(int n, double* m) const {
+  CHECK(file_);
+  if (parallel_ < 0) {
+    parallel_ = threads_ > 1 && cols_ > 0 && is_regular_file(file_);
+  }
+  if (parallel_) return read_block_parallel(n, m, &dvals_);
+  int i = 0;
+  for (; i < n && fscanf(file_, "%lf", m + i) == 1; ++i) { }
+  return i;
+}
@@ -0,0 +1,112 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef FAST_PCA_FILE_TEXT_H_
+#define FAST_PCA_FILE_TEXT_H_
+
+#include <cstdio>
+#include <vector>
+
+#include "fast_pca/file.h"
+
+using std::vector;
+
+// ------------------------------------------------------------------------
+// ---- Helpers shared by the text-based formats (ASCII, Octave, VBosch).
+// ------------------------------------------------------------------------
+
+// Maximum number of characters needed to represent any float/double
+// number with format_real (sign, 17 digits, dot, exponent).
+static const int FORMAT_REAL_MAX_CHARS = 32;
+
+// Write to buf the shortest decimal representation of x which is parsed
+// back (with strtof/strtod) into exactly the same number. Floats use at
+// most 9 significant digits and doubles at most 17.
+// Returns the number of written characters (no '\0' is appended).
+int format_real(float x, char* buf);
+int format_real(double x, char* buf);
+
+// Write n elements of the row-major matrix m into file, separating
+// elements with a whitespace and rows (of cols elements) with a newline.
+// All elements are formatted into a memory buffer, which is written to the
+// file with a single call. If threads > 1, the rows are split into chunks
+// which are formatted concurrently and then written in their original order.
+template <typename real_t>
+void write_text_block(
+    FILE* file, int n, int cols, const real_t* m, int threads);
+
+// ------------------------------------------------------------------------
+// ---- Base class of the text-based formats, implementing the reading of
+// ---- the matrix elements.
+// ---- Elements are read sequentially with fscanf, unless more than one
+// ---- thread is used, the number of columns is known and the file is a
+// ---- regular file. In that case, the file is read in large chunks which
+// ---- are split into line-aligned ranges and parsed concurrently. Each
+// ---- range must contain a whole number of rows, thus each row must be
+// ---- in its own line (or several rows in the same line).
+// ------------------------------------------------------------------------
+class MatrixFile_Text : public MatrixFile {
+ protected:
+  // Parallel parser state
+  mutable int parallel_;          // -1: undecided, 0: no, 1: yes
+  mutable bool eof_;              // no more chunks to read
+  mutable vector<char> chunk_;    // unparsed characters of the last chunk
+  mutable vector<float> fvals_;   // parsed elements, single precision
+  mutable vector<double> dvals_;  // parsed elements, double precision
+  mutable size_t next_;           // next parsed element to return
+
+  void reset_parser() {
+    parallel_ = -1;
+    eof_ = false;
+    chunk_.clear();
+    fvals_.clear();
+    dvals_.clear();
+    next_ = 0;
+  }
+
+  template <typename real_t>
+  int read_block_parallel(int n, real_t* m, vector<real_t>* vals) const;
+  template <typename real_t>
+  bool read_chunk(vector<real_t>* vals) const;
+
+ public:
+  explicit MatrixFile_Text(FORMAT_CODE format) : MatrixFile(format) {
+    reset_parser();
+  }
+  MatrixFile_Text(FORMAT_CODE format, FILE* file) : MatrixFile(format, file) {
+    reset_parser();
+  }
+
+  // Text formats must call this before reading the header of a new file,
+  // to discard the state of the parser.
+  virtual bool read_header() {
+    reset_parser();
+    return true;
+  }
+
+  virtual int read_block(int n, float* m) const;
+  virtual int read_block(int n, double* m) const;
+};
+
+#endif  // FAST_PCA_FILE_TEXT_H_
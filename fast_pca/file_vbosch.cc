@@ -24,17 +24,10 @@
 
 #include "fast_pca/file_vbosch.h"
 
-// virtual
-bool MatrixFile_VBosch::copy_header_from(const MatrixFile& other) {
-  if (other.format() != format_) return false;
-  rows_ = other.rows();
-  cols_ = other.cols();
-  return true;
-}
-
 // virtual
 bool MatrixFile_VBosch::read_header() {
   CHECK(file_);
+  MatrixFile_Text::read_header();
   return (fscanf(file_, "%d %d", &rows_, &cols_) == 2 &&
           rows_ >= 0 && cols_ >= 0);
 }
@@ -45,42 +38,14 @@ void MatrixFile_VBosch::write_header() const {
   fprintf(file_, "%d %d\n", rows_, cols_);
 }
 
-// virtual
-int MatrixFile_VBosch::read_block(int n, float* m) const {
-  CHECK(file_);
-  int i = 0;
-  for (; i < n && fscanf(file_, "%f", m + i) == 1; ++i) { }
-  return i;
-}
-
-// virtual
-int MatrixFile_VBosch::read_block(int n, double* m) const {
-  CHECK(file_);
-  int i = 0;
-  for (; i < n && fscanf(file_, "%lf", m + i) == 1; ++i) { }
-  return i;
-}
-
 // virtual
 void MatrixFile_VBosch::write_block(int n, const float* m) const {
-  CHECK(file_);
-  for (int i = 0; i < n; ++i) {
-    if ((i + 1) % cols_ == 0)
-      fprintf(file_, "%.16g\n", m[i]);
-    else
-      fprintf(file_, "%.16g ", m[i]);
-  }
+  write_text_block(file_, n, cols_, m, threads_);
 }
 
 // virtual
 void MatrixFile_VBosch::write_block(int n, const double* m) const {
-  CHECK(file_);
-  for (int i = 0; i < n; ++i) {
-    if ((i + 1) % cols_ == 0)
-      fprintf(file_, "%.16g\n", m[i]);
-    else
-      fprintf(file_, "%.16g ", m[i]);
-  }
+  write_text_block(file_, n, cols_, m, threads_);
 }
 
 // static
@@ -26,18 +26,18 @@
 #define FAST_PCA_FILE_VBOSCH_H_
 
 #include "fast_pca/file.h"
+#include "fast_pca/file_text.h"
 
-class MatrixFile_VBosch : public MatrixFile {
+class MatrixFile_VBosch : public MatrixFile_Text {
  public:
-  MatrixFile_VBosch() : MatrixFile(FMT_VBOSCH) {}
-  explicit MatrixFile_VBosch(FILE* file) : MatrixFile(file) {}
+  MatrixFile_VBosch() : MatrixFile_Text(FMT_VBOSCH) {}
+  explicit MatrixFile_VBosch(FILE* file) :
+      MatrixFile_Text(FMT_VBOSCH, file) {}
 
-  virtual bool copy_header_from(const MatrixFile& other);
+  virtual bool needs_rows() const { return true; }
   virtual bool read_header();
   virtual void write_header() const;
 
-  virtual int read_block(int n, float* m) const;
-  virtual int read_block(int n, double* m) const;
   virtual void write_block(int n, const float* m) const;
   virtual void write_block(int n, const double* m) const;
 };
@@ -0,0 +1,175 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef FAST_PCA_FLOAT16_H_
+#define FAST_PCA_FLOAT16_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+// ------------------------------------------------------------------------
+// ---- Conversion between single precision and IEEE 754 half precision
+// ---- (binary16) numbers. Conversion to half precision rounds to the
+// ---- nearest even, overflows to infinity and preserves NaNs.
+// ------------------------------------------------------------------------
+
+inline float half_to_float(uint16_t h) {
+  const uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+  const uint32_t expo = (h >> 10) & 0x1F;
+  uint32_t mant = h & 0x03FF;
+  uint32_t bits = 0;
+  if (expo == 0x1F) {
+    // infinity or NaN
+    bits = sign | 0x7F800000 | (mant << 13);
+  } else if (expo != 0) {
+    // normal number
+    bits = sign | ((expo + 112) << 23) | (mant << 13);
+  } else if (mant != 0) {
+    // subnormal number, normalize it
+    uint32_t e = 113;
+    while ((mant & 0x0400) == 0) { mant <<= 1; --e; }
+    bits = sign | (e << 23) | ((mant & 0x03FF) << 13);
+  } else {
+    // signed zero
+    bits = sign;
+  }
+  float f;
+  memcpy(&f, &bits, 4);
+  return f;
+}
+
+inline uint16_t float_to_half(float f) {
+  uint32_t bits;
+  memcpy(&bits, &f, 4);
+  const uint16_t sign = (bits >> 16) & 0x8000;
+  const uint32_t expo = (bits >> 23) & 0xFF;
+  uint32_t mant = bits & 0x007FFFFF;
+  if (expo == 0xFF) {
+    // infinity or NaN (keep NaNs quiet)
+    return sign | 0x7C00 | (mant ? 0x0200 | (mant >> 13) : 0);
+  }
+  const int e = static_cast<int>(expo) - 112;
+  if (e >= 31) {
+    // overflow
+    return sign | 0x7C00;
+  }
+  if (e <= 0) {
+    // subnormal half or zero
+    if (e < -10) return sign;
+    mant |= 0x00800000;
+    const int shift = 14 - e;
+    uint32_t h = mant >> shift;
+    const uint32_t rem = mant & ((1u << shift) - 1);
+    const uint32_t half = 1u << (shift - 1);
+    if (rem > half || (rem == half && (h & 1))) ++h;
+    return sign | h;
+  }
+  uint32_t h = (e << 10) | (mant >> 13);
+  const uint32_t rem = mant & 0x1FFF;
+  if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) ++h;  // may carry to inf
+  return sign | h;
+}
+
+// Convert n half precision numbers into single/double precision
+template <typename real_t>
+inline void half_to_real_block(size_t n, const uint16_t* src, real_t* dst) {
+  size_t i = 0;
+#if defined(__F16C__)
+  float tmp[8];
+  for (; i + 8 <= n; i += 8) {
+    const __m128i h =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm256_storeu_ps(tmp, _mm256_cvtph_ps(h));
+    for (int j = 0; j < 8; ++j) dst[i + j] = tmp[j];
+  }
+#endif
+  for (; i < n; ++i) dst[i] = half_to_float(src[i]);
+}
+
+// Convert n single/double precision numbers into half precision
+template <typename real_t>
+inline void real_to_half_block(size_t n, const real_t* src, uint16_t* dst) {
+  size_t i = 0;
+#if defined(__F16C__)
+  float tmp[8];
+  for (; i + 8 <= n; i += 8) {
+    for (int j = 0; j < 8; ++j) tmp[j] = src[i + j];
+    const __m128i h = _mm256_cvtps_ph(
+        _mm256_loadu_ps(tmp), _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+  }
+#endif
+  for (; i < n; ++i) dst[i] = float_to_half(src[i]);
+}
+
+// ------------------------------------------------------------------------
+// ---- Conversion between single precision and bfloat16 numbers (the 16
+// ---- most significant bits of a single precision number). Conversion to
+// ---- bfloat16 rounds to the nearest even and preserves NaNs.
+// ------------------------------------------------------------------------
+
+inline float bfloat16_to_float(uint16_t b) {
+  const uint32_t bits = static_cast<uint32_t>(b) << 16;
+  float f;
+  memcpy(&f, &bits, 4);
+  return f;
+}
+
+inline uint16_t float_to_bfloat16(float f) {
+  uint32_t bits;
+  memcpy(&bits, &f, 4);
+  if ((bits & 0x7FFFFFFF) > 0x7F800000) {
+    // NaN (keep it quiet, the mantissa could be truncated to zero)
+    return (bits >> 16) | 0x0040;
+  }
+  return (bits + 0x7FFF + ((bits >> 16) & 1)) >> 16;
+}
+
+// Convert n bfloat16 numbers into single/double precision
+template <typename real_t>
+inline void bfloat16_to_real_block(
+    size_t n, const uint16_t* src, real_t* dst) {
+  for (size_t i = 0; i < n; ++i) dst[i] = bfloat16_to_float(src[i]);
+}
+
+// Convert n single/double precision numbers into bfloat16 (the loop is
+// branch-free, so that the compiler vectorizes it)
+template <typename real_t>
+inline void real_to_bfloat16_block(
+    size_t n, const real_t* src, uint16_t* dst) {
+  for (size_t i = 0; i < n; ++i) {
+    const float f = src[i];
+    uint32_t bits;
+    memcpy(&bits, &f, 4);
+    const uint32_t rounded = (bits + 0x7FFF + ((bits >> 16) & 1)) >> 16;
+    const uint32_t nan = (bits >> 16) | 0x0040;
+    dst[i] = (bits & 0x7FFFFFFF) > 0x7F800000 ? nan : rounded;
+  }
+}
+
+#endif  // FAST_PCA_FLOAT16_H_
@@ -97,6 +97,24 @@ template <> int syev<double>(int n, int lda, double* a, double* w) {
   return info;
 }
 
+template <> int syev_workspace<float>(int n) {
+  char opt[2] = {'V', 'U'};
+  // workspace query, the matrix is not accessed
+  int info = 0, lwork = -1;
+  float a = 0, w = 0, wkopt = 0;
+  ssyev_(opt, opt + 1, &n, &a, &n, &w, &wkopt, &lwork, &info);
+  return info == 0 ? static_cast<int>(wkopt) : 3 * n;
+}
+
+template <> int syev_workspace<double>(int n) {
+  char opt[2] = {'V', 'U'};
+  // workspace query, the matrix is not accessed
+  int info = 0, lwork = -1;
+  double a = 0, w = 0, wkopt = 0;
+  dsyev_(opt, opt + 1, &n, &a, &n, &w, &wkopt, &lwork, &info);
+  return info == 0 ? static_cast<int>(wkopt) : 3 * n;
+}
+
 void gemm_op(char* opA, char* opB) {
   char TA = 'N', TB = 'N';
   // determine op(B) in col-major order
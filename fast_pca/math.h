@@ -38,6 +38,10 @@ void ger(
 template <typename real_t>
 int syev(int n, int lda, real_t* a, real_t* w);
 
+// number of elements of the workspace allocated by syev, for a n x n matrix
+template <typename real_t>
+int syev_workspace(int n);
+
 // C = alpha * A * B + beta * C
 template <typename real_t>
 void gemm(
@@ -63,6 +67,8 @@ template <> void ger<double>(
 // syev specializations for float and doubles
 template <> int syev<float>(int, int, float*, float*);
 template <> int syev<double>(int, int, double*, double*);
+template <> int syev_workspace<float>(int);
+template <> int syev_workspace<double>(int);
 
 // gemm specializations for float and doubles
 template <> void gemm<float>(
@@ -0,0 +1,161 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "fast_pca/memory.h"
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+
+#include "fast_pca/logging.h"
+#include "fast_pca/prefetch.h"
+
+using std::max;
+using std::min;
+
+const size_t Memory::DEFAULT_CHUNK_BYTES;
+size_t Memory::limit_ = 0;
+size_t Memory::reserved_ = 0;
+int Memory::prefetch_depth_ = MatrixPrefetcher::DEFAULT_DEPTH;
+size_t Memory::chunk_bytes_ = Memory::DEFAULT_CHUNK_BYTES;
+
+// Fraction of the limit used by the buffers of the readers (1 / n)
+static const size_t MEMORY_READERS_FRACTION = 8;
+// Bytes kept by each file opened ahead: when it is compressed, the buffers
+// of the decompression thread and of zlib/zstd
+static const size_t MEMORY_PREFETCH_FILE_BYTES = 4 << 20;
+// Copies of each chunk kept by the text readers: the characters, the
+// values parsed by each thread and the merged values
+static const size_t MEMORY_CHUNK_COPIES = 3;
+static const size_t MEMORY_MIN_CHUNK_BYTES = 1 << 16;
+// Size of the data blocks: at least MEMORY_MIN_BLOCK_BYTES, and growing
+// with the dense matrices updated with each block (1 / n of their size),
+// so that the time is not dominated by their memory traffic.
+static const size_t MEMORY_MIN_BLOCK_BYTES = 8 << 20;
+static const size_t MEMORY_DENSE_BLOCK_FRACTION = 16;
+static const size_t MEMORY_MAX_BLOCK_ROWS = 1 << 16;
+
+static double mb(size_t bytes) { return bytes / 1048576.0; }
+
+// Resident set size of the process, in bytes
+static size_t current_rss() {
+  FILE* file = fopen("/proc/self/statm", "r");
+  if (!file) return 0;
+  unsigned long size = 0, resident = 0;  // NOLINT(runtime/int)
+  const int r = fscanf(file, "%lu %lu", &size, &resident);
+  fclose(file);
+  return r == 2 ? resident * sysconf(_SC_PAGESIZE) : 0;
+}
+
+// static
+void Memory::Limit(size_t bytes, int threads) {
+  limit_ = bytes;
+  if (limit_ == 0) return;
+  threads = max(threads, 1);
+  // the readers may use a fraction of the limit, split between the files
+  // opened ahead and the chunks of the text parser
+  const size_t readers = limit_ / MEMORY_READERS_FRACTION;
+  prefetch_depth_ = static_cast<int>(min<size_t>(
+      MatrixPrefetcher::DEFAULT_DEPTH,
+      max<size_t>(1, readers / 2 / MEMORY_PREFETCH_FILE_BYTES)));
+  chunk_bytes_ = min<size_t>(
+      DEFAULT_CHUNK_BYTES,
+      max<size_t>(MEMORY_MIN_CHUNK_BYTES,
+                  readers / 2 / MEMORY_CHUNK_COPIES / threads));
+  // memory already used by the program (code, libraries, ...), and the
+  // buffers of the readers
+  reserved_ = current_rss() +
+      prefetch_depth_ * MEMORY_PREFETCH_FILE_BYTES +
+      threads * MEMORY_CHUNK_COPIES * chunk_bytes_;
+}
+
+// static
+void Memory::Plan(
+    const char* what, int dim, size_t dense_bytes, size_t row_bytes,
+    int* block) {
+  row_bytes = max<size_t>(row_bytes, 1);
+  int rows = 0;
+  if (block) {
+    const size_t target = max(
+        MEMORY_MIN_BLOCK_BYTES, dense_bytes / MEMORY_DENSE_BLOCK_FRACTION);
+    rows = *block > 0 ? *block : static_cast<int>(min<size_t>(
+        MEMORY_MAX_BLOCK_ROWS, max<size_t>(1, target / row_bytes)));
+  }
+  if (limit_ > 0) {
+    const size_t avail = limit_ > reserved_ ? limit_ - reserved_ : 0;
+    const size_t need = dense_bytes + (block ? row_bytes : 0);
+    if (need > avail) {
+      ERROR_FMT(
+          "The %s of %d dimensions needs at least %.1f MB (%.1f MB of dense "
+          "matrices and workspace, %.1f MB of program and readers), which "
+          "does not fit in the memory limit (--mem-limit %g)!", what, dim,
+          mb(reserved_ + need), mb(dense_bytes), mb(reserved_), mb(limit_));
+    }
+    const size_t fit = (avail - dense_bytes) / row_bytes;
+    if (block && static_cast<size_t>(rows) > fit) {
+      if (*block > 0) {
+        WARN_FMT(
+            "Reducing the block size of the %s to %d rows (-b %d), to fit in "
+            "the memory limit...", what, static_cast<int>(fit), *block);
+      }
+      rows = static_cast<int>(fit);
+    }
+    if (block) {
+      fprintf(
+          stderr, "Memory plan: %s of %d dimensions, %d rows per block, "
+          "%d files opened ahead, about %.1f MB\n", what, dim, rows,
+          prefetch_depth_, mb(reserved_ + dense_bytes + rows * row_bytes));
+    } else {
+      fprintf(
+          stderr, "Memory plan: %s of %d dimensions, about %.1f MB\n", what,
+          dim, mb(reserved_ + dense_bytes));
+    }
+  }
+  if (block) *block = rows;
+}
+
+// static
+size_t Memory::PeakRss() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return static_cast<size_t>(usage.ru_maxrss) << 10;
+}
+
+// static
+void Memory::Report() {
+  const size_t peak = PeakRss();
+  if (limit_ > 0) {
+    fprintf(
+        stderr, "Peak memory: %.1f MB (limit: %g MB)\n", mb(peak), mb(limit_));
+    if (peak > limit_) {
+      WARN_FMT(
+          "The peak memory (%.1f MB) exceeded the memory limit (%g MB)!",
+          mb(peak), mb(limit_));
+    }
+  } else {
+    fprintf(stderr, "Peak memory: %.1f MB\n", mb(peak));
+  }
+}
@@ -0,0 +1,81 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef FAST_PCA_MEMORY_H_
+#define FAST_PCA_MEMORY_H_
+
+#include <cstddef>
+
+// Value of the --mem-limit long option, for getopt_long
+static const int MEM_LIMIT_OPTION = 259;
+
+// Memory budget of the tools, given with --mem-limit. The buffers that do
+// not depend on the problem are planned when the limit is set: the files
+// opened ahead by the prefetcher and the bytes parsed by each thread of the
+// text readers. The rows of the data blocks are planned once the number of
+// dimensions is known, with the memory left by the dense matrices. Problems
+// whose dense matrices alone cannot fit in the limit are refused before the
+// data is read.
+// Without a limit, the data blocks are still sized from the number of
+// dimensions, the rest of buffers keep their default sizes.
+class Memory {
+ public:
+  // Default number of bytes parsed by each thread of the text readers
+  static const size_t DEFAULT_CHUNK_BYTES = 1 << 22;
+
+  // Set the memory limit (in bytes, 0: no limit), and plan the buffers of
+  // the readers for the given number of threads.
+  static void Limit(size_t bytes, int threads);
+  static size_t Limit() { return limit_; }
+
+  // Plan the rows of the data blocks for the given work (used in the
+  // messages). dim is the number of dimensions of the data, dense_bytes
+  // the size of the buffers that do not depend on the rows of the blocks
+  // and row_bytes the size of the buffers of each row. The rows given by
+  // the user (block > 0) are kept, unless they do not fit in the limit.
+  // The program is aborted with an estimate of the needed memory when the
+  // dense buffers do not fit.
+  static void Plan(
+      const char* what, int dim, size_t dense_bytes, size_t row_bytes,
+      int* block);
+
+  // Number of files opened ahead by the prefetcher
+  static int PrefetchDepth() { return prefetch_depth_; }
+  // Bytes read and parsed by each thread of the text readers
+  static size_t ChunkBytes() { return chunk_bytes_; }
+
+  // Peak resident set size of the process, in bytes
+  static size_t PeakRss();
+  // Print the peak resident set size to stderr, warning if it exceeded the
+  // limit.
+  static void Report();
+
+ private:
+  static size_t limit_;
+  static size_t reserved_;  // baseline and reader buffers
+  static int prefetch_depth_;
+  static size_t chunk_bytes_;
+};
+
+#endif  // FAST_PCA_MEMORY_H_
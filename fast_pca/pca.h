@@ -28,14 +28,24 @@
 #include <algorithm>
 #include <cmath>
 #include <cstring>
+#include <limits>
 #include <vector>
 
 #include "fast_pca/math.h"
+#include "fast_pca/project_int8.h"
+#include "fast_pca/stats.h"
 
 using std::sort;
 using std::swap;
 using std::vector;
 
+// Whitening of the projected data
+typedef enum {
+  WHITEN_NONE = 0,  // projected data is not whitened
+  WHITEN_PCA  = 1,  // projected dimensions are scaled to unit variance
+  WHITEN_ZCA  = 2   // whitened data is rotated back to the input space
+} WHITEN_MODE;
+
 // Compute eigenvalues and eigenvectors of the matrix m
 // n -> (input)  number of dimensions
 // l -> (input)  leading dimension of matrix m
@@ -43,6 +53,9 @@ using std::vector;
 // w -> (output) eigenvalues
 template <typename real_t>
 int eig(int n, int l, real_t* m, real_t* w) {
+  STATS_SCOPE(STATS_EIG);
+  // nominal cost of the symmetric QR algorithm, with the eigenvectors
+  STATS_FLOPS(STATS_EIG, 9.0 * n * n * n);
   // Compute eigenvalues and eigenvectors
   const int info = syev<real_t>(n, l, m, w);
   if (info != 0) { return info; }
@@ -56,6 +69,140 @@ int eig(int n, int l, real_t* m, real_t* w) {
   return 0;
 }
 
+// Orthonormalize the rows of the matrix s, assuming that the first k rows
+// are already orthonormal. The rest of rows are first projected out of the
+// span of the first k rows, and then orthonormalized with the modified
+// Gram-Schmidt method. Both steps are done twice, for numerical stability.
+// Rows which are linearly dependent on the previous ones are removed.
+// m -> (input)  number of rows
+// n -> (input)  number of columns
+// k -> (input)  number of leading orthonormal rows
+// s -> (input)  matrix, (output) orthonormal rows
+// Returns the number of remaining rows.
+template <typename real_t>
+int orthonormalize_rows(int m, int n, int k, real_t* s) {
+  const double min_rel_norm = sqrt(std::numeric_limits<real_t>::epsilon());
+  // norm of each row, before the orthogonalization
+  vector<double> norm0(m, 0.0);
+  for (int i = k; i < m; ++i) {
+    for (int d = 0; d < n; ++d) { norm0[i] += s[i * n + d] * s[i * n + d]; }
+  }
+  // S2 -= (S2 * S1') * S1
+  if (k > 0 && m > k) {
+    vector<real_t> c((m - k) * k);
+    for (int pass = 0; pass < 2; ++pass) {
+      gemm<real_t>(
+          'N', 'T', m - k, k, n, 1, s + k * n, n, s, n, 0, c.data(), k);
+      gemm<real_t>(
+          'N', 'N', m - k, n, k, -1, c.data(), k, s, n, 1, s + k * n, n);
+    }
+  }
+  int r = k;
+  for (int i = k; i < m; ++i) {
+    real_t* sr = s + r * n;
+    if (r != i) { memcpy(sr, s + i * n, sizeof(real_t) * n); }
+    if (norm0[i] == 0.0) continue;
+    for (int pass = 0; pass < 2; ++pass) {
+      for (int j = k; j < r; ++j) {
+        double dot = 0.0;
+        for (int d = 0; d < n; ++d) { dot += s[j * n + d] * sr[d]; }
+        axpy<real_t>(n, -dot, s + j * n, sr);
+      }
+    }
+    double norm = 0.0;
+    for (int d = 0; d < n; ++d) { norm += sr[d] * sr[d]; }
+    if (sqrt(norm) <= min_rel_norm * sqrt(norm0[i])) continue;
+    for (int d = 0; d < n; ++d) { sr[d] /= sqrt(norm); }
+    ++r;
+  }
+  return r;
+}
+
+// Compute the k largest eigenvalues and their eigenvectors of the matrix a,
+// using the LOBPCG method (Knyazev, 2001), starting from the given
+// approximation of the eigenvectors.
+// n        -> (input)  number of dimensions
+// k        -> (input)  number of eigenvalues to compute (3 * k <= n)
+// l        -> (input)  leading dimension of matrix a
+// a        -> (input)  squared & symmetric matrix
+// tol      -> (input)  maximum residual norm, relative to the largest
+//                      eigenvalue
+// max_iter -> (input)  maximum number of iterations
+// v        -> (input)  initial eigenvectors, (output) eigenvectors
+//                      size: k rows x n columns
+// w        -> (output) eigenvalues, in descending order
+// iter     -> (output) number of iterations
+// res      -> (output) relative residual norm
+// Returns 0 if the method converged, 1 otherwise, or the error of syev.
+template <typename real_t>
+int lobpcg(
+    int n, int k, int l, const real_t* a, real_t tol, int max_iter,
+    real_t* v, real_t* w, int* iter, real_t* res) {
+  vector<real_t> S(3 * k * n), AS(3 * k * n), G(9 * k * k), theta(3 * k);
+  vector<real_t> X(k * n), AX(k * n), P(k * n);
+  // initial subspace, completed with unit vectors if the given vectors are
+  // linearly dependent
+  memcpy(S.data(), v, sizeof(real_t) * k * n);
+  int m = orthonormalize_rows<real_t>(k, n, 0, S.data());
+  for (int d = 0; m < k && d < n; ++d) {
+    memset(S.data() + m * n, 0, sizeof(real_t) * n);
+    S[m * n + d] = 1;
+    m = orthonormalize_rows<real_t>(m + 1, n, m, S.data());
+  }
+  if (m < k) { return -1; }
+  int np = 0;  // number of search directions in P
+  *iter = 0;
+  for (;;) {
+    // Rayleigh-Ritz: eigenvectors of the matrix projected into the subspace
+    // spanned by the rows of S
+    // AS = S * A
+    gemm<real_t>(
+        'N', 'N', m, n, n, 1, S.data(), n, a, l, 0, AS.data(), n);
+    // G = S * A * S'
+    gemm<real_t>(
+        'N', 'T', m, m, n, 1, S.data(), n, AS.data(), n, 0, G.data(), m);
+    const int info = eig<real_t>(m, m, G.data(), theta.data());
+    if (info != 0) { return info; }
+    // X = Q * S, and A * X = Q * A * S, with the first k Ritz vectors Q
+    gemm<real_t>(
+        'N', 'N', k, n, m, 1, G.data(), m, S.data(), n, 0, X.data(), n);
+    gemm<real_t>(
+        'N', 'N', k, n, m, 1, G.data(), m, AS.data(), n, 0, AX.data(), n);
+    // P = the component of the new X out of the span of the previous X
+    np = m > k ? k : 0;
+    if (np > 0) {
+      gemm<real_t>(
+          'N', 'N', k, n, m - k, 1, G.data() + k, m, S.data() + k * n, n, 0,
+          P.data(), n);
+    }
+    // R = A * X - X * diag(theta), stored after X in the next subspace
+    memcpy(S.data(), X.data(), sizeof(real_t) * k * n);
+    memcpy(S.data() + k * n, AX.data(), sizeof(real_t) * k * n);
+    double max_res = 0.0;
+    for (int i = 0; i < k; ++i) {
+      real_t* ri = S.data() + (k + i) * n;
+      axpy<real_t>(n, -theta[i], X.data() + i * n, ri);
+      double norm = 0.0;
+      for (int d = 0; d < n; ++d) { norm += ri[d] * ri[d]; }
+      max_res = std::max(max_res, sqrt(norm));
+    }
+    *res = max_res / std::max<double>(fabs(theta[0]), 1E-30);
+    if (*res <= tol || *iter >= max_iter) break;
+    ++(*iter);
+    memcpy(S.data() + 2 * k * n, P.data(), sizeof(real_t) * np * n);
+    m = orthonormalize_rows<real_t>(2 * k + np, n, k, S.data());
+  }
+  // eigenvectors keep the sign of the initial ones
+  for (int i = 0; i < k; ++i) {
+    double dot = 0.0;
+    for (int d = 0; d < n; ++d) { dot += X[i * n + d] * v[i * n + d]; }
+    const real_t sign = dot < 0.0 ? -1 : 1;
+    for (int d = 0; d < n; ++d) { v[i * n + d] = sign * X[i * n + d]; }
+    w[i] = theta[i];
+  }
+  return *res <= tol ? 0 : 1;
+}
+
 // n -> (input)  number of data samples
 // p -> (input)  input data dimension
 // q -> (input)  output data dimension
@@ -66,11 +213,18 @@ int eig(int n, int l, real_t* m, real_t* w) {
 // x -> (input)  original data,
 //      (output) mean-centered and (optionally) normalized data
 // z -> (output) projected data
+// qv -> (input)  if not NULL, eigenvectors quantized to 8-bit integers, which
+//       are used instead of v
 template <typename real_t>
 int project(
     int n, int p, int q, int r, const real_t* v, const real_t* m,
-    const real_t* s, real_t* x, real_t* z) {
+    const real_t* s, real_t* x, real_t* z,
+    Int8Projection<real_t>* qv = NULL) {
   if (p < q || !x || !z) { return -1; }
+  STATS_SCOPE(STATS_PROJECT);
+  STATS_COUNT(STATS_PROJECT, sizeof(real_t) * n * p, n);
+  STATS_FLOPS(
+      STATS_PROJECT, n * (p + 2.0 * (p - abs(r)) * std::max(q - abs(r), 0)));
   // convert input data to zero-mean
   // TODO(jpuigcerver): this can run in parallel
   for (int i = 0; i < n; ++i) { axpy<real_t>(p, -1, m, x + i * p); }
@@ -100,10 +254,127 @@ int project(
     // projected
     real_t* x_offset = r <= 0 ? x : x + r;
     real_t* z_offset = r <= 0 ? z : z + r;
-    gemm<real_t>(
-        'N', 'T', n, eff_q, eff_p, 1, x_offset, p, v, eff_p, 0, z_offset, q);
+    if (qv) {
+      qv->project(n, x_offset, p, z_offset, q);
+    } else {
+      gemm<real_t>(
+          'N', 'T', n, eff_q, eff_p, 1, x_offset, p, v, eff_p, 0, z_offset,
+          q);
+    }
   }
   return 0;
 }
 
+// Fold the whitening of the projected data into the eigenvectors, so that
+// project() whitens the data at no extra cost. Each eigenvector is scaled by
+// 1 / sqrt(eigenvalue + eps) and, with ZCA, the result is rotated back to
+// the input space: V' * diag(1 / sqrt(w + eps)) * V.
+// mode -> (input)  whitening mode
+// p    -> (input)  number of projected input dimensions
+// q    -> (input)  number of eigenvectors used for the projection
+// eps  -> (input)  regularizer added to the eigenvalues
+// w    -> (input)  eigenvalues, (output) variance of each output dimension
+//                  size: q elements (p, with ZCA)
+// v    -> (input)  eigenvectors, (output) whitening projection matrix
+//                  size: q rows x p columns (p rows, with ZCA)
+template <typename real_t>
+void whiten(
+    WHITEN_MODE mode, int p, int q, double eps, vector<real_t>* w,
+    vector<real_t>* v) {
+  if (mode == WHITEN_NONE) { return; }
+  // scale of each eigenvector, eigenvalues which are not positive after the
+  // regularization are discarded
+  vector<real_t> scale(q, 0);
+  for (int i = 0; i < q; ++i) {
+    const double d = (*w)[i] + eps;
+    if (d > 0) { scale[i] = 1.0 / sqrt(d); }
+  }
+  // variance of the whitened dimensions
+  vector<real_t> var(q);
+  for (int i = 0; i < q; ++i) { var[i] = (*w)[i] * scale[i] * scale[i]; }
+  v->resize(q * p);
+  if (mode == WHITEN_PCA) {
+    for (int i = 0; i < q; ++i) {
+      for (int d = 0; d < p; ++d) { (*v)[i * p + d] *= scale[i]; }
+    }
+    *w = var;
+    return;
+  }
+  // ZCA: the projection matrix is symmetric, rows or columns are the same
+  vector<real_t> sv(*v);
+  for (int i = 0; i < q; ++i) {
+    for (int d = 0; d < p; ++d) { sv[i * p + d] *= scale[i]; }
+  }
+  vector<real_t> zca(p * p);
+  gemm<real_t>(
+      'T', 'N', p, p, q, 1, v->data(), p, sv.data(), p, 0, zca.data(), p);
+  // the variance of each output dimension is the diagonal of
+  // V' * diag(var) * V
+  w->assign(p, 0);
+  for (int i = 0; i < q; ++i) {
+    for (int d = 0; d < p; ++d) {
+      (*w)[d] += (*v)[i * p + d] * (*v)[i * p + d] * var[i];
+    }
+  }
+  v->swap(zca);
+}
+
+// Weights used by reconstruction_scores(), to undo the whitening of the
+// projected data (see whiten()).
+// mode -> (input)  whitening mode (WHITEN_NONE or WHITEN_PCA)
+// q    -> (input)  number of eigenvectors used for the projection
+// eps  -> (input)  regularizer added to the eigenvalues
+// w    -> (input)  eigenvalues
+// c    -> (output) squared scale of each projected dimension
+// iw   -> (output) squared scale of each projected dimension, divided by its
+//                  eigenvalue
+template <typename real_t>
+void reconstruction_score_weights(
+    WHITEN_MODE mode, int q, double eps, const vector<real_t>& w,
+    vector<real_t>* c, vector<real_t>* iw) {
+  c->assign(q, 1);
+  iw->assign(q, 0);
+  for (int i = 0; i < q; ++i) {
+    if (mode == WHITEN_PCA) { (*c)[i] = std::max<double>(w[i] + eps, 0); }
+    if (w[i] > 0) { (*iw)[i] = (*c)[i] / w[i]; }
+  }
+}
+
+// Compute the reconstruction error (squared norm of the residual) and the
+// squared Mahalanobis distance in the subspace of the eigenvectors of each
+// projected row, without reconstructing the rows: since the eigenvectors are
+// orthonormal, ||x - V' * V * x||^2 = ||x||^2 - ||V * x||^2. The non-projected
+// dimensions are ignored.
+// n  -> (input)  number of data samples
+// p  -> (input)  input data dimension
+// q  -> (input)  output data dimension
+// r  -> (input)  exclude these number of first/last dimensions
+// c  -> (input)  squared scale of each projected dimension
+// iw -> (input)  squared scale of each projected dimension, divided by its
+//                eigenvalue (see reconstruction_score_weights())
+// x  -> (input)  mean-centered data, as left by project()
+// z  -> (input)  projected data
+// s  -> (output) reconstruction error and Mahalanobis distance of each row
+//       size: n rows x 2 columns
+template <typename real_t>
+void reconstruction_scores(
+    int n, int p, int q, int r, const real_t* c, const real_t* iw,
+    const real_t* x, const real_t* z, real_t* s) {
+  const int eff_p = p - abs(r);
+  const int eff_q = q - abs(r);
+  for (int i = 0; i < n; ++i) {
+    const real_t* xi = r <= 0 ? x + i * p : x + i * p + r;
+    const real_t* zi = r <= 0 ? z + i * q : z + i * q + r;
+    double xx = 0.0, zz = 0.0, mm = 0.0;
+    for (int d = 0; d < eff_p; ++d) { xx += xi[d] * xi[d]; }
+    for (int k = 0; k < eff_q; ++k) {
+      zz += c[k] * zi[k] * zi[k];
+      mm += iw[k] * zi[k] * zi[k];
+    }
+    // rounding errors may give a small negative error
+    s[2 * i] = std::max(xx - zz, 0.0);
+    s[2 * i + 1] = mm;
+  }
+}
+
 #endif  // FAST_PCA_PCA_H_
@@ -0,0 +1,186 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "fast_pca/prefetch.h"
+
+#include <fcntl.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "fast_pca/file_fpca.h"
+#include "fast_pca/logging.h"
+#include "fast_pca/stats.h"
+#include "fast_pca/uring.h"
+
+using std::min;
+using std::unique_lock;
+
+int MatrixPrefetcher::shard_k_ = 0;
+int MatrixPrefetcher::shard_n_ = 1;
+
+// static
+void MatrixPrefetcher::Shard(int k, int n) {
+  CHECK(n > 0 && k >= 0 && k < n);
+  shard_k_ = k;
+  shard_n_ = n;
+}
+
+// static
+void MatrixPrefetcher::select_shard(Entry* entry) {
+  const char* fname =
+      entry->name == "" ? "**stdin**" : entry->name.c_str();
+  MatrixFile_FPCA* fpca = dynamic_cast<MatrixFile_FPCA*>(entry->reader.get());
+  CHECK_FMT(
+      fpca != NULL && fpca->rows() >= 0,
+      "Only FPCA files can be split into shards (file \"%s\")!", fname);
+  const int64_t rows = fpca->rows();
+  const int64_t r0 = rows * shard_k_ / shard_n_;
+  const int64_t r1 = rows * (shard_k_ + 1) / shard_n_;
+  CHECK_FMT(
+      r0 == r1 || fpca->seek_row(r0),
+      "Failed to seek row %ld in file \"%s\" (only regular, uncompressed "
+      "FPCA files can be split into shards)!", static_cast<long>(r0),  // NOLINT
+      fname);
+  entry->rows_left = r1 - r0;
+}
+
+MatrixPrefetcher::MatrixPrefetcher(
+    const vector<string>& names, Factory create, size_t real_size,
+    int threads, int depth) :
+    names_(names), create_(create), real_size_(real_size), depth_(depth),
+    entries_(names.size()),
+    next_open_(0), next_consume_(0), stop_(false) {
+  CHECK(threads > 0);
+  CHECK(depth > 0);
+  // no need for more helper threads than files
+  const size_t nthreads = min<size_t>(threads, names.size());
+  for (size_t t = 0; t < nthreads; ++t) {
+    workers_.push_back(thread(&MatrixPrefetcher::worker, this));
+  }
+}
+
+MatrixPrefetcher::~MatrixPrefetcher() {
+  {
+    unique_lock<mutex> lock(mutex_);
+    stop_ = true;
+  }
+  consumed_cv_.notify_all();
+  for (thread& t : workers_) t.join();
+  // close the files that were opened but never consumed
+  for (size_t f = next_consume_; f < entries_.size(); ++f) {
+    if (entries_[f] && entries_[f]->file != stdin) {
+      close_file(entries_[f]->file);
+    }
+  }
+}
+
+unique_ptr<MatrixPrefetcher::Entry> MatrixPrefetcher::next() {
+  unique_lock<mutex> lock(mutex_);
+  CHECK(next_consume_ < entries_.size());
+  opened_cv_.wait(lock, [this] { return entries_[next_consume_] != nullptr; });
+  unique_ptr<Entry> entry(std::move(entries_[next_consume_++]));
+  lock.unlock();
+  consumed_cv_.notify_all();
+  return entry;
+}
+
+void MatrixPrefetcher::worker() {
+  unique_lock<mutex> lock(mutex_);
+  for (;;) {
+    consumed_cv_.wait(lock, [this] {
+        return stop_ || next_open_ >= names_.size() ||
+            next_open_ < next_consume_ + depth_;
+      });
+    if (stop_ || next_open_ >= names_.size()) break;
+    const size_t f = next_open_++;
+    lock.unlock();
+    unique_ptr<Entry> entry(new Entry);
+    entry->name = names_[f];
+    open(entry.get());
+    lock.lock();
+    entries_[f] = std::move(entry);
+    opened_cv_.notify_all();
+  }
+}
+
+void MatrixPrefetcher::open(Entry* entry) const {
+  entry->reader.reset(create_());
+  entry->cached = false;
+  entry->rows_left = -1;
+  InputCache* cache = InputCache::Get();
+  if (entry->name != "" && cache && is_text_format(entry->reader->format())) {
+    // read the parsed data from the cache, if there is a valid copy
+    string header;
+    entry->file = cache->open(
+        entry->name, entry->reader->format(), real_size_, &header);
+    if (entry->file) {
+      entry->cached = true;
+      entry->header = true;
+      if (!header.empty()) {
+        FILE* hfile = fmemopen(&header[0], header.size(), "r");
+        CHECK(hfile);
+        entry->reader->file(hfile);
+        {
+          STATS_SCOPE(STATS_HEADER);
+          entry->header = entry->reader->read_header();
+        }
+        fclose(hfile);
+      }
+      entry->reader->file(entry->file);
+      return;
+    }
+  }
+  if (entry->name == "") {
+    entry->file = stdin;
+  } else {
+    entry->file = open_file(entry->name.c_str(), "rb");
+    // start reading the file into the page cache, while the previous
+    // files are being processed
+    posix_fadvise(uring_fd(entry->file), 0, 0, POSIX_FADV_WILLNEED);
+  }
+  entry->reader->file(entry->file);
+  {
+    STATS_SCOPE(STATS_HEADER);
+    entry->header = entry->reader->read_header();
+  }
+  if (entry->header && shard_n_ > 1) select_shard(entry);
+  if (entry->name != "" && entry->header && cache &&
+      is_text_format(entry->reader->format())) {
+    // write a copy of the parsed data into the cache, with the header
+    unique_ptr<MatrixFile> h(create_());
+    h->copy_header_from(*entry->reader);
+    char* buf = NULL;
+    size_t size = 0;
+    FILE* hfile = open_memstream(&buf, &size);
+    CHECK(hfile);
+    h->file(hfile);
+    h->write_header();
+    fclose(hfile);
+    const string header(buf, size);
+    free(buf);
+    entry->cache_writer.reset(cache->create(
+        entry->name, entry->reader->format(), real_size_, header));
+  }
+}
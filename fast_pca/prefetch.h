@@ -0,0 +1,145 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef FAST_PCA_PREFETCH_H_
+#define FAST_PCA_PREFETCH_H_
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fast_pca/cache.h"
+#include "fast_pca/file.h"
+#include "fast_pca/progress.h"
+#include "fast_pca/stats.h"
+
+// Value of the --shard long option, for getopt_long
+static const int SHARD_OPTION = 260;
+
+using std::condition_variable;
+using std::mutex;
+using std::string;
+using std::thread;
+using std::unique_ptr;
+using std::vector;
+
+// Opens the files of a list ahead of the consumer: a few helper threads open
+// each file, advise the kernel that it will be read soon and parse its header,
+// so that processing millions of small files is not dominated by the latency
+// of open() and the first read(). Files are handed out in the same order as
+// in the list, and at most `depth' files are kept open in advance.
+// If there is a global InputCache, text files are read from their cached
+// copy when it is valid, or a new copy is written while they are read.
+// If a shard is selected (see Shard()), only its rows of each file are read.
+class MatrixPrefetcher {
+ public:
+  typedef MatrixFile* (*Factory)();
+
+  struct Entry {
+    string name;                   // file name ("" is the standard input)
+    FILE* file;                    // opened file (or its cached copy)
+    unique_ptr<MatrixFile> reader; // reader, with the header already read
+    bool header;                   // whether read_header() succeeded
+    bool cached;                   // whether file is the cached copy
+    unique_ptr<InputCache::Writer> cache_writer;  // cached copy being written
+    int64_t rows_left;             // rows of the shard to read (-1: all)
+
+    // Read a block of elements from the file, or from its cached copy.
+    // Use this instead of reader->read_block().
+    template <typename real_t>
+    int read_block(int n, real_t* m) {
+      STATS_SCOPE(STATS_READ);
+      if (rows_left >= 0 && n > rows_left * reader->cols()) {
+        n = rows_left * reader->cols();
+      }
+      const int r = cached ?
+          fread(m, sizeof(real_t), n, file) : reader->read_block(n, m);
+      if (r > 0) {
+        const int rows = reader->cols() > 0 ? r / reader->cols() : 0;
+        if (rows_left >= 0) rows_left -= rows;
+        STATS_COUNT(STATS_READ, sizeof(real_t) * r, rows);
+        Progress::AddRows(rows, sizeof(real_t) * r);
+      }
+      if (cached) return r;
+      if (Progress::WantPosition()) Progress::SetPosition(ftell(file));
+      if (cache_writer) {
+        if (r > 0) {
+          cache_writer->write(m, sizeof(real_t) * r);
+        } else {
+          if (r == 0) cache_writer->commit();
+          cache_writer.reset();
+        }
+      }
+      return r;
+    }
+  };
+
+  static const int DEFAULT_THREADS = 4;
+  static const int DEFAULT_DEPTH = 32;
+
+  // real_size is the size of the elements read from the files, used to
+  // identify their cached copies.
+  MatrixPrefetcher(
+      const vector<string>& names, Factory create, size_t real_size,
+      int threads = DEFAULT_THREADS, int depth = DEFAULT_DEPTH);
+  ~MatrixPrefetcher();
+
+  // Returns the next file of the list, waiting until it is ready. The caller
+  // takes the ownership of the entry and must close its file.
+  unique_ptr<Entry> next();
+
+  // Read only the k-th of n (almost) equal ranges of rows of each file, to
+  // split the work among several processes. The files must be seekable
+  // FPCA files, with an index.
+  static void Shard(int k, int n);
+
+ private:
+  void worker();
+  void open(Entry* entry) const;
+  static void select_shard(Entry* entry);
+
+  static int shard_k_;
+  static int shard_n_;
+
+  const vector<string>& names_;
+  const Factory create_;
+  const size_t real_size_;
+  const size_t depth_;
+  vector<unique_ptr<Entry> > entries_;
+  size_t next_open_;     // next file to be opened by a helper thread
+  size_t next_consume_;  // next file to be returned by next()
+  bool stop_;
+  mutex mutex_;
+  condition_variable opened_cv_;
+  condition_variable consumed_cv_;
+  vector<thread> workers_;
+};
+
+#endif  // FAST_PCA_PREFETCH_H_
@@ -0,0 +1,261 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "fast_pca/progress.h"
+
+#include <errno.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include "fast_pca/logging.h"
+
+using std::lock_guard;
+using std::min;
+using std::mutex;
+using std::thread;
+
+atomic<int64_t> Progress::rows_(0);
+atomic<int64_t> Progress::bytes_(0);
+atomic<int64_t> Progress::position_(-1);
+atomic<bool> Progress::want_position_(false);
+
+// Maximum time given to the consumer to update the position in the current
+// file, before a report is printed (in microseconds), and the time between
+// checks of whether the position was already updated
+static const int PROGRESS_POSITION_WAIT = 250000;
+static const int PROGRESS_POSITION_POLL = 5000;
+
+// State of the current stage, protected by the mutex
+static mutex state_mutex;
+static string stage_name;
+static int stage_id = 0;
+static double stage_start = 0;
+static vector<string> stage_files;
+static int files_done = 0;
+static int cur_file = -1;
+static int64_t cur_rows_start = 0;  // rows_ when the current file started
+static int64_t cur_rows = -1;       // rows of the current file, if known
+// sizes of the input files of the stage (and their cumulative sum),
+// computed by the helper thread
+static int sizes_id = -1;
+static vector<int64_t> cum_size;
+static bool sizes_known = false;
+// counters at the time of the last report
+static double last_time = 0;
+static int64_t last_rows = 0;
+static int64_t last_bytes = 0;
+
+// Helper thread state
+static double report_interval = 0;
+static sem_t wake_sem;
+static sem_t done_sem;
+static volatile sig_atomic_t stop_worker = 0;
+static bool started = false;
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1E-9;
+}
+
+static void on_sigusr1(int) {
+  // sem_post is async-signal-safe
+  sem_post(&wake_sem);
+}
+
+// Time of the next periodic report, for sem_timedwait
+static void next_report(struct timespec* ts) {
+  clock_gettime(CLOCK_REALTIME, ts);
+  const int64_t ns = ts->tv_nsec + static_cast<int64_t>(
+      (report_interval - floor(report_interval)) * 1E9);
+  ts->tv_sec += static_cast<time_t>(report_interval) + ns / 1000000000;
+  ts->tv_nsec = ns % 1000000000;
+}
+
+static void format_duration(double secs, char* buf, size_t n) {
+  const long s = static_cast<long>(secs + 0.5);
+  snprintf(buf, n, "%ld:%02ld:%02ld", s / 3600, (s / 60) % 60, s % 60);
+}
+
+// static
+void Progress::Start(double interval) {
+  if (started) return;
+  CHECK(sem_init(&wake_sem, 0, 0) == 0);
+  CHECK(sem_init(&done_sem, 0, 0) == 0);
+  report_interval = interval;
+  started = true;
+  Stage("start");
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_sigusr1;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  CHECK(sigaction(SIGUSR1, &sa, NULL) == 0);
+  thread(&Progress::Worker).detach();
+}
+
+// static
+void Progress::Stop() {
+  if (!started) return;
+  stop_worker = 1;
+  sem_post(&wake_sem);
+  while (sem_wait(&done_sem) != 0 && errno == EINTR) {}
+  started = false;
+}
+
+// static
+void Progress::Stage(const char* name, const vector<string>& input) {
+  lock_guard<mutex> lock(state_mutex);
+  stage_name = name;
+  ++stage_id;
+  stage_start = last_time = now();
+  stage_files = input;
+  files_done = 0;
+  cur_file = -1;
+  cur_rows = -1;
+  rows_ = bytes_ = cur_rows_start = last_rows = last_bytes = 0;
+  position_ = -1;
+}
+
+// static
+void Progress::BeginFile(int f, int rows) {
+  lock_guard<mutex> lock(state_mutex);
+  cur_file = f;
+  cur_rows = rows;
+  cur_rows_start = rows_;
+  position_ = -1;
+}
+
+// static
+void Progress::EndFile() {
+  lock_guard<mutex> lock(state_mutex);
+  ++files_done;
+  cur_file = -1;
+  position_ = -1;
+}
+
+// static
+void Progress::Worker() {
+  // the helper thread must not receive the signals of the process
+  sigset_t set;
+  sigfillset(&set);
+  pthread_sigmask(SIG_BLOCK, &set, NULL);
+  struct timespec next;
+  next_report(&next);
+  while (!stop_worker) {
+    const int r = report_interval > 0 ?
+        sem_timedwait(&wake_sem, &next) : sem_wait(&wake_sem);
+    if (r != 0 && errno == EINTR) continue;
+    if (stop_worker) break;
+    if (r != 0) {
+      // periodic report, the next one is scheduled since this one
+      next_report(&next);
+    }
+    want_position_ = true;
+    for (int w = 0; w < PROGRESS_POSITION_WAIT && want_position_;
+         w += PROGRESS_POSITION_POLL) {
+      usleep(PROGRESS_POSITION_POLL);
+    }
+    Report();
+  }
+  sem_post(&done_sem);
+}
+
+// static
+void Progress::Report() {
+  // sizes of the input files of the stage, the mutex is not held while
+  // they are computed, since there may be many files
+  vector<string> files;
+  int id = 0;
+  {
+    lock_guard<mutex> lock(state_mutex);
+    id = stage_id;
+    if (sizes_id != stage_id) files = stage_files;
+  }
+  if (!files.empty()) {
+    vector<int64_t> cum(files.size() + 1, 0);
+    bool known = true;
+    for (size_t f = 0; f < files.size() && known; ++f) {
+      struct stat st;
+      known = files[f] != "" && stat(files[f].c_str(), &st) == 0 &&
+          S_ISREG(st.st_mode);
+      cum[f + 1] = cum[f] + (known ? st.st_size : 0);
+    }
+    lock_guard<mutex> lock(state_mutex);
+    if (id == stage_id) {
+      sizes_id = id;
+      cum_size.swap(cum);
+      sizes_known = known && cum_size.back() > 0;
+    }
+  }
+  lock_guard<mutex> lock(state_mutex);
+  const double t = now();
+  const int64_t rows = rows_, bytes = bytes_, pos = position_;
+  const double dt = t - last_time > 0 ? t - last_time : 1;
+  char elapsed[32];
+  format_duration(t - stage_start, elapsed, sizeof(elapsed));
+  fprintf(stderr, "Progress: %s, %s", stage_name.c_str(), elapsed);
+  if (!stage_files.empty()) {
+    const int nf = stage_files.size();
+    // fraction of the current file already processed
+    double cur = 0;
+    const bool sizes = sizes_known && sizes_id == stage_id;
+    const int64_t cur_size = sizes && cur_file >= 0 ?
+        cum_size[cur_file + 1] - cum_size[cur_file] : 0;
+    if (cur_file >= 0 && pos >= 0 && cur_size > 0) {
+      cur = min(1.0, static_cast<double>(pos) / cur_size);
+    } else if (cur_file >= 0 && cur_rows > 0) {
+      cur = min(1.0, static_cast<double>(rows - cur_rows_start) / cur_rows);
+    }
+    const int f = cur_file >= 0 ? cur_file : files_done;
+    const double done = sizes ?
+        (cum_size[f] + cur * cur_size) / cum_size.back() :
+        (files_done + cur) / nf;
+    fprintf(
+        stderr, ", %d/%d files, %lld rows, %.1f MB/s, %.0f rows/s",
+        files_done, nf, static_cast<long long>(rows),
+        (bytes - last_bytes) / dt / 1048576.0, (rows - last_rows) / dt);
+    if (done > 0) {
+      char eta[32];
+      format_duration((t - stage_start) * (1 - done) / done, eta, sizeof(eta));
+      fprintf(stderr, ", %.1f%%, ETA %s", 100.0 * done, eta);
+    } else {
+      fprintf(stderr, ", ETA unknown");
+    }
+  }
+  fprintf(stderr, "\n");
+  last_time = t;
+  last_rows = rows;
+  last_bytes = bytes;
+}
@@ -0,0 +1,93 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef FAST_PCA_PROGRESS_H_
+#define FAST_PCA_PROGRESS_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+using std::atomic;
+using std::string;
+using std::vector;
+
+// Value of the --progress long option, for getopt_long
+static const int PROGRESS_OPTION = 257;
+
+// Progress of long runs, reported on stderr by a helper thread every few
+// seconds and whenever the process receives SIGUSR1: current stage, files
+// done, rows, MB/s and rows/s (since the last report) and the estimated
+// remaining time of the stage.
+// The remaining time is estimated from the size of the input files and the
+// position in the current file, or from the number of rows given by its
+// header when the position is not known (e.g. compressed files).
+// The consumer only increments a few counters for each block, the rest of
+// the work is done by the helper thread.
+class Progress {
+ public:
+  // Start the helper thread, reporting every interval seconds (0: only
+  // when SIGUSR1 is received).
+  static void Start(double interval);
+  // Stop the helper thread.
+  static void Stop();
+
+  // Start a new stage, processing the given input files (if any).
+  static void Stage(const char* name, const vector<string>& input);
+  static void Stage(const char* name) { Stage(name, vector<string>()); }
+  // Start/finish the f-th input file of the current stage. rows is the
+  // number of rows given by the header of the file (-1 if not known).
+  static void BeginFile(int f, int rows);
+  static void EndFile();
+
+  // Add the rows and the bytes of data (in memory) read from the current
+  // file.
+  static inline void AddRows(int64_t rows, int64_t bytes) {
+    rows_.fetch_add(rows, std::memory_order_relaxed);
+    bytes_.fetch_add(bytes, std::memory_order_relaxed);
+  }
+  // Whether the helper thread needs the position in the current file, see
+  // SetPosition().
+  static inline bool WantPosition() {
+    return want_position_.load(std::memory_order_relaxed);
+  }
+  // Set the position (in bytes) in the current file, -1 if it is not known.
+  static void SetPosition(int64_t pos) {
+    position_.store(pos, std::memory_order_relaxed);
+    want_position_.store(false, std::memory_order_relaxed);
+  }
+
+ private:
+  static void Worker();
+  static void Report();
+
+  static atomic<int64_t> rows_;
+  static atomic<int64_t> bytes_;
+  static atomic<int64_t> position_;
+  static atomic<bool> want_position_;
+};
+
+#endif  // FAST_PCA_PROGRESS_H_
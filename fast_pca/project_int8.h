@@ -0,0 +1,191 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef FAST_PCA_PROJECT_INT8_H_
+#define FAST_PCA_PROJECT_INT8_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+using std::vector;
+
+// ------------------------------------------------------------------------
+// ---- Projection with the eigenvectors quantized to 8-bit integers (one
+// ---- scale for each eigenvector). Each input row is quantized on the fly
+// ---- (one scale for each row), and the dot products are computed with
+// ---- 32-bit integer accumulators. The model is 4 (or 8) times smaller
+// ---- than the float one, which helps when the projection is memory-bound
+// ---- (i.e. the eigenvectors do not fit in the cache).
+// ---- The AVX2 (vpmaddubsw) or AVX-VNNI (vpdpbusd) instructions are used
+// ---- when the compiler targets them (i.e. with -march=native).
+// ------------------------------------------------------------------------
+
+// Number of elements processed by each step of the dot product kernel,
+// rows are padded with zeros to a multiple of this.
+static const int INT8_DOT_STEP = 32;
+
+#if defined(__AVX2__)
+// acc += a * b, for each group of 4 consecutive 8-bit integers.
+// The values must be in [-127, 127]: vpmaddubsw multiplies unsigned by
+// signed bytes, thus a * b is computed as |a| * (b * sign(a)), and the sum
+// of two products can not saturate the 16-bit result.
+inline __m256i dot_int8_step(__m256i acc, __m256i a, __m256i b) {
+  const __m256i ua = _mm256_sign_epi8(a, a);
+  const __m256i sb = _mm256_sign_epi8(b, a);
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+  return _mm256_dpbusd_epi32(acc, ua, sb);
+#elif defined(__AVXVNNI__)
+  return _mm256_dpbusd_avx_epi32(acc, ua, sb);
+#else
+  const __m256i p = _mm256_maddubs_epi16(ua, sb);
+  return _mm256_add_epi32(acc, _mm256_madd_epi16(p, _mm256_set1_epi16(1)));
+#endif
+}
+
+inline int32_t hsum_int32(__m256i v) {
+  __m128i s = _mm_add_epi32(
+      _mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+  return _mm_cvtsi128_si32(s);
+}
+#endif
+
+// Dot products of the vector v with 4 vectors x (n elements each, n is a
+// multiple of INT8_DOT_STEP, separated by ldx elements).
+inline void dot_int8_x4(
+    int n, const int8_t* v, const int8_t* x, int ldx, int32_t* d) {
+#if defined(__AVX2__)
+  __m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+  __m256i acc2 = _mm256_setzero_si256(), acc3 = _mm256_setzero_si256();
+  for (int i = 0; i < n; i += INT8_DOT_STEP) {
+    const __m256i vi = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(v + i));
+    // the eigenvector is the first operand, its sign is applied to x
+    acc0 = dot_int8_step(acc0, vi, _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(x + i)));
+    acc1 = dot_int8_step(acc1, vi, _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(x + ldx + i)));
+    acc2 = dot_int8_step(acc2, vi, _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(x + 2 * ldx + i)));
+    acc3 = dot_int8_step(acc3, vi, _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(x + 3 * ldx + i)));
+  }
+  d[0] = hsum_int32(acc0);
+  d[1] = hsum_int32(acc1);
+  d[2] = hsum_int32(acc2);
+  d[3] = hsum_int32(acc3);
+#else
+  int32_t acc[4] = {0, 0, 0, 0};
+  for (int r = 0; r < 4; ++r) {
+    const int8_t* xr = x + r * ldx;
+    for (int i = 0; i < n; ++i) { acc[r] += v[i] * xr[i]; }
+  }
+  memcpy(d, acc, sizeof(acc));
+#endif
+}
+
+// Quantize the n elements of x, with a single scale (returned), which maps
+// the largest absolute value to 127.
+template <typename real_t>
+inline float quantize_int8_row(int n, const real_t* x, int8_t* q) {
+  real_t amax = 0;
+  for (int i = 0; i < n; ++i) { amax = std::max<real_t>(amax, fabs(x[i])); }
+  if (!(amax > 0)) {
+    memset(q, 0, n);
+    return 0;
+  }
+  const real_t inv_scale = 127 / amax;
+  for (int i = 0; i < n; ++i) {
+    const real_t v = x[i] * inv_scale;
+    q[i] = static_cast<int8_t>(v + (v >= 0 ? 0.5f : -0.5f));
+  }
+  return amax / 127;
+}
+
+template <typename real_t>
+class Int8Projection {
+ public:
+  // p -> (input) number of input dimensions
+  // q -> (input) number of eigenvectors
+  // v -> (input) eigenvectors, size: q rows x p columns
+  Int8Projection(int p, int q, const real_t* v) :
+      p_(p), q_(q), ldp_((p + INT8_DOT_STEP - 1) / INT8_DOT_STEP *
+                         INT8_DOT_STEP),
+      v_(static_cast<size_t>(q) * ldp_, 0), scale_(q, 0) {
+    for (int k = 0; k < q_; ++k) {
+      scale_[k] = quantize_int8_row<real_t>(
+          p_, v + static_cast<size_t>(k) * p_,
+          v_.data() + static_cast<size_t>(k) * ldp_);
+    }
+  }
+
+  int input_dim() const { return p_; }
+  int output_dim() const { return q_; }
+
+  // z = x * V', where x has n rows of p elements (separated by ldx
+  // elements) and z has n rows of q elements (separated by ldz elements).
+  void project(int n, const real_t* x, int ldx, real_t* z, int ldz) {
+    // rows are processed in groups of 4, so that each row of the model is
+    // read once for 4 input rows
+    const int n4 = (n + 3) / 4 * 4;
+    x_.assign(static_cast<size_t>(n4) * ldp_, 0);
+    xscale_.assign(n4, 0);
+    for (int i = 0; i < n; ++i) {
+      xscale_[i] = quantize_int8_row<real_t>(
+          p_, x + static_cast<size_t>(i) * ldx,
+          x_.data() + static_cast<size_t>(i) * ldp_);
+    }
+    int32_t d[4];
+    for (int i = 0; i < n; i += 4) {
+      const int8_t* xi = x_.data() + static_cast<size_t>(i) * ldp_;
+      for (int k = 0; k < q_; ++k) {
+        dot_int8_x4(
+            ldp_, v_.data() + static_cast<size_t>(k) * ldp_, xi, ldp_, d);
+        for (int r = 0; r < 4 && i + r < n; ++r) {
+          z[static_cast<size_t>(i + r) * ldz + k] =
+              static_cast<real_t>(xscale_[i + r]) * scale_[k] * d[r];
+        }
+      }
+    }
+  }
+
+ private:
+  int p_, q_;
+  int ldp_;                // padded number of input dimensions
+  vector<int8_t> v_;       // quantized eigenvectors
+  vector<float> scale_;    // scale of each eigenvector
+  vector<int8_t> x_;       // quantized input rows
+  vector<float> xscale_;   // scale of each input row
+};
+
+#endif  // FAST_PCA_PROJECT_INT8_H_
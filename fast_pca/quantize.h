@@ -0,0 +1,92 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef FAST_PCA_QUANTIZE_H_
+#define FAST_PCA_QUANTIZE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ------------------------------------------------------------------------
+// ---- Symmetric quantization to 8-bit integers, with one scale for each
+// ---- column of a row-major matrix: x ~= scale[j] * q, q in [-127, 127]
+// ---- (the zero point is always 0, projected data has zero mean).
+// ---- The loops are branch-free, so that the compiler vectorizes them.
+// ------------------------------------------------------------------------
+
+// Quantize n elements of a matrix with cols columns, starting at the
+// column col0. inv_scale contains the inverse of the scale of each column.
+template <typename real_t>
+inline void quantize_int8_block(
+    size_t n, size_t cols, size_t col0, const real_t* src,
+    const float* inv_scale, int8_t* dst) {
+  size_t i = 0;
+  // first (incomplete) row
+  for (size_t j = col0; i < n && j < cols; ++i, ++j) {
+    real_t v = src[i] * inv_scale[j];
+    v = v > -127 ? v : -127;  // NaNs are mapped to -127
+    v = v < 127 ? v : 127;
+    dst[i] = static_cast<int8_t>(v + (v >= 0 ? 0.5f : -0.5f));
+  }
+  // complete rows
+  for (; i + cols <= n; i += cols) {
+    const real_t* s = src + i;
+    int8_t* d = dst + i;
+    for (size_t j = 0; j < cols; ++j) {
+      real_t v = s[j] * inv_scale[j];
+      v = v > -127 ? v : -127;
+      v = v < 127 ? v : 127;
+      d[j] = static_cast<int8_t>(v + (v >= 0 ? 0.5f : -0.5f));
+    }
+  }
+  // last (incomplete) row
+  for (size_t j = 0; i < n; ++i, ++j) {
+    real_t v = src[i] * inv_scale[j];
+    v = v > -127 ? v : -127;
+    v = v < 127 ? v : 127;
+    dst[i] = static_cast<int8_t>(v + (v >= 0 ? 0.5f : -0.5f));
+  }
+}
+
+// Dequantize n elements of a matrix with cols columns, starting at the
+// column col0.
+template <typename real_t>
+inline void dequantize_int8_block(
+    size_t n, size_t cols, size_t col0, const int8_t* src,
+    const float* scale, real_t* dst) {
+  size_t i = 0;
+  for (size_t j = col0; i < n && j < cols; ++i, ++j) {
+    dst[i] = static_cast<real_t>(scale[j] * src[i]);
+  }
+  for (; i + cols <= n; i += cols) {
+    for (size_t j = 0; j < cols; ++j) {
+      dst[i + j] = static_cast<real_t>(scale[j] * src[i + j]);
+    }
+  }
+  for (size_t j = 0; i < n; ++i, ++j) {
+    dst[i] = static_cast<real_t>(scale[j] * src[i]);
+  }
+}
+
+#endif  // FAST_PCA_QUANTIZE_H_
@@ -0,0 +1,172 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef FAST_PCA_SPILL_H_
+#define FAST_PCA_SPILL_H_
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "fast_pca/file.h"
+#include "fast_pca/logging.h"
+
+using std::max;
+using std::min;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+// Keeps a copy of the parsed input data, so that it can be read again
+// without parsing the input files (or to read the standard input twice).
+// Data is kept in memory, up to a given number of bytes, and the rest is
+// written to an (unlinked) temporary file, in the native binary format.
+// The header of each matrix of the input files is kept too, so that the
+// output files can be written exactly as from the original input files.
+template <typename real_t>
+class DataSpill {
+ public:
+  explicit DataSpill(size_t mem_limit) :
+      mem_limit_(mem_limit / sizeof(real_t)), file_(NULL), read_pos_(0) { }
+
+  ~DataSpill() {
+    if (file_) fclose(file_);
+  }
+
+  // Start a new matrix from the input file with the given index. The
+  // header is copied from the given reader.
+  void begin_matrix(size_t file, MatrixFile* header) {
+    matrices_.push_back(Matrix());
+    matrices_.back().file = file;
+    matrices_.back().header.reset(header);
+    matrices_.back().rows = 0;
+  }
+
+  // Append rows to the current matrix.
+  void write(int rows, int cols, const real_t* x) {
+    CHECK(!matrices_.empty());
+    size_t n = static_cast<size_t>(rows) * cols;
+    const size_t nm = min(n, mem_limit_ - min(mem_limit_, mem_.size()));
+    // grow geometrically, but never beyond the limit
+    if (mem_.size() + nm > mem_.capacity()) {
+      mem_.reserve(
+          min(mem_limit_, max(mem_.size() + nm, 2 * mem_.capacity())));
+    }
+    mem_.insert(mem_.end(), x, x + nm);
+    if (nm < n) {
+      if (!file_) file_ = open_temporary_file();
+      CHECK_FMT(
+          fwrite(x + nm, sizeof(real_t), n - nm, file_) == n - nm,
+          "Failed to write temporary file: %s", strerror(errno));
+    }
+    matrices_.back().rows += rows;
+  }
+
+  // Maximum size of the data kept in memory, in bytes
+  size_t mem_limit() const { return mem_limit_ * sizeof(real_t); }
+
+  // Number of stored matrices
+  size_t matrices() const { return matrices_.size(); }
+
+  // Index of the input file of the given matrix
+  size_t matrix_file(size_t m) const { return matrices_[m].file; }
+
+  // Header of the given matrix
+  const MatrixFile& matrix_header(size_t m) const {
+    return *matrices_[m].header;
+  }
+
+  // Number of rows of the given matrix
+  int matrix_rows(size_t m) const { return matrices_[m].rows; }
+
+  // Start reading the stored data from the beginning
+  void rewind() {
+    read_pos_ = 0;
+    if (file_) {
+      CHECK_FMT(
+          fseek(file_, 0, SEEK_SET) == 0,
+          "Failed to rewind temporary file: %s", strerror(errno));
+    }
+  }
+
+  // Remove all the stored data (the temporary file is kept, to be reused)
+  void clear() {
+    mem_.clear();
+    matrices_.clear();
+    read_pos_ = 0;
+    if (file_) {
+      fflush(file_);
+      CHECK_FMT(
+          ftruncate(fileno(file_), 0) == 0 && fseek(file_, 0, SEEK_SET) == 0,
+          "Failed to truncate temporary file: %s", strerror(errno));
+    }
+  }
+
+  // Read the next n elements of the stored data.
+  void read(size_t n, real_t* x) {
+    const size_t nm = min(n, mem_.size() - min(mem_.size(), read_pos_));
+    memcpy(x, mem_.data() + read_pos_, nm * sizeof(real_t));
+    read_pos_ += nm;
+    if (nm < n) {
+      CHECK_FMT(
+          file_ && fread(x + nm, sizeof(real_t), n - nm, file_) == n - nm,
+          "Failed to read temporary file: %s", strerror(errno));
+    }
+  }
+
+ private:
+  struct Matrix {
+    size_t file;
+    unique_ptr<MatrixFile> header;
+    int rows;
+  };
+
+  static FILE* open_temporary_file() {
+    const char* dir = getenv("TMPDIR");
+    string fname = string(dir && dir[0] ? dir : "/tmp") + "/fast_pca.XXXXXX";
+    const int fd = mkstemp(&fname[0]);
+    CHECK_FMT(
+        fd >= 0, "Failed to create temporary file \"%s\": %s", fname.c_str(),
+        strerror(errno));
+    unlink(fname.c_str());
+    FILE* file = fdopen(fd, "w+b");
+    CHECK_FMT(file, "Failed to open temporary file: %s", strerror(errno));
+    return file;
+  }
+
+  const size_t mem_limit_;  // maximum number of elements kept in memory
+  vector<real_t> mem_;
+  FILE* file_;
+  size_t read_pos_;
+  vector<Matrix> matrices_;
+};
+
+#endif  // FAST_PCA_SPILL_H_
@@ -0,0 +1,275 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "fast_pca/stats.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef HAVE_PERF_EVENT
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "fast_pca/logging.h"
+
+using std::atomic;
+using std::vector;
+
+static const char* STATS_PHASE_NAME[STATS_NUM_PHASES] = {
+  "open", "header", "read", "parse", "center", "gemm", "ger", "eig",
+  "project", "write"
+};
+
+struct PhaseStats {
+  atomic<int64_t> blocks;
+  atomic<int64_t> wall_ns;
+  atomic<int64_t> cpu_ns;
+  atomic<int64_t> bytes;
+  atomic<int64_t> rows;
+  atomic<int64_t> flops;
+  atomic<int64_t> counters[STATS_NUM_COUNTERS];
+};
+
+static PhaseStats phase_stats[STATS_NUM_PHASES];
+// wall/CPU time of the process when the stats were enabled
+static int64_t start_wall_ns = 0;
+static int64_t start_cpu_ns = 0;
+
+bool Stats::enabled_ = false;
+bool Stats::counters_enabled_ = false;
+
+// File descriptors of the hardware counters of each thread, and the reason
+// why they are not available
+static vector<int> counter_fds[STATS_NUM_COUNTERS];
+static string counters_error = "not requested";
+
+#ifdef HAVE_PERF_EVENT
+static const uint64_t STATS_COUNTER_CONFIG[STATS_NUM_COUNTERS] = {
+  PERF_COUNT_HW_CPU_CYCLES,
+  PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_CACHE_MISSES  // usually, the last level cache misses
+};
+
+// Open a hardware counter of the given thread (and the threads that it
+// creates afterwards), in user space. Returns -1 on error.
+static int open_counter(pid_t tid, uint64_t config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.inherit = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(__NR_perf_event_open, &attr, tid, -1, -1, 0);
+}
+#endif
+
+static int64_t clock_ns(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+// static
+int64_t Stats::WallNs() { return clock_ns(CLOCK_MONOTONIC); }
+
+// static
+int64_t Stats::CpuNs() { return clock_ns(CLOCK_PROCESS_CPUTIME_ID); }
+
+// static
+void Stats::Enable() {
+#ifndef WITH_STATS
+  WARN(
+      "fast_pca was built without WITH_STATS, only the totals of the "
+      "process are reported!");
+#endif
+  for (int p = 0; p < STATS_NUM_PHASES; ++p) {
+    phase_stats[p].blocks = 0;
+    phase_stats[p].wall_ns = 0;
+    phase_stats[p].cpu_ns = 0;
+    phase_stats[p].bytes = 0;
+    phase_stats[p].rows = 0;
+    phase_stats[p].flops = 0;
+    for (int c = 0; c < STATS_NUM_COUNTERS; ++c) {
+      phase_stats[p].counters[c] = 0;
+    }
+  }
+  start_wall_ns = WallNs();
+  start_cpu_ns = CpuNs();
+  enabled_ = true;
+}
+
+// Open the hardware counters of all the threads, see EnableCounters()
+static bool open_counters() {
+#ifdef HAVE_PERF_EVENT
+  // Counters are opened for all the current threads of the process (e.g.
+  // the BLAS threads, which are usually created when the library is
+  // loaded), the threads created later are counted by their parent.
+  DIR* dir = opendir("/proc/self/task");
+  if (!dir) {
+    counters_error = "cannot list the threads of the process";
+    return false;
+  }
+  vector<pid_t> tids;
+  for (struct dirent* e = readdir(dir); e != NULL; e = readdir(dir)) {
+    if (e->d_name[0] != '.') tids.push_back(atoi(e->d_name));
+  }
+  closedir(dir);
+  for (size_t t = 0; t < tids.size(); ++t) {
+    for (int c = 0; c < STATS_NUM_COUNTERS; ++c) {
+      const int fd = open_counter(tids[t], STATS_COUNTER_CONFIG[c]);
+      if (fd < 0) {
+        // threads that already finished are ignored
+        if (errno == ESRCH) continue;
+        counters_error = string("perf_event_open failed: ") + strerror(errno);
+        for (int k = 0; k < STATS_NUM_COUNTERS; ++k) {
+          for (size_t i = 0; i < counter_fds[k].size(); ++i) {
+            close(counter_fds[k][i]);
+          }
+          counter_fds[k].clear();
+        }
+        return false;
+      }
+      counter_fds[c].push_back(fd);
+    }
+  }
+  counters_error = "";
+  return true;
+#else
+  counters_error = "not supported on this platform";
+  return false;
+#endif
+}
+
+// static
+bool Stats::EnableCounters() {
+  counters_enabled_ = open_counters();
+  if (!counters_enabled_) {
+    WARN_FMT(
+        "Hardware counters are not available (%s), only the times are "
+        "measured!", counters_error.c_str());
+  }
+  return counters_enabled_;
+}
+
+// static
+void Stats::ReadCounters(int64_t* values) {
+  for (int c = 0; c < STATS_NUM_COUNTERS; ++c) {
+    values[c] = 0;
+    for (size_t i = 0; i < counter_fds[c].size(); ++i) {
+      uint64_t v = 0;
+      if (read(counter_fds[c][i], &v, sizeof(v)) == sizeof(v)) {
+        values[c] += v;
+      }
+    }
+  }
+}
+
+// static
+void Stats::Add(
+    STATS_PHASE phase, int64_t wall_ns, int64_t cpu_ns,
+    const int64_t* counters) {
+  phase_stats[phase].blocks += 1;
+  phase_stats[phase].wall_ns += wall_ns;
+  phase_stats[phase].cpu_ns += cpu_ns;
+  for (int c = 0; counters && c < STATS_NUM_COUNTERS; ++c) {
+    phase_stats[phase].counters[c] += counters[c];
+  }
+}
+
+// static
+void Stats::Count(STATS_PHASE phase, int64_t bytes, int64_t rows) {
+  phase_stats[phase].bytes += bytes;
+  phase_stats[phase].rows += rows;
+}
+
+// static
+void Stats::Flops(STATS_PHASE phase, double flops) {
+  phase_stats[phase].flops += static_cast<int64_t>(flops);
+}
+
+// static
+bool Stats::WriteJson(const string& fname, const char* prog) {
+  FILE* file = fopen(fname.c_str(), "w");
+  if (!file) return false;
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  // program name, without the path
+  const char* name = strrchr(prog, '/') ? strrchr(prog, '/') + 1 : prog;
+  fprintf(file, "{\n  \"program\": \"%s\",\n", name);
+  fprintf(file, "  \"wall_seconds\": %.6f,\n",
+          (WallNs() - start_wall_ns) * 1E-9);
+  fprintf(file, "  \"cpu_seconds\": %.6f,\n",
+          (CpuNs() - start_cpu_ns) * 1E-9);
+  fprintf(file, "  \"max_rss_kb\": %ld,\n", usage.ru_maxrss);
+  if (counters_enabled_) {
+    fprintf(file, "  \"counters\": \"available\",\n");
+  } else {
+    fprintf(file, "  \"counters\": \"unavailable: %s\",\n",
+            counters_error.c_str());
+  }
+  fprintf(file, "  \"phases\": {");
+  bool first = true;
+  for (int p = 0; p < STATS_NUM_PHASES; ++p) {
+    const PhaseStats& s = phase_stats[p];
+    if (s.blocks == 0) continue;
+    fprintf(
+        file, "%s\n    \"%s\": {\"wall_seconds\": %.6f, \"cpu_seconds\": "
+        "%.6f, \"blocks\": %lld, \"bytes\": %lld, \"rows\": %lld",
+        first ? "" : ",", STATS_PHASE_NAME[p], s.wall_ns * 1E-9,
+        s.cpu_ns * 1E-9, static_cast<long long>(s.blocks),
+        static_cast<long long>(s.bytes), static_cast<long long>(s.rows));
+    if (s.flops > 0) {
+      fprintf(
+          file, ", \"flops\": %lld, \"gflops_per_second\": %.3f",
+          static_cast<long long>(s.flops),
+          s.wall_ns > 0 ? static_cast<double>(s.flops) / s.wall_ns : 0.0);
+    }
+    if (Counted(static_cast<STATS_PHASE>(p))) {
+      const int64_t cycles = s.counters[STATS_CYCLES];
+      const int64_t instructions = s.counters[STATS_INSTRUCTIONS];
+      fprintf(
+          file, ", \"cycles\": %lld, \"instructions\": %lld, "
+          "\"llc_misses\": %lld, \"ipc\": %.3f",
+          static_cast<long long>(cycles),
+          static_cast<long long>(instructions),
+          static_cast<long long>(s.counters[STATS_LLC_MISSES]),
+          cycles > 0 ? static_cast<double>(instructions) / cycles : 0.0);
+    }
+    fprintf(file, "}");
+    first = false;
+  }
+  fprintf(file, "%s}\n}\n", first ? "" : "\n  ");
+  return fclose(file) == 0;
+}
@@ -0,0 +1,175 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef FAST_PCA_STATS_H_
+#define FAST_PCA_STATS_H_
+
+#include <stdint.h>
+
+#include <string>
+
+using std::string;
+
+// Phases of the computation whose time and counters are reported with
+// --stats-json. Phases may overlap (e.g. headers are read on helper threads
+// while the previous file is processed, and the text parsing is part of the
+// reading of the data).
+typedef enum {
+  STATS_OPEN    = 0,  // open input/output files
+  STATS_HEADER  = 1,  // read matrix headers
+  STATS_READ    = 2,  // read data blocks (including the parsing)
+  STATS_PARSE   = 3,  // parse text data
+  STATS_CENTER  = 4,  // compute the block means and center the data
+  STATS_GEMM    = 5,  // update the co-moments matrix with the data block
+  STATS_GER     = 6,  // rank-1 updates of the co-moments matrix
+  STATS_EIG     = 7,  // eigendecomposition of the covariance matrix
+  STATS_PROJECT = 8,  // project the data
+  STATS_WRITE   = 9,  // write the projected data / statistics
+  STATS_NUM_PHASES = 10
+} STATS_PHASE;
+
+// Hardware counters measured in the compute phases (see EnableCounters)
+typedef enum {
+  STATS_CYCLES       = 0,
+  STATS_INSTRUCTIONS = 1,
+  STATS_LLC_MISSES   = 2,
+  STATS_NUM_COUNTERS = 3
+} STATS_COUNTER;
+
+// Global wall/CPU time and counters (bytes, rows, blocks) of each phase.
+// Nothing is measured unless Enable() was called, and nothing is compiled
+// when the project is built without WITH_STATS (see the STATS_* macros).
+// The CPU time is the time of the whole process (i.e. all threads, including
+// the BLAS threads) while the phase was running.
+class Stats {
+ public:
+  static void Enable();
+  static inline bool Enabled() { return enabled_; }
+
+  // Measure the hardware counters (cycles, instructions and LLC misses) of
+  // the whole process in the compute phases (parse, center, gemm, ger, eig
+  // and project), with perf_event_open (Linux only). This reads a few
+  // counters of each thread at the start and the end of each block, which
+  // is not free: use large blocks. Returns false, and only the times are
+  // measured, if the counters are not available (e.g. in containers, or
+  // when kernel.perf_event_paranoid does not allow it).
+  static bool EnableCounters();
+  static inline bool CountersEnabled() { return counters_enabled_; }
+  // Current value of the hardware counters, summed over all threads.
+  static void ReadCounters(int64_t* values);
+  // Whether the hardware counters are measured in the given phase.
+  static inline bool Counted(STATS_PHASE phase) {
+    return counters_enabled_ && phase != STATS_OPEN &&
+        phase != STATS_HEADER && phase != STATS_READ && phase != STATS_WRITE;
+  }
+
+  // Add the time of a run of the phase (one block), and the increments of
+  // the hardware counters (NULL if they were not measured), thread-safe.
+  static void Add(
+      STATS_PHASE phase, int64_t wall_ns, int64_t cpu_ns,
+      const int64_t* counters = NULL);
+  // Add the bytes and rows processed by the phase, thread-safe.
+  static void Count(STATS_PHASE phase, int64_t bytes, int64_t rows);
+  // Add the floating point operations done by the phase, thread-safe.
+  static void Flops(STATS_PHASE phase, double flops);
+
+  // Write the stats of all phases, and the totals of the process, to the
+  // given file as a JSON object. Returns false if the file cannot be
+  // written.
+  static bool WriteJson(const string& fname, const char* prog);
+
+  // Monotonic wall time and CPU time of the process, in ns.
+  static int64_t WallNs();
+  static int64_t CpuNs();
+
+ private:
+  static bool enabled_;
+  static bool counters_enabled_;
+};
+
+// Measures the time (and the hardware counters) from its construction to
+// its destruction, when the stats are enabled.
+class StatsTimer {
+ public:
+  explicit StatsTimer(STATS_PHASE phase) :
+      phase_(phase), wall_(-1), cpu_(0), counted_(false) {
+    if (Stats::Enabled()) {
+      counted_ = Stats::Counted(phase);
+      if (counted_) Stats::ReadCounters(counters_);
+      wall_ = Stats::WallNs();
+      cpu_ = Stats::CpuNs();
+    }
+  }
+  ~StatsTimer() {
+    if (wall_ >= 0) {
+      const int64_t wall = Stats::WallNs() - wall_;
+      const int64_t cpu = Stats::CpuNs() - cpu_;
+      if (counted_) {
+        int64_t end[STATS_NUM_COUNTERS];
+        Stats::ReadCounters(end);
+        for (int c = 0; c < STATS_NUM_COUNTERS; ++c) {
+          counters_[c] = end[c] - counters_[c];
+        }
+      }
+      Stats::Add(phase_, wall, cpu, counted_ ? counters_ : NULL);
+    }
+  }
+
+ private:
+  const STATS_PHASE phase_;
+  int64_t wall_;
+  int64_t cpu_;
+  bool counted_;
+  int64_t counters_[STATS_NUM_COUNTERS];
+};
+
+// Values of the --stats-json and --perf-counters long options (any value
+// that is not a short option), for getopt_long
+static const int STATS_JSON_OPTION = 256;
+static const int STATS_COUNTERS_OPTION = 258;
+
+#define STATS_CONCAT_(a, b) a##b
+#define STATS_CONCAT(a, b) STATS_CONCAT_(a, b)
+
+#ifdef WITH_STATS
+// Measure the time of the rest of the current scope, as a run of phase
+#define STATS_SCOPE(phase)                                        \
+  StatsTimer STATS_CONCAT(stats_timer_, __LINE__)(phase)
+// Add the processed bytes and rows to phase
+#define STATS_COUNT(phase, bytes, rows)                           \
+  do {                                                            \
+    if (Stats::Enabled()) Stats::Count((phase), (bytes), (rows)); \
+  } while (0)
+// Add the floating point operations done to phase
+#define STATS_FLOPS(phase, flops)                                 \
+  do {                                                            \
+    if (Stats::Enabled()) Stats::Flops((phase), (flops));         \
+  } while (0)
+#else
+#define STATS_SCOPE(phase)
+#define STATS_COUNT(phase, bytes, rows) do { } while (0)
+#define STATS_FLOPS(phase, flops) do { } while (0)
+#endif
+
+#endif  // FAST_PCA_STATS_H_
@@ -0,0 +1,144 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "fast_pca/stats_cache.h"
+
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "fast_pca/logging.h"
+
+static uint64_t hash_string(uint64_t h, const string& s) {
+  for (size_t i = 0; i < s.size(); ++i) {
+    h = (h ^ static_cast<unsigned char>(s[i])) * 0x100000001B3ULL;
+  }
+  // separator, so that the concatenation of strings is not ambiguous
+  return (h ^ 0xFF) * 0x100000001B3ULL;
+}
+
+static string hex_name(uint64_t h) {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(h));
+  return name;
+}
+
+// Suffix of the state file for the given type of the binary elements
+static string input_type_suffix(ELEM_TYPE type) {
+  return type == ELEM_TYPE_NATIVE ? "" :
+      ".T" + std::to_string(static_cast<int>(type));
+}
+
+StatsCache::StatsCache(
+    const string& dir, FORMAT_CODE format, size_t real_size) :
+    dir_(dir), format_(format), real_size_(real_size),
+    input_type_(
+        format == FMT_BINARY ? get_binary_input_type() : ELEM_TYPE_NATIVE),
+    state_(dir + "/state." + std::to_string(static_cast<int>(format)) + "." +
+           std::to_string(real_size) + input_type_suffix(input_type_) +
+           ".list") {
+  CHECK_FMT(
+      mkdir(dir.c_str(), 0777) == 0 || errno == EEXIST,
+      "Failed to create statistics directory \"%s\": %s", dir.c_str(),
+      strerror(errno));
+}
+
+string StatsCache::identity(const string& fname) {
+  char path[PATH_MAX];
+  struct stat st;
+  CHECK_FMT(
+      realpath(fname.c_str(), path) && stat(path, &st) == 0 &&
+      S_ISREG(st.st_mode),
+      "Failed to identify the input file \"%s\"!", fname.c_str());
+  char id[64];
+  snprintf(
+      id, sizeof(id), "%lld %lld ", static_cast<long long>(st.st_size),
+      st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec);
+  return string(id) + path;
+}
+
+uint64_t StatsCache::hash_key(uint64_t h) const {
+  h = hash_string(h, std::to_string(static_cast<int>(format_)));
+  h = hash_string(h, std::to_string(real_size_));
+  if (input_type_ != ELEM_TYPE_NATIVE) {
+    h = hash_string(h, std::to_string(static_cast<int>(input_type_)));
+  }
+  return h;
+}
+
+string StatsCache::input_stats(const string& id) const {
+  uint64_t h = 0xCBF29CE484222325ULL;
+  h = hash_string(h, id);
+  return dir_ + "/" + hex_name(hash_key(h)) + ".mat";
+}
+
+string StatsCache::merged_stats(const vector<string>& ids) const {
+  uint64_t h = 0xCBF29CE484222325ULL;
+  for (size_t i = 0; i < ids.size(); ++i) h = hash_string(h, ids[i]);
+  return dir_ + "/merged." + hex_name(hash_key(h)) + ".mat";
+}
+
+bool StatsCache::load_state(vector<string>* ids) const {
+  ids->clear();
+  FILE* file = fopen(state_.c_str(), "r");
+  if (!file) return false;
+  char* line = NULL;
+  size_t line_size = 0;
+  ssize_t len = 0;
+  while ((len = getline(&line, &line_size, file)) > 0) {
+    if (line[len - 1] == '\n') line[--len] = 0;
+    if (len > 0) ids->push_back(line);
+  }
+  free(line);
+  fclose(file);
+  return exists(merged_stats(*ids));
+}
+
+void StatsCache::save_state(const vector<string>& ids) const {
+  const string tmp = state_ + ".tmp";
+  FILE* file = fopen(tmp.c_str(), "w");
+  CHECK_FMT(file, "Failed to write file \"%s\"!", tmp.c_str());
+  for (size_t i = 0; i < ids.size(); ++i) {
+    fprintf(file, "%s\n", ids[i].c_str());
+  }
+  CHECK_FMT(fclose(file) == 0, "Failed to write file \"%s\"!", tmp.c_str());
+  commit(tmp, state_);
+}
+
+void StatsCache::commit(const string& tmp_fname, const string& fname) {
+  CHECK_FMT(
+      rename(tmp_fname.c_str(), fname.c_str()) == 0,
+      "Failed to rename file \"%s\" to \"%s\": %s", tmp_fname.c_str(),
+      fname.c_str(), strerror(errno));
+}
+
+bool StatsCache::exists(const string& fname) {
+  struct stat st;
+  return stat(fname.c_str(), &st) == 0;
+}
@@ -0,0 +1,80 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef FAST_PCA_STATS_CACHE_H_
+#define FAST_PCA_STATS_CACHE_H_
+
+#include <string>
+#include <vector>
+
+#include "fast_pca/file.h"
+
+using std::string;
+using std::vector;
+
+// Directory with the statistics (number of rows, mean and co-moments
+// matrix) of each input file processed by previous runs, and the merged
+// statistics of all the inputs of the last run.
+// Input files are identified by their absolute path, size and modification
+// time, so the statistics of a modified file are not reused. The statistics
+// also depend on the format, the floating point type and, for binary files,
+// the type of the elements (see set_binary_input_type).
+class StatsCache {
+ public:
+  StatsCache(const string& dir, FORMAT_CODE format, size_t real_size);
+
+  // Identity of the given input file.
+  static string identity(const string& fname);
+
+  // Name of the file with the statistics of the input with the given
+  // identity.
+  string input_stats(const string& id) const;
+
+  // Name of the file with the merged statistics of the given inputs.
+  string merged_stats(const vector<string>& ids) const;
+
+  // Read the identities of the inputs of the last run. Returns false if
+  // there is no last run, or its merged statistics are missing.
+  bool load_state(vector<string>* ids) const;
+
+  // Save the identities of the inputs of this run. Their merged statistics
+  // must have been saved before.
+  void save_state(const vector<string>& ids) const;
+
+  // Replace the file fname with tmp_fname.
+  static void commit(const string& tmp_fname, const string& fname);
+
+  static bool exists(const string& fname);
+
+ private:
+  const string dir_;
+  const FORMAT_CODE format_;
+  const size_t real_size_;
+  const ELEM_TYPE input_type_;
+  const string state_;
+
+  uint64_t hash_key(uint64_t h) const;
+};
+
+#endif  // FAST_PCA_STATS_CACHE_H_
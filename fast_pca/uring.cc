@@ -0,0 +1,428 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "fast_pca/uring.h"
+
+#ifdef HAVE_IO_URING
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "fast_pca/logging.h"
+
+using std::condition_variable;
+using std::deque;
+using std::lock_guard;
+using std::map;
+using std::mutex;
+using std::unique_lock;
+using std::vector;
+
+// Size of each buffer of the pool
+static const size_t URING_BUFFER_SIZE = 1 << 18;
+// Number of buffers in the pool, shared by all files
+static const int URING_POOL_SIZE = 64;
+// Maximum number of reads in flight for each file
+static const size_t URING_READS_PER_FILE = 8;
+
+// A read request of a file, into one of the buffers of the pool.
+struct UringRead {
+  int buffer;       // index of the buffer in the pool
+  off_t offset;     // offset of the file
+  size_t size;      // requested bytes
+  ssize_t result;   // read bytes, or -errno
+  bool done;
+};
+
+// A single io_uring instance, shared by all files opened with uring_open.
+// The rings are accessed directly (no liburing), all the state is protected
+// by mutex_ except for the wait for completions, which is done by only one
+// thread at a time (the reaper) without holding the mutex.
+class Uring {
+ public:
+  static Uring* Get() {
+    static Uring ring;
+    return ring.fd_ >= 0 ? &ring : NULL;
+  }
+
+  mutex& mu() { return mutex_; }
+
+  char* buffer(int b) const { return pool_ + b * URING_BUFFER_SIZE; }
+
+  // Get a free buffer from the pool, or -1 if there are none.
+  int acquire_buffer() {
+    if (free_.empty()) return -1;
+    const int b = free_.back();
+    free_.pop_back();
+    return b;
+  }
+
+  void release_buffer(int b) { free_.push_back(b); }
+
+  // Queue a read request. Requests are sent to the kernel by submit().
+  void queue(int fd, UringRead* r) {
+    const unsigned tail = *sq_tail_;
+    const unsigned idx = tail & *sq_mask_;
+    io_uring_sqe* sqe = sqes_ + idx;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = registered_ ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->off = r->offset;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer(r->buffer));
+    sqe->len = r->size;
+    sqe->buf_index = registered_ ? r->buffer : 0;
+    sqe->user_data = reinterpret_cast<uint64_t>(r);
+    sq_array_[idx] = idx;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    ++queued_;
+  }
+
+  void submit() {
+    while (queued_ > 0) {
+      const int r = syscall(__NR_io_uring_enter, fd_, queued_, 0, 0, NULL, 0);
+      if (r < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY)) {
+        continue;
+      }
+      CHECK_FMT(r >= 0, "io_uring submission failed: %s", strerror(errno));
+      queued_ -= r;
+    }
+  }
+
+  // Wait until the given request is completed. lock must hold mu().
+  void wait(UringRead* r, unique_lock<mutex>* lock) {
+    while (!r->done) {
+      if (reaping_) {
+        // another thread is waiting for completions, it will notify us
+        reaped_cv_.wait(*lock);
+        continue;
+      }
+      reap();
+      if (r->done) break;
+      reaping_ = true;
+      lock->unlock();
+      const int ret = syscall(
+          __NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+      const int err = errno;
+      lock->lock();
+      reaping_ = false;
+      reap();
+      reaped_cv_.notify_all();
+      CHECK_FMT(
+          ret >= 0 || err == EINTR, "io_uring wait failed: %s", strerror(err));
+    }
+  }
+
+ private:
+  Uring() : fd_(-1), registered_(false), queued_(0), reaping_(false) {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    // the queues can hold all the requests that fit in the buffer pool
+    const int fd = syscall(__NR_io_uring_setup, URING_POOL_SIZE, &p);
+    if (fd < 0) return;
+    const size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    const size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+    char* sq = static_cast<char*>(mmap(
+        NULL, single_mmap ? std::max(sq_size, cq_size) : sq_size,
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+        IORING_OFF_SQ_RING));
+    char* cq = single_mmap ? sq : static_cast<char*>(mmap(
+        NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+        IORING_OFF_CQ_RING));
+    void* sqes = mmap(
+        NULL, p.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED) {
+      close(fd);
+      return;
+    }
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+    // allocate the buffer pool and register it, to avoid mapping the
+    // buffers on each read (registration may fail if the amount of locked
+    // memory is limited, then regular reads are used)
+    void* pool = NULL;
+    if (posix_memalign(&pool, 4096, URING_POOL_SIZE * URING_BUFFER_SIZE)) {
+      close(fd);
+      return;
+    }
+    pool_ = static_cast<char*>(pool);
+    vector<iovec> iov(URING_POOL_SIZE);
+    for (int b = 0; b < URING_POOL_SIZE; ++b) {
+      iov[b].iov_base = buffer(b);
+      iov[b].iov_len = URING_BUFFER_SIZE;
+      free_.push_back(URING_POOL_SIZE - b - 1);
+    }
+    registered_ = syscall(
+        __NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, iov.data(),
+        URING_POOL_SIZE) == 0;
+    fd_ = fd;
+  }
+
+  // Process all the available completions.
+  void reap() {
+    unsigned head = *cq_head_;
+    const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+      const io_uring_cqe* cqe = cqes_ + (head & *cq_mask_);
+      UringRead* r = reinterpret_cast<UringRead*>(cqe->user_data);
+      r->result = cqe->res;
+      r->done = true;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+  }
+
+  int fd_;
+  bool registered_;
+  unsigned queued_;
+  bool reaping_;
+  mutex mutex_;
+  condition_variable reaped_cv_;
+  char* pool_;
+  vector<int> free_;
+  unsigned* sq_tail_;
+  unsigned* sq_mask_;
+  unsigned* sq_array_;
+  io_uring_sqe* sqes_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned* cq_mask_;
+  io_uring_cqe* cqes_;
+};
+
+// State of a file opened with uring_open.
+struct UringFile {
+  FILE* stream;
+  int fd;
+  off_t size;   // size of the file, when it was opened
+  off_t pos;    // current position of the stream
+  off_t next;   // offset of the next read request
+  deque<UringRead*> reads;  // requests in flight, sorted by offset
+};
+
+// Send read requests ahead of the current position. Must hold the ring mutex.
+static void uring_fill(Uring* ring, UringFile* f) {
+  bool queued = false;
+  while (f->reads.size() < URING_READS_PER_FILE && f->next < f->size) {
+    const int b = ring->acquire_buffer();
+    if (b < 0) break;
+    UringRead* r = new UringRead;
+    r->buffer = b;
+    r->offset = f->next;
+    r->size = std::min<off_t>(URING_BUFFER_SIZE, f->size - f->next);
+    r->result = 0;
+    r->done = false;
+    ring->queue(f->fd, r);
+    f->reads.push_back(r);
+    f->next += r->size;
+    queued = true;
+  }
+  if (queued) ring->submit();
+}
+
+// Wait for all the requests in flight and discard them, so that the next
+// read request starts at the current position. Must hold the ring mutex.
+static void uring_drain(
+    Uring* ring, UringFile* f, unique_lock<mutex>* lock) {
+  for (UringRead* r : f->reads) {
+    ring->wait(r, lock);
+    ring->release_buffer(r->buffer);
+    delete r;
+  }
+  f->reads.clear();
+  f->next = f->pos;
+}
+
+static ssize_t uring_read(void* cookie, char* buf, size_t n) {
+  UringFile* f = static_cast<UringFile*>(cookie);
+  Uring* ring = Uring::Get();
+  unique_lock<mutex> lock(ring->mu());
+  if (f->reads.empty()) uring_fill(ring, f);
+  if (f->reads.empty()) {
+    if (f->pos >= f->size) return 0;
+    // all the buffers of the pool are in use, read synchronously
+    lock.unlock();
+    const ssize_t r = pread(f->fd, buf, n, f->pos);
+    if (r > 0) f->pos += r;
+    f->next = f->pos;
+    return r;
+  }
+  UringRead* r = f->reads.front();
+  ring->wait(r, &lock);
+  if (r->result < 0) {
+    const int err = -r->result;
+    uring_drain(ring, f, &lock);
+    errno = err;
+    return -1;
+  }
+  const off_t end = r->offset + r->result;
+  if (f->pos >= end) {
+    // the file was truncated after it was opened
+    uring_drain(ring, f, &lock);
+    return 0;
+  }
+  const size_t k = std::min<off_t>(n, end - f->pos);
+  memcpy(buf, ring->buffer(r->buffer) + (f->pos - r->offset), k);
+  f->pos += k;
+  if (f->pos == end) {
+    if (static_cast<size_t>(r->result) < r->size) {
+      // short read, the following requests start at a wrong offset
+      uring_drain(ring, f, &lock);
+    } else {
+      f->reads.pop_front();
+      ring->release_buffer(r->buffer);
+      delete r;
+    }
+    uring_fill(ring, f);
+  }
+  return k;
+}
+
+static int uring_seek(void* cookie, off64_t* offset, int whence) {
+  UringFile* f = static_cast<UringFile*>(cookie);
+  off_t pos = *offset;
+  if (whence == SEEK_CUR) pos += f->pos;
+  else if (whence == SEEK_END) pos += f->size;
+  if (pos < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (pos != f->pos) {
+    Uring* ring = Uring::Get();
+    unique_lock<mutex> lock(ring->mu());
+    if (pos > f->pos && pos < f->next) {
+      // moving forward inside the requests in flight, keep the needed ones
+      while (pos >= static_cast<off_t>(
+          f->reads.front()->offset + f->reads.front()->size)) {
+        UringRead* r = f->reads.front();
+        ring->wait(r, &lock);
+        f->reads.pop_front();
+        ring->release_buffer(r->buffer);
+        delete r;
+      }
+    } else {
+      uring_drain(ring, f, &lock);
+    }
+    f->pos = pos;
+    if (f->reads.empty()) f->next = pos;
+  }
+  *offset = pos;
+  return 0;
+}
+
+// File descriptors of the open streams, used by uring_fd
+static mutex uring_fds_mutex;
+static map<FILE*, int> uring_fds;
+
+static int uring_close(void* cookie) {
+  UringFile* f = static_cast<UringFile*>(cookie);
+  {
+    lock_guard<mutex> lock(uring_fds_mutex);
+    uring_fds.erase(f->stream);
+  }
+  {
+    Uring* ring = Uring::Get();
+    unique_lock<mutex> lock(ring->mu());
+    uring_drain(ring, f, &lock);
+  }
+  const int r = close(f->fd);
+  delete f;
+  return r;
+}
+
+bool uring_available() {
+  return Uring::Get() != NULL;
+}
+
+FILE* uring_open(const char* fname) {
+  Uring* ring = Uring::Get();
+  if (!ring) return NULL;
+  const int fd = open(fname, O_RDONLY);
+  if (fd < 0) return NULL;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return NULL;
+  }
+  UringFile* f = new UringFile;
+  f->fd = fd;
+  f->size = st.st_size;
+  f->pos = f->next = 0;
+  cookie_io_functions_t io = {uring_read, NULL, uring_seek, uring_close};
+  FILE* file = fopencookie(f, "rb", io);
+  if (!file) {
+    close(fd);
+    delete f;
+    return NULL;
+  }
+  setvbuf(file, NULL, _IOFBF, 1 << 16);
+  f->stream = file;
+  {
+    lock_guard<mutex> lock(uring_fds_mutex);
+    uring_fds[file] = fd;
+  }
+  // start reading the file right away
+  unique_lock<mutex> lock(ring->mu());
+  uring_fill(ring, f);
+  return file;
+}
+
+int uring_fd(FILE* file) {
+  const int fd = fileno(file);
+  if (fd >= 0) return fd;
+  lock_guard<mutex> lock(uring_fds_mutex);
+  map<FILE*, int>::const_iterator it = uring_fds.find(file);
+  return it == uring_fds.end() ? -1 : it->second;
+}
+
+#else  // HAVE_IO_URING
+
+bool uring_available() { return false; }
+
+FILE* uring_open(const char* fname) { return NULL; }
+
+int uring_fd(FILE* file) { return fileno(file); }
+
+#endif  // HAVE_IO_URING
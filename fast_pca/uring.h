@@ -0,0 +1,55 @@
+/*
+  The MIT License (MIT)
+
+  Copyright (c) 2015 Joan Puigcerver
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef FAST_PCA_URING_H_
+#define FAST_PCA_URING_H_
+
+#include <cstdio>
+
+// ------------------------------------------------------------------------
+// ---- uring_available: Return true if Linux io_uring can be used to read
+// ---- files (the kernel supports it and fast_pca was compiled with it).
+// ------------------------------------------------------------------------
+bool uring_available();
+
+// ------------------------------------------------------------------------
+// ---- uring_open: Open a regular file for reading. The returned FILE* is
+// ---- served from a pool of large buffers, shared by all open files,
+// ---- which are filled asynchronously by io_uring: several reads of each
+// ---- file are kept in flight ahead of the current position, starting
+// ---- as soon as the file is opened. Returns NULL if the file is not a
+// ---- regular file or io_uring is not available.
+// ---- The returned FILE* has no file descriptor (fileno() fails, use
+// ---- uring_fd instead), it must be closed with fclose (or close_file).
+// ------------------------------------------------------------------------
+FILE* uring_open(const char* fname);
+
+// ------------------------------------------------------------------------
+// ---- uring_fd: Return the file descriptor of the file read by a FILE*
+// ---- returned by uring_open (e.g. to fstat or mmap the file), or
+// ---- fileno(file) for any other FILE*.
+// ------------------------------------------------------------------------
+int uring_fd(FILE* file);
+
+#endif  // FAST_PCA_URING_H_
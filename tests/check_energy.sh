@@ -0,0 +1,22 @@
+#!/bin/bash
+set -e;
+
+[ $# -ne 3 ] && {
+    echo "Usage: ${0##*/} pca_ref.mat pca_test.mat tolerance" >&2;
+    echo "Check that the energy of the eigenvalues of pca_test.mat plus" \
+         "the energy it misses matches the total energy of the reference." >&2;
+    exit 1;
+}
+
+octave --eval "
+load '$1';
+Tref = sum(D) + R;
+load '$2';
+T = sum(D) + R;
+if abs(Tref - T) > $3 * abs(Tref)
+  fprintf(stderr, 'Total energy %g does not match the reference %g', T, Tref);
+  exit(1);
+endif
+" || { echo "File \"$2\" does not match the reference \"$1\"!" >&2; exit 1; }
+
+exit 0;
@@ -0,0 +1,54 @@
+#!/bin/bash
+set -e;
+set -o pipefail;
+
+[ $# -ne 4 ] && {
+    echo "Usage: ${0##*/} proj_ref.mat proj_test.mat type cols" >&2;
+    echo "Check the projected data written with -O type (float16 or int8)," \
+         "against the float32 projection. Both are Binary or NPY files," \
+         "and the scales of int8 data are read from proj_test.mat.scales." >&2;
+    exit 1;
+}
+
+# Print the elements of a Binary or NPY file (the NPY header is skipped),
+# one per line, read with the given od type
+function dump () {
+  local skip=0;
+  if [ "$(head -c 6 "$1" | tail -c 5)" = "NUMPY" ]; then
+    skip=$(( 10 + $(od -An -t u2 -j 8 -N 2 "$1") ));
+  fi;
+  od -An -v -t "$2" -j "${skip}" "$1" | tr -s ' ' '\n' | sed '/^$/d';
+}
+
+case "$3" in
+  float16) dump "$2" u2 > "$2.elems"; echo 1 > "$2.elems.scales";;
+  int8) dump "$2" d1 > "$2.elems"; dump "$2.scales" f4 > "$2.elems.scales";;
+  *) echo "Unknown type \"$3\"!" >&2; exit 1;;
+esac;
+dump "$1" f4 | paste - "$2.elems" | awk -v type="$3" -v cols="$4" '
+  NR == FNR { scale[FNR - 1] = $1; next; }
+  NF != 2 { printf("Number of elements does not match\n"); exit 1; }
+  {
+    j = (FNR - 1) % cols;
+    if (type == "float16") {
+      e = int($2 / 1024) % 32;
+      m = $2 % 1024;
+      x = e == 0 ? m * 2 ^ -24 : (1 + m / 1024) * 2 ^ (e - 15);
+      if ($2 >= 32768) x = -x;
+      # round to nearest, with 11 bits of precision
+      bad = e == 31 || ($1 - x) ^ 2 > (2 ^ -11 * $1) ^ 2 + 1E-12;
+    } else {
+      x = scale[j] * $2;
+      # round to nearest, values beyond 127 steps are clipped
+      bad = ($1 - x) ^ 2 > (0.5001 * scale[j]) ^ 2 &&
+          !($2 == 127 && $1 > x) && !($2 == -127 && $1 < x);
+    }
+    if (bad) {
+      printf("Element %d: %g (expected: %g)\n", FNR, x, $1);
+      exit 1;
+    }
+  }' "$2.elems.scales" - >&2 ||
+{ echo "File \"$2\" does not match the reference \"$1\"!" >&2; exit 1; }
+rm -f "$2.elems" "$2.elems.scales";
+
+exit 0;
@@ -0,0 +1,30 @@
+#!/bin/bash
+set -e;
+
+[ $# -ne 5 ] && {
+    echo "Usage: ${0##*/} pca.mat data.mat odim scores.txt tolerance" >&2;
+    exit 1;
+}
+
+octave --eval "
+load '$1';
+X = load('$2');
+M = M(:)'; D = D(:)';
+X = X - repmat(M, size(X, 1), 1);
+Z = X * V(1:$3, :)';
+R = X - Z * V(1:$3, :);
+Sref = [sum(R .^ 2, 2), sum((Z .^ 2) ./ repmat(D(1:$3), size(X, 1), 1), 2)];
+S = load('$4');
+if sum(size(S) ~= size(Sref)) ~= 0
+  fprintf(stderr, 'Sizes do not match (%d,%d) vs (%d,%d)\n', ...
+          size(Sref, 1), size(Sref, 2), size(S, 1), size(S, 2));
+  exit(1);
+endif
+max_err = max(max(abs(S - Sref) ./ (1 + abs(Sref))));
+if max_err > $5
+  fprintf(stderr, 'Maximum Relative Error: %g\n', max_err);
+  exit(1);
+endif
+" || { echo "Scores \"$4\" do not match the reference!" >&2; exit 1; }
+
+exit 0;
@@ -0,0 +1,25 @@
+#!/bin/bash
+set -e;
+
+[ $# -lt 2 ] && {
+    echo "Usage: ${0##*/} stats.json phase [phase ...]" >&2;
+    exit 1;
+}
+
+STATS="$1";
+shift;
+for key in program wall_seconds cpu_seconds max_rss_kb phases; do
+  grep -q "\"${key}\":" "${STATS}" || {
+    echo "Field \"${key}\" was not found in file \"${STATS}\"!" >&2;
+    exit 1;
+  }
+done;
+for phase in "$@"; do
+  grep -q "^    \"${phase}\": {\"wall_seconds\": [0-9.]*, \"cpu_seconds\": " \
+      "${STATS}" || {
+    echo "Phase \"${phase}\" was not found in file \"${STATS}\"!" >&2;
+    exit 1;
+  }
+done;
+
+exit 0;
@@ -0,0 +1,20 @@
+#!/bin/bash
+set -e;
+
+[ $# -ne 2 ] && {
+    echo "Usage: ${0##*/} proj_test.mat tolerance" >&2;
+    exit 1;
+}
+
+octave --eval "
+X = load('$1');
+C = cov(X);
+max_err = max(max(abs(C - eye(size(C)))));
+if max_err > $2
+  fprintf(stderr, 'Covariance of the whitened data is not the identity. ');
+  fprintf(stderr, 'Maximum Absolute Error: %g\n', max_err);
+  exit(1);
+endif
+" || { echo "File \"$1\" is not white!" >&2; exit 1; }
+
+exit 0;
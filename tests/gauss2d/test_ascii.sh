@@ -31,6 +31,58 @@ FAST_PCA_CMD="$1";
     > proj.ascii.norm.sp.2.mat;
 "${FAST_PCA_CMD}" -C -P -d -n -f ascii -p 2 -m pca.ascii.dp.2.mat "${DATA}" \
     > proj.ascii.norm.dp.2.mat;
+## Compute PCA & Project data in a single pass, reading from stdin
+"${FAST_PCA_CMD}" -C -P -f ascii -p 2 -m pca.ascii.sp.3.mat < "${DATA}" \
+    > proj.ascii.sp.3.mat;
+"${FAST_PCA_CMD}" -C -P -d -k 0 -f ascii -p 2 -m pca.ascii.dp.3.mat \
+    < "${DATA}" > proj.ascii.dp.3.mat;
+## Project data into another format (the number of rows is not known until
+## all the data is read)
+"${FAST_PCA_CMD}" -P -d -f ascii -F octave -p 2 "${DATA}" \
+    -m pca.ascii.dp.mat > proj.ascii2octave.dp.mat;
+## Project whitened data
+"${FAST_PCA_CMD}" -P -d -f ascii -W pca -E 0 -p 2 "${DATA}" \
+    -m pca.ascii.dp.mat > proj.ascii.pcaw.dp.mat;
+"${FAST_PCA_CMD}" -P -d -f ascii -W zca -E 0 -p 2 "${DATA}" \
+    -m pca.ascii.dp.mat > proj.ascii.zcaw.dp.mat;
+## Project data with the eigenvectors quantized to 8-bit integers
+"${FAST_PCA_CMD}" -P -d -f ascii -Q 0.05 -p 2 "${DATA}" \
+    -m pca.ascii.dp.mat > proj.ascii.int8.dp.mat;
+## Project data into a single dimension, computing the reconstruction scores
+"${FAST_PCA_CMD}" -P -d -f ascii -q 1 -R scores.ascii.dp.txt -p 2 "${DATA}" \
+    -m pca.ascii.dp.mat > proj.ascii.q1.dp.mat;
+## Compute PCA & Project data, reporting the time of each phase
+"${FAST_PCA_CMD}" -C -P -f ascii -p 2 -t 2 -m pca.ascii.sp.4.mat \
+    --stats-json stats.ascii.json "${DATA}" > proj.ascii.sp.4.mat;
+## Compute PCA & Project data within a memory limit
+"${FAST_PCA_CMD}" -C -P -f ascii -p 2 --mem-limit 64 -m pca.ascii.sp.5.mat \
+    < "${DATA}" > proj.ascii.sp.5.mat;
+## Refuse a problem whose co-moments matrix does not fit in the memory limit,
+## before reading the data
+if "${FAST_PCA_CMD}" -C -f ascii -p 100000 --mem-limit 64 \
+    -m pca.ascii.big.mat /dev/null 2> mem.ascii.err; then
+  echo "Expected the memory limit to be exceeded!" >&2;
+  exit 1;
+fi;
+grep -q "does not fit in the memory limit" mem.ascii.err;
+## Compute PCA & Project data with the io_uring backend (or stdio, where
+## io_uring is not available), from one file and from two files, with the
+## text split among threads: the result must match the stdio one
+head -n 400 "${DATA}" > data.part0.ascii.mat;
+tail -n +401 "${DATA}" > data.part1.ascii.mat;
+for io in stdio uring; do
+  "${FAST_PCA_CMD}" -C -P -f ascii -p 2 -t 2 -i ${io} \
+      -m pca.ascii.${io}.mat --stats-json stats.ascii.${io}.json "${DATA}" \
+      > proj.ascii.${io}.mat;
+  "${FAST_PCA_CMD}" -C -P -f ascii -p 2 -t 2 -i ${io} \
+      -m pca.ascii.${io}.parts.mat \
+      data.part0.ascii.mat proj.ascii.${io}.part0.mat \
+      data.part1.ascii.mat proj.ascii.${io}.part1.mat;
+done;
+for f in pca.ascii.@ proj.ascii.@ pca.ascii.@.parts proj.ascii.@.part0 \
+    proj.ascii.@.part1; do
+  cmp "${f/@/stdio}.mat" "${f/@/uring}.mat";
+done;
 
 ## Check PCA
 "${SDIR}/../check_pca.sh" "${PCA_REF}" pca.ascii.sp.mat 1E-5;
@@ -38,12 +90,38 @@ FAST_PCA_CMD="$1";
 ## Check PCA 2
 "${SDIR}/../check_pca.sh" "${PCA_REF}" pca.ascii.sp.2.mat 1E-5;
 "${SDIR}/../check_pca.sh" "${PCA_REF}" pca.ascii.dp.2.mat 1E-4;
+## Check PCA 4
+"${SDIR}/../check_pca.sh" "${PCA_REF}" pca.ascii.sp.4.mat 1E-5;
+## Check PCA 5
+"${SDIR}/../check_pca.sh" "${PCA_REF}" pca.ascii.sp.5.mat 1E-5;
 ## Check data projections
 "${SDIR}/../check_proj_ascii.sh" "${DATA_PROJ_REF}" proj.ascii.sp.mat 1E-2;
 "${SDIR}/../check_proj_ascii.sh" "${DATA_PROJ_REF}" proj.ascii.dp.mat 1E-4;
 ## Check data projections 2
 "${SDIR}/../check_proj_ascii.sh" "${DATA_PROJ_REF}" proj.ascii.sp.2.mat 1E-2;
 "${SDIR}/../check_proj_ascii.sh" "${DATA_PROJ_REF}" proj.ascii.dp.2.mat 1E-4;
+## Check data projections 3
+"${SDIR}/../check_proj_ascii.sh" "${DATA_PROJ_REF}" proj.ascii.sp.3.mat 1E-2;
+"${SDIR}/../check_proj_ascii.sh" "${DATA_PROJ_REF}" proj.ascii.dp.3.mat 1E-4;
+## Check data projections 5
+"${SDIR}/../check_proj_ascii.sh" "${DATA_PROJ_REF}" proj.ascii.sp.5.mat 1E-2;
+## Check data projections into another format
+"${SDIR}/../check_proj_octave.sh" "${DATA_PROJ_REF}" \
+    proj.ascii2octave.dp.mat 1E-4;
+## Check data projections with the int8 eigenvectors
+"${SDIR}/../check_proj_ascii.sh" "${DATA_PROJ_REF}" \
+    proj.ascii.int8.dp.mat 5E-2;
+## Check whitened data projections
+"${SDIR}/../check_whiten.sh" proj.ascii.pcaw.dp.mat 1E-6;
+"${SDIR}/../check_whiten.sh" proj.ascii.zcaw.dp.mat 1E-6;
+## Check reconstruction scores
+"${SDIR}/../check_scores.sh" pca.ascii.dp.mat "${DATA}" 1 \
+    scores.ascii.dp.txt 1E-6;
+## Check reported phases
+"${SDIR}/../check_stats.sh" stats.ascii.json open header read parse center \
+    gemm ger eig project write;
+"${SDIR}/../check_stats.sh" stats.ascii.uring.json open header read parse \
+    center gemm ger eig project write;
 ## Check normalized data projections
 "${SDIR}/../check_proj_ascii.sh" "${DATA_PROJ_NORM_REF}" \
     proj.ascii.norm.sp.mat 1E-2;
@@ -4,19 +4,237 @@ set -e;
 SDIR=$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd );
 DATA_SP="${SDIR}/../../examples/gauss2d/data.binary.sp.mat";
 DATA_DP="${SDIR}/../../examples/gauss2d/data.binary.dp.mat";
+PCA_REF="${SDIR}/pca.reference.mat";
 DATA_PROJ_REF="${SDIR}/data.proj.reference.mat";
 DATA_PROJ_NORM_REF="${SDIR}/data.proj.norm.reference.mat";
 FAST_PCA_CMD="$1";
+BIN_DIR="$(dirname "${FAST_PCA_CMD}")";
 
 ## Compute PCA & Project data in a single pass
 "${FAST_PCA_CMD}" -C -P -f binary -p 2 -m pca.binary.sp.mat "${DATA_SP}" > proj.binary.sp.mat;
 "${FAST_PCA_CMD}" -C -P -d -f binary -p 2 -m pca.binary.dp.mat "${DATA_DP}" > proj.binary.dp.mat;
 
+## Compute PCA & Project data twice, the second time from the statistics
+## kept by the first run
+rm -rf stats.binary;
+"${FAST_PCA_CMD}" -C -P -d -s stats.binary -f binary -p 2 \
+    -m pca.binary.dp.2.mat "${DATA_DP}" > proj.binary.dp.2.mat;
+"${FAST_PCA_CMD}" -C -P -d -s stats.binary -f binary -p 2 \
+    -m pca.binary.dp.3.mat "${DATA_DP}" > proj.binary.dp.3.mat;
+
 LC_NUMERIC=C od -An -t f4 -w8 proj.binary.sp.mat > proj.binary2ascii.sp.mat;
 LC_NUMERIC=C od -An -t f8 -w16 proj.binary.dp.mat > proj.binary2ascii.dp.mat;
+LC_NUMERIC=C od -An -t f8 -w16 proj.binary.dp.2.mat > proj.binary2ascii.dp.2.mat;
+LC_NUMERIC=C od -An -t f8 -w16 proj.binary.dp.3.mat > proj.binary2ascii.dp.3.mat;
 
 ## Check data projections
 "${SDIR}/../check_proj_ascii.sh" "${DATA_PROJ_REF}" proj.binary2ascii.sp.mat 1E-2;
 "${SDIR}/../check_proj_ascii.sh" "${DATA_PROJ_REF}" proj.binary2ascii.dp.mat 1E-8;
+## Check data projections 2 & 3 (reused statistics)
+"${SDIR}/../check_proj_ascii.sh" "${DATA_PROJ_REF}" proj.binary2ascii.dp.2.mat 1E-8;
+"${SDIR}/../check_proj_ascii.sh" "${DATA_PROJ_REF}" proj.binary2ascii.dp.3.mat 1E-8;
+
+## Compute PCA with map & reduce: same PCA as fast_pca -C, also when only
+## the first eigenvector is kept (the energy of the second one is missed)
+"${BIN_DIR}/fast_pca_map" -d -f binary -p 2 -o map.binary.dp.mat "${DATA_DP}";
+"${BIN_DIR}/fast_pca_reduce" -d -m pca.reduce.binary.dp.mat map.binary.dp.mat;
+"${BIN_DIR}/fast_pca_reduce" -d -q 1 -m pca.reduce.binary.q1.mat \
+    map.binary.dp.mat;
+"${FAST_PCA_CMD}" -C -d -q 1 -f binary -p 2 -m pca.binary.q1.mat "${DATA_DP}";
+"${SDIR}/../check_pca.sh" "${PCA_REF}" pca.reduce.binary.dp.mat 1E-8;
+"${SDIR}/../check_pca.sh" pca.binary.q1.mat pca.reduce.binary.q1.mat 1E-8;
+"${SDIR}/../check_energy.sh" "${PCA_REF}" pca.binary.q1.mat 1E-8;
+"${SDIR}/../check_energy.sh" "${PCA_REF}" pca.reduce.binary.q1.mat 1E-8;
+
+## Compute only the leading eigenvectors (-w), starting from the PCA of half
+## of the data: same PCA as the full solve, with fast_pca and with
+## fast_pca_reduce
+"${BIN_DIR}/fast_pca_gen" -d -f binary -p 20 -n 2000 -e exp:0.7 \
+    > data.gen.binary.dp.mat;
+head -c 160000 data.gen.binary.dp.mat > data.gen.half.binary.dp.mat;
+"${FAST_PCA_CMD}" -C -d -q 3 -f binary -p 20 -m pca.gen.half.mat \
+    data.gen.half.binary.dp.mat;
+"${FAST_PCA_CMD}" -C -d -q 3 -f binary -p 20 -m pca.gen.mat \
+    data.gen.binary.dp.mat;
+"${FAST_PCA_CMD}" -C -d -q 3 -w pca.gen.half.mat -f binary -p 20 \
+    -m pca.gen.warm.mat data.gen.binary.dp.mat 2> warm.log;
+grep -q "^Eigensolver: [0-9]* iterations" warm.log;
+"${BIN_DIR}/fast_pca_map" -d -f binary -p 20 -o map.gen.mat \
+    data.gen.binary.dp.mat;
+"${BIN_DIR}/fast_pca_reduce" -d -q 3 -w pca.gen.half.mat \
+    -m pca.gen.reduce.warm.mat map.gen.mat 2> warm.log;
+grep -q "^Eigensolver: [0-9]* iterations" warm.log;
+## Fall back to the full solve when the 3 x 2 vectors of the iterative
+## method do not fit in the 2 dimensions of the data, or the 3 eigenvectors
+## of the previous model do not preserve the energy requested with -j
+"${FAST_PCA_CMD}" -C -d -w "${PCA_REF}" -f binary -p 2 \
+    -m pca.binary.warm.mat "${DATA_DP}" 2> warm.log;
+if grep -q "^Eigensolver:" warm.log; then
+  echo "Expected all the eigenvectors to be computed!" >&2;
+  exit 1;
+fi;
+"${FAST_PCA_CMD}" -C -d -j 0.999 -f binary -p 20 -m pca.gen.j.mat \
+    data.gen.binary.dp.mat;
+"${FAST_PCA_CMD}" -C -d -j 0.999 -w pca.gen.half.mat -f binary -p 20 \
+    -m pca.gen.warm.j.mat data.gen.binary.dp.mat 2> warm.log;
+grep -q "do not preserve the requested energy" warm.log;
+"${SDIR}/../check_pca.sh" pca.gen.mat pca.gen.warm.mat 1E-8;
+"${SDIR}/../check_pca.sh" pca.gen.mat pca.gen.reduce.warm.mat 1E-8;
+"${SDIR}/../check_pca.sh" "${PCA_REF}" pca.binary.warm.mat 1E-8;
+"${SDIR}/../check_pca.sh" pca.gen.j.mat pca.gen.warm.j.mat 1E-8;
+
+## Incremental PCA: compute the statistics of 3 parts of the data, then
+## remove one part (downdate) or add a new one (merge), and compare with
+## the PCA computed from scratch
+for p in 0 1 2 3; do
+  dd if="${DATA_DP}" of=data.part${p}.binary.dp.mat bs=4000 skip=${p} \
+      count=1 2> /dev/null;
+done;
+rm -rf stats.parts stats.parts.merge;
+"${FAST_PCA_CMD}" -C -d -s stats.parts -f binary -p 2 \
+    -m pca.parts.3.mat data.part{0,1,2}.binary.dp.mat;
+cp -r stats.parts stats.parts.merge;
+"${FAST_PCA_CMD}" -C -d -s stats.parts -f binary -p 2 \
+    -m pca.parts.2.mat data.part{0,1}.binary.dp.mat 2> stats.parts.log;
+grep -q "2 files reused, 0 files read, 1 files removed" stats.parts.log;
+"${FAST_PCA_CMD}" -C -d -s stats.parts.merge -f binary -p 2 \
+    -m pca.parts.4.mat data.part{0,1,2,3}.binary.dp.mat 2> stats.parts.log;
+grep -q "3 files reused, 1 files read, 0 files removed" stats.parts.log;
+"${FAST_PCA_CMD}" -C -d -f binary -p 2 -m pca.parts.2.ref.mat \
+    data.part{0,1}.binary.dp.mat;
+"${FAST_PCA_CMD}" -C -d -f binary -p 2 -m pca.parts.4.ref.mat \
+    data.part{0,1,2,3}.binary.dp.mat;
+"${SDIR}/../check_pca.sh" pca.parts.2.ref.mat pca.parts.2.mat 1E-8;
+"${SDIR}/../check_pca.sh" pca.parts.4.ref.mat pca.parts.4.mat 1E-8;
+## The statistics of the elements read with another type are not reused
+"${FAST_PCA_CMD}" -C -d -s stats.parts -T float64 -f binary -p 2 \
+    -m pca.parts.T.mat data.part0.binary.dp.mat 2> stats.parts.log;
+grep -q "0 files reused, 1 files read" stats.parts.log;
+
+## Compute PCA & Project data with the io_uring backend (or stdio, where
+## io_uring is not available), from one file and from two files: the result
+## must match the stdio one
+for p in 0 1; do
+  dd if="${DATA_SP}" of=data.part${p}.binary.sp.mat bs=4000 skip=${p} \
+      count=1 2> /dev/null;
+done;
+for io in stdio uring; do
+  "${FAST_PCA_CMD}" -C -P -f binary -p 2 -i ${io} -m pca.binary.${io}.mat \
+      "${DATA_SP}" > proj.binary.${io}.mat;
+  "${FAST_PCA_CMD}" -C -P -f binary -p 2 -i ${io} \
+      -m pca.binary.${io}.parts.mat \
+      data.part0.binary.sp.mat proj.binary.${io}.part0.mat \
+      data.part1.binary.sp.mat proj.binary.${io}.part1.mat;
+done;
+for f in pca.binary.@ proj.binary.@ pca.binary.@.parts proj.binary.@.part0 \
+    proj.binary.@.part1; do
+  cmp "${f/@/stdio}.mat" "${f/@/uring}.mat";
+done;
+
+## Read the names of the input and output files from a list (-S), which
+## may have blank lines: same result as with the names given as arguments
+printf "data.part0.binary.sp.mat proj.binary.list.part0.mat\n\n" \
+    > list.binary.txt;
+printf " data.part1.binary.sp.mat\tproj.binary.list.part1.mat\n" \
+    >> list.binary.txt;
+"${FAST_PCA_CMD}" -P -f binary -p 2 -m pca.binary.stdio.parts.mat \
+    -S list.binary.txt;
+"${FAST_PCA_CMD}" -P -f binary -p 2 -m pca.binary.stdio.parts.mat \
+    data.part0.binary.sp.mat proj.binary.args.part0.mat \
+    data.part1.binary.sp.mat proj.binary.args.part1.mat;
+cmp proj.binary.args.part0.mat proj.binary.list.part0.mat;
+cmp proj.binary.args.part1.mat proj.binary.list.part1.mat;
+printf "data.part0.binary.sp.mat\n\ndata.part1.binary.sp.mat\n" \
+    > list.map.binary.txt;
+"${BIN_DIR}/fast_pca_map" -f binary -p 2 -o map.binary.list.mat \
+    -S list.map.binary.txt;
+"${BIN_DIR}/fast_pca_map" -f binary -p 2 -o map.binary.args.mat \
+    data.part0.binary.sp.mat data.part1.binary.sp.mat;
+cmp map.binary.args.mat map.binary.list.mat;
+## Refuse the lines of a list with too many names: fast_pca_map writes all
+## the statistics to a single output, so it takes one name per line
+if "${BIN_DIR}/fast_pca_map" -f binary -p 2 -o map.binary.bad.mat \
+    -S list.binary.txt 2> list.binary.err; then
+  echo "Expected the list to be refused!" >&2;
+  exit 1;
+fi;
+grep -q "Too many file names in line 1 of list" list.binary.err;
+printf "\ndata.part0.binary.sp.mat proj.binary.bad.mat extra.mat\n" \
+    > list.bad.binary.txt;
+if "${FAST_PCA_CMD}" -P -f binary -p 2 -m pca.binary.stdio.parts.mat \
+    -S list.bad.binary.txt 2> list.binary.err; then
+  echo "Expected the list to be refused!" >&2;
+  exit 1;
+fi;
+grep -q "Too many file names in line 2 of list" list.binary.err;
+
+## Project data with reduced precision (the int8 scales are written to
+## proj.binary.int8.mat.scales), and check it against the float32 data
+for t in float16 int8; do
+  "${FAST_PCA_CMD}" -P -O ${t} -f binary -p 2 -m pca.binary.sp.mat \
+      "${DATA_SP}" proj.binary.${t}.mat;
+  "${SDIR}/../check_proj_quantized.sh" proj.binary.sp.mat \
+      proj.binary.${t}.mat ${t} 2;
+done;
+
+## Same data with integer values (10 x + 100, between 35 and 197), read as
+## uint8, int16 and float16 elements with -T, and from MAT4 and FPCA files
+## with integer types: all must give the PCA of the float32 data
+DATA_ASCII="${SDIR}/../../examples/gauss2d/data.ascii.mat";
+awk '{ printf("%d %d\n", int(10 * $1 + 100.5), int(10 * $2 + 100.5)); }' \
+    "${DATA_ASCII}" > data.int.ascii.mat;
+# Print the elements (or the given integer) as little-endian bytes of the
+# given type, escaped for printf %b
+function to_bytes () {
+  awk -v t="$1" -v x="$2" '
+    function le(v, n,   i, s) {
+      for (i = 0; i < n; ++i) {
+        s = s sprintf("\\x%02x", v % 256);
+        v = int(v / 256);
+      }
+      return s;
+    }
+    function f16(v,   e) {
+      if (v == 0) return le(0, 2);
+      for (e = 0; 2 ^ (e + 1) <= v; ++e) {}
+      return le((e + 15) * 1024 + (v / 2 ^ e - 1) * 1024, 2);
+    }
+    function put(v) {
+      if (t == "uint8") printf("%s", le(v, 1));
+      else if (t == "int16") printf("%s", le(v, 2));
+      else if (t == "float16") printf("%s", f16(v));
+      else printf("%s", le(v, t));
+    }
+    BEGIN { if (x != "") { put(x); exit; } }
+    { for (i = 1; i <= NF; ++i) put($i); }' data.int.ascii.mat;
+}
+for t in uint8 int16 float16; do
+  printf "%b" "$(to_bytes ${t})" > data.int.${t}.mat;
+  "${FAST_PCA_CMD}" -C -f binary -T ${t} -p 2 -m pca.int.${t}.mat \
+      data.int.${t}.mat;
+done;
+"${FAST_PCA_CMD}" -C -f ascii -p 2 -m pca.int.ascii.mat data.int.ascii.mat;
+# MAT4 (type: 30 int16, 50 uint8) and FPCA (dtype: 3 uint8, 4 int16) files,
+# with 2 x 1000 elements
+for t in uint8 int16; do
+  [ ${t} = uint8 ] && m4=50 && fd=3 && es=1 || m4=30 fd=4 es=2;
+  printf "%b" "$(to_bytes 4 ${m4})$(to_bytes 4 2)$(to_bytes 4 1000)" \
+      > data.int.${t}.mat4.mat;
+  printf "%b" "$(to_bytes 4 0)$(to_bytes 4 2)X\x00$(to_bytes ${t})" \
+      >> data.int.${t}.mat4.mat;
+  printf "%b" "FPCA$(to_bytes 2 1)$(to_bytes 2 64)$(to_bytes 4 ${fd})" \
+      > data.int.${t}.fpca.mat;
+  printf "%b" "$(to_bytes 4 0)$(to_bytes 8 1000)$(to_bytes 8 2)" \
+      >> data.int.${t}.fpca.mat;
+  printf "%b" "$(to_bytes 8 1000)$(to_bytes 24 0)" >> data.int.${t}.fpca.mat;
+  printf "%b" "$(to_bytes 4 1000)$(to_bytes 4 0)$(to_bytes 8 $((2000 * es)))" \
+      >> data.int.${t}.fpca.mat;
+  printf "%b" "$(to_bytes ${t})$(to_bytes 16 0)" >> data.int.${t}.fpca.mat;
+  "${FAST_PCA_CMD}" -C -f mat4 -m pca.int.${t}.mat4.mat data.int.${t}.mat4.mat;
+  "${FAST_PCA_CMD}" -C -f fpca -m pca.int.${t}.fpca.mat data.int.${t}.fpca.mat;
+done;
+for t in uint8 int16 float16 uint8.mat4 int16.mat4 uint8.fpca int16.fpca; do
+  "${SDIR}/../check_pca.sh" pca.int.ascii.mat pca.int.${t}.mat 1E-5;
+done;
 
 exit 0;
@@ -0,0 +1,43 @@
+#!/bin/bash
+set -e;
+
+SDIR=$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd );
+DATA="${SDIR}/../../examples/gauss2d/data.fpca.mat";
+DATA_PROJ_REF="${SDIR}/data.proj.reference.mat";
+DATA_PROJ_NORM_REF="${SDIR}/data.proj.norm.reference.mat";
+FAST_PCA_CMD="$1";
+BIN_DIR="$(dirname "${FAST_PCA_CMD}")";
+PCA_REF="${SDIR}/pca.reference.mat";
+
+## Compute PCA & Project data in a single pass
+"${FAST_PCA_CMD}" -C -P -f fpca -m pca.fpca.sp.mat "${DATA}" \
+    > proj.fpca.sp.mat;
+"${FAST_PCA_CMD}" -C -P -d -f fpca -m pca.fpca.dp.mat "${DATA}" \
+    > proj.fpca.dp.mat;
+## Project data with reduced precision
+"${FAST_PCA_CMD}" -P -O bfloat16 -f fpca -m pca.fpca.sp.mat "${DATA}" \
+    > proj.fpca.bf16.mat;
+
+## Check data projections
+"${SDIR}/../check_proj_fpca.sh" "${DATA_PROJ_REF}" proj.fpca.sp.mat 1E-2;
+"${SDIR}/../check_proj_fpca.sh" "${DATA_PROJ_REF}" proj.fpca.dp.mat 1E-4;
+"${SDIR}/../check_proj_fpca.sh" "${DATA_PROJ_REF}" proj.fpca.bf16.mat 1E-2;
+
+## Compute PCA from three shards of the rows, with map & reduce
+for k in 0 1 2; do
+  "${BIN_DIR}/fast_pca_map" -f fpca --shard ${k}/3 -o "shard.${k}.fpca.mat" \
+      "${DATA}";
+done;
+"${BIN_DIR}/fast_pca_reduce" shard.{0,1,2}.fpca.mat > pca.fpca.shards.mat;
+"${SDIR}/../check_pca.sh" "${PCA_REF}" pca.fpca.shards.mat 1E-5;
+
+## Append rows to a FPCA file: same PCA as the concatenated binary data
+"${BIN_DIR}/fast_pca_gen" -f fpca -p 5 -n 600 -s 1 append.fpca;
+"${BIN_DIR}/fast_pca_gen" -a -f fpca -p 5 -n 400 -s 2 append.fpca;
+"${BIN_DIR}/fast_pca_gen" -f binary -p 5 -n 600 -s 1 > append.bin;
+"${BIN_DIR}/fast_pca_gen" -f binary -p 5 -n 400 -s 2 >> append.bin;
+"${FAST_PCA_CMD}" -C -f fpca -m pca.append.fpca.mat append.fpca;
+"${FAST_PCA_CMD}" -C -f binary -p 5 -m pca.append.bin.mat append.bin;
+cmp pca.append.fpca.mat pca.append.bin.mat;
+
+exit 0;
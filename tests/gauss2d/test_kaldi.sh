@@ -0,0 +1,34 @@
+#!/bin/bash
+set -e;
+
+SDIR=$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd );
+DATA="${SDIR}/../../examples/gauss2d/data.kaldi.mat";
+DATA_PROJ_REF="${SDIR}/data.proj.reference.mat";
+DATA_PROJ_NORM_REF="${SDIR}/data.proj.norm.reference.mat";
+FAST_PCA_CMD="$1";
+
+## Compute PCA & Project data in a single pass
+"${FAST_PCA_CMD}" -C -P -f kaldi -m pca.kaldi.sp.mat "${DATA}" \
+    > proj.kaldi.sp.mat;
+"${FAST_PCA_CMD}" -C -P -d -f kaldi -m pca.kaldi.dp.mat "${DATA}" \
+    > proj.kaldi.dp.mat;
+
+## Check data projections
+"${SDIR}/../check_proj_kaldi.sh" "${DATA_PROJ_REF}" proj.kaldi.sp.mat 1E-2;
+"${SDIR}/../check_proj_kaldi.sh" "${DATA_PROJ_REF}" proj.kaldi.dp.mat 1E-4;
+
+## Archives with several matrices cannot be written to single-matrix formats
+for fmt in fpca npy; do
+  if "${FAST_PCA_CMD}" -P -f kaldi -F ${fmt} -m pca.kaldi.sp.mat "${DATA}" \
+      > proj.kaldi.${fmt}.mat 2> /dev/null; then
+    echo "Projecting a kaldi archive to ${fmt} should fail!" >&2;
+    exit 1;
+  fi;
+  if "${FAST_PCA_CMD}" -C -P -k 1 -f kaldi -F ${fmt} -m pca.kaldi.spill.mat \
+      < "${DATA}" > proj.kaldi.${fmt}.mat 2> /dev/null; then
+    echo "Projecting a kaldi archive from stdin to ${fmt} should fail!" >&2;
+    exit 1;
+  fi;
+done;
+
+exit 0;
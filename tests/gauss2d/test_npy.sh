@@ -0,0 +1,31 @@
+#!/bin/bash
+set -e;
+
+SDIR=$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd );
+DATA="${SDIR}/../../examples/gauss2d/data.npy.mat";
+DATA_PROJ_REF="${SDIR}/data.proj.reference.mat";
+DATA_PROJ_NORM_REF="${SDIR}/data.proj.norm.reference.mat";
+FAST_PCA_CMD="$1";
+
+## Compute PCA & Project data in a single pass
+"${FAST_PCA_CMD}" -C -P -f npy -m pca.npy.sp.mat "${DATA}" \
+    > proj.npy.sp.mat;
+"${FAST_PCA_CMD}" -C -P -d -f npy -m pca.npy.dp.mat "${DATA}" \
+    > proj.npy.dp.mat;
+
+## Check data projections
+"${SDIR}/../check_proj_npy.sh" "${DATA_PROJ_REF}" proj.npy.sp.mat 1E-2;
+"${SDIR}/../check_proj_npy.sh" "${DATA_PROJ_REF}" proj.npy.dp.mat 1E-4;
+
+## Project data with reduced precision (the int8 scales are written to
+## proj.npy.int8.mat.scales), and check it against the float32 data
+"${FAST_PCA_CMD}" -P -O float32 -f npy -m pca.npy.sp.mat "${DATA}" \
+    > proj.npy.float32.mat;
+for t in float16 int8; do
+  "${FAST_PCA_CMD}" -P -O ${t} -f npy -m pca.npy.sp.mat "${DATA}" \
+      proj.npy.${t}.mat;
+  "${SDIR}/../check_proj_quantized.sh" proj.npy.float32.mat \
+      proj.npy.${t}.mat ${t} 2;
+done;
+
+exit 0;
@@ -24,6 +24,30 @@ FAST_PCA_CMD="$1";
 "${FAST_PCA_CMD}" -C -P -d -n -f octave -m pca.octave.sp.2.mat "${DATA}" > proj.octave.norm.sp.2.mat;
 "${FAST_PCA_CMD}" -C -P -d -n -f octave -m pca.octave.dp.2.mat "${DATA}" > proj.octave.norm.dp.2.mat;
 
+## Compute PCA & Project data twice, the second time from the cache: the
+## cached copy must be reused (same inode, newer modification time), and a
+## temporary copy left by a dead process must be removed
+rm -rf cache.octave;
+"${FAST_PCA_CMD}" -C -P -d -c cache.octave -f octave -m pca.octave.dp.3.mat \
+    "${DATA}" > proj.octave.dp.3.mat;
+BLOB="$(ls cache.octave/*.fpc)";
+BLOB_STAT="$(stat -c "%i %y" "${BLOB}")";
+true & DEAD_PID=$!;
+wait ${DEAD_PID};
+STALE_TMP="${BLOB%.fpc}.tmp.${DEAD_PID}.0";
+echo "partial copy" > "${STALE_TMP}";
+"${FAST_PCA_CMD}" -C -P -d -c cache.octave -f octave -m pca.octave.dp.4.mat \
+    "${DATA}" > proj.octave.dp.4.mat;
+[ "$(ls cache.octave)" = "${BLOB##*/}" ] || {
+  echo "Stale temporary copy \"${STALE_TMP}\" was not removed!" >&2;
+  exit 1;
+}
+[ "$(stat -c %i "${BLOB}")" = "${BLOB_STAT%% *}" ] &&
+[ "$(stat -c "%i %y" "${BLOB}")" != "${BLOB_STAT}" ] || {
+  echo "Cached copy \"${BLOB}\" was not reused!" >&2;
+  exit 1;
+}
+
 
 ## Check PCA
 "${SDIR}/../check_pca.sh" "${PCA_REF}" pca.octave.sp.mat 1E-5;
@@ -37,6 +61,9 @@ FAST_PCA_CMD="$1";
 ## Check data projections 2
 "${SDIR}/../check_proj_octave.sh" "${DATA_PROJ_REF}" proj.octave.sp.2.mat 1E-2;
 "${SDIR}/../check_proj_octave.sh" "${DATA_PROJ_REF}" proj.octave.dp.2.mat 1E-8;
+## Check data projections 3 & 4 (cached)
+"${SDIR}/../check_proj_octave.sh" "${DATA_PROJ_REF}" proj.octave.dp.3.mat 1E-8;
+"${SDIR}/../check_proj_octave.sh" "${DATA_PROJ_REF}" proj.octave.dp.4.mat 1E-8;
 ## Check normalized data projections
 "${SDIR}/../check_proj_octave.sh" "${DATA_PROJ_NORM_REF}" proj.octave.norm.sp.mat 1E-2;
 "${SDIR}/../check_proj_octave.sh" "${DATA_PROJ_NORM_REF}" proj.octave.norm.dp.mat 1E-8;
@@ -0,0 +1,150 @@
+#!/bin/bash
+set -e;
+set -o pipefail;
+
+# End-to-end performance tests: synthetic data of each size is written with
+# fast_pca_gen, and the PCA is computed with fast_pca (-C), with
+# fast_pca_map + fast_pca_reduce, and the data is projected (-P). The wall
+# time, rows/s and peak memory of each step, and the accuracy of the
+# eigenvalues/eigenvectors (against the ground truth) are written to the
+# results file, and compared with the baseline file, if it exists. If it
+# does not exist, the results are kept as the new baseline.
+#
+# Environment variables:
+#   PERF_SIZES      sizes of the data (default: "10M 100M 1G", up to "100G")
+#   PERF_DIMS       data dimensions (default: 256)
+#   PERF_FORMAT     format of the data (default: binary)
+#   PERF_PARTS      number of files the data is split into (default: 4)
+#   PERF_TOLERANCE  relative tolerance w.r.t. the baseline (default: 0.25)
+#   PERF_BASELINE   baseline file (default: perf_baseline.txt, in the
+#                   working directory; give a checked-in file to use it)
+#   PERF_RESULTS    results file (default: perf_results.txt)
+#   PERF_WORKDIR    directory for the data (default: a temporary directory)
+
+[ $# -ne 1 ] && {
+    echo "Usage: ${0##*/} bin_dir" >&2;
+    exit 1;
+}
+
+SDIR=$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd );
+BIN="$1";
+SIZES="${PERF_SIZES:-10M 100M 1G}";
+DIMS="${PERF_DIMS:-256}";
+FORMAT="${PERF_FORMAT:-binary}";
+PARTS="${PERF_PARTS:-4}";
+TOL="${PERF_TOLERANCE:-0.25}";
+BASELINE="${PERF_BASELINE:-perf_baseline.txt}";
+RESULTS="${PERF_RESULTS:-perf_results.txt}";
+WORKDIR="${PERF_WORKDIR:-$(mktemp -d)}";
+[ -z "${PERF_WORKDIR}" ] && trap "rm -rf '${WORKDIR}'" EXIT;
+
+# Convert a size with suffix (K, M, G) to bytes
+function size_bytes () {
+  local n="${1%[KMG]}";
+  case "$1" in
+    *K) echo $(( n << 10 ));;
+    *M) echo $(( n << 20 ));;
+    *G) echo $(( n << 30 ));;
+    *) echo "$n";;
+  esac;
+}
+
+# Run a command, and print its wall time (seconds) and peak resident memory
+# (KB). The processes of the command must write their stats to files
+# ${WORKDIR}/*.stats.json (with --stats-json), and the peak memory is the
+# largest max_rss_kb among them. Returns the exit status of the command.
+function measure () {
+  local t0=$(date +%s.%N) status=0;
+  rm -f "${WORKDIR}"/*.stats.json;
+  "$@" 2> /dev/null || status=$?;
+  local t1=$(date +%s.%N);
+  cat "${WORKDIR}"/*.stats.json 2> /dev/null |
+    awk -v t0="${t0}" -v t1="${t1}" '
+      $1 == "\"max_rss_kb\":" && $2 + 0 > rss { rss = $2 + 0; }
+      END { printf("%.3f %d\n", t1 - t0, rss); }';
+  return "${status}";
+}
+
+# Record the wall time, rows/s and peak memory of a step
+function record () {
+  local name="$1" rows="$2" m; shift 2;
+  m=( $(measure "$@") ) || {
+    echo "Step ${name} failed: $*" >&2;
+    exit 1;
+  };
+  echo "${name}.seconds ${m[0]}" >> "${RESULTS}";
+  awk -v n="${name}" -v r="${rows}" -v t="${m[0]}" \
+    'BEGIN { printf("%s.rows_per_s %.0f\n", n, r / t); }' >> "${RESULTS}";
+  echo "${name}.peak_rss_kb ${m[1]}" >> "${RESULTS}";
+}
+
+: > "${RESULTS}";
+for size in ${SIZES}; do
+  rows=$(( $(size_bytes "${size}") / (DIMS * 4) ));
+  files=();
+  for p in $(seq 1 "${PARTS}"); do
+    files+=( "${WORKDIR}/data.${p}.${FORMAT}" );
+  done;
+  record "${size}.gen" "${rows}" "${BIN}/fast_pca_gen" -f "${FORMAT}" \
+    -n "${rows}" -p "${DIMS}" -m "${WORKDIR}/truth.mat" \
+    --stats-json "${WORKDIR}/gen.stats.json" "${files[@]}";
+  # PCA in a single process
+  record "${size}.compute" "${rows}" "${BIN}/fast_pca" -C -f "${FORMAT}" \
+    -p "${DIMS}" -m "${WORKDIR}/pca.mat" \
+    --stats-json "${WORKDIR}/compute.stats.json" "${files[@]}";
+  # PCA with map-reduce (map steps run sequentially)
+  maps=();
+  for f in "${files[@]}"; do maps+=( "${f}.map" ); done;
+  record "${size}.map" "${rows}" bash -c "
+    for f in ${files[*]}; do
+      '${BIN}/fast_pca_map' -f '${FORMAT}' -p '${DIMS}' -o \"\${f}.map\" \
+        --stats-json \"\${f}.stats.json\" \"\${f}\" || exit 1;
+    done";
+  record "${size}.reduce" "${rows}" "${BIN}/fast_pca_reduce" \
+    -m "${WORKDIR}/pca.mr.mat" --stats-json "${WORKDIR}/reduce.stats.json" \
+    "${maps[@]}";
+  # projection into 10% of the dimensions
+  proj=();
+  for f in "${files[@]}"; do proj+=( "${f}" /dev/null ); done;
+  record "${size}.project" "${rows}" "${BIN}/fast_pca" -P -f "${FORMAT}" \
+    -p "${DIMS}" -q $(( (DIMS + 9) / 10 )) -m "${WORKDIR}/pca.mat" \
+    --stats-json "${WORKDIR}/project.stats.json" "${proj[@]}";
+  # accuracy of the leading eigenvalues/eigenvectors
+  "${BIN}/fast_pca_gen" -c "${WORKDIR}/truth.mat" -q 10 "${WORKDIR}/pca.mat" |
+    awk -v s="${size}" '$1 != "eigenvectors" { print s"."$1, $2 }' \
+      >> "${RESULTS}";
+  "${BIN}/fast_pca_gen" -c "${WORKDIR}/truth.mat" -q 10 \
+    "${WORKDIR}/pca.mr.mat" |
+    awk -v s="${size}" '$1 != "eigenvectors" { print s".mr."$1, $2 }' \
+      >> "${RESULTS}";
+  rm -f "${files[@]}" "${maps[@]}";
+done;
+
+cat "${RESULTS}";
+if [ ! -s "${BASELINE}" ]; then
+  echo "Baseline \"${BASELINE}\" not found, keeping the results as the new" \
+       "baseline..." >&2;
+  cp "${RESULTS}" "${BASELINE}";
+  exit 0;
+fi;
+
+# Higher is better for rows/s, lower is better for the rest. The errors are
+# also allowed to grow by a small absolute amount, due to the random data.
+awk -v tol="${TOL}" '
+  NR == FNR { base[$1] = $2; next; }
+  ($1 in base) {
+    b = base[$1];
+    if ($1 ~ /rows_per_s$/) bad = $2 < b * (1 - tol);
+    else if ($1 ~ /_error$/) bad = $2 > b * (1 + tol) + 1E-6;
+    else bad = $2 > b * (1 + tol);
+    if (bad) {
+      printf("%s: %g (baseline: %g)\n", $1, $2, b) > "/dev/stderr";
+      failed = 1;
+    }
+  }
+  END { exit failed; }' "${BASELINE}" "${RESULTS}" || {
+  echo "Performance does not match the baseline \"${BASELINE}\"!" >&2;
+  exit 1;
+}
+
+exit 0;
@@ -0,0 +1,50 @@
+function X = readfpca(file)
+  % READFPCA read a matrix stored in the native fast_pca format (FPCA).
+  % Only uncompressed float32/float64/bfloat16/int8 chunks are supported.
+  fid = fopen(file, 'r', 'l');
+  if fid < 0
+    error(sprintf('Cannot read from file %s', file));
+  end
+  magic = fread(fid, 4, 'char=>char')';
+  if ~strcmp(magic, 'FPCA')
+    error(sprintf('File %s is not a FPCA file', file));
+  end
+  fread(fid, 2, 'uint16');
+  dtype = fread(fid, 1, 'uint32');
+  fread(fid, 1, 'uint32');
+  fread(fid, 1, 'uint64');
+  cols = fread(fid, 1, 'uint64');
+  fseek(fid, 64, 'bof');
+  % int8 data is followed by the scale of each column
+  scale = ones(1, cols);
+  if dtype == 6
+    scale = fread(fid, cols, 'float32')';
+    fseek(fid, 64 + ceil(cols * 4 / 16) * 16, 'bof');
+  end
+  X = zeros(0, cols);
+  while true
+    rows = fread(fid, 1, 'uint32');
+    flags = fread(fid, 1, 'uint32');
+    bytes = fread(fid, 1, 'uint64');
+    if isempty(rows) || rows == 0
+      break;
+    end
+    if flags ~= 0 || (dtype > 1 && dtype ~= 5 && dtype ~= 6)
+      error(sprintf('Unsupported FPCA chunk in file %s', file));
+    end
+    if dtype == 0
+      B = fread(fid, [cols, rows], 'float32')';
+    elseif dtype == 1
+      B = fread(fid, [cols, rows], 'float64')';
+    elseif dtype == 5
+      % bfloat16: upper half of a float32 number
+      B = fread(fid, [cols, rows], 'uint16=>uint32')';
+      B = double(reshape(typecast(bitshift(B(:), 16), 'single'), rows, cols));
+    else
+      B = fread(fid, [cols, rows], 'int8')' .* repmat(scale, rows, 1);
+    end
+    X = [X; B];
+    fseek(fid, mod(16 - mod(bytes, 16), 16), 'cof');
+  end
+  fclose(fid);
+end
@@ -0,0 +1,29 @@
+function X = readkaldi(file)
+  % READKALDI read all matrices from a Kaldi binary archive and concatenate
+  % them. Only float (FM) and double (DM) matrices are supported.
+  fid = fopen(file, 'r', 'l');
+  if fid < 0
+    error(sprintf('Cannot read from file %s', file));
+  end
+  X = [];
+  while true
+    key = fscanf(fid, '%s', 1);
+    if isempty(key)
+      break;
+    end
+    fread(fid, 3, 'uint8');
+    token = fread(fid, 3, 'char=>char')';
+    fread(fid, 1, 'uint8');
+    rows = fread(fid, 1, 'int32');
+    fread(fid, 1, 'uint8');
+    cols = fread(fid, 1, 'int32');
+    if strcmp(token, 'FM ')
+      X = [X; fread(fid, [cols, rows], 'float32')'];
+    elseif strcmp(token, 'DM ')
+      X = [X; fread(fid, [cols, rows], 'float64')'];
+    else
+      error(sprintf('Unsupported Kaldi object in file %s', file));
+    end
+  end
+  fclose(fid);
+end
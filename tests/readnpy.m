@@ -0,0 +1,20 @@
+function X = readnpy(file)
+  % READNPY read a matrix stored in the NumPy .npy format.
+  % Only little-endian float32/float64 matrices are supported.
+  fid = fopen(file, 'r', 'l');
+  if fid < 0
+    error(sprintf('Cannot read from file %s', file));
+  end
+  fread(fid, 8, 'uint8');
+  header = fread(fid, fread(fid, 1, 'uint16'), 'char=>char')';
+  descr = regexp(header, '''descr'': *''<f(\d)''', 'tokens'){1}{1};
+  fortran = ~isempty(strfind(header, '''fortran_order'': True'));
+  shape = str2num(regexp(header, '''shape'': *\(([^)]*)\)', 'tokens'){1}{1});
+  types = struct('f4', 'float32', 'f8', 'float64');
+  if fortran
+    X = fread(fid, shape, types.(['f' descr]));
+  else
+    X = fread(fid, fliplr(shape), types.(['f' descr]))';
+  end
+  fclose(fid);
+end